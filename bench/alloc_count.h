@@ -0,0 +1,33 @@
+/*
+ * alloc_count.h - Pool allocation counting for the microbenchmarks
+ *
+ * Force-included (-include) into the module sources built for the
+ * microbenchmark, so every pool allocation they make goes through a
+ * counter. The module build never sees this file.
+ */
+#ifndef MUSE_AI_BENCH_ALLOC_COUNT_H
+#define MUSE_AI_BENCH_ALLOC_COUNT_H
+
+#include <string.h>
+#include <apr_pools.h>
+#include <apr_strings.h>
+
+extern unsigned long bench_alloc_calls;
+extern unsigned long bench_alloc_bytes;
+
+void *bench_palloc(apr_pool_t *pool, apr_size_t size);
+char *bench_pstrdup(apr_pool_t *pool, const char *s);
+char *bench_pstrndup(apr_pool_t *pool, const char *s, apr_size_t n);
+void *bench_pmemdup(apr_pool_t *pool, const void *m, apr_size_t n);
+char *bench_count_string(char *result);
+
+#undef apr_pcalloc
+#define apr_palloc(p, n) bench_palloc(p, n)
+#define apr_pcalloc(p, n) memset(bench_palloc(p, n), 0, n)
+#define apr_pstrdup(p, s) bench_pstrdup(p, s)
+#define apr_pstrndup(p, s, n) bench_pstrndup(p, s, n)
+#define apr_pmemdup(p, m, n) bench_pmemdup(p, m, n)
+#define apr_pstrcat(...) bench_count_string(apr_pstrcat(__VA_ARGS__))
+#define apr_psprintf(...) bench_count_string(apr_psprintf(__VA_ARGS__))
+
+#endif /* MUSE_AI_BENCH_ALLOC_COUNT_H */
@@ -0,0 +1,290 @@
+/*
+ * load_driver.c - Concurrent HTTP load driver for mod_muse_ai
+ *
+ * Runs a fixed number of client threads against httpd, each issuing
+ * GET requests back to back on fresh connections, and reports throughput
+ * and latency percentiles:
+ *
+ *   TTFB     first byte of the response (status line)
+ *   TTFT     first byte of the response body, i.e. the first generated
+ *            content the module flushed
+ *   latency  complete response, connection closed by the server
+ *
+ * Plain HTTP/1.1 over loopback or a LAN; no dependencies beyond libc and
+ * pthreads.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    const char *host;
+    const char *port;
+    const char *path;
+    int concurrency;
+    int requests;
+    int warmup;
+    int timeout_s;
+} driver_options_t;
+
+typedef struct {
+    double ttfb_ms;
+    double ttft_ms;
+    double total_ms;
+    long bytes;
+    int status;
+    int ok;
+} sample_t;
+
+static driver_options_t opts = {
+    .host = "127.0.0.1",
+    .port = "80",
+    .path = "/index.ai",
+    .concurrency = 8,
+    .requests = 200,
+    .warmup = 0,
+    .timeout_s = 300
+};
+
+static struct addrinfo *target = NULL;
+static sample_t *samples = NULL;
+static atomic_int next_request = 0;
+
+static void usage_exit(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -H HOST    server address (default %s)\n"
+        "  -p PORT    server port (default %s)\n"
+        "  -u PATH    request path, e.g. /index.ai or /ai?prompt=hello (default %s)\n"
+        "  -c N       concurrent clients (default %d)\n"
+        "  -n N       measured requests (default %d)\n"
+        "  -w N       warm-up requests, not measured (default %d)\n"
+        "  -t SEC     per-request timeout (default %d)\n",
+        prog, opts.host, opts.port, opts.path, opts.concurrency, opts.requests,
+        opts.warmup, opts.timeout_s);
+    exit(2);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static void run_request(sample_t *s)
+{
+    char request[1024];
+    char buf[16384];
+    char head[4096];
+    size_t head_len = 0;
+    int in_body = 0;
+    int fd, one = 1, len;
+    double start = now_ms();
+    struct timeval tv = { .tv_sec = opts.timeout_s, .tv_usec = 0 };
+
+    memset(s, 0, sizeof(*s));
+    s->ttfb_ms = s->ttft_ms = -1;
+
+    fd = socket(target->ai_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (connect(fd, target->ai_addr, target->ai_addrlen) < 0) {
+        close(fd);
+        return;
+    }
+
+    len = snprintf(request, sizeof(request),
+                   "GET %s HTTP/1.1\r\n"
+                   "Host: %s\r\n"
+                   "User-Agent: muse-ai-load-driver\r\n"
+                   "Accept: text/html\r\n"
+                   "Connection: close\r\n"
+                   "\r\n", opts.path, opts.host);
+    if (send(fd, request, (size_t)len, MSG_NOSIGNAL) != len) {
+        close(fd);
+        return;
+    }
+
+    for (;;) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        double t;
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            s->ok = n == 0 && in_body;
+            break;
+        }
+
+        t = now_ms() - start;
+        if (s->ttfb_ms < 0) {
+            s->ttfb_ms = t;
+        }
+        s->bytes += n;
+
+        if (!in_body) {
+            /* Collect the head until the blank line */
+            size_t take = (size_t)n < sizeof(head) - 1 - head_len ? (size_t)n : sizeof(head) - 1 - head_len;
+            char *end;
+
+            memcpy(head + head_len, buf, take);
+            head_len += take;
+            head[head_len] = '\0';
+            if ((end = strstr(head, "\r\n\r\n")) != NULL) {
+                in_body = 1;
+                s->status = atoi(head + 9);
+                /* Body bytes in this same read */
+                if ((size_t)(end + 4 - head) < head_len) {
+                    s->ttft_ms = t;
+                }
+            }
+        } else if (s->ttft_ms < 0) {
+            s->ttft_ms = t;
+        }
+    }
+
+    s->total_ms = now_ms() - start;
+    s->ok = s->ok && s->status >= 200 && s->status < 400;
+    close(fd);
+}
+
+static void *client_thread(void *arg)
+{
+    int total = opts.warmup + opts.requests;
+    (void)arg;
+
+    for (;;) {
+        int i = atomic_fetch_add(&next_request, 1);
+        sample_t discard;
+
+        if (i >= total) {
+            break;
+        }
+        run_request(i < opts.warmup ? &discard : &samples[i - opts.warmup]);
+    }
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Nearest-rank percentile of a sorted array */
+static double percentile(const double *sorted, int n, double p)
+{
+    int rank;
+
+    if (n == 0) {
+        return 0;
+    }
+    rank = (int)(p / 100.0 * n + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[(rank > n ? n : rank) - 1];
+}
+
+static void report(const char *name, int field)
+{
+    double *values = malloc(sizeof(double) * (size_t)opts.requests);
+    double sum = 0;
+    int n = 0;
+
+    for (int i = 0; i < opts.requests; i++) {
+        double v = field == 0 ? samples[i].ttfb_ms : field == 1 ? samples[i].ttft_ms : samples[i].total_ms;
+        if (samples[i].ok && v >= 0) {
+            values[n++] = v;
+            sum += v;
+        }
+    }
+    qsort(values, (size_t)n, sizeof(double), compare_double);
+
+    printf("%-8s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", name,
+           n ? values[0] : 0, n ? sum / n : 0,
+           percentile(values, n, 50), percentile(values, n, 99),
+           percentile(values, n, 99.9), n ? values[n - 1] : 0);
+    free(values);
+}
+
+int main(int argc, char **argv)
+{
+    struct addrinfo hints;
+    pthread_t *threads;
+    double started, elapsed;
+    long bytes = 0;
+    int ok = 0, c, rv;
+
+    while ((c = getopt(argc, argv, "H:p:u:c:n:w:t:h")) != -1) {
+        switch (c) {
+            case 'H': opts.host = optarg; break;
+            case 'p': opts.port = optarg; break;
+            case 'u': opts.path = optarg; break;
+            case 'c': opts.concurrency = atoi(optarg); break;
+            case 'n': opts.requests = atoi(optarg); break;
+            case 'w': opts.warmup = atoi(optarg); break;
+            case 't': opts.timeout_s = atoi(optarg); break;
+            default: usage_exit(argv[0]);
+        }
+    }
+    if (opts.concurrency < 1 || opts.requests < 1 || opts.warmup < 0 || opts.timeout_s < 1) {
+        usage_exit(argv[0]);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_socktype = SOCK_STREAM;
+    if ((rv = getaddrinfo(opts.host, opts.port, &hints, &target)) != 0) {
+        fprintf(stderr, "load_driver: %s:%s: %s\n", opts.host, opts.port, gai_strerror(rv));
+        return 1;
+    }
+
+    samples = calloc((size_t)opts.requests, sizeof(sample_t));
+    threads = calloc((size_t)opts.concurrency, sizeof(pthread_t));
+
+    started = now_ms();
+    for (int i = 0; i < opts.concurrency; i++) {
+        pthread_create(&threads[i], NULL, client_thread, NULL);
+    }
+    for (int i = 0; i < opts.concurrency; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    elapsed = (now_ms() - started) / 1000.0;
+
+    for (int i = 0; i < opts.requests; i++) {
+        ok += samples[i].ok;
+        bytes += samples[i].bytes;
+    }
+
+    printf("target       http://%s:%s%s\n", opts.host, opts.port, opts.path);
+    printf("clients      %d\n", opts.concurrency);
+    printf("requests     %d (%d ok, %d failed), %d warm-up\n", opts.requests, ok, opts.requests - ok, opts.warmup);
+    printf("elapsed      %.2f s (including warm-up)\n", elapsed);
+    printf("throughput   %.2f req/s, %.1f KiB/s\n",
+           (opts.requests + opts.warmup) / elapsed, bytes / 1024.0 / elapsed);
+    printf("\n%-8s %10s %10s %10s %10s %10s %10s\n", "ms", "min", "mean", "p50", "p99", "p999", "max");
+    report("ttfb", 0);
+    report("ttft", 1);
+    report("latency", 2);
+
+    freeaddrinfo(target);
+    free(threads);
+    free(samples);
+    return ok == opts.requests ? 0 : 1;
+}
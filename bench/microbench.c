@@ -0,0 +1,362 @@
+/*
+ * microbench.c - Microbenchmarks for the content processing hot paths
+ *
+ * Replays a corpus of recorded backend SSE streams through the pure
+ * functions the module runs on every response and reports, per function:
+ *
+ *   ns/B      CPU time per input byte
+ *   allocs/KB pool allocations per KiB of input
+ *   alloc B/B bytes allocated from the pool per input byte
+ *
+ * Each corpus file is the body of a streamed chat completion (a leading
+ * HTTP response head is skipped). The "data: " lines feed the SSE and JSON
+ * parsers; the concatenated content deltas feed the sanitizer functions.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <apr_general.h>
+
+#include "mod_muse_ai.h"
+#include "sse_parser.h"
+
+#ifndef MUSE_AI_BENCH_CORPUS
+#define MUSE_AI_BENCH_CORPUS "bench/corpus"
+#endif
+
+unsigned long bench_alloc_calls = 0;
+unsigned long bench_alloc_bytes = 0;
+
+/* Redirected module allocations (see alloc_count.h) */
+void *bench_palloc(apr_pool_t *pool, apr_size_t size)
+{
+    bench_alloc_calls++;
+    bench_alloc_bytes += size;
+    return apr_palloc(pool, size);
+}
+
+char *bench_pstrdup(apr_pool_t *pool, const char *s)
+{
+    if (s) {
+        bench_alloc_calls++;
+        bench_alloc_bytes += strlen(s) + 1;
+    }
+    return apr_pstrdup(pool, s);
+}
+
+char *bench_pstrndup(apr_pool_t *pool, const char *s, apr_size_t n)
+{
+    char *result = apr_pstrndup(pool, s, n);
+    if (result) {
+        bench_alloc_calls++;
+        bench_alloc_bytes += strlen(result) + 1;
+    }
+    return result;
+}
+
+void *bench_pmemdup(apr_pool_t *pool, const void *m, apr_size_t n)
+{
+    bench_alloc_calls++;
+    bench_alloc_bytes += n;
+    return apr_pmemdup(pool, m, n);
+}
+
+char *bench_count_string(char *result)
+{
+    if (result) {
+        bench_alloc_calls++;
+        bench_alloc_bytes += strlen(result) + 1;
+    }
+    return result;
+}
+
+/* One recorded stream, split into the inputs of each function */
+typedef struct {
+    const char *name;
+    apr_array_header_t *events;     /* "data: ...\n" lines */
+    apr_array_header_t *payloads;   /* JSON after "data: " */
+    const char *content;            /* Concatenated content deltas */
+    apr_size_t events_bytes;
+    apr_size_t payloads_bytes;
+    apr_size_t content_bytes;
+} corpus_entry_t;
+
+typedef enum { INPUT_EVENTS, INPUT_PAYLOADS, INPUT_CONTENT } input_kind_t;
+
+typedef struct {
+    const char *name;
+    input_kind_t input;
+    void (*run)(apr_pool_t *pool, const char *input);
+    double ns;                      /* Totals over the corpus */
+    double bytes;
+    double calls;
+    double alloc_bytes;
+} bench_fn_t;
+
+static volatile int sink;
+
+static void run_parse_sse_chunk(apr_pool_t *pool, const char *in) { sink += parse_sse_chunk(pool, in) != NULL; }
+static void run_extract_json_content(apr_pool_t *pool, const char *in) { sink += extract_json_content(pool, in) != NULL; }
+static void run_escape_json_string(apr_pool_t *pool, const char *in) { sink += escape_json_string(pool, in)[0]; }
+static void run_remove_thinking_tags(apr_pool_t *pool, const char *in) { sink += remove_thinking_tags(pool, in)[0]; }
+static void run_cleanup_code_fences(apr_pool_t *pool, const char *in) { sink += cleanup_code_fences(pool, in)[0]; }
+static void run_sanitize_response(apr_pool_t *pool, const char *in) { sink += sanitize_response(pool, in, NULL)[0]; }
+static void run_find_html_end(apr_pool_t *pool, const char *in) { (void)pool; sink += find_html_end(in); }
+
+static bench_fn_t functions[] = {
+    { "parse_sse_chunk",      INPUT_EVENTS,   run_parse_sse_chunk,      0, 0, 0, 0 },
+    { "extract_json_content", INPUT_PAYLOADS, run_extract_json_content, 0, 0, 0, 0 },
+    { "escape_json_string",   INPUT_CONTENT,  run_escape_json_string,   0, 0, 0, 0 },
+    { "remove_thinking_tags", INPUT_CONTENT,  run_remove_thinking_tags, 0, 0, 0, 0 },
+    { "cleanup_code_fences",  INPUT_CONTENT,  run_cleanup_code_fences,  0, 0, 0, 0 },
+    { "sanitize_response",    INPUT_CONTENT,  run_sanitize_response,    0, 0, 0, 0 },
+    { "find_html_end",        INPUT_CONTENT,  run_find_html_end,        0, 0, 0, 0 },
+};
+#define FUNCTION_COUNT (sizeof(functions) / sizeof(functions[0]))
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static char *read_whole_file(apr_pool_t *pool, const char *path, apr_size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    char *data;
+    long size;
+
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = apr_palloc(pool, (apr_size_t)size + 1);
+    *len = fread(data, 1, (size_t)size, f);
+    data[*len] = '\0';
+    fclose(f);
+    return data;
+}
+
+static corpus_entry_t *load_entry(apr_pool_t *pool, const char *path)
+{
+    apr_size_t len;
+    char *data = read_whole_file(pool, path, &len);
+    char *line, *state;
+    corpus_entry_t *entry;
+    apr_array_header_t *content;
+
+    if (!data) {
+        fprintf(stderr, "microbench: cannot read %s\n", path);
+        return NULL;
+    }
+
+    /* Captures may start with the backend's response head */
+    if (strncmp(data, "HTTP/", 5) == 0) {
+        char *body = strstr(data, "\r\n\r\n");
+        data = body ? body + 4 : data + len;
+    }
+
+    entry = apr_pcalloc(pool, sizeof(*entry));
+    entry->name = apr_pstrdup(pool, strrchr(path, '/') ? strrchr(path, '/') + 1 : path);
+    entry->events = apr_array_make(pool, 256, sizeof(const char *));
+    entry->payloads = apr_array_make(pool, 256, sizeof(const char *));
+    content = apr_array_make(pool, 256, sizeof(const char *));
+
+    for (line = strtok_r(data, "\n", &state); line; line = strtok_r(NULL, "\n", &state)) {
+        apr_size_t n = strlen(line);
+        const char *delta;
+
+        if (n && line[n - 1] == '\r') {
+            line[--n] = '\0';
+        }
+        if (strncmp(line, "data: ", 6) != 0) {
+            continue;
+        }
+
+        APR_ARRAY_PUSH(entry->events, const char *) = apr_pstrcat(pool, line, "\n", NULL);
+        entry->events_bytes += n + 1;
+        if (strcmp(line + 6, "[DONE]") == 0) {
+            continue;
+        }
+
+        APR_ARRAY_PUSH(entry->payloads, const char *) = line + 6;
+        entry->payloads_bytes += n - 6;
+
+        delta = extract_json_content(pool, line + 6);
+        if (delta) {
+            APR_ARRAY_PUSH(content, const char *) = delta;
+        }
+    }
+
+    entry->content = apr_array_pstrcat(pool, content, 0);
+    entry->content_bytes = strlen(entry->content);
+    return entry;
+}
+
+/* Run fn over one corpus entry for at least min_ns */
+static void measure(apr_pool_t *pool, bench_fn_t *fn, corpus_entry_t *entry, double min_ns, int verbose)
+{
+    apr_array_header_t *inputs = NULL;
+    const char *single = NULL;
+    apr_size_t bytes;
+    unsigned long calls, alloc_bytes;
+    double start, elapsed;
+    long passes = 0;
+
+    switch (fn->input) {
+        case INPUT_EVENTS:   inputs = entry->events;   bytes = entry->events_bytes;   break;
+        case INPUT_PAYLOADS: inputs = entry->payloads; bytes = entry->payloads_bytes; break;
+        default:             single = entry->content;  bytes = entry->content_bytes;  break;
+    }
+    if (bytes == 0) {
+        return;
+    }
+
+    /* Allocations are deterministic; count them on one pass */
+    bench_alloc_calls = bench_alloc_bytes = 0;
+    if (single) {
+        fn->run(pool, single);
+    } else {
+        for (int i = 0; i < inputs->nelts; i++) {
+            fn->run(pool, APR_ARRAY_IDX(inputs, i, const char *));
+        }
+    }
+    calls = bench_alloc_calls;
+    alloc_bytes = bench_alloc_bytes;
+    apr_pool_clear(pool);
+
+    start = now_ns();
+    do {
+        if (single) {
+            fn->run(pool, single);
+        } else {
+            for (int i = 0; i < inputs->nelts; i++) {
+                fn->run(pool, APR_ARRAY_IDX(inputs, i, const char *));
+            }
+        }
+        apr_pool_clear(pool);
+        passes++;
+        elapsed = now_ns() - start;
+    } while (elapsed < min_ns);
+
+    fn->ns += elapsed / passes;
+    fn->bytes += bytes;
+    fn->calls += calls;
+    fn->alloc_bytes += alloc_bytes;
+
+    if (verbose) {
+        printf("  %-22s %-28s %10.2f %10.2f %10.2f\n", fn->name, entry->name,
+               elapsed / passes / bytes, calls * 1024.0 / bytes, (double)alloc_bytes / bytes);
+    }
+}
+
+static void usage_exit(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [-t MS] [-v] [-T] [corpus directory or files...]\n"
+        "  -t MS   minimum time per function and corpus file (default 200)\n"
+        "  -v      also report every corpus file\n"
+        "  -T      tab-separated output for scripts\n"
+        "Default corpus: %s\n",
+        prog, MUSE_AI_BENCH_CORPUS);
+    exit(2);
+}
+
+static void add_path(apr_pool_t *pool, apr_array_header_t *paths, const char *path)
+{
+    DIR *dir = opendir(path);
+    struct dirent *de;
+
+    if (!dir) {
+        APR_ARRAY_PUSH(paths, const char *) = path;
+        return;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        const char *ext = strrchr(de->d_name, '.');
+        if (ext && strcmp(ext, ".sse") == 0) {
+            APR_ARRAY_PUSH(paths, const char *) = apr_pstrcat(pool, path, "/", de->d_name, NULL);
+        }
+    }
+    closedir(dir);
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+int main(int argc, char **argv)
+{
+    apr_pool_t *pool, *work;
+    apr_array_header_t *paths, *entries;
+    double min_ns = 200e6;
+    int verbose = 0, tsv = 0, c;
+
+    while ((c = getopt(argc, argv, "t:vTh")) != -1) {
+        switch (c) {
+            case 't': min_ns = atof(optarg) * 1e6; break;
+            case 'v': verbose = 1; break;
+            case 'T': tsv = 1; break;
+            default: usage_exit(argv[0]);
+        }
+    }
+
+    apr_initialize();
+    atexit(apr_terminate);
+    apr_pool_create(&pool, NULL);
+    apr_pool_create(&work, pool);
+
+    paths = apr_array_make(pool, 16, sizeof(const char *));
+    if (optind >= argc) {
+        add_path(pool, paths, MUSE_AI_BENCH_CORPUS);
+    }
+    for (int i = optind; i < argc; i++) {
+        add_path(pool, paths, argv[i]);
+    }
+    qsort(paths->elts, (size_t)paths->nelts, sizeof(const char *), compare_paths);
+
+    entries = apr_array_make(pool, paths->nelts, sizeof(corpus_entry_t *));
+    for (int i = 0; i < paths->nelts; i++) {
+        corpus_entry_t *entry = load_entry(pool, APR_ARRAY_IDX(paths, i, const char *));
+        if (entry) {
+            APR_ARRAY_PUSH(entries, corpus_entry_t *) = entry;
+        }
+    }
+    if (entries->nelts == 0) {
+        fprintf(stderr, "microbench: empty corpus\n");
+        return 1;
+    }
+
+    if (verbose && !tsv) {
+        printf("  %-22s %-28s %10s %10s %10s\n", "function", "corpus file", "ns/B", "allocs/KB", "alloc B/B");
+    }
+    for (size_t f = 0; f < FUNCTION_COUNT; f++) {
+        for (int i = 0; i < entries->nelts; i++) {
+            measure(work, &functions[f], APR_ARRAY_IDX(entries, i, corpus_entry_t *), min_ns, verbose && !tsv);
+        }
+    }
+
+    if (!tsv) {
+        printf("%s%d corpus file(s)\n\n%-22s %10s %10s %10s\n", verbose ? "\n" : "", entries->nelts,
+               "function", "ns/B", "allocs/KB", "alloc B/B");
+    }
+    for (size_t f = 0; f < FUNCTION_COUNT; f++) {
+        bench_fn_t *fn = &functions[f];
+        double bytes = fn->bytes > 0 ? fn->bytes : 1;
+        printf(tsv ? "%s\t%.3f\t%.3f\t%.3f\n" : "%-22s %10.2f %10.2f %10.2f\n", fn->name,
+               fn->ns / bytes, fn->calls * 1024.0 / bytes, fn->alloc_bytes / bytes);
+    }
+
+    apr_pool_destroy(pool);
+    return 0;
+}
@@ -0,0 +1,378 @@
+/*
+ * mock_backend.c - OpenAI-compatible mock backend for benchmarking
+ *
+ * Answers POST .../chat/completions with a generated HTML page, either as
+ * an SSE stream ("stream": true) or as a single JSON response, and
+ * GET .../models for the health probes. Timing and shape of the stream are
+ * configurable so that module overhead can be measured against a backend
+ * with known behaviour, on a laptop and without network access.
+ *
+ * Output is deterministic for a given seed: connection n always gets the
+ * same text and the same jitter sequence.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    int port;
+    double token_rate;      /* tokens per second, 0 = as fast as possible */
+    int token_size;         /* bytes of content per SSE delta */
+    int ttft_ms;            /* delay before the first delta */
+    int think_tokens;       /* deltas inside a <think> preamble */
+    int code_fences;        /* wrap the page in ```html fences */
+    int jitter_pct;         /* +/- percentage applied to every delay */
+    int page_tokens;        /* deltas of visible page content */
+    int usage;              /* send a usage report before [DONE] */
+    unsigned int seed;
+} mock_options_t;
+
+typedef struct {
+    int fd;
+    unsigned int seed;
+} connection_t;
+
+static mock_options_t opts = {
+    .port = 18080,
+    .token_rate = 50.0,
+    .token_size = 4,
+    .ttft_ms = 200,
+    .think_tokens = 0,
+    .code_fences = 0,
+    .jitter_pct = 0,
+    .page_tokens = 500,
+    .usage = 1,
+    .seed = 1
+};
+
+static const char *const words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+    "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+    "et", "dolore", "magna", "aliqua", "enim", "ad", "minim", "veniam"
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static void usage_exit(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  -p PORT    listen port on 127.0.0.1 (default %d)\n"
+        "  -r RATE    tokens per second, 0 = unthrottled (default %.0f)\n"
+        "  -s BYTES   content bytes per token (default %d)\n"
+        "  -t MS      time to first token (default %d)\n"
+        "  -k N       tokens of <think> preamble (default %d)\n"
+        "  -f         wrap the page in ```html code fences\n"
+        "  -j PCT     +/- jitter on every delay, in percent (default %d)\n"
+        "  -n N       tokens of page content (default %d)\n"
+        "  -U         do not send a usage report\n"
+        "  -S SEED    random seed (default %u)\n",
+        prog, opts.port, opts.token_rate, opts.token_size, opts.ttft_ms,
+        opts.think_tokens, opts.jitter_pct, opts.page_tokens, opts.seed);
+    exit(2);
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Sleep for ms milliseconds, +/- the configured jitter */
+static void delay_ms(double ms, unsigned int *seed)
+{
+    struct timespec ts;
+
+    if (opts.jitter_pct > 0) {
+        double f = (double)(rand_r(seed) % (2 * opts.jitter_pct + 1) - opts.jitter_pct) / 100.0;
+        ms *= 1.0 + f;
+    }
+    if (ms <= 0) {
+        return;
+    }
+
+    ts.tv_sec = (time_t)(ms / 1000.0);
+    ts.tv_nsec = (long)((ms - (double)ts.tv_sec * 1000.0) * 1e6);
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+/* Page text: a complete HTML document. Apart from the \n escapes around
+ * code fences, only characters that need no JSON escaping are used, so
+ * chunks can be pasted into the deltas as-is. */
+static char *build_page(unsigned int *seed, size_t *len)
+{
+    size_t body = (size_t)opts.page_tokens * (size_t)opts.token_size;
+    size_t cap = body + 256;
+    char *page = malloc(cap);
+    size_t n = 0;
+
+    n += (size_t)snprintf(page + n, cap - n, "%s<!DOCTYPE html><html><head><title>Bench</title></head><body><p>",
+                          opts.code_fences ? "```html\\n" : "");
+    while (n < body) {
+        const char *w = words[rand_r(seed) % WORD_COUNT];
+        n += (size_t)snprintf(page + n, cap - n, "%s ", w);
+        if (rand_r(seed) % 40 == 0 && n < body) {
+            n += (size_t)snprintf(page + n, cap - n, "</p><p>");
+        }
+    }
+    n += (size_t)snprintf(page + n, cap - n, "</p></body></html>%s", opts.code_fences ? "\\n```" : "");
+
+    *len = n;
+    return page;
+}
+
+static int send_delta(int fd, const char *content, size_t len)
+{
+    char buf[512];
+    int n = snprintf(buf, sizeof(buf),
+                     "data: {\"id\":\"mock\",\"object\":\"chat.completion.chunk\",\"model\":\"mock\","
+                     "\"choices\":[{\"index\":0,\"delta\":{\"content\":\"%.*s\"},\"finish_reason\":null}]}\n\n",
+                     (int)len, content);
+    return write_all(fd, buf, (size_t)n);
+}
+
+static void stream_response(int fd, unsigned int *seed)
+{
+    static const char headers[] =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/event-stream\r\n"
+        "Cache-Control: no-cache\r\n"
+        "Connection: close\r\n"
+        "\r\n";
+    double gap = opts.token_rate > 0 ? 1000.0 / opts.token_rate : 0;
+    size_t page_len, sent = 0;
+    char *page = build_page(seed, &page_len);
+    int tokens = 0;
+    char tail[256];
+
+    if (write_all(fd, headers, sizeof(headers) - 1) < 0) {
+        goto done;
+    }
+    delay_ms(opts.ttft_ms, seed);
+
+    if (opts.think_tokens > 0) {
+        if (send_delta(fd, "<think>", 7) < 0) {
+            goto done;
+        }
+        for (int i = 0; i < opts.think_tokens; i++, tokens++) {
+            const char *w = words[rand_r(seed) % WORD_COUNT];
+            delay_ms(gap, seed);
+            if (send_delta(fd, w, strlen(w)) < 0) {
+                goto done;
+            }
+        }
+        if (send_delta(fd, "</think>", 8) < 0) {
+            goto done;
+        }
+    }
+
+    while (sent < page_len) {
+        size_t n = page_len - sent < (size_t)opts.token_size ? page_len - sent : (size_t)opts.token_size;
+        /* Never split an escape sequence */
+        if (page[sent + n - 1] == '\\' && sent + n < page_len) {
+            n++;
+        }
+        if (tokens > 0) {
+            delay_ms(gap, seed);
+        }
+        if (send_delta(fd, page + sent, n) < 0) {
+            goto done;
+        }
+        sent += n;
+        tokens++;
+    }
+
+    if (opts.usage) {
+        int n = snprintf(tail, sizeof(tail),
+                         "data: {\"id\":\"mock\",\"object\":\"chat.completion.chunk\",\"model\":\"mock\","
+                         "\"choices\":[],\"usage\":{\"prompt_tokens\":100,\"completion_tokens\":%d,"
+                         "\"total_tokens\":%d}}\n\n", tokens, tokens + 100);
+        if (write_all(fd, tail, (size_t)n) < 0) {
+            goto done;
+        }
+    }
+    write_all(fd, "data: [DONE]\n\n", 14);
+
+done:
+    free(page);
+}
+
+static void json_response(int fd, unsigned int *seed)
+{
+    size_t page_len;
+    char *page = build_page(seed, &page_len);
+    size_t cap = page_len + 512;
+    char *body = malloc(cap);
+    char headers[256];
+    int body_len, header_len;
+    int tokens = (int)(page_len / (size_t)opts.token_size) + opts.think_tokens;
+
+    /* The whole generation time passes before anything is sent */
+    delay_ms(opts.ttft_ms + (opts.token_rate > 0 ? tokens * 1000.0 / opts.token_rate : 0), seed);
+
+    body_len = snprintf(body, cap,
+                        "{\"id\":\"mock\",\"object\":\"chat.completion\",\"model\":\"mock\","
+                        "\"choices\":[{\"index\":0,\"message\":{\"role\":\"assistant\",\"content\":\"%s\"},"
+                        "\"finish_reason\":\"stop\"}],"
+                        "\"usage\":{\"prompt_tokens\":100,\"completion_tokens\":%d,\"total_tokens\":%d}}",
+                        page, tokens, tokens + 100);
+    header_len = snprintf(headers, sizeof(headers),
+                          "HTTP/1.1 200 OK\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Content-Length: %d\r\n"
+                          "Connection: close\r\n"
+                          "\r\n", body_len);
+
+    if (write_all(fd, headers, (size_t)header_len) == 0) {
+        write_all(fd, body, (size_t)body_len);
+    }
+    free(body);
+    free(page);
+}
+
+/* Read the request head and, for POSTs, the body */
+static int read_request(int fd, char *buf, size_t cap, size_t *len)
+{
+    char *head_end = NULL;
+    size_t need = 0;
+
+    *len = 0;
+    while (*len < cap - 1) {
+        ssize_t n = recv(fd, buf + *len, cap - 1 - *len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        *len += (size_t)n;
+        buf[*len] = '\0';
+
+        if (!head_end && (head_end = strstr(buf, "\r\n\r\n")) != NULL) {
+            const char *cl = strcasestr(buf, "\r\nContent-Length:");
+            need = (size_t)(head_end + 4 - buf) + (cl ? strtoul(cl + 17, NULL, 10) : 0);
+        }
+        if (head_end && *len >= need) {
+            return 0;
+        }
+    }
+    return 0; /* Oversized body: answer with what we have */
+}
+
+static void *handle_connection(void *arg)
+{
+    connection_t *conn = arg;
+    char buf[65536];
+    size_t len;
+
+    if (read_request(conn->fd, buf, sizeof(buf), &len) == 0) {
+        if (strncmp(buf, "GET ", 4) == 0) {
+            static const char models[] = "{\"object\":\"list\",\"data\":[{\"id\":\"mock\",\"object\":\"model\"}]}";
+            char head[160];
+            int n = snprintf(head, sizeof(head),
+                             "HTTP/1.1 200 OK\r\n"
+                             "Content-Type: application/json\r\n"
+                             "Content-Length: %zu\r\n"
+                             "Connection: close\r\n"
+                             "\r\n", sizeof(models) - 1);
+            if (write_all(conn->fd, head, (size_t)n) == 0) {
+                write_all(conn->fd, models, sizeof(models) - 1);
+            }
+        } else if (strstr(buf, "\"stream\": true") || strstr(buf, "\"stream\":true")) {
+            stream_response(conn->fd, &conn->seed);
+        } else {
+            json_response(conn->fd, &conn->seed);
+        }
+    }
+
+    shutdown(conn->fd, SHUT_WR);
+    close(conn->fd);
+    free(conn);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in addr;
+    unsigned int connections = 0;
+    int listener, one = 1, c;
+
+    while ((c = getopt(argc, argv, "p:r:s:t:k:fj:n:US:h")) != -1) {
+        switch (c) {
+            case 'p': opts.port = atoi(optarg); break;
+            case 'r': opts.token_rate = atof(optarg); break;
+            case 's': opts.token_size = atoi(optarg); break;
+            case 't': opts.ttft_ms = atoi(optarg); break;
+            case 'k': opts.think_tokens = atoi(optarg); break;
+            case 'f': opts.code_fences = 1; break;
+            case 'j': opts.jitter_pct = atoi(optarg); break;
+            case 'n': opts.page_tokens = atoi(optarg); break;
+            case 'U': opts.usage = 0; break;
+            case 'S': opts.seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            default: usage_exit(argv[0]);
+        }
+    }
+    if (opts.token_size < 1 || opts.token_size > 256 || opts.page_tokens < 1 ||
+        opts.jitter_pct < 0 || opts.jitter_pct > 100) {
+        usage_exit(argv[0]);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)opts.port);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 1024) < 0) {
+        perror("mock_backend: bind/listen");
+        return 1;
+    }
+
+    fprintf(stderr, "mock_backend: listening on 127.0.0.1:%d (rate %.0f tok/s, %d bytes/token, ttft %d ms, "
+            "think %d, fences %s, jitter %d%%, %d tokens)\n",
+            opts.port, opts.token_rate, opts.token_size, opts.ttft_ms, opts.think_tokens,
+            opts.code_fences ? "on" : "off", opts.jitter_pct, opts.page_tokens);
+
+    for (;;) {
+        pthread_t thread;
+        connection_t *conn;
+        int fd = accept(listener, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("mock_backend: accept");
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        conn = malloc(sizeof(*conn));
+        conn->fd = fd;
+        conn->seed = opts.seed * 2654435761u + connections++;
+        if (pthread_create(&thread, NULL, handle_connection, conn) != 0) {
+            close(fd);
+            free(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
@@ -0,0 +1,458 @@
+/*
+ * replay_backend.c - Replays recorded backend streams for benchmarking
+ *
+ * Serves the .musecap files written by MuseAiCaptureDir: every POST gets
+ * the next capture in turn, sent byte for byte as the real backend sent
+ * it, with the recorded timing (optionally scaled). GET .../models answers
+ * the health probes. Streaming, flush and sanitizer changes can then be
+ * measured against production traffic shapes, deterministically.
+ *
+ * With -d, converts captures of streamed responses into .sse files for
+ * the microbench corpus instead.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CAPTURE_MAGIC "MUSEAI-CAPTURE 1\n"
+#define CAPTURE_EXTENSION ".musecap"
+
+typedef struct {
+    long long offset_us;    /* Since the request was sent */
+    const char *data;
+    size_t len;
+} record_t;
+
+typedef struct {
+    char *path;
+    char *model;
+    char *raw;              /* Whole file; records point into it */
+    record_t *records;
+    int count;
+    int truncated;
+} capture_t;
+
+typedef struct {
+    int port;
+    double scale;           /* Multiplier on recorded delays, 0 = none */
+    const char *dump_dir;
+} replay_options_t;
+
+static replay_options_t opts = {
+    .port = 18081,
+    .scale = 1.0,
+    .dump_dir = NULL
+};
+
+static capture_t *captures = NULL;
+static int capture_count = 0;
+static atomic_uint next_capture = 0;
+
+static void usage_exit(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [options] CAPTURE...\n"
+        "  CAPTURE    " CAPTURE_EXTENSION " files or directories of them\n"
+        "  -p PORT    listen port on 127.0.0.1 (default %d)\n"
+        "  -x SCALE   multiply recorded delays, e.g. 0.5 = twice as fast, 0 = no delays (default %.1f)\n"
+        "  -d DIR     write the body of each streamed capture to DIR/<name>.sse and exit\n",
+        prog, opts.port, opts.scale);
+    exit(2);
+}
+
+static char *read_whole_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    char *data;
+    long size;
+
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data = malloc((size_t)size + 1);
+    *len = fread(data, 1, (size_t)size, f);
+    data[*len] = '\0';
+    fclose(f);
+    return data;
+}
+
+/* Parse a capture file; see src/stream_capture.h for the format */
+static int load_capture(const char *path, capture_t *cap)
+{
+    size_t len;
+    char *p, *end, *line;
+    int cap_records = 64;
+
+    memset(cap, 0, sizeof(*cap));
+    if (!(cap->raw = read_whole_file(path, &len))) {
+        perror(path);
+        return -1;
+    }
+    if (strncmp(cap->raw, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC) - 1) != 0) {
+        fprintf(stderr, "replay_backend: %s: not a capture file\n", path);
+        free(cap->raw);
+        return -1;
+    }
+    cap->path = strdup(path);
+    end = cap->raw + len;
+
+    /* Header lines up to the blank line */
+    p = cap->raw + sizeof(CAPTURE_MAGIC) - 1;
+    while (p < end && *p != '\n') {
+        char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl) {
+            break;
+        }
+        *nl = '\0';
+        line = p;
+        if (strncmp(line, "model: ", 7) == 0) {
+            cap->model = line + 7;
+        } else if (strncmp(line, "truncated: ", 11) == 0) {
+            cap->truncated = atoi(line + 11);
+        }
+        p = nl + 1;
+    }
+    p++;
+
+    cap->records = malloc(sizeof(record_t) * (size_t)cap_records);
+    while (p < end) {
+        char *after;
+        long long offset = strtoll(p, &after, 10);
+        size_t n = strtoul(after, &after, 10);
+
+        if (after >= end || *after != '\n' || (size_t)(end - after - 1) < n) {
+            fprintf(stderr, "replay_backend: %s: record %d is incomplete, ignoring the rest\n",
+                    path, cap->count);
+            break;
+        }
+        if (cap->count == cap_records) {
+            cap_records *= 2;
+            cap->records = realloc(cap->records, sizeof(record_t) * (size_t)cap_records);
+        }
+        cap->records[cap->count].offset_us = offset;
+        cap->records[cap->count].data = after + 1;
+        cap->records[cap->count].len = n;
+        cap->count++;
+        p = after + 1 + n + 1;
+    }
+
+    if (!cap->model) {
+        cap->model = "replay";
+    }
+    return 0;
+}
+
+static void add_path(const char *path)
+{
+    DIR *dir = opendir(path);
+    struct dirent *de;
+
+    if (!dir) {
+        captures = realloc(captures, sizeof(capture_t) * (size_t)(capture_count + 1));
+        if (load_capture(path, &captures[capture_count]) == 0) {
+            capture_count++;
+        }
+        return;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        const char *ext = strrchr(de->d_name, '.');
+        if (ext && strcmp(ext, CAPTURE_EXTENSION) == 0) {
+            char full[4096];
+            snprintf(full, sizeof(full), "%s/%s", path, de->d_name);
+            add_path(full);
+        }
+    }
+    closedir(dir);
+}
+
+static int compare_captures(const void *a, const void *b)
+{
+    return strcmp(((const capture_t *)a)->path, ((const capture_t *)b)->path);
+}
+
+/* The recorded response as one buffer */
+static char *join_records(const capture_t *cap, size_t *len)
+{
+    size_t total = 0, n = 0;
+    char *out;
+
+    for (int i = 0; i < cap->count; i++) {
+        total += cap->records[i].len;
+    }
+    out = malloc(total + 1);
+    for (int i = 0; i < cap->count; i++) {
+        memcpy(out + n, cap->records[i].data, cap->records[i].len);
+        n += cap->records[i].len;
+    }
+    out[n] = '\0';
+    *len = n;
+    return out;
+}
+
+/* Undo chunked transfer coding in place; returns the decoded length */
+static size_t dechunk(char *body, size_t len)
+{
+    char *in = body, *out = body, *end = body + len;
+
+    while (in < end) {
+        char *after;
+        size_t size = strtoul(in, &after, 16);
+        char *nl = memchr(after, '\n', (size_t)(end - after));
+
+        if (!nl || size == 0) {
+            break;
+        }
+        in = nl + 1;
+        if (size > (size_t)(end - in)) {
+            size = (size_t)(end - in);
+        }
+        memmove(out, in, size);
+        out += size;
+        in += size;
+        if (in < end && *in == '\r') {
+            in++;
+        }
+        if (in < end && *in == '\n') {
+            in++;
+        }
+    }
+    return (size_t)(out - body);
+}
+
+static int dump_captures(void)
+{
+    int written = 0;
+
+    for (int i = 0; i < capture_count; i++) {
+        capture_t *cap = &captures[i];
+        const char *base = strrchr(cap->path, '/');
+        size_t len, body_len;
+        char *response = join_records(cap, &len);
+        char *body = strstr(response, "\r\n\r\n");
+        char out_path[4096];
+        FILE *f;
+
+        base = base ? base + 1 : cap->path;
+        if (!body) {
+            fprintf(stderr, "replay_backend: %s: no complete response head, skipped\n", cap->path);
+            free(response);
+            continue;
+        }
+        *body = '\0';
+        body += 4;
+        body_len = len - (size_t)(body - response);
+        if (strcasestr(response, "\nTransfer-Encoding: chunked")) {
+            body_len = dechunk(body, body_len);
+        }
+        if (strncmp(body, "data:", 5) != 0) {
+            fprintf(stderr, "replay_backend: %s: not a streamed response, skipped\n", cap->path);
+            free(response);
+            continue;
+        }
+
+        snprintf(out_path, sizeof(out_path), "%s/%.*s.sse", opts.dump_dir,
+                 (int)(strlen(base) - strlen(CAPTURE_EXTENSION)), base);
+        if (!(f = fopen(out_path, "wb"))) {
+            perror(out_path);
+            free(response);
+            return 1;
+        }
+        fwrite(body, 1, body_len, f);
+        fclose(f);
+        printf("%s -> %s (%zu bytes%s)\n", cap->path, out_path, body_len, cap->truncated ? ", truncated" : "");
+        written++;
+        free(response);
+    }
+    return written > 0 ? 0 : 1;
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/* Sleep until start + us */
+static void sleep_until(double start, double us)
+{
+    double wait = start + us - now_us();
+    struct timespec ts;
+
+    if (wait <= 0) {
+        return;
+    }
+    ts.tv_sec = (time_t)(wait / 1e6);
+    ts.tv_nsec = (long)((wait - (double)ts.tv_sec * 1e6) * 1e3);
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR) {
+    }
+}
+
+static void replay(int fd, const capture_t *cap)
+{
+    double start = now_us();
+
+    for (int i = 0; i < cap->count; i++) {
+        sleep_until(start, (double)cap->records[i].offset_us * opts.scale);
+        if (write_all(fd, cap->records[i].data, cap->records[i].len) < 0) {
+            return;
+        }
+    }
+}
+
+/* Read the request head and, for POSTs, the body */
+static int read_request(int fd, char *buf, size_t cap, size_t *len)
+{
+    char *head_end = NULL;
+    size_t need = 0;
+
+    *len = 0;
+    while (*len < cap - 1) {
+        ssize_t n = recv(fd, buf + *len, cap - 1 - *len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        *len += (size_t)n;
+        buf[*len] = '\0';
+
+        if (!head_end && (head_end = strstr(buf, "\r\n\r\n")) != NULL) {
+            const char *cl = strcasestr(buf, "\r\nContent-Length:");
+            need = (size_t)(head_end + 4 - buf) + (cl ? strtoul(cl + 17, NULL, 10) : 0);
+        }
+        if (head_end && *len >= need) {
+            return 0;
+        }
+    }
+    return 0; /* Oversized body: answer with what we have */
+}
+
+static void *handle_connection(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    char buf[65536];
+    size_t len;
+
+    if (read_request(fd, buf, sizeof(buf), &len) == 0) {
+        if (strncmp(buf, "GET ", 4) == 0) {
+            char models[512], head[160];
+            int body_len = snprintf(models, sizeof(models),
+                                    "{\"object\":\"list\",\"data\":[{\"id\":\"%s\",\"object\":\"model\"}]}",
+                                    captures[0].model);
+            int n = snprintf(head, sizeof(head),
+                             "HTTP/1.1 200 OK\r\n"
+                             "Content-Type: application/json\r\n"
+                             "Content-Length: %d\r\n"
+                             "Connection: close\r\n"
+                             "\r\n", body_len);
+            if (write_all(fd, head, (size_t)n) == 0) {
+                write_all(fd, models, (size_t)body_len);
+            }
+        } else {
+            unsigned int i = atomic_fetch_add(&next_capture, 1) % (unsigned int)capture_count;
+            replay(fd, &captures[i]);
+        }
+    }
+
+    shutdown(fd, SHUT_WR);
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_in addr;
+    int listener, one = 1, c;
+
+    while ((c = getopt(argc, argv, "p:x:d:h")) != -1) {
+        switch (c) {
+            case 'p': opts.port = atoi(optarg); break;
+            case 'x': opts.scale = atof(optarg); break;
+            case 'd': opts.dump_dir = optarg; break;
+            default: usage_exit(argv[0]);
+        }
+    }
+    if (optind >= argc || opts.scale < 0) {
+        usage_exit(argv[0]);
+    }
+
+    for (int i = optind; i < argc; i++) {
+        add_path(argv[i]);
+    }
+    if (capture_count == 0) {
+        fprintf(stderr, "replay_backend: no captures loaded\n");
+        return 1;
+    }
+    /* Same order on every run */
+    qsort(captures, (size_t)capture_count, sizeof(capture_t), compare_captures);
+
+    if (opts.dump_dir) {
+        return dump_captures();
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)opts.port);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 1024) < 0) {
+        perror("replay_backend: bind/listen");
+        return 1;
+    }
+
+    fprintf(stderr, "replay_backend: listening on 127.0.0.1:%d, %d capture(s), time scale %.2f\n",
+            opts.port, capture_count, opts.scale);
+
+    for (;;) {
+        pthread_t thread;
+        int fd = accept(listener, NULL, NULL);
+
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("replay_backend: accept");
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if (pthread_create(&thread, NULL, handle_connection, (void *)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+}
@@ -1,9 +1,11 @@
 #!/usr/bin/env python3
 """
-Generate supported_locales.c from locale-identifiers.csv
+Generate supported_locales.c from pruned-languages.csv
 
 This script reads the CSV file containing locale identifiers and generates
 a C source file with static arrays and functions for locale validation.
+Locale lookups go through a perfect hash and a language index table that
+are computed here, so the C code never scans the locale array.
 """
 
 import csv
@@ -45,27 +47,96 @@ def read_locales_csv(csv_path):
     
     return locales
 
+# Languages written right-to-left
+RTL_LANGUAGES = {'ar', 'fa', 'he', 'ur'}
+
+# Default locale for languages with several variants; other languages map to
+# their first locale in sorted order
+DEFAULT_LOCALES = {
+    'en': 'en_US',  # US English (most common on web)
+    'es': 'es_ES',  # Spain Spanish (original)
+    'pt': 'pt_BR',  # Brazilian Portuguese (most common)
+    'zh': 'zh_CN',  # Simplified Chinese (most common)
+}
+
+# Locale hash table size as a power of two
+HASH_BITS = 7
+
+def pack_locale(code):
+    """Pack "ll_CC" into the 32-bit key used by the C lookup"""
+    return (ord(code[0]) << 24) | (ord(code[1]) << 16) | (ord(code[3]) << 8) | ord(code[4])
+
+def locale_hash(key, multiplier):
+    return ((key * multiplier) & 0xFFFFFFFF) >> (32 - HASH_BITS)
+
+def find_perfect_hash(keys):
+    """Find an odd multiplier for which every key gets a slot of its own"""
+    for multiplier in range(0x9E3779B1, 0x9E3779B1 + 2 * 1000000, 2):
+        slots = {locale_hash(key, multiplier) for key in keys}
+        if len(slots) == len(keys):
+            return multiplier
+    print(f"No perfect hash found for {len(keys)} locales in {1 << HASH_BITS} slots", file=sys.stderr)
+    sys.exit(1)
+
+def c_string(value):
+    return '"' + value.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
 def generate_c_file(locales, output_path):
     """Generate the C implementation file"""
     
     # Sort locales by code for consistent output
     locales.sort(key=lambda x: x['code'])
     
+    for locale in locales:
+        code = locale['code']
+        if len(code) != 5 or code[2] != '_' or not code[:2].islower() or not code[3:].isupper():
+            print(f"Locale code {code} is not of the form ll_CC", file=sys.stderr)
+            sys.exit(1)
+    if len(locales) >= 0xFF:
+        print("Too many locales for 8-bit table indexes", file=sys.stderr)
+        sys.exit(1)
+    
+    keys = [pack_locale(locale['code']) for locale in locales]
+    multiplier = find_perfect_hash(keys)
+    
+    slots = [0xFF] * (1 << HASH_BITS)
+    for i, key in enumerate(keys):
+        slots[locale_hash(key, multiplier)] = i
+    
+    # Language code -> index of its default locale, indexed by the two letters
+    languages = [0xFF] * (26 * 26)
+    for i, locale in enumerate(locales):
+        lang = locale['code'][:2]
+        slot = (ord(lang[0]) - ord('a')) * 26 + (ord(lang[1]) - ord('a'))
+        if lang in DEFAULT_LOCALES:
+            if locale['code'] == DEFAULT_LOCALES[lang]:
+                languages[slot] = i
+        elif languages[slot] == 0xFF:
+            languages[slot] = i
+    
     c_content = f'''/**
  * @file supported_locales.c
  * @brief Implementation of supported locales module
  * 
- * This file is auto-generated from docs/locale-identifiers.csv
+ * This file is auto-generated from docs/pruned-languages.csv
  * Do not edit manually - run scripts/generate_locales.py to regenerate
  * 
  * Generated on: {__import__('datetime').datetime.now().strftime('%Y-%m-%d %H:%M:%S')}
  * Total locales: {len(locales)}
+ * 
+ * Lookups do not scan the locale array. A full locale "ll_CC" is packed
+ * into a 32-bit key and found through a perfect hash chosen by the
+ * generator; a language code indexes a table of its default locale by its
+ * two letters. Display names, tiers and RTL flags are precomputed.
+ * 
+ * Nothing here is mutable: every function is thread-safe and returns
+ * pointers into the static tables, which callers may keep without copying.
  */
 
 #include "supported_locales.h"
 #include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
+#include <stdint.h>
+#include <ctype.h>
 
 /**
  * @brief Static array of all supported locales
@@ -76,9 +147,11 @@ static const muse_locale_t supported_locales[] = {{
     # Generate the locale array
     for i, locale in enumerate(locales):
         comma = ',' if i < len(locales) - 1 else ''
-        # Escape quotes in notes field
-        notes_escaped = locale["notes"].replace('"', '\\"')
-        c_content += f'    {{"{locale["code"]}", "{locale["language"]}", "{locale["country"]}", "{locale["tier"]}", "{notes_escaped}"}}{comma}\n'
+        display_name = f"{locale['language']} ({locale['country']})"
+        rtl = 'true' if locale['code'][:2] in RTL_LANGUAGES else 'false'
+        c_content += (f'    {{"{locale["code"]}", {c_string(locale["language"])}, {c_string(locale["country"])}, '
+                      f'{c_string(locale["tier"])}, {c_string(locale["notes"])}, "{locale["code"][:2]}", '
+                      f'{c_string(display_name)}, {rtl}}}{comma}\n')
     
     c_content += f'''
 }};
@@ -88,136 +161,181 @@ static const muse_locale_t supported_locales[] = {{
  */
 static const size_t num_supported_locales = {len(locales)};
 
+#define LOCALE_NONE 0xFF
+#define LOCALE_HASH_BITS {HASH_BITS}
+#define LOCALE_HASH_MULTIPLIER 0x{multiplier:08X}u
+
+/**
+ * @brief Packed "ll_CC" key of each locale, in array order
+ */
+static const uint32_t locale_keys[] = {{
+'''
+    for i in range(0, len(keys), 6):
+        c_content += '    ' + ', '.join(f'0x{key:08X}' for key in keys[i:i + 6]) + ',\n'
+    
+    c_content += '''};
+
 /**
- * @brief Forward declaration for internal use
+ * @brief Perfect hash of the packed keys to locale indexes
  */
-static bool muse_extract_language_code_internal(const char *locale_code, char *buffer, size_t buffer_size);
+static const uint8_t locale_slots[1 << LOCALE_HASH_BITS] = {
+'''
+    for i in range(0, len(slots), 16):
+        c_content += '    ' + ', '.join(f'{slot:3d}' for slot in slots[i:i + 16]) + ',\n'
+    
+    c_content += '''};
+
+/**
+ * @brief Default locale index of each two-letter language code ("aa".."zz")
+ */
+static const uint8_t language_locales[26 * 26] = {
+'''
+    for i in range(0, len(languages), 26):
+        c_content += '    ' + ', '.join(f'{idx:3d}' for idx in languages[i:i + 26]) + f', /* {chr(ord("a") + i // 26)}? */\n'
+    
+    c_content += '''};
 
-bool muse_is_locale_supported(const char *locale_code) {{
-    if (!locale_code) {{
+/* Find a locale by its language and country letters; NULL if unsupported */
+static const muse_locale_t *lookup_locale(unsigned char l0, unsigned char l1,
+                                          unsigned char c0, unsigned char c1) {
+    uint32_t key = ((uint32_t)l0 << 24) | ((uint32_t)l1 << 16) | ((uint32_t)c0 << 8) | c1;
+    uint8_t idx = locale_slots[(uint32_t)(key * LOCALE_HASH_MULTIPLIER) >> (32 - LOCALE_HASH_BITS)];
+    
+    return (idx != LOCALE_NONE && locale_keys[idx] == key) ? &supported_locales[idx] : NULL;
+}
+
+/* Find a full locale code ("ll_CC"); NULL if unsupported */
+static const muse_locale_t *find_locale(const char *code) {
+    if (!code[0] || !code[1] || code[2] != '_' || !code[3] || !code[4] || code[5]) {
+        return NULL;
+    }
+    return lookup_locale(code[0], code[1], code[3], code[4]);
+}
+
+/* Find the default locale of a language code ("ll"); NULL if unsupported */
+static const muse_locale_t *find_language(const char *code) {
+    uint8_t idx;
+    
+    if (code[0] < 'a' || code[0] > 'z' || code[1] < 'a' || code[1] > 'z' || code[2]) {
+        return NULL;
+    }
+    
+    idx = language_locales[(code[0] - 'a') * 26 + (code[1] - 'a')];
+    return idx != LOCALE_NONE ? &supported_locales[idx] : NULL;
+}
+
+bool muse_is_locale_supported(const char *locale_code) {
+    if (!locale_code) {
         return false;
-    }}
-    
-    // First try exact match
-    for (size_t i = 0; i < num_supported_locales; i++) {{
-        if (strcmp(supported_locales[i].code, locale_code) == 0) {{
-            return true;
-        }}
-    }}
-    
-    // If no exact match, try language-only match (e.g., "en" matches "en_US")
-    char lang_code[8];
-    if (muse_extract_language_code_internal(locale_code, lang_code, sizeof(lang_code))) {{
-        // Check if the input was already a language code
-        if (strcmp(lang_code, locale_code) == 0) {{
-            // Input is language-only, check if any variant exists
-            for (size_t i = 0; i < num_supported_locales; i++) {{
-                char supported_lang[8];
-                if (muse_extract_language_code_internal(supported_locales[i].code, supported_lang, sizeof(supported_lang))) {{
-                    if (strcmp(supported_lang, lang_code) == 0) {{
-                        return true;
-                    }}
-                }}
-            }}
-        }}
-    }}
-    
-    return false;
-}}
-
-const char *muse_get_full_locale(const char *language_code) {{
-    if (!language_code) {{
+    }
+    
+    // Exact match, or a language-only code with any variant (e.g., "en" matches "en_US")
+    return find_locale(locale_code) != NULL || find_language(locale_code) != NULL;
+}
+
+const muse_locale_t *muse_find_locale(const char *locale_code) {
+    const muse_locale_t *locale;
+    
+    if (!locale_code) {
+        return NULL;
+    }
+    
+    locale = find_locale(locale_code);
+    return locale ? locale : find_language(locale_code);
+}
+
+const char *muse_get_full_locale(const char *language_code) {
+    const muse_locale_t *locale;
+    
+    if (!language_code) {
         return NULL;
-    }}
-    
-    // If it's already a full locale code, return it if supported
-    if (strchr(language_code, '_') != NULL) {{
-        return muse_is_locale_supported(language_code) ? language_code : NULL;
-    }}
-    
-    // Find first matching locale for this language
-    for (size_t i = 0; i < num_supported_locales; i++) {{
-        char lang_code[8];
-        if (muse_extract_language_code_internal(supported_locales[i].code, lang_code, sizeof(lang_code))) {{
-            if (strcmp(lang_code, language_code) == 0) {{
-                return supported_locales[i].code;
-            }}
-        }}
-    }}
-    
-    return NULL;
-}}
-
-const muse_locale_t *muse_get_supported_locales(size_t *count) {{
-    if (count) {{
+    }
+    
+    // Hyphenated format, country in any case (es-mx -> es_MX)
+    const char *hyphen = strchr(language_code, '-');
+    if (hyphen == language_code + 2 && hyphen[1] && hyphen[2] && !hyphen[3]) {
+        locale = lookup_locale(language_code[0], language_code[1],
+                               toupper((unsigned char)hyphen[1]), toupper((unsigned char)hyphen[2]));
+        if (locale) {
+            return locale->code;
+        }
+    }
+    
+    // A full locale code, or the default locale of a language
+    // (e.g., "en" -> "en_US", "pt" -> "pt_BR")
+    if (strchr(language_code, '_') != NULL) {
+        locale = find_locale(language_code);
+    } else {
+        locale = find_language(language_code);
+    }
+    return locale ? locale->code : NULL;
+}
+
+const muse_locale_t *muse_get_supported_locales(size_t *count) {
+    if (count) {
         *count = num_supported_locales;
-    }}
+    }
     return supported_locales;
-}}
+}
 
-const char *muse_get_locale_display_name(const char *locale_code) {{
-    if (!locale_code) {{
+const char *muse_get_locale_display_name(const char *locale_code) {
+    const muse_locale_t *locale;
+    
+    if (!locale_code) {
         return NULL;
-    }}
-    
-    for (size_t i = 0; i < num_supported_locales; i++) {{
-        if (strcmp(supported_locales[i].code, locale_code) == 0) {{
-            static char display_name[256];
-            snprintf(display_name, sizeof(display_name), "%s (%s)", 
-                    supported_locales[i].language, supported_locales[i].country);
-            return display_name;
-        }}
-    }}
-    
-    return NULL;
-}}
-
-static bool muse_extract_language_code_internal(const char *locale_code, char *buffer, size_t buffer_size) {{
-    if (!locale_code || !buffer || buffer_size < 3) {{
+    }
+    
+    locale = find_locale(locale_code);
+    return locale ? locale->display_name : NULL;
+}
+
+bool muse_extract_language_code(const char *locale_code, char *buffer, size_t buffer_size) {
+    if (!locale_code || !buffer || buffer_size < 3) {
         return false;
-    }}
+    }
     
     // Check for empty string
-    if (strlen(locale_code) == 0) {{
+    if (locale_code[0] == '\\0') {
         return false;
-    }}
+    }
     
     const char *underscore = strchr(locale_code, '_');
-    if (underscore) {{
-        size_t lang_len = underscore - locale_code;
-        if (lang_len == 0 || lang_len >= buffer_size) {{
-            return false;
-        }}
-        strncpy(buffer, locale_code, lang_len);
-        buffer[lang_len] = '\\0';
-    }} else {{
-        // No underscore, assume it's already a language code
-        if (strlen(locale_code) >= buffer_size) {{
-            return false;
-        }}
-        strcpy(buffer, locale_code);
-    }}
+    size_t lang_len = underscore ? (size_t)(underscore - locale_code) : strlen(locale_code);
+    
+    // No underscore means it is already a language code
+    if (lang_len == 0 || lang_len >= buffer_size) {
+        return false;
+    }
+    memcpy(buffer, locale_code, lang_len);
+    buffer[lang_len] = '\\0';
     
     return true;
-}}
+}
 
-bool muse_extract_language_code(const char *locale_code, char *buffer, size_t buffer_size) {{
-    return muse_extract_language_code_internal(locale_code, buffer, buffer_size);
-}}
-
-const char *muse_get_locale_tier(const char *locale_code) {{
-    if (!locale_code) {{
+const char *muse_get_locale_tier(const char *locale_code) {
+    const muse_locale_t *locale;
+    
+    if (!locale_code) {
         return NULL;
-    }}
+    }
     
-    for (size_t i = 0; i < num_supported_locales; i++) {{
-        if (strcmp(supported_locales[i].code, locale_code) == 0) {{
-            return supported_locales[i].tier;
-        }}
-    }}
+    locale = find_locale(locale_code);
+    return locale ? locale->tier : NULL;
+}
+
+bool muse_is_locale_rtl(const char *locale_code) {
+    const muse_locale_t *locale;
+    
+    if (!locale_code) {
+        return false;
+    }
     
-    return NULL;
-}}
+    locale = find_locale(locale_code);
+    if (!locale) {
+        locale = find_language(locale_code);
+    }
+    return locale ? locale->is_rtl : false;
+}
 '''
     
     try:
@@ -1,4 +1,11 @@
 #include "advanced_config.h"
+#include "backend_health.h"
+#include "rate_limit.h"
+#include "stream_capture.h"
+#include "http_response.h"
+#include "advanced_streaming.h"
+#include "source_translation.h"
+#include "translation_memory.h"
 #include <apr_strings.h>
 #include <http_log.h>
 #include <apr_env.h> /* For apr_env_get */
@@ -54,6 +61,40 @@ void *create_advanced_muse_ai_config(apr_pool_t *pool, server_rec *s)
     cfg->cache_enable = 0; /* Caching disabled by default */
     cfg->cache_ttl_seconds = 300; /* Default 5 minutes */
 
+    cfg->metrics_enable = 1; /* Metrics enabled by default */
+    cfg->server_timing = 0;
+    cfg->slow_trace_threshold_ms = 0;
+    cfg->slow_trace_file = NULL;
+    cfg->capture_dir = NULL;
+    cfg->capture_sample = MUSE_AI_CAPTURE_DEFAULT_SAMPLE;
+    cfg->capture_max_bytes = MUSE_AI_CAPTURE_DEFAULT_MAX_BYTES;
+
+    cfg->ratelimit_enable = -1; /* -1 = not set, off unless inherited */
+    cfg->ratelimit_requests_per_minute = MUSE_AI_RATELIMIT_DEFAULT_RPM;
+    cfg->ratelimit_burst_size = MUSE_AI_RATELIMIT_DEFAULT_BURST;
+    cfg->token_budget_client = 0;
+    cfg->token_budget_vhost = 0;
+    cfg->token_budget_window = MUSE_AI_TOKEN_BUDGET_DEFAULT_WINDOW;
+
+    cfg->load_balance_method = "round_robin";
+    cfg->health_check_interval = MUSE_AI_HEALTH_CHECK_INTERVAL;
+    cfg->circuit_breaker_threshold = MUSE_AI_BREAKER_FAILURE_THRESHOLD;
+    cfg->circuit_breaker_cooldown = MUSE_AI_BREAKER_COOLDOWN;
+    cfg->readiness_max_inflight = 0;
+
+    cfg->max_retries = MUSE_AI_DEFAULT_MAX_RETRIES;
+    cfg->retry_delay_ms = MUSE_AI_DEFAULT_RETRY_DELAY_MS;
+    cfg->hedge_percentile = MUSE_AI_DEFAULT_HEDGE_PERCENTILE;
+    cfg->hedge_min_delay_ms = MUSE_AI_DEFAULT_HEDGE_MIN_DELAY_MS;
+    cfg->max_response_size = MUSE_AI_DEFAULT_MAX_RESPONSE_SIZE;
+    cfg->flush_bytes = MUSE_AI_DEFAULT_FLUSH_BYTES;
+    cfg->flush_interval_ms = MUSE_AI_DEFAULT_FLUSH_INTERVAL_MS;
+    cfg->translate_source_dir = NULL;
+    cfg->translate_model = NULL;
+    cfg->translate_batch_size = MUSE_AI_TRANSLATE_DEFAULT_BATCH;
+    cfg->translation_memory_file = NULL;
+    cfg->translation_memory_size_mb = MUSE_AI_TM_DEFAULT_SIZE_MB;
+
     /* Set all other pointers to NULL to avoid crashes during initialization */
     cfg->reasoning_model_patterns = NULL;
     cfg->backend_endpoints = NULL;
@@ -92,11 +133,53 @@ void *merge_advanced_muse_ai_config(apr_pool_t *p, void *base_conf, void *new_co
     merged->cache_enable = new->cache_enable;
     merged->cache_ttl_seconds = new->cache_ttl_seconds;
 
+    // Metrics - a vhost may switch collection off
+    merged->metrics_enable = (new->metrics_enable != 1) ? new->metrics_enable : base->metrics_enable;
+    merged->server_timing = new->server_timing ? new->server_timing : base->server_timing;
+    merged->slow_trace_threshold_ms = new->slow_trace_threshold_ms ? new->slow_trace_threshold_ms : base->slow_trace_threshold_ms;
+    merged->slow_trace_file = base->slow_trace_file; // One trace log per server
+    merged->capture_dir = new->capture_dir ? new->capture_dir : base->capture_dir;
+    merged->capture_sample = (new->capture_sample != MUSE_AI_CAPTURE_DEFAULT_SAMPLE) ? new->capture_sample : base->capture_sample;
+    merged->capture_max_bytes = (new->capture_max_bytes != MUSE_AI_CAPTURE_DEFAULT_MAX_BYTES) ? new->capture_max_bytes : base->capture_max_bytes;
+
+    // Load balancing and health checking - vhosts inherit the main server's backends
+    merged->backend_endpoints = new->backend_endpoints ? new->backend_endpoints : base->backend_endpoints;
+    merged->load_balance_method = new->load_balance_method ? new->load_balance_method : base->load_balance_method;
+    merged->health_check_interval = (new->health_check_interval != MUSE_AI_HEALTH_CHECK_INTERVAL) ? new->health_check_interval : base->health_check_interval;
+    merged->circuit_breaker_threshold = (new->circuit_breaker_threshold != MUSE_AI_BREAKER_FAILURE_THRESHOLD) ? new->circuit_breaker_threshold : base->circuit_breaker_threshold;
+    merged->circuit_breaker_cooldown = (new->circuit_breaker_cooldown != MUSE_AI_BREAKER_COOLDOWN) ? new->circuit_breaker_cooldown : base->circuit_breaker_cooldown;
+    merged->readiness_max_inflight = new->readiness_max_inflight ? new->readiness_max_inflight : base->readiness_max_inflight;
+
+    // Retries and hedging
+    merged->max_retries = (new->max_retries != MUSE_AI_DEFAULT_MAX_RETRIES) ? new->max_retries : base->max_retries;
+    merged->retry_delay_ms = (new->retry_delay_ms != MUSE_AI_DEFAULT_RETRY_DELAY_MS) ? new->retry_delay_ms : base->retry_delay_ms;
+    merged->hedge_percentile = (new->hedge_percentile != MUSE_AI_DEFAULT_HEDGE_PERCENTILE) ? new->hedge_percentile : base->hedge_percentile;
+    merged->hedge_min_delay_ms = (new->hedge_min_delay_ms != MUSE_AI_DEFAULT_HEDGE_MIN_DELAY_MS) ? new->hedge_min_delay_ms : base->hedge_min_delay_ms;
+    merged->max_response_size = (new->max_response_size != MUSE_AI_DEFAULT_MAX_RESPONSE_SIZE) ? new->max_response_size : base->max_response_size;
+
+    // Output batching
+    merged->flush_bytes = (new->flush_bytes != MUSE_AI_DEFAULT_FLUSH_BYTES) ? new->flush_bytes : base->flush_bytes;
+    merged->flush_interval_ms = (new->flush_interval_ms != MUSE_AI_DEFAULT_FLUSH_INTERVAL_MS) ? new->flush_interval_ms : base->flush_interval_ms;
+
     // Set all complex fields to NULL to avoid crashes, but preserve prompts_dir
     merged->reasoning_model_patterns = NULL;
-    merged->backend_endpoints = NULL;
     merged->prompts_dir = new->prompts_dir ? new->prompts_dir : base->prompts_dir;
-    merged->ratelimit_whitelist_ips = NULL;
+
+    // Translation from cached source pages
+    merged->translate_source_dir = new->translate_source_dir ? new->translate_source_dir : base->translate_source_dir;
+    merged->translate_model = new->translate_model ? new->translate_model : base->translate_model;
+    merged->translate_batch_size = (new->translate_batch_size != MUSE_AI_TRANSLATE_DEFAULT_BATCH) ? new->translate_batch_size : base->translate_batch_size;
+    merged->translation_memory_file = base->translation_memory_file; // One memory per server
+    merged->translation_memory_size_mb = base->translation_memory_size_mb;
+
+    // Rate limiting - vhosts inherit the main server's limits unless overridden
+    merged->ratelimit_enable = (new->ratelimit_enable != -1) ? new->ratelimit_enable : base->ratelimit_enable;
+    merged->ratelimit_requests_per_minute = (new->ratelimit_requests_per_minute != MUSE_AI_RATELIMIT_DEFAULT_RPM) ? new->ratelimit_requests_per_minute : base->ratelimit_requests_per_minute;
+    merged->ratelimit_burst_size = (new->ratelimit_burst_size != MUSE_AI_RATELIMIT_DEFAULT_BURST) ? new->ratelimit_burst_size : base->ratelimit_burst_size;
+    merged->ratelimit_whitelist_ips = new->ratelimit_whitelist_ips ? new->ratelimit_whitelist_ips : base->ratelimit_whitelist_ips;
+    merged->token_budget_client = new->token_budget_client ? new->token_budget_client : base->token_budget_client;
+    merged->token_budget_vhost = new->token_budget_vhost ? new->token_budget_vhost : base->token_budget_vhost;
+    merged->token_budget_window = (new->token_budget_window != MUSE_AI_TOKEN_BUDGET_DEFAULT_WINDOW) ? new->token_budget_window : base->token_budget_window;
 
     return merged;
 }
@@ -180,6 +263,75 @@ const char *set_ratelimit_rpm(cmd_parms *cmd, void *cfg, const char *arg)
     return NULL;
 }
 
+const char *set_ratelimit_burst_size(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 1 || value > MUSE_AI_RATELIMIT_MAX_BURST) {
+        return "MuseAiRateLimitBurstSize must be between 1 and 10000";
+    }
+    
+    config->ratelimit_burst_size = value;
+    return NULL;
+}
+
+const char *set_ratelimit_whitelist_ips(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    
+    return rate_limit_add_whitelist(cmd->pool, &config->ratelimit_whitelist_ips, arg);
+}
+
+const char *set_token_budget_client(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 1000000000) {
+        return "MuseAiTokenBudgetPerClient must be between 0 (unlimited) and 1000000000";
+    }
+    
+    config->token_budget_client = value;
+    return NULL;
+}
+
+const char *set_token_budget_vhost(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 1000000000) {
+        return "MuseAiTokenBudgetPerVhost must be between 0 (unlimited) and 1000000000";
+    }
+    
+    config->token_budget_vhost = value;
+    return NULL;
+}
+
+const char *set_token_budget_window(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 60 || value > 2592000) {
+        return "MuseAiTokenBudgetWindow must be between 60 and 2592000 seconds";
+    }
+    
+    config->token_budget_window = value;
+    return NULL;
+}
+
 const char *set_metrics_enable(cmd_parms *cmd, void *cfg, const char *arg)
 {
     (void)cfg;
@@ -197,6 +349,101 @@ const char *set_metrics_enable(cmd_parms *cmd, void *cfg, const char *arg)
     return NULL;
 }
 
+const char *set_server_timing(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    
+    if (strcasecmp(arg, "on") == 0 || strcasecmp(arg, "yes") == 0 || strcasecmp(arg, "1") == 0) {
+        config->server_timing = 1;
+    } else if (strcasecmp(arg, "off") == 0 || strcasecmp(arg, "no") == 0 || strcasecmp(arg, "0") == 0) {
+        config->server_timing = 0;
+    } else {
+        return "MuseAiServerTiming must be On or Off";
+    }
+    
+    return NULL;
+}
+
+const char *set_slow_trace_threshold(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 3600000) {
+        return "MuseAiSlowTraceThreshold must be between 0 (disabled) and 3600000 milliseconds";
+    }
+    
+    config->slow_trace_threshold_ms = value;
+    return NULL;
+}
+
+const char *set_slow_trace_file(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    
+    if (err) {
+        return err;
+    }
+    
+    config->slow_trace_file = ap_server_root_relative(cmd->pool, arg);
+    if (!config->slow_trace_file) {
+        return apr_pstrcat(cmd->pool, "MuseAiSlowTraceFile: invalid path ", arg, NULL);
+    }
+    
+    return NULL;
+}
+
+const char *set_capture_dir(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    
+    config->capture_dir = ap_server_root_relative(cmd->pool, arg);
+    if (!config->capture_dir) {
+        return apr_pstrcat(cmd->pool, "MuseAiCaptureDir: invalid path ", arg, NULL);
+    }
+    
+    return NULL;
+}
+
+const char *set_capture_sample(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 1000000) {
+        return "MuseAiCaptureSample must be between 0 (disabled) and 1000000";
+    }
+    
+    config->capture_sample = value;
+    return NULL;
+}
+
+const char *set_capture_max_bytes(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 1024 || value > 64 * 1024 * 1024) {
+        return "MuseAiCaptureMaxBytes must be between 1024 and 67108864 bytes";
+    }
+    
+    config->capture_max_bytes = value;
+    return NULL;
+}
+
 const char *set_reasoning_model_pattern(cmd_parms *cmd, void *cfg, const char *pattern)
 {
     (void)cfg;
@@ -213,7 +460,9 @@ const char *set_reasoning_model_pattern(cmd_parms *cmd, void *cfg, const char *p
 
 const char *set_backend_endpoint(cmd_parms *cmd, void *cfg, const char *endpoint)
 {
-    advanced_muse_ai_config *config = (advanced_muse_ai_config *)cfg;
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
     backend_endpoint_t *new_endpoint;
 
     if (!endpoint || strlen(endpoint) == 0) {
@@ -248,13 +497,16 @@ const char *set_backend_endpoint(cmd_parms *cmd, void *cfg, const char *endpoint
     new_endpoint->total_requests = 0;
     new_endpoint->failed_requests = 0;
     new_endpoint->last_health_check = 0;
+    new_endpoint->last_probe_latency = 0;
     new_endpoint->healthy = 1; // Assume healthy until a check fails
+    new_endpoint->breaker_state = 0;
+    new_endpoint->consecutive_failures = 0;
+    new_endpoint->breaker_opened_at = 0;
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, cmd->server, 
                  "[mod_muse_ai] Added backend endpoint for load balancing: %s", new_endpoint->url);
 
     return NULL;
-    return NULL;
 }
 
 const char *set_load_balance_method(cmd_parms *cmd, void *cfg, const char *method)
@@ -273,6 +525,126 @@ const char *set_load_balance_method(cmd_parms *cmd, void *cfg, const char *metho
     return NULL;
 }
 
+const char *set_health_check_interval(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 3600) {
+        return "MuseAiHealthCheckInterval must be between 0 (disabled) and 3600 seconds";
+    }
+    
+    config->health_check_interval = value;
+    return NULL;
+}
+
+const char *set_circuit_breaker_threshold(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 1 || value > 1000) {
+        return "MuseAiCircuitBreakerThreshold must be between 1 and 1000";
+    }
+    
+    config->circuit_breaker_threshold = value;
+    return NULL;
+}
+
+const char *set_circuit_breaker_cooldown(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 1 || value > 3600) {
+        return "MuseAiCircuitBreakerCooldown must be between 1 and 3600 seconds";
+    }
+    
+    config->circuit_breaker_cooldown = value;
+    return NULL;
+}
+
+const char *set_readiness_max_inflight(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 1000000) {
+        return "MuseAiReadinessMaxInflight must be between 0 (unlimited) and 1000000";
+    }
+    
+    config->readiness_max_inflight = value;
+    return NULL;
+}
+
+const char *set_max_retries(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 10) {
+        return "MuseAiMaxRetries must be between 0 and 10";
+    }
+    
+    config->max_retries = value;
+    return NULL;
+}
+
+const char *set_retry_delay_ms(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 60000) {
+        return "MuseAiRetryDelayMs must be between 0 and 60000 milliseconds";
+    }
+    
+    config->retry_delay_ms = value;
+    return NULL;
+}
+
+const char *set_hedge_percentile(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 99) {
+        return "MuseAiHedgePercentile must be between 0 (disabled) and 99";
+    }
+    
+    config->hedge_percentile = value;
+    return NULL;
+}
+
+const char *set_hedge_min_delay_ms(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 60000) {
+        return "MuseAiHedgeMinDelayMs must be between 0 and 60000 milliseconds";
+    }
+    
+    config->hedge_min_delay_ms = value;
+    return NULL;
+}
+
 const char *set_streaming_buffer_size(cmd_parms *cmd, void *cfg, const char *arg)
 {
     (void)cfg;
@@ -288,6 +660,36 @@ const char *set_streaming_buffer_size(cmd_parms *cmd, void *cfg, const char *arg
     return NULL;
 }
 
+const char *set_flush_bytes(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 256 || value > 65536) {
+        return "MuseAiFlushBytes must be between 256 and 65536 bytes";
+    }
+    
+    config->flush_bytes = value;
+    return NULL;
+}
+
+const char *set_flush_interval_ms(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 0 || value > 5000) {
+        return "MuseAiFlushIntervalMs must be between 0 and 5000 milliseconds";
+    }
+    
+    config->flush_interval_ms = value;
+    return NULL;
+}
+
 const char *set_security_max_request_size(cmd_parms *cmd, void *cfg, const char *arg)
 {
     (void)cfg;
@@ -303,6 +705,21 @@ const char *set_security_max_request_size(cmd_parms *cmd, void *cfg, const char
     return NULL;
 }
 
+const char *set_max_response_size(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 65536 || value > 268435456) { /* 64KB to 256MB */
+        return "MuseAiMaxResponseSize must be between 65536 and 268435456 bytes";
+    }
+    
+    config->max_response_size = value;
+    return NULL;
+}
+
 const char *set_muse_ai_prompts_dir(cmd_parms *cmd, void *cfg, const char *arg)
 {
     (void)cfg;
@@ -339,6 +756,74 @@ const char *set_muse_ai_prompts_minify(cmd_parms *cmd, void *cfg, const char *ar
     return NULL;
 }
 
+const char *set_translate_source_dir(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    
+    config->translate_source_dir = ap_server_root_relative(cmd->pool, arg);
+    if (!config->translate_source_dir) {
+        return apr_pstrcat(cmd->pool, "MuseAiTranslateSourceDir: invalid path ", arg, NULL);
+    }
+    
+    return NULL;
+}
+
+const char *set_translate_model(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    
+    config->translate_model = apr_pstrdup(cmd->pool, arg);
+    return NULL;
+}
+
+const char *set_translate_batch_size(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 1 || value > 500) {
+        return "MuseAiTranslateBatchSize must be between 1 and 500 segments";
+    }
+    
+    config->translate_batch_size = value;
+    return NULL;
+}
+
+const char *set_translation_memory(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    
+    config->translation_memory_file = ap_server_root_relative(cmd->pool, arg);
+    if (!config->translation_memory_file) {
+        return apr_pstrcat(cmd->pool, "MuseAiTranslationMemory: invalid path ", arg, NULL);
+    }
+    
+    return NULL;
+}
+
+const char *set_translation_memory_size(cmd_parms *cmd, void *cfg, const char *arg)
+{
+    (void)cfg;
+    extern module muse_ai_module;
+    advanced_muse_ai_config *config = (advanced_muse_ai_config *)ap_get_module_config(cmd->server->module_config, &muse_ai_module);
+    int value = atoi(arg);
+    
+    if (value < 1 || value > 4096) {
+        return "MuseAiTranslationMemorySize must be between 1 and 4096 megabytes";
+    }
+    
+    config->translation_memory_size_mb = value;
+    return NULL;
+}
+
 /* Configuration validation */
 const char *set_muse_ai_endpoint(cmd_parms *cmd, void *dcfg, const char *arg)
 {
@@ -470,14 +955,41 @@ const command_rec muse_ai_advanced_cmds[] = {
     AP_INIT_TAKE1("MuseAiCacheTTL", set_cache_ttl, NULL, OR_ALL, "Set cache time-to-live in seconds for a directory (0 to disable)"),
     AP_INIT_TAKE1("MuseAiRateLimitEnable", set_ratelimit_enable, NULL, RSRC_CONF, "Enable rate limiting (On/Off)"),
     AP_INIT_TAKE1("MuseAiRateLimitRPM", set_ratelimit_rpm, NULL, RSRC_CONF, "Rate limit in requests per minute"),
+    AP_INIT_TAKE1("MuseAiRateLimitBurstSize", set_ratelimit_burst_size, NULL, RSRC_CONF, "Requests a client may burst above the per-minute rate"),
+    AP_INIT_ITERATE("MuseAiRateLimitWhitelistIPs", set_ratelimit_whitelist_ips, NULL, RSRC_CONF, "IP addresses or CIDR ranges exempt from rate limiting"),
+    AP_INIT_TAKE1("MuseAiTokenBudgetPerClient", set_token_budget_client, NULL, RSRC_CONF, "Generated tokens allowed per client IP per budget window (0 = unlimited)"),
+    AP_INIT_TAKE1("MuseAiTokenBudgetPerVhost", set_token_budget_vhost, NULL, RSRC_CONF, "Generated tokens allowed per virtual host per budget window (0 = unlimited)"),
+    AP_INIT_TAKE1("MuseAiTokenBudgetWindow", set_token_budget_window, NULL, RSRC_CONF, "Length of the token budget window in seconds"),
     AP_INIT_TAKE1("MuseAiMetricsEnable", set_metrics_enable, NULL, RSRC_CONF, "Enable performance metrics (On/Off)"),
+    AP_INIT_TAKE1("MuseAiServerTiming", set_server_timing, NULL, RSRC_CONF, "Send per-phase Server-Timing headers (On/Off)"),
+    AP_INIT_TAKE1("MuseAiSlowTraceThreshold", set_slow_trace_threshold, NULL, RSRC_CONF, "Write a trace record for requests slower than this many milliseconds (0 to disable)"),
+    AP_INIT_TAKE1("MuseAiSlowTraceFile", set_slow_trace_file, NULL, RSRC_CONF, "File the slow-request trace records are appended to"),
+    AP_INIT_TAKE1("MuseAiCaptureDir", set_capture_dir, NULL, RSRC_CONF, "Directory sampled backend response streams are recorded to"),
+    AP_INIT_TAKE1("MuseAiCaptureSample", set_capture_sample, NULL, RSRC_CONF, "Record one in this many backend responses (1 = all, 0 to disable)"),
+    AP_INIT_TAKE1("MuseAiCaptureMaxBytes", set_capture_max_bytes, NULL, RSRC_CONF, "Bytes recorded per captured response"),
     AP_INIT_TAKE1("MuseAiReasoningModelPattern", set_reasoning_model_pattern, NULL, RSRC_CONF, "Regex pattern to identify a reasoning model"),
     AP_INIT_TAKE1("MuseAiBackendEndpoint", set_backend_endpoint, NULL, RSRC_CONF, "Define a backend endpoint for load balancing"),
     AP_INIT_TAKE1("MuseAiLoadBalanceMethod", set_load_balance_method, NULL, RSRC_CONF, "Load balancing method (round_robin, least_connections, random)"),
+    AP_INIT_TAKE1("MuseAiHealthCheckInterval", set_health_check_interval, NULL, RSRC_CONF, "Seconds between active backend health probes (0 to disable)"),
+    AP_INIT_TAKE1("MuseAiCircuitBreakerThreshold", set_circuit_breaker_threshold, NULL, RSRC_CONF, "Consecutive failures before a backend is taken out of rotation"),
+    AP_INIT_TAKE1("MuseAiCircuitBreakerCooldown", set_circuit_breaker_cooldown, NULL, RSRC_CONF, "Seconds before a failed backend receives a trial request"),
+    AP_INIT_TAKE1("MuseAiReadinessMaxInflight", set_readiness_max_inflight, NULL, RSRC_CONF, "In-flight requests at which the readiness check fails (0 = unlimited)"),
+    AP_INIT_TAKE1("MuseAiMaxRetries", set_max_retries, NULL, RSRC_CONF, "Retries on another backend before any response byte is sent"),
+    AP_INIT_TAKE1("MuseAiRetryDelayMs", set_retry_delay_ms, NULL, RSRC_CONF, "Delay between retries in milliseconds"),
+    AP_INIT_TAKE1("MuseAiHedgePercentile", set_hedge_percentile, NULL, RSRC_CONF, "First-byte latency percentile after which a hedged request is sent (0 to disable)"),
+    AP_INIT_TAKE1("MuseAiHedgeMinDelayMs", set_hedge_min_delay_ms, NULL, RSRC_CONF, "Minimum delay in milliseconds before a hedged request is sent"),
     AP_INIT_TAKE1("MuseAiStreamingBufferSize", set_streaming_buffer_size, NULL, RSRC_CONF, "Streaming buffer size in bytes"),
+    AP_INIT_TAKE1("MuseAiFlushBytes", set_flush_bytes, NULL, RSRC_CONF, "Pending streamed bytes that force a flush to the client"),
+    AP_INIT_TAKE1("MuseAiFlushIntervalMs", set_flush_interval_ms, NULL, RSRC_CONF, "Milliseconds after which pending streamed output is flushed (0 = every token)"),
     AP_INIT_TAKE1("MuseAiSecurityMaxRequestSize", set_security_max_request_size, NULL, RSRC_CONF, "Maximum allowed request body size in bytes"),
+    AP_INIT_TAKE1("MuseAiMaxResponseSize", set_max_response_size, NULL, RSRC_CONF, "Largest non-streaming backend response accepted, in bytes"),
     AP_INIT_TAKE1("MuseAiPromptsDir", set_muse_ai_prompts_dir, NULL, RSRC_CONF, "Directory for prompt files"),
     AP_INIT_TAKE1("MuseAiPromptsMinify", set_muse_ai_prompts_minify, NULL, RSRC_CONF, "Enable minified layout for prompts (On/Off)"),
+    AP_INIT_TAKE1("MuseAiTranslateSourceDir", set_translate_source_dir, NULL, RSRC_CONF, "Directory for cached en_US source pages; translated pages are made from them"),
+    AP_INIT_TAKE1("MuseAiTranslateModel", set_translate_model, NULL, RSRC_CONF, "Model for translating source page text (default: MuseAiModel)"),
+    AP_INIT_TAKE1("MuseAiTranslateBatchSize", set_translate_batch_size, NULL, RSRC_CONF, "Text segments sent per translation request"),
+    AP_INIT_TAKE1("MuseAiTranslationMemory", set_translation_memory, NULL, RSRC_CONF, "Memory-mapped file remembering translated text segments (main server only)"),
+    AP_INIT_TAKE1("MuseAiTranslationMemorySize", set_translation_memory_size, NULL, RSRC_CONF, "Size of the translation memory file in megabytes"),
     AP_INIT_TAKE1("MuseAiMaxTokens", set_muse_ai_max_tokens, NULL, RSRC_CONF, "Set the maximum number of tokens for the AI response (0 = no limit)"),
     AP_INIT_TAKE1("MuseAiEnable", set_muse_ai_enable, NULL, OR_ALL, "Enable or disable mod_muse_ai for a directory"),
     {NULL}
@@ -517,7 +1029,7 @@ int validate_advanced_config(advanced_muse_ai_config *cfg, server_rec *s)
         return -1;
     }
     
-    if (cfg->ratelimit_enable && cfg->ratelimit_requests_per_minute <= 0) {
+    if (cfg->ratelimit_enable > 0 && cfg->ratelimit_requests_per_minute <= 0) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, 
                     "[mod_muse_ai] Rate limit RPM must be positive when rate limiting is enabled");
         return -1;
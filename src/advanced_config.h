@@ -39,15 +39,24 @@ typedef struct advanced_muse_ai_config {
     char *cache_key_prefix;
     
     /* Rate Limiting */
-    int ratelimit_enable;
+    int ratelimit_enable; /* 1 = On, 0 = Off, -1 = not set */
     int ratelimit_requests_per_minute;
     int ratelimit_burst_size;
-    char *ratelimit_whitelist_ips;
+    apr_array_header_t *ratelimit_whitelist_ips; /* apr_ipsubnet_t * entries */
+    int token_budget_client; /* generated tokens per client per window, 0 = unlimited */
+    int token_budget_vhost; /* generated tokens per virtual host per window, 0 = unlimited */
+    int token_budget_window; /* budget window in seconds */
     
     /* Performance Monitoring */
     int metrics_enable;
     char *metrics_endpoint;
     int metrics_include_request_details;
+    int server_timing; /* Send per-phase Server-Timing headers */
+    int slow_trace_threshold_ms; /* Trace requests slower than this, 0 = off */
+    char *slow_trace_file; /* Trace log path (main server only) */
+    char *capture_dir; /* Backend stream captures go here, NULL = off */
+    int capture_sample; /* Capture one in this many backend responses */
+    int capture_max_bytes; /* Bytes recorded per capture */
     
     /* Reasoning Models Support */
     apr_table_t *reasoning_model_patterns;
@@ -57,16 +66,22 @@ typedef struct advanced_muse_ai_config {
     int streaming_buffer_size;
     int streaming_chunk_size;
     int streaming_sanitization_enable;
+    int flush_bytes;       /* Pending output bytes that force a flush */
+    int flush_interval_ms; /* Flush pending output after this long, 0 = every token */
     
     /* Security */
     int security_validate_content_type;
     int security_max_request_size;
+    int max_response_size; /* Largest non-streaming backend response, in bytes */
     char *security_allowed_origins;
     
     /* Load Balancing */
     apr_array_header_t *backend_endpoints;
     char *load_balance_method; /* "round_robin", "least_connections", "random" */
-    int health_check_interval;
+    int health_check_interval; /* seconds between active probes, 0 = disabled */
+    int circuit_breaker_threshold; /* consecutive failures before a backend is skipped */
+    int circuit_breaker_cooldown; /* seconds before a half-open trial request */
+    int readiness_max_inflight; /* in-flight requests before /ready fails, 0 = unlimited */
     
     /* Timeouts and Retries */
     int connect_timeout;
@@ -74,10 +89,17 @@ typedef struct advanced_muse_ai_config {
     int write_timeout;
     int max_retries;
     int retry_delay_ms;
+    int hedge_percentile; /* first-byte percentile before hedging, 0 = disabled */
+    int hedge_min_delay_ms;
 
     /* Prompts Directory Configuration */
     char *prompts_dir; /* Path to the prompts directory */
     int prompts_minify; /* Flag to use minified layout */
+    char *translate_source_dir; /* Cached source pages, NULL = translate while generating */
+    char *translate_model; /* Model for segment translation, NULL = MuseAiModel */
+    int translate_batch_size; /* Text segments per translation request */
+    char *translation_memory_file; /* Shared segment translation memory (main server only) */
+    int translation_memory_size_mb; /* Size of that file */
     int phase3_initialized; /* Flag to check if phase 3 features are initialized */
     
 } advanced_muse_ai_config;
@@ -87,11 +109,17 @@ typedef struct backend_endpoint {
     char *url;
     char *api_key;
     int weight;
-    int active_connections;
-    int total_requests;
-    int failed_requests;
-    apr_time_t last_health_check;
-    int healthy;
+    volatile apr_uint32_t active_connections;
+    volatile apr_uint32_t total_requests;
+    volatile apr_uint32_t failed_requests;
+    volatile apr_uint64_t last_health_check; /* apr_time_t, written by the probe thread */
+    apr_interval_time_t last_probe_latency;
+    volatile apr_uint32_t healthy;
+
+    /* Circuit breaker, updated with apr_atomic_* from request and probe threads */
+    volatile apr_uint32_t breaker_state; /* breaker_state_t, see backend_health.h */
+    volatile apr_uint32_t consecutive_failures;
+    volatile apr_uint32_t breaker_opened_at; /* apr_time_sec() when last opened */
 } backend_endpoint_t;
 
 /* Metrics structure */
@@ -102,6 +130,15 @@ typedef struct muse_ai_metrics {
     long failed_requests;
     long cached_responses;
     
+    /* Accept-Language negotiation cache */
+    long accept_language_hits;
+    long accept_language_misses;
+    
+    /* Segment translation memory */
+    long translation_memory_hits;
+    long translation_memory_misses;
+    long translation_tokens_saved;
+    
     /* Timing metrics */
     double avg_response_time_ms;
     double min_response_time_ms;
@@ -116,6 +153,9 @@ typedef struct muse_ai_metrics {
     /* Rate limiting metrics */
     long ratelimit_blocked_requests;
     
+    /* Token accounting */
+    long generated_tokens;
+    
     /* Backend health */
     int healthy_backends;
     int total_backends;
@@ -134,11 +174,38 @@ const char *set_cache_enable(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_cache_ttl(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_ratelimit_enable(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_ratelimit_rpm(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_ratelimit_burst_size(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_ratelimit_whitelist_ips(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_token_budget_client(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_token_budget_vhost(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_token_budget_window(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_metrics_enable(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_server_timing(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_slow_trace_threshold(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_slow_trace_file(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_capture_dir(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_capture_sample(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_capture_max_bytes(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_translate_source_dir(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_translate_model(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_translate_batch_size(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_translation_memory(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_translation_memory_size(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_reasoning_model_pattern(cmd_parms *cmd, void *cfg, const char *pattern);
 const char *set_backend_endpoint(cmd_parms *cmd, void *cfg, const char *endpoint);
 const char *set_load_balance_method(cmd_parms *cmd, void *cfg, const char *method);
+const char *set_health_check_interval(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_circuit_breaker_threshold(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_circuit_breaker_cooldown(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_readiness_max_inflight(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_max_retries(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_retry_delay_ms(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_hedge_percentile(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_max_response_size(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_hedge_min_delay_ms(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_streaming_buffer_size(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_flush_bytes(cmd_parms *cmd, void *cfg, const char *arg);
+const char *set_flush_interval_ms(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_security_max_request_size(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_muse_ai_prompts_dir(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_muse_ai_prompts_minify(cmd_parms *cmd, void *cfg, const char *arg);
@@ -146,11 +213,11 @@ const char *set_muse_ai_max_tokens(cmd_parms *cmd, void *cfg, const char *arg);
 const char *set_muse_ai_enable(cmd_parms *cmd, void *cfg, const char *arg);
 
 /* Metrics functions */
-muse_ai_metrics_t *get_global_metrics(void);
-void update_request_metrics(double response_time_ms, int success);
+muse_ai_metrics_t *get_global_metrics(apr_pool_t *pool);
 void update_cache_metrics(int cache_hit);
 void update_pool_metrics(int active, int idle, int created, int reused);
 void update_ratelimit_metrics(int blocked);
+void update_backend_metrics(int healthy, int total);
 void reset_metrics(void);
 
 /* Configuration validation */
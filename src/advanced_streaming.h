@@ -11,6 +11,11 @@
 #define MUSE_AI_STREAM_CHUNK_SIZE 1024
 #define MUSE_AI_STREAM_SANITIZE_PATTERNS 10
 
+/* Output batching: flush when this many bytes are pending, or when the
+ * interval has passed and the output ends on a tag or line boundary */
+#define MUSE_AI_DEFAULT_FLUSH_BYTES 4096
+#define MUSE_AI_DEFAULT_FLUSH_INTERVAL_MS 100
+
 /* Streaming states */
 typedef enum {
     STREAM_STATE_INIT,
@@ -0,0 +1,547 @@
+/* Backend health checking and passive circuit breaking */
+#include "backend_health.h"
+#include <apr_strings.h>
+#include <apr_atomic.h>
+#include <apr_uri.h>
+#include <apr_network_io.h>
+#include <apr_thread_proc.h>
+#include <http_log.h>
+
+/* Per-process registry of unique backend endpoints. It is built once in
+ * child_init and never resized afterwards, so entries can be handed out by
+ * pointer and updated with atomics from any thread. */
+static apr_array_header_t *g_backends = NULL;
+static volatile apr_uint32_t g_rr_counter = 0;
+static apr_uint32_t g_breaker_threshold = MUSE_AI_BREAKER_FAILURE_THRESHOLD;
+static apr_uint32_t g_breaker_cooldown = MUSE_AI_BREAKER_COOLDOWN;
+static int g_check_interval = 0;
+
+static apr_thread_t *g_health_thread = NULL;
+static volatile int g_health_thread_stop = 0;
+
+const char *backend_breaker_state_name(int state)
+{
+    switch (state) {
+        case BREAKER_CLOSED:    return "closed";
+        case BREAKER_OPEN:      return "open";
+        case BREAKER_HALF_OPEN: return "half_open";
+        default:                return "unknown";
+    }
+}
+
+/* Add a URL to the registry unless it is already known */
+static void register_backend(apr_pool_t *pool, const char *url, const char *api_key, int weight)
+{
+    backend_endpoint_t *be;
+
+    if (!url || !*url || find_backend_endpoint(url)) {
+        return;
+    }
+
+    be = (backend_endpoint_t *)apr_array_push(g_backends);
+    memset(be, 0, sizeof(*be));
+    be->url = apr_pstrdup(pool, url);
+    be->api_key = api_key ? apr_pstrdup(pool, api_key) : NULL;
+    be->weight = weight > 0 ? weight : 1;
+    be->healthy = 1; /* Assume healthy until a probe or request says otherwise */
+    be->breaker_state = BREAKER_CLOSED;
+}
+
+/* Build the per-process backend registry */
+apr_status_t init_backend_registry(apr_pool_t *pool, server_rec *s)
+{
+    extern module muse_ai_module;
+    advanced_muse_ai_config *main_cfg;
+    server_rec *sv;
+
+    g_backends = apr_array_make(pool, 8, sizeof(backend_endpoint_t));
+    g_check_interval = 0;
+
+    main_cfg = (advanced_muse_ai_config *)ap_get_module_config(s->module_config, &muse_ai_module);
+    if (main_cfg) {
+        if (main_cfg->circuit_breaker_threshold > 0) {
+            g_breaker_threshold = (apr_uint32_t)main_cfg->circuit_breaker_threshold;
+        }
+        if (main_cfg->circuit_breaker_cooldown > 0) {
+            g_breaker_cooldown = (apr_uint32_t)main_cfg->circuit_breaker_cooldown;
+        }
+    }
+
+    for (sv = s; sv; sv = sv->next) {
+        advanced_muse_ai_config *cfg = (advanced_muse_ai_config *)ap_get_module_config(sv->module_config, &muse_ai_module);
+        if (!cfg) {
+            continue;
+        }
+
+        if (cfg->backend_endpoints && cfg->backend_endpoints->nelts > 0) {
+            for (int i = 0; i < cfg->backend_endpoints->nelts; i++) {
+                backend_endpoint_t *conf_be = &APR_ARRAY_IDX(cfg->backend_endpoints, i, backend_endpoint_t);
+                register_backend(pool, conf_be->url,
+                                 conf_be->api_key ? conf_be->api_key : cfg->api_key,
+                                 conf_be->weight);
+            }
+        } else {
+            register_backend(pool, cfg->endpoint, cfg->api_key, 1);
+        }
+
+        /* The shortest configured interval wins for the whole process */
+        if (cfg->health_check_interval > 0 &&
+            (g_check_interval == 0 || cfg->health_check_interval < g_check_interval)) {
+            g_check_interval = cfg->health_check_interval;
+        }
+    }
+
+    update_backend_metrics(g_backends->nelts, g_backends->nelts);
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s,
+                "[mod_muse_ai] Backend registry initialized with %d endpoint(s), breaker threshold=%u cooldown=%us",
+                g_backends->nelts, g_breaker_threshold, g_breaker_cooldown);
+
+    return APR_SUCCESS;
+}
+
+backend_endpoint_t *find_backend_endpoint(const char *url)
+{
+    if (!g_backends || !url) {
+        return NULL;
+    }
+
+    for (int i = 0; i < g_backends->nelts; i++) {
+        backend_endpoint_t *be = &APR_ARRAY_IDX(g_backends, i, backend_endpoint_t);
+        if (strcmp(be->url, url) == 0) {
+            return be;
+        }
+    }
+
+    return NULL;
+}
+
+static void breaker_open(backend_endpoint_t *be, const char *reason)
+{
+    apr_uint32_t previous;
+
+    apr_atomic_set32(&be->breaker_opened_at, (apr_uint32_t)apr_time_sec(apr_time_now()));
+    previous = apr_atomic_xchg32(&be->breaker_state, BREAKER_OPEN);
+
+    if (previous != BREAKER_OPEN) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, NULL,
+                    "[mod_muse_ai] Circuit breaker OPEN for %s (%s, %u consecutive failures)",
+                    be->url, reason, apr_atomic_read32(&be->consecutive_failures));
+    }
+}
+
+static void breaker_close(backend_endpoint_t *be)
+{
+    apr_uint32_t previous = apr_atomic_xchg32(&be->breaker_state, BREAKER_CLOSED);
+
+    if (previous != BREAKER_CLOSED) {
+        ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, NULL,
+                    "[mod_muse_ai] Circuit breaker CLOSED for %s", be->url);
+    }
+}
+
+/* Non-blocking admission check. In the half-open state only one request per
+ * cooldown period is let through as a trial. */
+static int breaker_try_acquire(backend_endpoint_t *be)
+{
+    apr_uint32_t now = (apr_uint32_t)apr_time_sec(apr_time_now());
+    apr_uint32_t state = apr_atomic_read32(&be->breaker_state);
+    apr_uint32_t opened;
+
+    if (state == BREAKER_CLOSED) {
+        return 1;
+    }
+
+    opened = apr_atomic_read32(&be->breaker_opened_at);
+    if (now - opened < g_breaker_cooldown) {
+        return 0;
+    }
+
+    /* Cooldown expired: whoever swaps the timestamp owns the trial request */
+    if (apr_atomic_cas32(&be->breaker_opened_at, now, opened) != opened) {
+        return 0;
+    }
+    apr_atomic_set32(&be->breaker_state, BREAKER_HALF_OPEN);
+    return 1;
+}
+
+int backend_available_count(int *total)
+{
+    apr_uint32_t now = (apr_uint32_t)apr_time_sec(apr_time_now());
+    int available = 0;
+
+    *total = g_backends ? g_backends->nelts : 0;
+    for (int i = 0; i < *total; i++) {
+        backend_endpoint_t *be = &APR_ARRAY_IDX(g_backends, i, backend_endpoint_t);
+
+        if (!apr_atomic_read32(&be->healthy)) {
+            continue;
+        }
+        /* An open breaker past its cooldown will admit a trial request */
+        if (apr_atomic_read32(&be->breaker_state) == BREAKER_CLOSED ||
+            now - apr_atomic_read32(&be->breaker_opened_at) >= g_breaker_cooldown) {
+            available++;
+        }
+    }
+
+    return available;
+}
+
+int backend_allow_request(const char *url)
+{
+    backend_endpoint_t *be = find_backend_endpoint(url);
+
+    if (!be) {
+        return 1;
+    }
+
+    return breaker_try_acquire(be);
+}
+
+/* Count one failure, from a request or a health probe, toward the threshold */
+static void breaker_record_failure(backend_endpoint_t *be, const char *reason)
+{
+    if (apr_atomic_inc32(&be->consecutive_failures) + 1 >= g_breaker_threshold ||
+        apr_atomic_read32(&be->breaker_state) == BREAKER_HALF_OPEN) {
+        breaker_open(be, reason);
+    }
+}
+
+void backend_report_result(const char *url, int success)
+{
+    backend_endpoint_t *be = find_backend_endpoint(url);
+
+    if (!be) {
+        return;
+    }
+
+    apr_atomic_inc32(&be->total_requests);
+    if (apr_atomic_read32(&be->active_connections) > 0) {
+        apr_atomic_dec32(&be->active_connections);
+    }
+
+    if (success) {
+        apr_atomic_set32(&be->consecutive_failures, 0);
+        breaker_close(be);
+        return;
+    }
+
+    apr_atomic_inc32(&be->failed_requests);
+    breaker_record_failure(be, "request failures");
+}
+
+void backend_release_endpoint(const char *url)
+{
+    backend_endpoint_t *be = find_backend_endpoint(url);
+
+    if (be && apr_atomic_read32(&be->active_connections) > 0) {
+        apr_atomic_dec32(&be->active_connections);
+    }
+}
+
+/* Claim a backend for a request: account the connection and return its URL */
+static const char *claim_backend(backend_endpoint_t *be)
+{
+    apr_atomic_inc32(&be->active_connections);
+    return be->url;
+}
+
+const char *select_backend_endpoint(request_rec *r, advanced_muse_ai_config *cfg,
+                                    const char *endpoint, const char *exclude)
+{
+    backend_endpoint_t *candidates[32];
+    int n = 0;
+    const char *method;
+
+    if (!cfg) {
+        return NULL;
+    }
+
+    /* Map the configured endpoints to their registry entries */
+    if (cfg->backend_endpoints && cfg->backend_endpoints->nelts > 0) {
+        for (int i = 0; i < cfg->backend_endpoints->nelts && n < 32; i++) {
+            backend_endpoint_t *conf_be = &APR_ARRAY_IDX(cfg->backend_endpoints, i, backend_endpoint_t);
+            backend_endpoint_t *be = find_backend_endpoint(conf_be->url);
+            if (be && !(exclude && strcmp(be->url, exclude) == 0)) {
+                candidates[n++] = be;
+            }
+        }
+    } else {
+        backend_endpoint_t *be;
+
+        if (exclude && endpoint && strcmp(endpoint, exclude) == 0) {
+            return NULL;
+        }
+        be = find_backend_endpoint(endpoint);
+        if (!be) {
+            /* Not in the registry (a models.json endpoint, or no child_init
+             * yet): nothing to guard */
+            return endpoint;
+        }
+        candidates[n++] = be;
+    }
+
+    if (n == 0) {
+        return exclude ? NULL : endpoint;
+    }
+
+    method = cfg->load_balance_method ? cfg->load_balance_method : "round_robin";
+
+    if (strcasecmp(method, "least_connections") == 0) {
+        backend_endpoint_t *best = NULL;
+        for (int i = 0; i < n; i++) {
+            if (apr_atomic_read32(&candidates[i]->breaker_state) != BREAKER_CLOSED) {
+                continue;
+            }
+            if (!best || apr_atomic_read32(&candidates[i]->active_connections) <
+                         apr_atomic_read32(&best->active_connections)) {
+                best = candidates[i];
+            }
+        }
+        if (best) {
+            return claim_backend(best);
+        }
+        /* Every breaker is open or half-open: try for a trial slot below */
+    }
+
+    {
+        apr_uint32_t start = (strcasecmp(method, "random") == 0)
+                           ? ap_random_pick(0, (apr_uint32_t)n - 1)
+                           : apr_atomic_inc32(&g_rr_counter);
+
+        for (int i = 0; i < n; i++) {
+            backend_endpoint_t *be = candidates[(start + i) % n];
+            if (breaker_try_acquire(be)) {
+                if (i > 0) {
+                    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
+                                 "[mod_muse_ai] Skipped %d unavailable backend(s), using %s", i, be->url);
+                }
+                return claim_backend(be);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* Probe GET <endpoint>/models. Returns the HTTP status code, or -1 when the
+ * backend could not be reached at all. */
+static int probe_backend(apr_pool_t *pool, backend_endpoint_t *be)
+{
+    apr_uri_t uri;
+    apr_sockaddr_t *sa;
+    apr_socket_t *sock;
+    apr_status_t rv;
+    const char *host;
+    apr_port_t port;
+    char *path, *request;
+    apr_size_t path_len;
+    char buf[64];
+    apr_size_t len;
+    apr_size_t total = 0;
+    int status = -1;
+
+    if (apr_uri_parse(pool, be->url, &uri) != APR_SUCCESS) {
+        return -1;
+    }
+
+    host = uri.hostname ? uri.hostname : "127.0.0.1";
+    port = uri.port ? uri.port : 11434;
+
+    /* ".../v1/" probes .../v1/models too */
+    path = apr_pstrdup(pool, uri.path ? uri.path : "/v1");
+    path_len = strlen(path);
+    while (path_len > 0 && path[path_len - 1] == '/') {
+        path[--path_len] = '\0';
+    }
+
+    rv = apr_sockaddr_info_get(&sa, host, APR_INET, port, 0, pool);
+    if (rv != APR_SUCCESS) {
+        return -1;
+    }
+
+    rv = apr_socket_create(&sock, APR_INET, SOCK_STREAM, APR_PROTO_TCP, pool);
+    if (rv != APR_SUCCESS) {
+        return -1;
+    }
+    apr_socket_timeout_set(sock, apr_time_from_sec(MUSE_AI_HEALTH_PROBE_TIMEOUT));
+
+    rv = apr_socket_connect(sock, sa);
+    if (rv != APR_SUCCESS) {
+        apr_socket_close(sock);
+        return -1;
+    }
+
+    request = apr_psprintf(pool,
+        "GET %s/models HTTP/1.1\r\n"
+        "Host: %s:%d\r\n"
+        "%s%s%s"
+        "Connection: close\r\n"
+        "\r\n",
+        path, host, port,
+        be->api_key ? "Authorization: Bearer " : "",
+        be->api_key ? be->api_key : "",
+        be->api_key ? "\r\n" : "");
+
+    len = strlen(request);
+    rv = apr_socket_send(sock, request, &len);
+    if (rv != APR_SUCCESS) {
+        apr_socket_close(sock);
+        return -1;
+    }
+
+    /* We only need the status line */
+    while (total < sizeof(buf) - 1) {
+        len = sizeof(buf) - 1 - total;
+        rv = apr_socket_recv(sock, buf + total, &len);
+        total += len;
+        if (rv != APR_SUCCESS || len == 0 || memchr(buf, '\n', total)) {
+            break;
+        }
+    }
+    buf[total] = '\0';
+    apr_socket_close(sock);
+
+    if (strncmp(buf, "HTTP/", 5) == 0) {
+        const char *sp = strchr(buf, ' ');
+        if (sp) {
+            status = atoi(sp + 1);
+        }
+    }
+
+    return status > 0 ? status : -1;
+}
+
+/* Background thread: probe every endpoint once per interval */
+static void *APR_THREAD_FUNC backend_health_monitor(apr_thread_t *thd, void *data)
+{
+    volatile int *stop_flag = (volatile int *)data;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    (void)thd;
+
+    rv = apr_pool_create(&pool, NULL);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL,
+                    "[mod_muse_ai] Failed to create memory pool for backend health monitor thread");
+        return NULL;
+    }
+
+    while (!*stop_flag) {
+        int healthy = 0;
+
+        for (int i = 0; i < g_backends->nelts && !*stop_flag; i++) {
+            backend_endpoint_t *be = &APR_ARRAY_IDX(g_backends, i, backend_endpoint_t);
+            apr_time_t started = apr_time_now();
+            int status = probe_backend(pool, be);
+            apr_time_t finished = apr_time_now();
+
+            apr_atomic_set64(&be->last_health_check, (apr_uint64_t)finished);
+            be->last_probe_latency = finished - started;
+
+            /* Any HTTP answer below 500 means the server is up and serving */
+            if (status > 0 && status < 500) {
+                if (!apr_atomic_xchg32(&be->healthy, 1)) {
+                    ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, NULL,
+                                "[mod_muse_ai] Backend %s is healthy again (HTTP %d)", be->url, status);
+                }
+                healthy++;
+
+                /* Let real traffic confirm recovery through a half-open trial */
+                if (apr_atomic_read32(&be->breaker_state) == BREAKER_OPEN) {
+                    apr_atomic_set32(&be->breaker_opened_at, 0);
+                }
+            } else {
+                if (apr_atomic_xchg32(&be->healthy, 0)) {
+                    ap_log_error(APLOG_MARK, APLOG_WARNING, 0, NULL,
+                                "[mod_muse_ai] Health probe failed for %s (%s)",
+                                be->url, status > 0 ? apr_psprintf(pool, "HTTP %d", status) : "unreachable");
+                }
+                breaker_record_failure(be, "health probe failed");
+            }
+
+            apr_pool_clear(pool);
+        }
+
+        update_backend_metrics(healthy, g_backends->nelts);
+
+        /* Sleep in one-second steps so shutdown is not delayed */
+        for (int slept = 0; slept < g_check_interval && !*stop_flag; slept++) {
+            apr_sleep(APR_USEC_PER_SEC);
+        }
+    }
+
+    apr_pool_destroy(pool);
+    return NULL;
+}
+
+static apr_status_t health_monitor_cleanup(void *data)
+{
+    (void)data;
+    stop_backend_health_monitor();
+    return APR_SUCCESS;
+}
+
+/* Start the background probe thread for this child process. Every child
+ * probes on its own, so each backend gets one probe per child and interval. */
+apr_status_t start_backend_health_monitor(apr_pool_t *pool, server_rec *s)
+{
+    apr_status_t rv;
+    apr_threadattr_t *thread_attr;
+
+    if (!g_backends || g_backends->nelts == 0 || g_check_interval <= 0) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s,
+                    "[mod_muse_ai] Backend health checking disabled");
+        return APR_SUCCESS;
+    }
+
+    rv = apr_threadattr_create(&thread_attr, pool);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s,
+                    "[mod_muse_ai] Failed to create thread attributes for backend health monitor");
+        return rv;
+    }
+
+    /* Joinable: the thread reads the registry in this pool, so the pool
+     * cleanup has to wait for it to finish */
+    rv = apr_threadattr_detach_set(thread_attr, 0);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s,
+                    "[mod_muse_ai] Failed to set thread attributes for backend health monitor");
+        return rv;
+    }
+
+    g_health_thread_stop = 0;
+
+    rv = apr_thread_create(&g_health_thread, thread_attr, backend_health_monitor,
+                           (void *)&g_health_thread_stop, pool);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s,
+                    "[mod_muse_ai] Failed to create backend health monitor thread");
+        return rv;
+    }
+
+    /* A pre-cleanup, so the join happens before the thread's own subpool
+     * and the registry are torn down */
+    apr_pool_pre_cleanup_register(pool, NULL, health_monitor_cleanup);
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s,
+                "[mod_muse_ai] Backend health monitor started (%d endpoint(s), every %ds)",
+                g_backends->nelts, g_check_interval);
+
+    return APR_SUCCESS;
+}
+
+/* Stop the background probe thread */
+void stop_backend_health_monitor(void)
+{
+    apr_status_t thread_rv;
+
+    if (g_health_thread) {
+        /* The thread notices the flag within a second, or when the probe
+         * in flight times out */
+        g_health_thread_stop = 1;
+        apr_thread_join(&thread_rv, g_health_thread);
+        g_health_thread = NULL;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef BACKEND_HEALTH_H
+#define BACKEND_HEALTH_H
+
+#include <httpd.h>
+#include <http_config.h>
+#include <apr_pools.h>
+#include <apr_time.h>
+
+#include "advanced_config.h"
+
+/* Health checking defaults */
+#define MUSE_AI_HEALTH_CHECK_INTERVAL 10        /* seconds between probe rounds */
+#define MUSE_AI_HEALTH_PROBE_TIMEOUT 2          /* seconds per probe */
+#define MUSE_AI_BREAKER_FAILURE_THRESHOLD 5     /* consecutive failures before opening */
+#define MUSE_AI_BREAKER_COOLDOWN 30             /* seconds before a half-open trial */
+
+/* Retry and hedging defaults */
+#define MUSE_AI_DEFAULT_MAX_RETRIES 1
+#define MUSE_AI_DEFAULT_RETRY_DELAY_MS 100
+#define MUSE_AI_DEFAULT_HEDGE_PERCENTILE 95     /* 0 disables hedging */
+#define MUSE_AI_DEFAULT_HEDGE_MIN_DELAY_MS 100
+
+/* Circuit breaker states (stored in backend_endpoint_t.breaker_state) */
+typedef enum {
+    BREAKER_CLOSED = 0,     /* Traffic flows normally */
+    BREAKER_OPEN = 1,       /* Backend is skipped until the cooldown expires */
+    BREAKER_HALF_OPEN = 2   /* One trial request is in flight */
+} breaker_state_t;
+
+/* Function declarations */
+
+/* Build the per-process backend registry from every server config.
+ * Called from the child_init hook. */
+apr_status_t init_backend_registry(apr_pool_t *pool, server_rec *s);
+
+/* Start/stop the background probe thread (one per child process) */
+apr_status_t start_backend_health_monitor(apr_pool_t *pool, server_rec *s);
+void stop_backend_health_monitor(void);
+
+/* Look up the registry entry for a backend base URL (NULL if unknown) */
+backend_endpoint_t *find_backend_endpoint(const char *url);
+
+/* Pick a backend for this request according to MuseAiLoadBalanceMethod,
+ * skipping endpoints whose breaker is open and the optional exclude URL.
+ * Falls back to endpoint, the request's own (MuseAiEndpoint or the models.json
+ * entry), when no MuseAiBackendEndpoint is configured.
+ * Returns NULL only when every candidate is currently unavailable. */
+const char *select_backend_endpoint(request_rec *r, advanced_muse_ai_config *cfg,
+                                    const char *endpoint, const char *exclude);
+
+/* Passive circuit breaker: may a request be sent to this URL right now?
+ * Unknown URLs are always allowed. */
+int backend_allow_request(const char *url);
+
+/* Record the outcome of a request against a backend URL */
+void backend_report_result(const char *url, int success);
+
+/* Release a selected backend without judging it (e.g. a cancelled hedge) */
+void backend_release_endpoint(const char *url);
+
+/* Number of registry endpoints that are healthy and not cut off by an open
+ * breaker; *total receives the registry size. Lock-free, for readiness. */
+int backend_available_count(int *total);
+
+/* Human-readable breaker state name */
+const char *backend_breaker_state_name(int state);
+
+#endif /* BACKEND_HEALTH_H */
@@ -53,5 +53,6 @@ int return_pooled_connection(connection_pool_t *pool,
                            pooled_connection_t *conn);
 void cleanup_connection_pool(connection_pool_t *pool);
 void log_pool_stats(connection_pool_t *pool, server_rec *s);
+connection_pool_t *get_global_connection_pool(void);
 
 #endif /* CONNECTION_POOL_H */
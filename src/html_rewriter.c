@@ -0,0 +1,242 @@
+/* Streaming link and direction rewriting for translated pages, see html_rewriter.h */
+#include "html_rewriter.h"
+#include "html_tokenizer.h"
+#include "supported_locales.h"
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <string.h>
+#include <strings.h>
+
+#define RTL_ATTRIBUTE " dir=\"rtl\""
+
+struct html_rewriter {
+    html_tokenizer_t *tok;
+    html_rewrite_sink_fn sink;
+    void *baton;
+    const char *prefix;     /* "/es", prepended to local links */
+    apr_size_t prefix_len;
+    int rtl;                /* dir="rtl" still to be added to <html> */
+    const char *run;        /* Untouched bytes not passed to the sink yet */
+    apr_size_t run_len;
+    int changes;
+};
+
+/* Links into these directories, or to files with these extensions, are
+ * shared by every language */
+static const char *const asset_dirs[] = {
+    "/css/", "/js/", "/img/", "/images/", "/fonts/", "/assets/", "/static/", NULL
+};
+static const char *const asset_extensions[] = {
+    "css", "js", "mjs", "map", "json", "xml", "txt", "png", "jpg", "jpeg", "gif", "svg",
+    "webp", "avif", "ico", "woff", "woff2", "ttf", "otf", "pdf", "zip", "mp3", "mp4", "webm", NULL
+};
+
+static int is_asset_link(const char *value, apr_size_t len)
+{
+    const char *end = value + len, *p, *dot = NULL;
+
+    for (int i = 0; asset_dirs[i]; i++) {
+        apr_size_t n = strlen(asset_dirs[i]);
+        if (len >= n && strncasecmp(value, asset_dirs[i], n) == 0) {
+            return 1;
+        }
+    }
+
+    /* Extension of the last path segment, before any query or fragment */
+    for (p = value; p < end && *p != '?' && *p != '#'; p++) {
+        if (*p == '/') {
+            dot = NULL;
+        } else if (*p == '.') {
+            dot = p;
+        }
+    }
+    if (!dot) {
+        return 0;
+    }
+    for (int i = 0; asset_extensions[i]; i++) {
+        apr_size_t n = strlen(asset_extensions[i]);
+        if ((apr_size_t)(p - dot - 1) == n && strncasecmp(dot + 1, asset_extensions[i], n) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Does the link start with a language prefix already? Same rule as the
+ * request side: a first segment of two or three letters naming a locale. */
+static int has_language_prefix(const char *value, apr_size_t len)
+{
+    char code[4];
+    apr_size_t n = 0;
+
+    while (n + 1 < len && n < 4 && value[n + 1] != '/' && value[n + 1] != '?' && value[n + 1] != '#') {
+        n++;
+    }
+    if (n < 2 || n > 3) {
+        return 0;
+    }
+    memcpy(code, value + 1, n);
+    code[n] = '\0';
+    return muse_is_locale_supported(code);
+}
+
+/* A root-relative page link: "/" or "/path", not "//host/path" */
+static int is_local_page_link(const char *value, apr_size_t len)
+{
+    if (len == 0 || value[0] != '/' || (len > 1 && value[1] == '/')) {
+        return 0;
+    }
+    return !is_asset_link(value, len) && !has_language_prefix(value, len);
+}
+
+static void flush_run(html_rewriter_t *rw)
+{
+    if (rw->run_len > 0) {
+        rw->sink(rw->baton, rw->run, rw->run_len);
+    }
+    rw->run = NULL;
+    rw->run_len = 0;
+}
+
+/* Pass bytes through unchanged; adjacent pieces reach the sink as one */
+static void pass(html_rewriter_t *rw, const char *data, apr_size_t len)
+{
+    if (rw->run && rw->run + rw->run_len == data) {
+        rw->run_len += len;
+        return;
+    }
+    flush_run(rw);
+    rw->run = data;
+    rw->run_len = len;
+}
+
+static void insert(html_rewriter_t *rw, const char *text, apr_size_t len)
+{
+    flush_run(rw);
+    rw->sink(rw->baton, text, len);
+    rw->changes++;
+}
+
+static int rewrite_token(void *baton, const html_token_t *token)
+{
+    html_rewriter_t *rw = baton;
+    html_attr_t attr;
+
+    if (rw->rtl && html_tag_is(token, "html") && !token->end_tag) {
+        rw->rtl = 0;
+        if (!html_tag_attr(token, "dir", &attr)) {
+            const char *name_end = token->name + token->name_len;
+
+            pass(rw, token->data, (apr_size_t)(name_end - token->data));
+            insert(rw, RTL_ATTRIBUTE, sizeof(RTL_ATTRIBUTE) - 1);
+            pass(rw, name_end, (apr_size_t)(token->data + token->len - name_end));
+            return 0;
+        }
+    }
+
+    if (rw->prefix && html_tag_is(token, "a") && html_tag_attr(token, "href", &attr) && attr.value &&
+        is_local_page_link(attr.value, attr.value_len)) {
+        pass(rw, token->data, (apr_size_t)(attr.value - token->data));
+        insert(rw, rw->prefix, rw->prefix_len);
+        pass(rw, attr.value, (apr_size_t)(token->data + token->len - attr.value));
+        return 0;
+    }
+
+    pass(rw, token->data, token->len);
+    return 0;
+}
+
+html_rewriter_t *html_rewriter_create(request_rec *r, const muse_language_selection_t *lang_selection,
+                                      html_rewrite_sink_fn sink, void *baton)
+{
+    html_rewriter_t *rw;
+
+    if (!lang_selection) {
+        return NULL;
+    }
+
+    rw = apr_pcalloc(r->pool, sizeof(html_rewriter_t));
+    rw->sink = sink;
+    rw->baton = baton;
+    rw->rtl = lang_selection->is_rtl;
+
+    /* Only a language chosen by the URL is carried over to the links; a
+     * cookie or Accept-Language choice applies to unprefixed URLs anyway */
+    if (lang_selection->is_translation_requested && lang_selection->is_supported &&
+        lang_selection->language_code) {
+        rw->prefix = apr_pstrcat(r->pool, "/", lang_selection->language_code, NULL);
+        rw->prefix_len = strlen(rw->prefix);
+    }
+    if (!rw->rtl && !rw->prefix) {
+        return NULL;
+    }
+
+    rw->tok = html_tokenizer_create(r->pool, rewrite_token, rw);
+    return rw;
+}
+
+void html_rewriter_write(html_rewriter_t *rw, const char *data, apr_size_t len)
+{
+    html_tokenizer_feed(rw->tok, data, len);
+    /* Tokens point into data, or into the tokenizer's buffer which the next
+     * feed reuses */
+    flush_run(rw);
+}
+
+void html_rewriter_finish(html_rewriter_t *rw)
+{
+    html_tokenizer_finish(rw->tok);
+    flush_run(rw);
+}
+
+/* A piece of the rewritten page */
+typedef struct {
+    const char *data;
+    apr_size_t len;
+} page_piece_t;
+
+static void collect_piece(void *baton, const char *data, apr_size_t len)
+{
+    page_piece_t *piece = &APR_ARRAY_PUSH((apr_array_header_t *)baton, page_piece_t);
+
+    piece->data = data;
+    piece->len = len;
+}
+
+char *html_rewrite_page(request_rec *r, const muse_language_selection_t *lang_selection, char *page)
+{
+    apr_array_header_t *pieces;
+    html_rewriter_t *rw;
+    apr_size_t out_len = 0;
+    char *out, *o;
+
+    if (!page) {
+        return page;
+    }
+
+    pieces = apr_array_make(r->pool, 32, sizeof(page_piece_t));
+    rw = html_rewriter_create(r, lang_selection, collect_piece, pieces);
+    if (!rw) {
+        return page;
+    }
+
+    /* Fed in one piece, the tokens point into page itself, so the pieces
+     * can be joined after the fact; the only copy is the final one */
+    html_rewriter_write(rw, page, strlen(page));
+    html_rewriter_finish(rw);
+    if (rw->changes == 0) {
+        return page;
+    }
+
+    for (int i = 0; i < pieces->nelts; i++) {
+        out_len += APR_ARRAY_IDX(pieces, i, page_piece_t).len;
+    }
+    o = out = apr_palloc(r->pool, out_len + 1);
+    for (int i = 0; i < pieces->nelts; i++) {
+        page_piece_t *piece = &APR_ARRAY_IDX(pieces, i, page_piece_t);
+        memcpy(o, piece->data, piece->len);
+        o += piece->len;
+    }
+    *o = '\0';
+    return out;
+}
@@ -0,0 +1,42 @@
+#ifndef HTML_REWRITER_H
+#define HTML_REWRITER_H
+
+#include <httpd.h>
+#include "language_selection.h"
+
+/* Output rewriting for translated pages. A page served under a language
+ * prefix (/es/features.ai, or ?lang=es) gets its root-relative <a href>
+ * links moved under the same prefix, so that the visitor stays in the
+ * language while navigating. Stylesheets, scripts, other assets, external
+ * and already prefixed links are left alone. A page in a right-to-left
+ * language gets dir="rtl" on its <html> tag unless it sets a direction.
+ *
+ * The rewriter sits on the incremental tokenizer and carries its state from
+ * chunk to chunk: in streaming mode every chunk goes through it on the way
+ * to the client, and a link cut by a chunk boundary is held back until its
+ * tag is complete. Untouched bytes are passed to the sink as they are; only
+ * the inserted attributes are new. */
+
+/* Receives the rewritten document piece by piece; data is only valid during
+ * the call */
+typedef void (*html_rewrite_sink_fn)(void *baton, const char *data, apr_size_t len);
+
+typedef struct html_rewriter html_rewriter_t;
+
+/* Function declarations */
+
+/* Create a rewriter for the page of this request, or NULL when the page
+ * needs no rewriting */
+html_rewriter_t *html_rewriter_create(request_rec *r, const muse_language_selection_t *lang_selection,
+                                      html_rewrite_sink_fn sink, void *baton);
+
+/* Rewrite the next len bytes of the document */
+void html_rewriter_write(html_rewriter_t *rw, const char *data, apr_size_t len);
+
+/* End of document: pass on whatever is still held back */
+void html_rewriter_finish(html_rewriter_t *rw);
+
+/* Rewrite a complete page. Returns page itself when nothing changed. */
+char *html_rewrite_page(request_rec *r, const muse_language_selection_t *lang_selection, char *page);
+
+#endif /* HTML_REWRITER_H */
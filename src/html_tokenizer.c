@@ -0,0 +1,342 @@
+/* Incremental HTML tokenizer, see html_tokenizer.h */
+#include "html_tokenizer.h"
+#include <apr_strings.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+struct html_tokenizer {
+    apr_pool_t *pool;
+    html_token_fn fn;
+    void *baton;
+    char *held;             /* Unfinished markup from the previous feed */
+    apr_size_t held_off;    /* ... starts here; moved to the front by the next feed */
+    apr_size_t held_len;
+    apr_size_t held_cap;
+    const char *raw_name;   /* "script" or "style" while inside one */
+};
+
+/* Markup scan results */
+#define MARKUP_INCOMPLETE 0
+#define MARKUP_TOKEN      1
+#define MARKUP_NONE       2 /* A '<' that opens no markup */
+
+html_tokenizer_t *html_tokenizer_create(apr_pool_t *pool, html_token_fn fn, void *baton)
+{
+    html_tokenizer_t *tok = apr_pcalloc(pool, sizeof(html_tokenizer_t));
+
+    tok->pool = pool;
+    tok->fn = fn;
+    tok->baton = baton;
+    return tok;
+}
+
+static int emit_text(html_tokenizer_t *tok, const char *p, apr_size_t len, int raw)
+{
+    html_token_t token;
+
+    if (len == 0) {
+        return 0;
+    }
+
+    memset(&token, 0, sizeof(token));
+    token.type = HTML_TOKEN_TEXT;
+    token.data = p;
+    token.len = len;
+    token.raw_text = raw;
+    return tok->fn(tok->baton, &token);
+}
+
+/* Classify the markup starting at p ('<'). On MARKUP_TOKEN, token is
+ * filled in. */
+static int scan_markup(const char *p, const char *end, html_token_t *token)
+{
+    const char *q, *name;
+    int end_tag;
+    char quote = 0, prev = 0;
+
+    if (end - p < 2) {
+        return MARKUP_INCOMPLETE;
+    }
+
+    memset(token, 0, sizeof(*token));
+    token->data = p;
+
+    if (p[1] == '!' || p[1] == '?') {
+        token->type = HTML_TOKEN_OTHER;
+        if (p[1] == '!' && (end - p < 4 || strncmp(p, "<!--", 4) == 0)) {
+            if (end - p < 4) {
+                return strncmp(p, "<!--", (apr_size_t)(end - p)) == 0 ? MARKUP_INCOMPLETE : MARKUP_NONE;
+            }
+            for (q = p + 4; q + 3 <= end; q++) {
+                if (q[0] == '-' && q[1] == '-' && q[2] == '>') {
+                    token->len = (apr_size_t)(q + 3 - p);
+                    return MARKUP_TOKEN;
+                }
+            }
+            return MARKUP_INCOMPLETE;
+        }
+        q = memchr(p, '>', (apr_size_t)(end - p));
+        if (!q) {
+            return MARKUP_INCOMPLETE;
+        }
+        token->len = (apr_size_t)(q + 1 - p);
+        return MARKUP_TOKEN;
+    }
+
+    end_tag = p[1] == '/';
+    name = p + 1 + end_tag;
+    if (name >= end) {
+        return MARKUP_INCOMPLETE;
+    }
+    if (!isalpha((unsigned char)*name)) {
+        return MARKUP_NONE;
+    }
+
+    for (q = name; q < end && !isspace((unsigned char)*q) && *q != '/' && *q != '>'; q++) {
+    }
+    token->type = HTML_TOKEN_TAG;
+    token->name = name;
+    token->name_len = (apr_size_t)(q - name);
+    token->end_tag = end_tag;
+
+    /* '>' inside a quoted attribute value does not close the tag */
+    for (; q < end; q++) {
+        if (quote) {
+            if (*q == quote) {
+                quote = 0;
+            }
+        } else if ((*q == '"' || *q == '\'') && prev == '=') {
+            quote = *q;
+        } else if (*q == '>') {
+            token->len = (apr_size_t)(q + 1 - p);
+            return MARKUP_TOKEN;
+        }
+        if (!isspace((unsigned char)*q)) {
+            prev = *q;
+        }
+    }
+    return MARKUP_INCOMPLETE;
+}
+
+/* Tokenize buf[0..len). Stops at markup that is not complete yet unless
+ * final; *consumed tells how far it got. */
+static int scan(html_tokenizer_t *tok, const char *buf, apr_size_t len, int final, apr_size_t *consumed)
+{
+    const char *p = buf, *end = buf + len, *q;
+    html_token_t token;
+    int rv = 0;
+
+    while (p < end && rv == 0) {
+        if (tok->raw_name) {
+            apr_size_t n = strlen(tok->raw_name);
+            const char *hold = NULL;
+
+            for (q = p; q < end; q++) {
+                if (*q != '<') {
+                    continue;
+                }
+                if ((apr_size_t)(end - q) < n + 3) {
+                    if (!final) {
+                        hold = q;
+                        break;
+                    }
+                    continue;
+                }
+                if (q[1] == '/' && strncasecmp(q + 2, tok->raw_name, n) == 0 &&
+                    (q[2 + n] == '>' || q[2 + n] == '/' || isspace((unsigned char)q[2 + n]))) {
+                    break;
+                }
+            }
+            if (hold) {
+                rv = emit_text(tok, p, (apr_size_t)(hold - p), 1);
+                p = hold;
+                break;
+            }
+            rv = emit_text(tok, p, (apr_size_t)(q - p), 1);
+            p = q;
+            if (q < end) {
+                tok->raw_name = NULL;
+            }
+            continue;
+        }
+
+        if (*p != '<') {
+            q = memchr(p, '<', (apr_size_t)(end - p));
+            q = q ? q : end;
+            rv = emit_text(tok, p, (apr_size_t)(q - p), 0);
+            p = q;
+            continue;
+        }
+
+        switch (scan_markup(p, end, &token)) {
+        case MARKUP_TOKEN:
+            if (token.type == HTML_TOKEN_TAG && !token.end_tag) {
+                if (html_tag_is(&token, "script")) {
+                    tok->raw_name = "script";
+                } else if (html_tag_is(&token, "style")) {
+                    tok->raw_name = "style";
+                }
+            }
+            rv = tok->fn(tok->baton, &token);
+            p += token.len;
+            break;
+        case MARKUP_NONE:
+            /* A literal '<': text up to the next one */
+            q = memchr(p + 1, '<', (apr_size_t)(end - p - 1));
+            q = q ? q : end;
+            rv = emit_text(tok, p, (apr_size_t)(q - p), 0);
+            p = q;
+            break;
+        default:
+            if (!final) {
+                *consumed = (apr_size_t)(p - buf);
+                return 0;
+            }
+            rv = emit_text(tok, p, (apr_size_t)(end - p), 0);
+            p = end;
+            break;
+        }
+    }
+
+    *consumed = (apr_size_t)(p - buf);
+    return rv;
+}
+
+/* Grow the hold-back buffer to at least need bytes, keeping its contents */
+static void reserve_held(html_tokenizer_t *tok, apr_size_t need)
+{
+    apr_size_t cap = tok->held_cap ? tok->held_cap : 256;
+    char *held;
+
+    if (need <= tok->held_cap) {
+        return;
+    }
+    while (cap < need) {
+        cap *= 2;
+    }
+    held = apr_palloc(tok->pool, cap);
+    if (tok->held_len > 0) {
+        memcpy(held, tok->held, tok->held_len);
+    }
+    tok->held = held;
+    tok->held_cap = cap;
+}
+
+int html_tokenizer_feed(html_tokenizer_t *tok, const char *data, apr_size_t len)
+{
+    apr_size_t consumed;
+    int rv;
+
+    if (tok->held_len == 0) {
+        rv = scan(tok, data, len, 0, &consumed);
+        if (consumed < len) {
+            /* Keep the unfinished markup for the next feed */
+            reserve_held(tok, len - consumed);
+            memcpy(tok->held, data + consumed, len - consumed);
+            tok->held_off = 0;
+            tok->held_len = len - consumed;
+        }
+        return rv;
+    }
+
+    /* Complete the held-back markup with the new bytes */
+    if (tok->held_off > 0) {
+        memmove(tok->held, tok->held + tok->held_off, tok->held_len);
+        tok->held_off = 0;
+    }
+    reserve_held(tok, tok->held_len + len);
+    memcpy(tok->held + tok->held_len, data, len);
+    tok->held_len += len;
+
+    /* What is left stays in place until the next feed, so the bytes of the
+     * tokens just emitted remain valid until then */
+    rv = scan(tok, tok->held, tok->held_len, 0, &consumed);
+    tok->held_off = consumed;
+    tok->held_len -= consumed;
+    return rv;
+}
+
+int html_tokenizer_finish(html_tokenizer_t *tok)
+{
+    apr_size_t consumed;
+    int rv = 0;
+
+    if (tok->held_len > 0) {
+        rv = scan(tok, tok->held + tok->held_off, tok->held_len, 1, &consumed);
+        tok->held_off = 0;
+        tok->held_len = 0;
+    }
+    return rv;
+}
+
+int html_tag_is(const html_token_t *token, const char *name)
+{
+    return token->type == HTML_TOKEN_TAG && token->name_len == strlen(name) &&
+           strncasecmp(token->name, name, token->name_len) == 0;
+}
+
+int html_tag_attr(const html_token_t *token, const char *name, html_attr_t *attr)
+{
+    const char *p, *end;
+    apr_size_t n = strlen(name);
+
+    if (token->type != HTML_TOKEN_TAG || token->end_tag) {
+        return 0;
+    }
+
+    p = token->name + token->name_len;
+    end = token->data + token->len - 1; /* The closing '>' */
+
+    while (p < end) {
+        const char *an, *value = NULL;
+        apr_size_t an_len, value_len = 0;
+
+        while (p < end && (isspace((unsigned char)*p) || *p == '/')) {
+            p++;
+        }
+        if (p >= end) {
+            break;
+        }
+
+        an = p;
+        while (p < end && !isspace((unsigned char)*p) && *p != '=' && *p != '/') {
+            p++;
+        }
+        an_len = (apr_size_t)(p - an);
+
+        while (p < end && isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (p < end && *p == '=') {
+            p++;
+            while (p < end && isspace((unsigned char)*p)) {
+                p++;
+            }
+            if (p < end && (*p == '"' || *p == '\'')) {
+                const char *close = memchr(p + 1, *p, (apr_size_t)(end - p - 1));
+                value = p + 1;
+                p = close ? close + 1 : end;
+                value_len = (apr_size_t)((close ? close : end) - value);
+            } else {
+                value = p;
+                while (p < end && !isspace((unsigned char)*p)) {
+                    p++;
+                }
+                value_len = (apr_size_t)(p - value);
+            }
+        }
+
+        if (an_len == n && strncasecmp(an, name, n) == 0) {
+            attr->start = an;
+            attr->len = (apr_size_t)(p - an);
+            attr->value = value;
+            attr->value_len = value_len;
+            return 1;
+        }
+        if (an_len == 0) {
+            p++;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef HTML_TOKENIZER_H
+#define HTML_TOKENIZER_H
+
+#include <apr_pools.h>
+
+/* A small incremental HTML tokenizer. It does not build a tree: it only
+ * splits markup into text, tags and "other" (comments, doctype), which is
+ * all the rewriting and translation code needs. Bytes can be fed in any
+ * pieces; a tag cut by a chunk boundary is held back until its '>' arrives,
+ * while text is passed on as soon as it is seen, so a stream is never
+ * delayed by more than one unfinished tag. The contents of <script> and
+ * <style> come out as raw text tokens and are never parsed as markup. */
+
+typedef enum {
+    HTML_TOKEN_TEXT,        /* Character data, possibly one piece of a longer run */
+    HTML_TOKEN_TAG,         /* Start or end tag, "<" to ">" */
+    HTML_TOKEN_OTHER        /* Comment, doctype or processing instruction */
+} html_token_type_t;
+
+typedef struct {
+    html_token_type_t type;
+    const char *data;       /* Raw bytes of the token, valid until the next feed or finish */
+    apr_size_t len;
+    const char *name;       /* Tags: element name, not lowercased */
+    apr_size_t name_len;
+    int end_tag;            /* Tags: "</name>" */
+    int raw_text;           /* Text: inside <script> or <style> */
+} html_token_t;
+
+/* An attribute of a tag token, pointing into the token's bytes */
+typedef struct {
+    const char *start;      /* Whole attribute, name through value */
+    apr_size_t len;
+    const char *value;      /* Value without quotes, NULL for a bare attribute */
+    apr_size_t value_len;
+} html_attr_t;
+
+/* Called for every token in document order; a non-zero return stops the
+ * tokenizer and is passed back to the caller of html_tokenizer_feed() */
+typedef int (*html_token_fn)(void *baton, const html_token_t *token);
+
+typedef struct html_tokenizer html_tokenizer_t;
+
+/* Function declarations */
+
+/* Create a tokenizer; its hold-back buffer is allocated from pool */
+html_tokenizer_t *html_tokenizer_create(apr_pool_t *pool, html_token_fn fn, void *baton);
+
+/* Tokenize the next len bytes of the document */
+int html_tokenizer_feed(html_tokenizer_t *tok, const char *data, apr_size_t len);
+
+/* End of document: whatever is still held back comes out as text */
+int html_tokenizer_finish(html_tokenizer_t *tok);
+
+/* Case-insensitive element name test for a tag token */
+int html_tag_is(const html_token_t *token, const char *name);
+
+/* Find an attribute of a tag token by case-insensitive name. Returns 1 and
+ * fills attr when the tag has it, 0 otherwise. */
+int html_tag_attr(const html_token_t *token, const char *name, html_attr_t *attr);
+
+#endif /* HTML_TOKENIZER_H */
@@ -1,6 +1,48 @@
 #include "mod_muse_ai.h"
 #include <string.h>
 #include "advanced_streaming.h"
+#include "backend_health.h"
+#include "rate_limit.h"
+#include "request_context.h"
+#include "metrics.h"
+#include "sse_parser.h"
+#include "stream_capture.h"
+#include "http_response.h"
+#include "html_rewriter.h"
+#include "cJSON.h"
+#include <apr_atomic.h>
+#include <apr_poll.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+/* Bytes read from each backend while waiting for the first response byte */
+#define MUSE_AI_PREFETCH_SIZE 4096
+
+/* Recent first-byte times (ms) used to derive the hedge delay */
+#define MUSE_AI_FIRST_BYTE_SAMPLES 256
+#define MUSE_AI_HEDGE_MIN_SAMPLES 20
+#define MUSE_AI_HEDGE_REFRESH_SAMPLES 32   /* New samples before re-sorting */
+
+static volatile apr_uint32_t first_byte_samples[MUSE_AI_FIRST_BYTE_SAMPLES];
+static volatile apr_uint32_t first_byte_count = 0;
+
+/* Sorted copy of the samples that requests read percentiles from; one
+ * request at a time refreshes it */
+static volatile apr_uint32_t first_byte_sorted[MUSE_AI_FIRST_BYTE_SAMPLES];
+static volatile apr_uint32_t first_byte_sorted_len = 0;
+static volatile apr_uint32_t first_byte_sorted_at = 0;  /* first_byte_count when sorted */
+static volatile apr_uint32_t first_byte_sorting = 0;
+
+/* One request attempt against a backend */
+typedef struct {
+    const char *url;        /* Backend base URL */
+    apr_socket_t *sock;     /* NULL once the attempt is closed */
+    char *buf;              /* Response bytes read before the attempt won */
+    apr_size_t len;
+    apr_time_t started;
+    int http_status;        /* Backend status code, 0 until the headers are in */
+    stream_capture_t *capture; /* NULL unless this request is captured */
+} backend_attempt_t;
 
 /* Calculate optimal buffer size based on max_tokens configuration */
 static size_t calculate_buffer_size(int max_tokens) {
@@ -27,131 +69,85 @@ static size_t calculate_buffer_size(int max_tokens) {
     return buffer_size;
 }
 
-/* Parse SSE (Server-Sent Events) data chunk */
-static char *parse_sse_chunk(apr_pool_t *pool, const char *chunk)
+/* Mark the first token that is not part of a <think> preamble */
+static void note_visible_token(request_rec *r, muse_ai_request_ctx_t *ctx, const char *content)
 {
-    if (!chunk) return NULL;
-    
-    /* Look for "data: " prefix anywhere in the chunk */
-    const char *data_prefix = "data: ";
-    char *data_line = strstr(chunk, data_prefix);
+    const char *p = content;
     
-    if (!data_line) {
-        /* Check for [DONE] marker */
-        if (strstr(chunk, "[DONE]")) {
-            return NULL; /* End of stream */
-        }
-        return NULL;
+    if (ctx->phases[MUSE_AI_PHASE_FIRST_TOKEN]) {
+        return;
     }
     
-    /* Skip the "data: " prefix */
-    data_line += strlen(data_prefix);
-    
-    /* Find end of line */
-    char *line_end = strchr(data_line, '\n');
-    if (!line_end) line_end = strchr(data_line, '\r');
-    
-    if (line_end) {
-        /* Extract the data content */
-        int data_len = line_end - data_line;
-        char *data_content = apr_palloc(pool, data_len + 1);
-        strncpy(data_content, data_line, data_len);
-        data_content[data_len] = '\0';
-        
-        /* Check for [DONE] marker */
-        if (strcmp(data_content, "[DONE]") == 0) {
-            return NULL; /* End of stream */
+    while (*p) {
+        if (ctx->in_thinking) {
+            const char *end = strstr(p, "</think>");
+            if (!end) {
+                return;
+            }
+            ctx->in_thinking = 0;
+            p = end + 8;
+            continue;
         }
         
-        return data_content;
+        const char *start = strstr(p, "<think>");
+        const char *limit = start ? start : p + strlen(p);
+        while (p < limit && isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (p < limit) {
+            muse_ai_mark_phase(r, MUSE_AI_PHASE_FIRST_TOKEN);
+            return;
+        }
+        if (!start) {
+            return;
+        }
+        ctx->in_thinking = 1;
+        p = start + 7;
     }
-    
-    return NULL;
 }
 
-/* Extract content from JSON chunk */
-static char *extract_json_content(apr_pool_t *pool, const char *json_data)
+/* Decide whether streamed output should be flushed now. The first
+ * content goes out at once for time to first byte; after that output is
+ * flushed when MuseAiFlushBytes are pending or MuseAiFlushIntervalMs has
+ * passed. The read loop also flushes when the backend stays silent for
+ * the rest of the interval. */
+static int should_flush(request_rec *r, advanced_muse_ai_config *adv_cfg,
+                        apr_size_t pending_bytes, apr_time_t last_flush)
 {
-    if (!json_data) return NULL;
-    
-    /* Simple JSON parsing - look for "content":"..." pattern */
-    char *content_start = strstr(json_data, "\"content\":\"");
-    if (!content_start) return NULL;
-    
-    content_start += strlen("\"content\":\"");
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
     
-    /* Find the closing quote, handling escaped quotes */
-    char *content_end = content_start;
-    while (*content_end && !(*content_end == '"' && *(content_end - 1) != '\\')) {
-        content_end++;
+    if (!ctx->phases[MUSE_AI_PHASE_FIRST_FLUSH] || !adv_cfg || adv_cfg->flush_interval_ms <= 0) {
+        return 1;
     }
-    
-    if (*content_end == '"') {
-        int content_len = content_end - content_start;
-        char *content = apr_palloc(pool, content_len + 1);
-        strncpy(content, content_start, content_len);
-        content[content_len] = '\0';
-        
-        /* Unescape common JSON escape sequences */
-        char *unescaped = apr_pstrdup(pool, content);
-        
-        /* Replace Unicode escape sequences */
-        char *unicode_pos;
-        while ((unicode_pos = strstr(unescaped, "\\u")) != NULL) {
-            /* Parse the 4-digit hex code */
-            if (strlen(unicode_pos) >= 6) {
-                char hex_str[5];
-                strncpy(hex_str, unicode_pos + 2, 4);
-                hex_str[4] = '\0';
-                
-                /* Convert hex to integer */
-                unsigned int unicode_val = (unsigned int)strtol(hex_str, NULL, 16);
-                
-                /* Convert common Unicode values to ASCII */
-                char replacement = 0;
-                if (unicode_val == 0x003c) replacement = '<';      /* \u003c -> < */
-                else if (unicode_val == 0x003e) replacement = '>'; /* \u003e -> > */
-                else if (unicode_val == 0x0026) replacement = '&'; /* \u0026 -> & */
-                else if (unicode_val == 0x0022) replacement = '"'; /* \u0022 -> " */
-                else if (unicode_val == 0x0027) replacement = '\''; /* \u0027 -> ' */
-                else if (unicode_val == 0x002f) replacement = '/'; /* \u002f -> / */
-                
-                if (replacement) {
-                    *unicode_pos = replacement;
-                    memmove(unicode_pos + 1, unicode_pos + 6, strlen(unicode_pos + 6) + 1);
-                } else {
-                    /* Skip this Unicode sequence if we don't handle it */
-                    unicode_pos += 6;
-                }
-            } else {
-                break;
-            }
-        }
-        
-        /* Replace \\n with \n */
-        char *newline_pos;
-        while ((newline_pos = strstr(unescaped, "\\n")) != NULL) {
-            *newline_pos = '\n';
-            memmove(newline_pos + 1, newline_pos + 2, strlen(newline_pos + 2) + 1);
-        }
-        
-        /* Replace \\\" with \" */
-        char *quote_pos;
-        while ((quote_pos = strstr(unescaped, "\\\"")) != NULL) {
-            *quote_pos = '"';
-            memmove(quote_pos + 1, quote_pos + 2, strlen(quote_pos + 2) + 1);
-        }
-        
-        return unescaped;
+    if (pending_bytes >= (apr_size_t)adv_cfg->flush_bytes) {
+        return 1;
     }
-    
-    return NULL;
+    return apr_time_now() - last_flush >= apr_time_from_msec(adv_cfg->flush_interval_ms);
+}
+
+/* Send the output written so far to the client */
+static void flush_to_client(request_rec *r, muse_ai_request_ctx_t *ctx,
+                            apr_size_t *pending_bytes, apr_time_t *last_flush)
+{
+    ap_rflush(r);
+    ctx->flushes++;
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_FIRST_FLUSH);
+    *pending_bytes = 0;
+    *last_flush = apr_time_now();
+}
+
+/* Rewritten streaming output goes straight to the client */
+static void write_to_client(void *baton, const char *data, apr_size_t len)
+{
+    ap_rwrite(data, (int)len, baton);
 }
 
 /* Handle streaming response from backend */
 static int handle_streaming_response(request_rec *r, muse_ai_config *cfg, 
-                                   apr_socket_t *sock, streaming_state_t *state, 
-                                   const muse_language_selection_t *lang_selection)
+                                   apr_socket_t *sock, stream_capture_t *capture,
+                                   streaming_state_t *state, 
+                                   const muse_language_selection_t *lang_selection,
+                                   const char *prefetched, apr_size_t prefetched_len)
 {
     /* Calculate dynamic buffer sizes based on max_tokens */
     size_t buffer_size = calculate_buffer_size(cfg->max_tokens);
@@ -171,6 +167,11 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
     apr_size_t len;
     apr_status_t rv;
     int headers_complete = 0;
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+    advanced_muse_ai_config *adv_cfg = ap_get_module_config(r->server->module_config, &muse_ai_module);
+    apr_size_t pending_bytes = 0;
+    apr_time_t last_flush = 0;
+    html_rewriter_t *rewriter = html_rewriter_create(r, lang_selection, write_to_client, r);
     
     /* Set proper headers for streaming response */
     ap_set_content_type(r, "text/html;charset=UTF-8");
@@ -190,7 +191,36 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
                          "mod_muse_ai: About to receive data from socket");
         }
         
-        rv = apr_socket_recv(sock, line_buffer, &len);
+        if (prefetched_len > 0) {
+            /* Bytes already read while waiting for the first response byte */
+            len = prefetched_len < len ? prefetched_len : len;
+            memcpy(line_buffer, prefetched, len);
+            prefetched += len;
+            prefetched_len -= len;
+            rv = APR_SUCCESS;
+        } else {
+            /* With output held back, wait for the backend no longer than
+             * the rest of the flush interval */
+            if (pending_bytes > 0) {
+                apr_time_t due = last_flush + apr_time_from_msec(adv_cfg->flush_interval_ms);
+                apr_time_t now = apr_time_now();
+                
+                if (due <= now) {
+                    flush_to_client(r, ctx, &pending_bytes, &last_flush);
+                } else {
+                    apr_socket_timeout_set(sock, due - now);
+                }
+            }
+            rv = apr_socket_recv(sock, line_buffer, &len);
+            if (pending_bytes > 0) {
+                apr_socket_timeout_set(sock, apr_time_from_sec(cfg->timeout));
+                if (APR_STATUS_IS_TIMEUP(rv)) {
+                    flush_to_client(r, ctx, &pending_bytes, &last_flush);
+                    continue;
+                }
+            }
+            stream_capture_data(capture, line_buffer, len);
+        }
         
         if (cfg->debug) {
             ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
@@ -213,6 +243,7 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
         }
         
         line_buffer[len] = '\0';
+        ctx->backend_bytes += len;
         
         if (cfg->debug) {
             ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
@@ -225,14 +256,31 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
             char *header_end = strstr(line_buffer, "\r\n\r\n");
             if (header_end) {
                 headers_complete = 1;
+
+                /* Backend errors must not be streamed as page content */
+                if (strncmp(line_buffer, "HTTP/", 5) == 0) {
+                    const char *sp = strchr(line_buffer, ' ');
+                    int backend_status = sp ? atoi(sp + 1) : 0;
+                    if (backend_status >= 400) {
+                        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                                     "mod_muse_ai: Backend returned HTTP %d for streaming request", backend_status);
+                        return HTTP_BAD_GATEWAY;
+                    }
+                }
+
                 body_start = header_end + 4;
                 len = len - (body_start - line_buffer);
+                muse_ai_mark_phase(r, MUSE_AI_PHASE_HEADERS);
             } else {
                 /* Headers not complete yet, continue reading */
                 continue;
             }
         }
         
+        if (len > 0) {
+            muse_ai_mark_phase(r, MUSE_AI_PHASE_FIRST_BYTE);
+        }
+        
         /* Add to accumulated buffer */
         if (accumulated_len + len < accumulated_buffer_size - 1) {
             memcpy(accumulated_buffer + accumulated_len, body_start, len);
@@ -269,6 +317,9 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
                     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
                                  "mod_muse_ai: Received [DONE] marker");
                 }
+                if (rewriter) {
+                    html_rewriter_finish(rewriter);
+                }
                 return OK;
             }
             
@@ -281,6 +332,9 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
                                  "mod_muse_ai: Processing SSE line: '%.100s...'", json_data);
                 }
                 
+                /* Token accounting: the final chunk may carry a usage report */
+                muse_ai_parse_usage(ctx, json_data);
+                
                 /* Extract content from JSON */
                 char *content = extract_json_content(r->pool, json_data);
                 if (cfg->debug) {
@@ -289,13 +343,35 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
                 }
                 
                 if (content && strlen(content) > 0) {
+                    /* Without a usage report, each delta counts as one token */
+                    if (!ctx->tokens_from_usage) {
+                        ctx->completion_tokens++;
+                    }
+                    metrics_observe_token(r);
+                    note_visible_token(r, ctx, content);
+                    
                     /* Process through streaming pipeline */
                     char *processed_content = process_streaming_content(r, state, content, lang_selection);
                     
                     if (processed_content && strlen(processed_content) > 0) {
-                        /* Send processed content to client */
-                        ap_rputs(processed_content, r);
-                        ap_rflush(r);
+                        /* Headers go out with the first flush */
+                        if (!ctx->phases[MUSE_AI_PHASE_FIRST_FLUSH]) {
+                            muse_ai_set_server_timing(r);
+                        }
+                        
+                        /* Send processed content to client, links localized on the
+                         * way; flushes are batched so
+                         * that compression filters see blocks, not single tokens */
+                        apr_size_t processed_len = strlen(processed_content);
+                        if (rewriter) {
+                            html_rewriter_write(rewriter, processed_content, processed_len);
+                        } else {
+                            ap_rwrite(processed_content, (int)processed_len, r);
+                        }
+                        pending_bytes += processed_len;
+                        if (should_flush(r, adv_cfg, pending_bytes, last_flush)) {
+                            flush_to_client(r, ctx, &pending_bytes, &last_flush);
+                        }
                         
                         if (cfg->debug) {
                             ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
@@ -307,10 +383,14 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
                     
                     /* Check if HTML is complete */
                     if (state->html_complete) {
+                        muse_ai_mark_phase(r, MUSE_AI_PHASE_HTML_DONE);
                         if (cfg->debug) {
                             ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
                                          "mod_muse_ai: HTML complete, stopping stream");
                         }
+                        if (rewriter) {
+                            html_rewriter_finish(rewriter);
+                        }
                         return OK;
                     }
                 }
@@ -330,13 +410,17 @@ static int handle_streaming_response(request_rec *r, muse_ai_config *cfg,
         }
     }
     
+    if (rewriter) {
+        html_rewriter_finish(rewriter);
+    }
     return OK;
 }
 
-/* Make HTTP POST request to backend API with streaming support */
-int make_backend_request(request_rec *r, muse_ai_config *cfg, 
-                        const char *backend_url, const char *json_payload,
-                        char **response_body, const muse_language_selection_t *lang_selection)
+/* Connect to a backend and send the request. On success att->sock is
+ * ready to read the response from. */
+static apr_status_t open_backend_attempt(request_rec *r, muse_ai_config *cfg,
+                                         const char *backend_url, const char *json_payload,
+                                         backend_attempt_t *att)
 {
     apr_socket_t *sock;
     apr_sockaddr_t *sa;
@@ -346,16 +430,18 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
     apr_port_t port;
     char *request_headers;
     
-    *response_body = NULL;
+    att->url = backend_url;
+    att->sock = NULL;
+    att->buf = apr_palloc(r->pool, MUSE_AI_PREFETCH_SIZE);
+    att->buf[0] = '\0';
+    att->len = 0;
+    att->started = apr_time_now();
     
     /* Parse the backend URL */
-    ap_log_rerror(APLOG_MARK, APLOG_NOTICE, 0, r,
-                 "mod_muse_ai: HTTP CLIENT - Received backend_url: %s", backend_url);
-    
     if (apr_uri_parse(r->pool, backend_url, &uri) != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
                      "mod_muse_ai: Failed to parse backend URL: %s", backend_url);
-        return HTTP_INTERNAL_SERVER_ERROR;
+        return APR_EBADPATH;
     }
     
     ap_log_rerror(APLOG_MARK, APLOG_NOTICE, 0, r,
@@ -374,7 +460,7 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
     if (rv != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
                      "mod_muse_ai: Failed to resolve host %s:%d", host, port);
-        return HTTP_INTERNAL_SERVER_ERROR;
+        return rv;
     }
     
     /* Create socket */
@@ -382,7 +468,7 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
     if (rv != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
                      "mod_muse_ai: Failed to create socket");
-        return HTTP_INTERNAL_SERVER_ERROR;
+        return rv;
     }
     
     /* Set socket timeout */
@@ -406,8 +492,13 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
                      "mod_muse_ai: Failed to connect to %s:%d", host, port);
         apr_socket_close(sock);
-        return HTTP_INTERNAL_SERVER_ERROR;
+        return rv;
     }
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_CONNECT);
+    
+    /* Complete responses may come compressed; streams must not be buffered
+     * by a compressor on the way */
+    const char *accept_encoding = cfg->streaming ? "" : "Accept-Encoding: gzip\r\n";
     
     /* Build HTTP request with optional Authorization header */
     if (cfg->api_key && strlen(cfg->api_key) > 0) {
@@ -417,6 +508,7 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
             "Content-Type: application/json\r\n"
             "Authorization: Bearer %s\r\n"
             "Content-Length: %lu\r\n"
+            "%s"
             "Connection: close\r\n"
             "\r\n"
             "%s",
@@ -424,6 +516,7 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
             host, port,
             cfg->api_key,
             (unsigned long)strlen(json_payload),
+            accept_encoding,
             json_payload);
     } else {
         request_headers = apr_psprintf(r->pool,
@@ -431,12 +524,14 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
             "Host: %s:%d\r\n"
             "Content-Type: application/json\r\n"
             "Content-Length: %lu\r\n"
+            "%s"
             "Connection: close\r\n"
             "\r\n"
             "%s",
             uri.path ? apr_pstrcat(r->pool, uri.path, "/chat/completions", NULL) : "/v1/chat/completions",
             host, port,
             (unsigned long)strlen(json_payload),
+            accept_encoding,
             json_payload);
     }
     
@@ -446,10 +541,6 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
                      (unsigned long)strlen(request_headers));
     }
     
-    // CRITICAL DEBUG: Show the full HTTP request being sent
-    ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
-                 "CRITICAL DEBUG: Full HTTP request headers:\n%s", request_headers);
-    
     if (cfg->debug) {
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
                      "mod_muse_ai: Sending request headers");
@@ -465,15 +556,446 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
             ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
                          "mod_muse_ai: Failed to send request");
             apr_socket_close(sock);
-            return HTTP_INTERNAL_SERVER_ERROR;
+            return rv;
         }
         p += sent_len;
         request_len -= sent_len;
     }
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_SENT);
+    
+    att->sock = sock;
+    att->capture = stream_capture_start(r, backend_url);
+    return APR_SUCCESS;
+}
+
+/* Read what is available on a racing attempt.
+ * Returns 1 once the response headers and the first body byte have arrived
+ * (or the backend answered with a client error), 0 if more data is needed,
+ * and -1 if the attempt failed and may be retried elsewhere. */
+static int read_backend_attempt(request_rec *r, backend_attempt_t *att)
+{
+    apr_size_t len = MUSE_AI_PREFETCH_SIZE - 1 - att->len;
+    apr_status_t rv = apr_socket_recv(att->sock, att->buf + att->len, &len);
+    char *header_end;
+    
+    stream_capture_data(att->capture, att->buf + att->len, len);
+    att->len += len;
+    att->buf[att->len] = '\0';
+    
+    if (APR_STATUS_IS_EOF(rv) || (rv == APR_SUCCESS && len == 0)) {
+        return att->len > 0 ? 1 : -1;
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
+                     "mod_muse_ai: Error reading response from %s", att->url);
+        return -1;
+    }
+    
+    header_end = strstr(att->buf, "\r\n\r\n");
+    if (header_end) {
+        const char *sp = strchr(att->buf, ' ');
+        int backend_status = sp ? atoi(sp + 1) : 0;
+        
+        if (!att->http_status) {
+            muse_ai_mark_phase(r, MUSE_AI_PHASE_HEADERS);
+        }
+        att->http_status = backend_status;
+        if (header_end + 4 < att->buf + att->len) {
+            muse_ai_mark_phase(r, MUSE_AI_PHASE_FIRST_BYTE);
+        }
+        if (backend_status >= 500) {
+            ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
+                         "mod_muse_ai: Backend %s returned HTTP %d", att->url, backend_status);
+            return -1;
+        }
+        if (backend_status >= 400 || header_end + 4 < att->buf + att->len) {
+            return 1;
+        }
+    }
+    
+    /* Oversized headers: let the response handler deal with it */
+    return att->len >= MUSE_AI_PREFETCH_SIZE - 1 ? 1 : 0;
+}
+
+/* Remember how long a backend took to produce its first byte */
+static void record_first_byte_time(apr_interval_time_t elapsed)
+{
+    apr_uint32_t slot = apr_atomic_inc32(&first_byte_count) % MUSE_AI_FIRST_BYTE_SAMPLES;
+    apr_atomic_set32(&first_byte_samples[slot], (apr_uint32_t)apr_time_as_msec(elapsed));
+}
+
+static int compare_uint32(const void *a, const void *b)
+{
+    apr_uint32_t x = *(const apr_uint32_t *)a;
+    apr_uint32_t y = *(const apr_uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Re-sort the recent samples into first_byte_sorted */
+static void refresh_sorted_first_bytes(apr_uint32_t count)
+{
+    apr_uint32_t sorted[MUSE_AI_FIRST_BYTE_SAMPLES];
+    apr_uint32_t len = count < MUSE_AI_FIRST_BYTE_SAMPLES ? count : MUSE_AI_FIRST_BYTE_SAMPLES;
+    
+    for (apr_uint32_t i = 0; i < len; i++) {
+        sorted[i] = apr_atomic_read32(&first_byte_samples[i]);
+    }
+    qsort(sorted, len, sizeof(apr_uint32_t), compare_uint32);
+    
+    for (apr_uint32_t i = 0; i < len; i++) {
+        apr_atomic_set32(&first_byte_sorted[i], sorted[i]);
+    }
+    apr_atomic_set32(&first_byte_sorted_len, len);
+    apr_atomic_set32(&first_byte_sorted_at, count);
+}
+
+/* Hedge delay: the configured percentile of recent first-byte times. The
+ * samples are sorted again only every MUSE_AI_HEDGE_REFRESH_SAMPLES new
+ * ones, not on every request.
+ * Returns -1 when hedging is disabled or there is not enough history yet. */
+static apr_interval_time_t calculate_hedge_delay(muse_ai_config *cfg)
+{
+    apr_uint32_t count = apr_atomic_read32(&first_byte_count);
+    apr_uint32_t sorted_at = apr_atomic_read32(&first_byte_sorted_at);
+    apr_uint32_t len, ms;
+    
+    if (cfg->hedge_percentile <= 0 || count < MUSE_AI_HEDGE_MIN_SAMPLES) {
+        return -1;
+    }
+    
+    if ((sorted_at == 0 || count - sorted_at >= MUSE_AI_HEDGE_REFRESH_SAMPLES) &&
+        apr_atomic_cas32(&first_byte_sorting, 1, 0) == 0) {
+        refresh_sorted_first_bytes(count);
+        apr_atomic_set32(&first_byte_sorting, 0);
+    }
+    
+    len = apr_atomic_read32(&first_byte_sorted_len);
+    if (len == 0) {
+        return -1; /* First sort still in progress elsewhere */
+    }
+    ms = apr_atomic_read32(&first_byte_sorted[(len - 1) * (apr_uint32_t)cfg->hedge_percentile / 100]);
+    if (ms < (apr_uint32_t)cfg->hedge_min_delay_ms) {
+        ms = (apr_uint32_t)cfg->hedge_min_delay_ms;
+    }
+    
+    return apr_time_from_msec(ms);
+}
+
+/* Wait for the first response byte from backend_url. If it has not arrived
+ * within the hedge delay, send the same request to a second backend and keep
+ * whichever answers first; the other socket is closed.
+ * Returns OK with *winner set, HTTP_BAD_GATEWAY when every attempt failed
+ * (retryable), or HTTP_GATEWAY_TIME_OUT. */
+static int race_backend_attempts(request_rec *r, muse_ai_config *cfg,
+                                 advanced_muse_ai_config *adv_cfg,
+                                 const char *backend_url, const char *json_payload,
+                                 backend_attempt_t **winner)
+{
+    backend_attempt_t *attempts = apr_pcalloc(r->pool, 2 * sizeof(backend_attempt_t));
+    int num_attempts = 1;
+    apr_time_t start = apr_time_now();
+    apr_time_t deadline = start + apr_time_from_sec(cfg->timeout);
+    apr_interval_time_t hedge_delay = calculate_hedge_delay(cfg);
+    apr_status_t rv;
+    
+    *winner = NULL;
+    
+    rv = open_backend_attempt(r, cfg, backend_url, json_payload, &attempts[0]);
+    if (rv != APR_SUCCESS) {
+        backend_report_result(backend_url, 0);
+        return APR_STATUS_IS_EBADPATH(rv) ? HTTP_INTERNAL_SERVER_ERROR : HTTP_BAD_GATEWAY;
+    }
+    
+    while (1) {
+        apr_pollfd_t pfds[2];
+        apr_int32_t num_pfds = 0;
+        apr_int32_t num_ready = 0;
+        apr_time_t now = apr_time_now();
+        apr_interval_time_t wait;
+        
+        if (now >= deadline) {
+            for (int i = 0; i < num_attempts; i++) {
+                if (attempts[i].sock) {
+                    apr_socket_close(attempts[i].sock);
+                    backend_report_result(attempts[i].url, 0);
+                }
+            }
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                         "mod_muse_ai: No response from backend within %d seconds", cfg->timeout);
+            return HTTP_GATEWAY_TIME_OUT;
+        }
+        wait = deadline - now;
+        
+        /* Time to hedge? */
+        if (num_attempts == 1 && hedge_delay >= 0) {
+            if (now - start >= hedge_delay) {
+                const char *hedge_url = select_backend_endpoint(r, adv_cfg, cfg->endpoint, backend_url);
+                hedge_delay = -1;
+                if (hedge_url) {
+                    ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r,
+                                 "mod_muse_ai: No first byte from %s after %" APR_TIME_T_FMT " ms, hedging to %s",
+                                 backend_url, apr_time_as_msec(now - start), hedge_url);
+                    if (open_backend_attempt(r, cfg, hedge_url, json_payload, &attempts[1]) == APR_SUCCESS) {
+                        num_attempts = 2;
+                    } else {
+                        backend_report_result(hedge_url, 0);
+                    }
+                }
+                continue;
+            }
+            if (start + hedge_delay - now < wait) {
+                wait = start + hedge_delay - now;
+            }
+        }
+        
+        for (int i = 0; i < num_attempts; i++) {
+            if (attempts[i].sock) {
+                pfds[num_pfds].p = r->pool;
+                pfds[num_pfds].desc_type = APR_POLL_SOCKET;
+                pfds[num_pfds].reqevents = APR_POLLIN;
+                pfds[num_pfds].rtnevents = 0;
+                pfds[num_pfds].desc.s = attempts[i].sock;
+                pfds[num_pfds].client_data = &attempts[i];
+                num_pfds++;
+            }
+        }
+        
+        if (num_pfds == 0) {
+            /* Every attempt failed; a pending hedge is no longer useful */
+            return HTTP_BAD_GATEWAY;
+        }
+        
+        rv = apr_poll(pfds, num_pfds, &num_ready, wait);
+        if (APR_STATUS_IS_TIMEUP(rv) || APR_STATUS_IS_EINTR(rv)) {
+            continue;
+        }
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
+                         "mod_muse_ai: Failed to poll backend sockets");
+            for (int i = 0; i < num_attempts; i++) {
+                if (attempts[i].sock) {
+                    apr_socket_close(attempts[i].sock);
+                    backend_release_endpoint(attempts[i].url);
+                }
+            }
+            return HTTP_INTERNAL_SERVER_ERROR;
+        }
+        
+        for (int i = 0; i < num_pfds; i++) {
+            backend_attempt_t *att = pfds[i].client_data;
+            int result;
+            
+            if (!pfds[i].rtnevents) {
+                continue;
+            }
+            
+            result = read_backend_attempt(r, att);
+            if (result < 0) {
+                apr_socket_close(att->sock);
+                att->sock = NULL;
+                backend_report_result(att->url, 0);
+            } else if (result > 0) {
+                /* First answer wins; cancel the other attempt */
+                for (int j = 0; j < num_attempts; j++) {
+                    if (&attempts[j] != att && attempts[j].sock) {
+                        apr_socket_close(attempts[j].sock);
+                        attempts[j].sock = NULL;
+                        backend_release_endpoint(attempts[j].url);
+                    }
+                }
+                record_first_byte_time(apr_time_now() - att->started);
+                stream_capture_keep(att->capture);
+                *winner = att;
+                return OK;
+            }
+        }
+    }
+}
+
+/* Part of a non-streaming response whose length was not announced */
+typedef struct {
+    char *data;
+    apr_size_t len;
+} response_block_t;
+
+/* Read the rest of a non-streaming response into one buffer, status line
+ * and headers included. With a Content-Length every byte is received
+ * straight into its final place; otherwise into fixed-size blocks that are
+ * joined with a single copy once the backend closes the connection. Memory
+ * stays linear in the response size, which is capped at max_size. */
+static int read_complete_response(request_rec *r, muse_ai_config *cfg, backend_attempt_t *att,
+                                  apr_size_t max_size, http_response_head_t *head,
+                                  char **response, apr_size_t *response_len)
+{
+    apr_size_t total, len;
+    apr_status_t rv;
+    char *buf;
+    
+    if (parse_http_response_head(att->buf, att->len, head) <= 0) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                     "mod_muse_ai: Malformed or oversized response head from %s", att->url);
+        return HTTP_BAD_GATEWAY;
+    }
+    
+    if (head->content_length >= 0) {
+        apr_size_t have = att->len;
+        
+        if ((apr_size_t)head->content_length > max_size - head->head_len) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                         "mod_muse_ai: Response of %" APR_OFF_T_FMT " bytes from %s exceeds MuseAiMaxResponseSize",
+                         head->content_length, att->url);
+            return HTTP_BAD_GATEWAY;
+        }
+        
+        total = head->head_len + (apr_size_t)head->content_length;
+        buf = apr_palloc(r->pool, total + 1);
+        if (have > total) {
+            have = total;
+        }
+        memcpy(buf, att->buf, have);
+        
+        while (have < total) {
+            len = total - have;
+            rv = apr_socket_recv(att->sock, buf + have, &len);
+            stream_capture_data(att->capture, buf + have, len);
+            have += len;
+            
+            if (rv == APR_EOF || len == 0) {
+                ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
+                             "mod_muse_ai: Response from %s ended after %" APR_SIZE_T_FMT " of %" APR_SIZE_T_FMT " bytes",
+                             att->url, have, total);
+                break;
+            }
+            if (rv != APR_SUCCESS) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
+                             "mod_muse_ai: Error reading response");
+                return HTTP_INTERNAL_SERVER_ERROR;
+            }
+            muse_ai_mark_phase(r, MUSE_AI_PHASE_FIRST_BYTE);
+        }
+        
+        buf[have] = '\0';
+        *response = buf;
+        *response_len = have;
+        return OK;
+    }
+    
+    /* Chunked or delimited by the end of the connection */
+    apr_size_t block_size = calculate_buffer_size(cfg->max_tokens);
+    apr_array_header_t *blocks = apr_array_make(r->pool, 8, sizeof(response_block_t));
+    response_block_t *block = NULL;
+    
+    total = att->len;
+    while (1) {
+        if (!block || block->len == block_size) {
+            block = &APR_ARRAY_PUSH(blocks, response_block_t);
+            block->data = apr_palloc(r->pool, block_size);
+            block->len = 0;
+        }
+        
+        len = block_size - block->len;
+        rv = apr_socket_recv(att->sock, block->data + block->len, &len);
+        stream_capture_data(att->capture, block->data + block->len, len);
+        
+        if (rv == APR_EOF || len == 0) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
+                         "mod_muse_ai: Error reading response");
+            return HTTP_INTERNAL_SERVER_ERROR;
+        }
+        muse_ai_mark_phase(r, MUSE_AI_PHASE_FIRST_BYTE);
+        
+        block->len += len;
+        total += len;
+        if (total > max_size) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                         "mod_muse_ai: Response from %s exceeds MuseAiMaxResponseSize (%" APR_SIZE_T_FMT " bytes)",
+                         att->url, max_size);
+            return HTTP_BAD_GATEWAY;
+        }
+    }
+    
+    buf = apr_palloc(r->pool, total + 1);
+    memcpy(buf, att->buf, att->len);
+    len = att->len;
+    for (int i = 0; i < blocks->nelts; i++) {
+        block = &APR_ARRAY_IDX(blocks, i, response_block_t);
+        memcpy(buf + len, block->data, block->len);
+        len += block->len;
+    }
+    buf[total] = '\0';
+    
+    *response = buf;
+    *response_len = total;
+    return OK;
+}
+
+/* Decode the body of a chat completion: undo chunked and gzip coding, then
+ * parse the JSON with cJSON, which MuseAiMaxResponseSize bounds. Takes
+ * choices[0].message.content and the token counts of the "usage" object.
+ * Returns the content, or NULL with the reason logged. */
+static const char *decode_completion_body(request_rec *r, const char *url, const http_response_head_t *head,
+                                          char *body, apr_size_t body_len, apr_size_t max_size)
+{
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+    cJSON *json, *choices, *message, *content, *usage, *item;
+    const char *text = NULL;
+    
+    if (head->chunked && http_dechunk_body(body, &body_len) != 0) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                     "mod_muse_ai: Malformed chunked response from %s", url);
+        return NULL;
+    }
+    if (head->gzip && http_gunzip_body(r->pool, body, body_len, max_size, &body, &body_len) != 0) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                     "mod_muse_ai: Corrupt or oversized gzip response from %s", url);
+        return NULL;
+    }
+    
+    json = cJSON_ParseWithLength(body, body_len);
+    if (!json) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                     "mod_muse_ai: Invalid JSON response from %s: '%.100s'", url, body);
+        return NULL;
+    }
     
+    choices = cJSON_GetObjectItemCaseSensitive(json, "choices");
+    message = cJSON_IsArray(choices) ? cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(choices, 0), "message") : NULL;
+    content = message ? cJSON_GetObjectItemCaseSensitive(message, "content") : NULL;
+    if (cJSON_IsString(content)) {
+        text = apr_pstrdup(r->pool, content->valuestring);
+    } else {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                     "mod_muse_ai: No choices[0].message.content in response from %s", url);
+    }
+    
+    /* Token accounting: use the usage report, else estimate ~4 bytes per token */
+    usage = cJSON_GetObjectItemCaseSensitive(json, "usage");
+    item = usage ? cJSON_GetObjectItemCaseSensitive(usage, "completion_tokens") : NULL;
+    if (cJSON_IsNumber(item)) {
+        ctx->completion_tokens += (apr_uint32_t)item->valuedouble;
+        ctx->tokens_from_usage = 1;
+        item = cJSON_GetObjectItemCaseSensitive(usage, "prompt_tokens");
+        if (cJSON_IsNumber(item)) {
+            ctx->prompt_tokens += (apr_uint32_t)item->valuedouble;
+        }
+    } else if (text) {
+        ctx->completion_tokens += (apr_uint32_t)(strlen(text) / 4);
+    }
+    
+    cJSON_Delete(json);
+    return text;
+}
+
+/* Handle the response of the winning attempt */
+static int handle_backend_response(request_rec *r, muse_ai_config *cfg, backend_attempt_t *att,
+                                   char **response_body, const muse_language_selection_t *lang_selection)
+{
     if (cfg->debug) {
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
-                     "mod_muse_ai: Request sent successfully, handling response");
+                     "mod_muse_ai: Request sent successfully, handling response from %s", att->url);
     }
     
     /* Handle response based on streaming configuration */
@@ -482,51 +1004,136 @@ int make_backend_request(request_rec *r, muse_ai_config *cfg,
         streaming_state_t *state = create_streaming_state(r->pool);
         
         /* Handle streaming response */
-        int result = handle_streaming_response(r, cfg, sock, state, lang_selection);
-        apr_socket_close(sock);
+        int result = handle_streaming_response(r, cfg, att->sock, att->capture, state, lang_selection,
+                                               att->buf, att->len);
+        apr_socket_close(att->sock);
+        muse_ai_mark_phase(r, MUSE_AI_PHASE_CLOSE);
         return result;
     } else {
-        /* Handle non-streaming response (original behavior) */
-        size_t buffer_size = calculate_buffer_size(cfg->max_tokens);
-        char *buffer = apr_palloc(r->pool, buffer_size);
-        apr_size_t len;
+        advanced_muse_ai_config *adv_cfg = ap_get_module_config(r->server->module_config, &muse_ai_module);
+        muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+        http_response_head_t head;
         char *response = NULL;
+        const char *content;
         apr_size_t response_len = 0;
+        apr_size_t max_size = adv_cfg ? (apr_size_t)adv_cfg->max_response_size : MUSE_AI_DEFAULT_MAX_RESPONSE_SIZE;
+        int status;
         
-        /* Read complete response */
-        response = apr_pcalloc(r->pool, 1);
-        response_len = 0;
+        status = read_complete_response(r, cfg, att, max_size, &head, &response, &response_len);
+        apr_socket_close(att->sock);
+        muse_ai_mark_phase(r, MUSE_AI_PHASE_CLOSE);
+        if (status != OK) {
+            return status;
+        }
         
-        while (1) {
-            len = buffer_size - 1;
-            rv = apr_socket_recv(sock, buffer, &len);
-            
-            if (rv == APR_EOF || len == 0) {
-                break;
-            }
-            
-            if (rv != APR_SUCCESS) {
-                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
-                             "mod_muse_ai: Error reading response");
-                apr_socket_close(sock);
-                return HTTP_INTERNAL_SERVER_ERROR;
-            }
-            
-            buffer[len] = '\0';
-            
-            /* Append to response */
-            char *new_response = apr_palloc(r->pool, response_len + len + 1);
-            if (response_len > 0) {
-                memcpy(new_response, response, response_len);
-            }
-            memcpy(new_response + response_len, buffer, len);
-            new_response[response_len + len] = '\0';
-            response = new_response;
-            response_len += len;
+        ctx->backend_bytes += response_len;
+        
+        if (head.status < 200 || head.status >= 300) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
+                         "mod_muse_ai: Backend %s returned HTTP %d: '%.200s'",
+                         att->url, head.status, response + head.head_len);
+            return HTTP_BAD_GATEWAY;
         }
         
-        apr_socket_close(sock);
-        *response_body = response;
+        content = decode_completion_body(r, att->url, &head, response + head.head_len,
+                                         response_len - head.head_len, max_size);
+        if (!content) {
+            return HTTP_BAD_GATEWAY;
+        }
+        
+        if (cfg->raw_content) {
+            *response_body = remove_thinking_tags(r->pool, content);
+            return OK;
+        }
+        
+        /* The whole page is known: sanitize it once */
+        *response_body = sanitize_response(r->pool, content, lang_selection);
+        *response_body = html_rewrite_page(r, lang_selection, *response_body);
+        ctx->sanitize_passes++;
         return OK;
     }
 }
+
+/* Charge the tokens generated by one backend request to the budgets; metrics
+ * pick up the request total from the request context at log time.
+ * Partial streams count too: the backend did the work either way. */
+static void account_generated_tokens(request_rec *r, advanced_muse_ai_config *adv_cfg,
+                                     const char *backend_url, apr_uint32_t tokens_before)
+{
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+    apr_uint32_t tokens = ctx->completion_tokens - tokens_before;
+    
+    if (tokens == 0) {
+        return;
+    }
+    
+    rate_limit_charge_tokens(r, adv_cfg, tokens);
+    
+    if (adv_cfg && adv_cfg->debug) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
+                     "mod_muse_ai: %u tokens generated by %s (%s)", tokens,
+                     backend_url, ctx->tokens_from_usage ? "usage report" : "counted deltas");
+    }
+}
+
+/* Make HTTP POST request to backend API with streaming support.
+ * Connection failures and 5xx answers are retried on another backend (up to
+ * MuseAiMaxRetries times) as long as nothing has been sent to the client.
+ * Every outcome feeds the backend's circuit breaker. */
+int make_backend_request(request_rec *r, muse_ai_config *cfg, 
+                        const char *backend_url, const char *json_payload,
+                        char **response_body, const muse_language_selection_t *lang_selection)
+{
+    advanced_muse_ai_config *adv_cfg = ap_get_module_config(r->server->module_config, &muse_ai_module);
+    backend_attempt_t *winner = NULL;
+    const char *url = backend_url;
+    int status;
+    
+    *response_body = NULL;
+    
+    ap_log_rerror(APLOG_MARK, APLOG_NOTICE, 0, r,
+                 "mod_muse_ai: HTTP CLIENT - Received backend_url: %s", backend_url);
+    
+    for (int attempt = 0; ; attempt++) {
+        status = race_backend_attempts(r, cfg, adv_cfg, url, json_payload, &winner);
+        if (status == OK || status != HTTP_BAD_GATEWAY || attempt >= cfg->max_retries) {
+            break;
+        }
+        
+        if (cfg->retry_delay_ms > 0) {
+            apr_sleep(apr_time_from_msec(cfg->retry_delay_ms));
+        }
+        
+        /* Prefer a different backend; fall back to the same one */
+        const char *next_url = select_backend_endpoint(r, adv_cfg, cfg->endpoint, url);
+        if (!next_url) {
+            next_url = select_backend_endpoint(r, adv_cfg, cfg->endpoint, NULL);
+        }
+        if (!next_url) {
+            status = HTTP_SERVICE_UNAVAILABLE;
+            break;
+        }
+        
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
+                     "mod_muse_ai: Retrying request (%d/%d) on %s", attempt + 1, cfg->max_retries, next_url);
+        url = next_url;
+    }
+    
+    if (status != OK) {
+        return status;
+    }
+    
+    /* Metrics labels for this request */
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+    apr_uint32_t tokens_before = ctx->completion_tokens;
+    ctx->backend_url = winner->url;
+    ctx->model = cfg->model;
+    
+    status = handle_backend_response(r, cfg, winner, response_body, lang_selection);
+    /* A 4xx is the backend answering, not failing: only transport errors
+     * and 5xx count against the breaker */
+    backend_report_result(winner->url, status == OK ||
+                          (winner->http_status >= 400 && winner->http_status < 500));
+    account_generated_tokens(r, adv_cfg, winner->url, tokens_before);
+    return status;
+}
@@ -0,0 +1,201 @@
+/* HTTP/1.x response framing for the non-streaming backend path */
+#include "http_response.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+/* Case-insensitive "name:" at the start of a header line */
+static int header_is(const char *line, const char *end, const char *name, const char **value)
+{
+    apr_size_t n = strlen(name);
+
+    if ((apr_size_t)(end - line) <= n || strncasecmp(line, name, n) != 0 || line[n] != ':') {
+        return 0;
+    }
+
+    line += n + 1;
+    while (line < end && (*line == ' ' || *line == '\t')) {
+        line++;
+    }
+    *value = line;
+    return 1;
+}
+
+/* Case-insensitive search for token within [p, end) */
+static int contains_token(const char *p, const char *end, const char *token)
+{
+    apr_size_t n = strlen(token);
+
+    for (; p + n <= end; p++) {
+        if (strncasecmp(p, token, n) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int parse_http_response_head(const char *buf, apr_size_t len, http_response_head_t *head)
+{
+    const char *end = NULL;
+    const char *line, *eol;
+
+    head->status = 0;
+    head->head_len = 0;
+    head->content_length = -1;
+    head->chunked = 0;
+    head->gzip = 0;
+
+    if (len >= 5 && strncmp(buf, "HTTP/", 5) != 0) {
+        return -1;
+    }
+
+    for (apr_size_t i = 3; i < len; i++) {
+        if (buf[i] == '\n' && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r') {
+            end = buf + i + 1;
+            break;
+        }
+    }
+    if (!end) {
+        return 0;
+    }
+
+    /* "HTTP/1.1 200 OK" */
+    eol = memchr(buf, '\n', (apr_size_t)(end - buf));
+    line = memchr(buf, ' ', (apr_size_t)(eol - buf));
+    if (!line) {
+        return -1;
+    }
+    head->status = atoi(line + 1);
+    head->head_len = (apr_size_t)(end - buf);
+
+    for (line = eol + 1; line < end - 2; line = eol + 1) {
+        const char *value;
+
+        eol = memchr(line, '\n', (apr_size_t)(end - line));
+        if (header_is(line, eol, "Content-Length", &value)) {
+            head->content_length = (apr_off_t)strtoll(value, NULL, 10);
+        } else if (header_is(line, eol, "Transfer-Encoding", &value)) {
+            head->chunked = contains_token(value, eol, "chunked");
+        } else if (header_is(line, eol, "Content-Encoding", &value)) {
+            head->gzip = contains_token(value, eol, "gzip");
+        }
+    }
+
+    /* Transfer-Encoding wins over Content-Length (RFC 9112, 6.3) */
+    if (head->chunked) {
+        head->content_length = -1;
+    }
+
+    return 1;
+}
+
+int http_dechunk_body(char *body, apr_size_t *len)
+{
+    char *in = body, *out = body, *end = body + *len;
+
+    while (in < end) {
+        char *size_end;
+        unsigned long size = strtoul(in, &size_end, 16);
+        char *eol = memchr(in, '\n', (apr_size_t)(end - in));
+
+        if (size_end == in || !eol) {
+            return -1;
+        }
+        if (size == 0) {
+            /* Last chunk; trailers are ignored */
+            *len = (apr_size_t)(out - body);
+            *out = '\0';
+            return 0;
+        }
+
+        in = eol + 1;
+        if (size > (unsigned long)(end - in)) {
+            return -1;
+        }
+        memmove(out, in, size);
+        out += size;
+        in += size;
+
+        if (in < end && *in == '\r') {
+            in++;
+        }
+        if (in < end && *in == '\n') {
+            in++;
+        }
+    }
+
+    /* Connection closed before the last chunk */
+    return -1;
+}
+
+int http_gunzip_body(apr_pool_t *pool, const char *in, apr_size_t in_len, apr_size_t max_size,
+                     char **out, apr_size_t *out_len)
+{
+    const unsigned char *trailer;
+    apr_size_t size;
+    z_stream zs;
+    int rc;
+
+    if (in_len < 18) {
+        return -1;
+    }
+
+    /* ISIZE: the uncompressed length modulo 2^32 */
+    trailer = (const unsigned char *)in + in_len - 4;
+    size = (apr_size_t)trailer[0] | (apr_size_t)trailer[1] << 8 |
+           (apr_size_t)trailer[2] << 16 | (apr_size_t)trailer[3] << 24;
+    if (size > max_size) {
+        return -1;
+    }
+
+    *out = apr_palloc(pool, size + 1);
+
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+        return -1;
+    }
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)in_len;
+    zs.next_out = (Bytef *)*out;
+    zs.avail_out = (uInt)size;
+
+    rc = inflate(&zs, Z_FINISH);
+    *out_len = (apr_size_t)zs.total_out;
+    inflateEnd(&zs);
+
+    if (rc != Z_STREAM_END || *out_len != size) {
+        return -1;
+    }
+
+    (*out)[size] = '\0';
+    return 0;
+}
+
+int http_gzip_body(apr_pool_t *pool, const char *in, apr_size_t in_len, int level,
+                   char **out, apr_size_t *out_len)
+{
+    z_stream zs;
+    uLong bound;
+    int rc;
+
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+
+    /* One allocation: deflateBound covers the gzip header and trailer */
+    bound = deflateBound(&zs, (uLong)in_len);
+    *out = apr_palloc(pool, bound);
+
+    zs.next_in = (Bytef *)in;
+    zs.avail_in = (uInt)in_len;
+    zs.next_out = (Bytef *)*out;
+    zs.avail_out = (uInt)bound;
+
+    rc = deflate(&zs, Z_FINISH);
+    *out_len = (apr_size_t)zs.total_out;
+    deflateEnd(&zs);
+
+    return rc == Z_STREAM_END ? 0 : -1;
+}
@@ -0,0 +1,41 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <apr_pools.h>
+
+/* Largest non-streaming backend response read into memory */
+#define MUSE_AI_DEFAULT_MAX_RESPONSE_SIZE (8 * 1024 * 1024)
+
+/* Framing of a backend HTTP/1.x response, parsed in place from the bytes
+ * received so far */
+typedef struct {
+    int status;                 /* Status code from the status line */
+    apr_size_t head_len;        /* Status line and headers, blank line included */
+    apr_off_t content_length;   /* -1 when the response has no Content-Length */
+    int chunked;                /* Transfer-Encoding: chunked */
+    int gzip;                   /* Content-Encoding: gzip */
+} http_response_head_t;
+
+/* Function declarations */
+
+/* Parse the status line and the framing headers of buf[0..len).
+ * Returns 1 when the head is complete, 0 when more bytes are needed and
+ * -1 when buf does not start with an HTTP/1.x status line. */
+int parse_http_response_head(const char *buf, apr_size_t len, http_response_head_t *head);
+
+/* Decode a chunked body in place. On success *len is the decoded length
+ * and 0 is returned; -1 means the chunk framing is malformed. */
+int http_dechunk_body(char *body, apr_size_t *len);
+
+/* Inflate a gzip body into a new NUL-terminated buffer of at most
+ * max_size bytes, sized once from the gzip trailer. Returns 0 on success,
+ * -1 when the data is corrupt or inflates beyond max_size. */
+int http_gunzip_body(apr_pool_t *pool, const char *in, apr_size_t in_len, apr_size_t max_size,
+                     char **out, apr_size_t *out_len);
+
+/* Compress a body into a new gzip member allocated from pool. Returns 0 on
+ * success and -1 when zlib fails. */
+int http_gzip_body(apr_pool_t *pool, const char *in, apr_size_t in_len, int level,
+                   char **out, apr_size_t *out_len);
+
+#endif /* HTTP_RESPONSE_H */
@@ -5,17 +5,38 @@
 
 #include "language_selection.h"
 #include "supported_locales.h"
+#include "metrics.h"
+#include "request_context.h"
+#include "utils.h"
 #include "http_protocol.h"
 #include "http_log.h"
-#include "util_script.h"
 #include <apr_strings.h>
+#include <apr_atomic.h>
 #include <string.h>
 #include <ctype.h>
 
+/*
+ * Accept-Language negotiation cache. Real traffic carries a few hundred
+ * distinct header values, so the outcome of parse_accept_language is
+ * memoized per process under a 64-bit FNV-1a hash of the raw header.
+ *
+ * A slot is a single 64-bit word: the hash with its low byte replaced by
+ * the negotiated locale index (ACCEPT_LANG_NONE when nothing matched), 0
+ * when empty. Slots are read and written with atomic 64-bit operations, so
+ * lookups take no lock and never see a torn entry; two headers that share
+ * 56 hash bits would share an entry. Entries never go stale because the
+ * locale table is compiled in. A bucket holds ACCEPT_LANG_CACHE_WAYS slots;
+ * when all are taken, one chosen by the hash is overwritten.
+ */
+#define ACCEPT_LANG_CACHE_SLOTS 1024
+#define ACCEPT_LANG_CACHE_WAYS 4
+#define ACCEPT_LANG_NONE 0xFF
+
+static volatile apr_uint64_t accept_lang_cache[ACCEPT_LANG_CACHE_SLOTS];
+
 /* Forward declarations */
 static const char *parse_accept_language(const char *accept_lang, apr_pool_t *pool);
 static bool is_valid_language_code(const char *code);
-static const char *extract_cookie_value(const char *cookie_header, const char *cookie_name, apr_pool_t *pool);
 static const char* detect_from_url_or_query(request_rec *r, muse_language_selection_t *result);
 
 static const char* detect_from_url_or_query(request_rec *r, muse_language_selection_t *result)
@@ -51,7 +72,7 @@ static const char* detect_from_url_or_query(request_rec *r, muse_language_select
 muse_language_selection_t *muse_detect_language(request_rec *r, const char *fallback_locale)
 {
     muse_language_selection_t *result;
-    char lang_buffer[8];
+    const muse_locale_t *locale;
     const char *detected_lang = NULL;
     const char *source = "fallback";
     bool is_translation_requested = false;
@@ -133,22 +154,15 @@ muse_language_selection_t *muse_detect_language(request_rec *r, const char *fall
         is_translation_requested = false;
     }
 
-    /* Extract short language code from the final locale */
-    if (result->selected_locale && muse_extract_language_code(result->selected_locale, lang_buffer, sizeof(lang_buffer))) {
-        result->language_code = apr_pstrdup(r->pool, lang_buffer);
-    } else {
-        /* Fallback to the detected code if extraction fails */
-        result->language_code = detected_lang;
-    }
+    /* Language code, support and direction come from the locale table */
+    locale = muse_find_locale(result->selected_locale);
+    result->language_code = locale ? locale->language_code : detected_lang;
 
     /* Set final properties */
     result->source = source;
     result->is_translation_requested = is_translation_requested;
-    result->is_supported = result->selected_locale ? muse_is_locale_supported(result->selected_locale) : false;
-    result->is_rtl = (result->language_code && 
-                      (strcmp(result->language_code, "ar") == 0 || 
-                       strcmp(result->language_code, "fa") == 0 || 
-                       strcmp(result->language_code, "he") == 0));
+    result->is_supported = locale != NULL;
+    result->is_rtl = locale ? locale->is_rtl : false;
 
     ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r,
                  "[language_selection] Final selection: locale=%s, source=%s, supported=%s, rtl=%s, translation_requested=%s",
@@ -218,28 +232,24 @@ bool muse_extract_language_from_url(const char *uri,
 const char *muse_get_language_from_query(request_rec *r)
 {
     const char *lang_param = NULL;
-    apr_table_t *query_params;
     
     if (!r || !r->args) {
         return NULL;
     }
     
-    /* Parse query parameters */
-    query_params = apr_table_make(r->pool, 10);
-    ap_args_to_table(r, &query_params);
-    
-    /* Check various parameter names */
-    lang_param = apr_table_get(query_params, "lang");
+    /* Check various parameter names; the query string is split once per
+     * request and shared with prompt extraction */
+    lang_param = muse_ai_query_param(r, "lang");
     if (!lang_param) {
-        lang_param = apr_table_get(query_params, "language");
+        lang_param = muse_ai_query_param(r, "language");
     }
     if (!lang_param) {
-        lang_param = apr_table_get(query_params, "locale");
+        lang_param = muse_ai_query_param(r, "locale");
     }
     
     /* Validate the parameter */
     if (lang_param && is_valid_language_code(lang_param)) {
-        return apr_pstrdup(r->pool, lang_param);
+        return lang_param;
     }
     
     return NULL;
@@ -247,25 +257,20 @@ const char *muse_get_language_from_query(request_rec *r)
 
 const char *muse_get_language_from_cookie(request_rec *r)
 {
-    const char *cookie_header;
     const char *lang_value = NULL;
     
     if (!r) {
         return NULL;
     }
     
-    cookie_header = apr_table_get(r->headers_in, "Cookie");
-    if (!cookie_header) {
-        return NULL;
-    }
-    
-    /* Try different cookie names */
-    lang_value = extract_cookie_value(cookie_header, "language", r->pool);
+    /* Try different cookie names; names must match exactly, so
+     * "xlanguage=" is not taken for "language=" */
+    lang_value = muse_ai_cookie(r, "language");
     if (!lang_value) {
-        lang_value = extract_cookie_value(cookie_header, "locale", r->pool);
+        lang_value = muse_ai_cookie(r, "locale");
     }
     if (!lang_value) {
-        lang_value = extract_cookie_value(cookie_header, "muse_lang", r->pool);
+        lang_value = muse_ai_cookie(r, "muse_lang");
     }
     
     /* Validate the value */
@@ -279,6 +284,11 @@ const char *muse_get_language_from_cookie(request_rec *r)
 const char *muse_get_language_from_header(request_rec *r)
 {
     const char *accept_lang;
+    const muse_locale_t *locales;
+    const char *negotiated;
+    apr_uint64_t hash;
+    apr_uint64_t tag, entry;
+    unsigned int bucket, victim, idx;
     
     if (!r) {
         return NULL;
@@ -289,7 +299,32 @@ const char *muse_get_language_from_header(request_rec *r)
         return NULL;
     }
     
-    return parse_accept_language(accept_lang, r->pool);
+    hash = muse_hash64(accept_lang, strlen(accept_lang));
+    tag = hash & ~APR_UINT64_C(0xFF);
+    if (tag == 0) {
+        tag = 0x100;
+    }
+    
+    locales = muse_get_supported_locales(NULL);
+    bucket = (unsigned int)(hash >> 8) & (ACCEPT_LANG_CACHE_SLOTS - ACCEPT_LANG_CACHE_WAYS);
+    victim = bucket + ((unsigned int)(hash >> 32) & (ACCEPT_LANG_CACHE_WAYS - 1));
+    for (int way = 0; way < ACCEPT_LANG_CACHE_WAYS; way++) {
+        entry = apr_atomic_read64(&accept_lang_cache[bucket + way]);
+        if (entry == 0) {
+            victim = bucket + way;
+        } else if ((entry & ~APR_UINT64_C(0xFF)) == tag) {
+            metrics_accept_language_lookup(1);
+            idx = (unsigned int)(entry & 0xFF);
+            return idx == ACCEPT_LANG_NONE ? NULL : locales[idx].code;
+        }
+    }
+    
+    metrics_accept_language_lookup(0);
+    negotiated = parse_accept_language(accept_lang, r->pool);
+    idx = negotiated ? (unsigned int)(muse_find_locale(negotiated) - locales) : ACCEPT_LANG_NONE;
+    apr_atomic_set64(&accept_lang_cache[victim], tag | idx);
+    
+    return negotiated;
 }
 
 void muse_set_language_cookie(request_rec *r, const char *locale, int max_age)
@@ -299,6 +334,12 @@ void muse_set_language_cookie(request_rec *r, const char *locale, int max_age)
     if (!r || !locale) {
         return;
     }
+
+    /* Re-sending an unchanged cookie only makes the page uncacheable */
+    const char *current = muse_ai_cookie(r, "muse_lang");
+    if (current && strcmp(current, locale) == 0) {
+        return;
+    }
     
     if (max_age > 0) {
         cookie_value = apr_psprintf(r->pool, "muse_lang=%s; Max-Age=%d; Path=/; SameSite=Lax",
@@ -324,24 +365,15 @@ bool muse_uri_has_language_prefix(const char *uri)
 
 const char *muse_normalize_language_to_locale(const char *language_code, apr_pool_t *pool)
 {
-    const char *full_locale;
+    (void)pool;
     
-    if (!language_code || !pool) {
+    if (!language_code) {
         return NULL;
     }
     
-    /* If it's already a full locale and supported, return it */
-    if (strchr(language_code, '_') && muse_is_locale_supported(language_code)) {
-        return apr_pstrdup(pool, language_code);
-    }
-    
-    /* Try to get full locale from language code */
-    full_locale = muse_get_full_locale(language_code);
-    if (full_locale) {
-        return apr_pstrdup(pool, full_locale);
-    }
-    
-    return NULL;
+    /* Full locale, hyphenated tag or language code; the result points into
+     * the static locale table and needs no copy */
+    return muse_get_full_locale(language_code);
 }
 
 const char *muse_generate_language_redirect_url(request_rec *r, const char *locale, const char *original_uri)
@@ -367,6 +399,8 @@ const char *muse_generate_language_redirect_url(request_rec *r, const char *loca
 
 /* Static helper functions */
 
+/* Best supported locale of an Accept-Language value, as a pointer into the
+ * static locale table */
 static const char *parse_accept_language(const char *accept_lang, apr_pool_t *pool)
 {
     char *lang_list, *token, *saveptr;
@@ -418,7 +452,7 @@ static const char *parse_accept_language(const char *accept_lang, apr_pool_t *po
         
         /* Check if this language is supported and has better quality */
         if (quality > best_quality && muse_is_locale_supported(lang_code)) {
-            best_lang = apr_pstrdup(pool, lang_code);
+            best_lang = muse_get_full_locale(lang_code);
             best_quality = quality;
         }
         
@@ -429,7 +463,7 @@ static const char *parse_accept_language(const char *accept_lang, apr_pool_t *po
             if (quality > best_quality && muse_is_locale_supported(lang_code)) {
                 const char *full_locale = muse_get_full_locale(lang_code);
                 if (full_locale) {
-                    best_lang = apr_pstrdup(pool, full_locale);
+                    best_lang = full_locale;
                     best_quality = quality;
                 }
             }
@@ -456,50 +490,3 @@ static bool is_valid_language_code(const char *code)
     
     return true;
 }
-
-static const char *extract_cookie_value(const char *cookie_header, const char *cookie_name, apr_pool_t *pool)
-{
-    const char *start, *end;
-    char *search_pattern;
-    size_t value_len;
-    
-    if (!cookie_header || !cookie_name || !pool) {
-        return NULL;
-    }
-    
-    /* Create search pattern "name=" */
-    search_pattern = apr_pstrcat(pool, cookie_name, "=", NULL);
-    
-    /* Find the cookie */
-    start = strstr(cookie_header, search_pattern);
-    if (!start) {
-        return NULL;
-    }
-    
-    /* Move past the name= part */
-    start += strlen(search_pattern);
-    
-    /* Find the end of the value (semicolon or end of string) */
-    end = strchr(start, ';');
-    if (!end) {
-        end = start + strlen(start);
-    }
-    
-    /* Extract the value */
-    value_len = end - start;
-    if (value_len == 0) {
-        return NULL;
-    }
-    
-    char *value = apr_pstrndup(pool, start, value_len);
-    
-    /* Trim whitespace */
-    while (isspace(*value)) value++;
-    char *value_end = value + strlen(value) - 1;
-    while (value_end > value && isspace(*value_end)) {
-        *value_end = '\0';
-        value_end--;
-    }
-    
-    return strlen(value) > 0 ? value : NULL;
-}
@@ -120,9 +120,10 @@ bool muse_uri_has_language_prefix(const char *uri);
 /**
  * @brief Normalize language code to full locale
  * 
- * @param language_code Input language code (e.g., "es", "en", "fr")
- * @param pool Apache memory pool for allocation
- * @return Full locale code (e.g., "es_ES", "en_US", "fr_FR") or NULL if unsupported
+ * @param language_code Input language code (e.g., "es", "en", "fr", "es-mx")
+ * @param pool Unused; the result is not allocated
+ * @return Full locale code (e.g., "es_ES", "en_US", "fr_FR") from the static
+ *         locale table, or NULL if unsupported
  */
 const char *muse_normalize_language_to_locale(const char *language_code, apr_pool_t *pool);
 
@@ -1,281 +1,892 @@
+/* Performance metrics in shared memory: sharded counters and labeled histograms */
 #include "advanced_config.h"
+#include "metrics.h"
+#include "request_context.h"
+#include "utils.h"
 #include <apr_strings.h>
 #include <apr_time.h>
+#include <apr_atomic.h>
+#include <apr_shm.h>
+#include <apr_tables.h>
+#include <apr_buckets.h>
 #include <http_log.h>
-#include <math.h>
+#include <util_filter.h>
+#include <stdarg.h>
+#include <string.h>
 
-/* Global metrics instance */
-static muse_ai_metrics_t *global_metrics = NULL;
-static apr_thread_mutex_t *metrics_mutex = NULL;
+/*
+ * One segment is created in post_config and inherited by every child, so a
+ * scrape sees the whole server rather than whichever child answered it.
+ *
+ * Plain counters are split into cache-line aligned shards. A thread picks a
+ * shard the first time it records something and keeps it, so threads of a
+ * worker child do not fight over the same line; a scrape sums all shards.
+ *
+ * Histograms and token counters are kept per label set (model, backend,
+ * locale, cache status) in a fixed open-addressing table. A slot is claimed
+ * by compare-and-swap on its label hash, its labels are written once, then
+ * it is marked ready for scrapes. All updates are atomic adds, no lock is
+ * taken anywhere on the request path.
+ */
+enum {
+    CTR_REQUESTS = 0,
+    CTR_SUCCESSFUL,
+    CTR_FAILED,
+    CTR_CACHED,
+    CTR_RATELIMITED,
+    CTR_TOKENS,
+    CTR_POOL_CREATED,
+    CTR_POOL_REUSED,
+    CTR_LATENCY_SUM,            /* microseconds */
+    CTR_ACCEPT_LANG_HITS,
+    CTR_ACCEPT_LANG_MISSES,
+    CTR_TM_HITS,
+    CTR_TM_MISSES,
+    CTR_TM_TOKENS_SAVED,
+    CTR_COUNT
+};
+
+typedef struct {
+    _Alignas(MUSE_AI_CACHE_LINE) volatile apr_uint64_t value[CTR_COUNT];
+} metrics_shard_t;
+
+/* Throughput windows: (window number + 1) << 40 | tokens in that window */
+#define WINDOW_TOKEN_BITS 40
+#define WINDOW_TOKEN_MASK ((APR_UINT64_C(1) << WINDOW_TOKEN_BITS) - 1)
+#define WINDOW_PACK(window, tokens) ((((apr_uint64_t)(window) + 1) << WINDOW_TOKEN_BITS) | ((apr_uint64_t)(tokens) & WINDOW_TOKEN_MASK))
+#define WINDOW_NUMBER(w) (((w) >> WINDOW_TOKEN_BITS) - 1)
+#define WINDOW_TOKENS(w) ((w) & WINDOW_TOKEN_MASK)
+
+typedef struct {
+    _Alignas(MUSE_AI_CACHE_LINE) volatile apr_uint64_t key;  /* Label hash, 0 = free */
+    volatile apr_uint32_t ready;                /* Labels are written */
+    char model[64];
+    char backend[128];
+    char locale[16];
+    char cache[8];
+    char labels[MUSE_AI_METRICS_LABELS_MAX];   /* Escaped Prometheus label block */
+    volatile apr_uint64_t requests;
+    volatile apr_uint64_t tokens;
+    volatile apr_uint64_t token_window;         /* Current throughput window */
+    volatile apr_uint64_t token_window_prev;    /* The one before it */
+    volatile apr_uint64_t buckets[MUSE_AI_HIST_COUNT][MUSE_AI_HIST_SLOTS];
+    volatile apr_uint64_t sums[MUSE_AI_HIST_COUNT];
+} metrics_series_t;
+
+typedef struct {
+    apr_time_t started;
+    volatile apr_uint32_t next_shard;
+    volatile apr_uint32_t healthy_backends;
+    volatile apr_uint32_t total_backends;
+    volatile apr_uint32_t pool_active;
+    volatile apr_uint32_t pool_idle;
+    volatile apr_uint32_t series_dropped;       /* Label sets that found no free slot */
+    volatile apr_uint32_t inflight;             /* Admitted requests not yet logged */
+    volatile apr_uint64_t min_latency;          /* microseconds, 0 = none yet */
+    volatile apr_uint64_t max_latency;
+    volatile apr_uint64_t last_updated;
+    metrics_shard_t shards[MUSE_AI_METRICS_SHARDS];
+    metrics_series_t series[MUSE_AI_METRICS_MAX_SERIES];
+} metrics_table_t;
+
+/* Histogram upper bounds, in the unit the family is observed in */
+static const apr_uint64_t hist_bounds[MUSE_AI_HIST_COUNT][MUSE_AI_HIST_BOUNDS] = {
+    /* Latency: 50ms .. 2min */
+    { 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000,
+      10000000, 20000000, 30000000, 60000000, 120000000 },
+    /* Time to first backend byte: 10ms .. 1min */
+    { 10000, 25000, 50000, 100000, 250000, 500000, 1000000,
+      2500000, 5000000, 10000000, 30000000, 60000000 },
+    /* Time to first token: 25ms .. 1min */
+    { 25000, 50000, 100000, 250000, 500000, 1000000, 2000000,
+      5000000, 10000000, 20000000, 30000000, 60000000 },
+    /* Inter-token gap: 5ms .. 10s */
+    { 5000, 10000, 25000, 50000, 75000, 100000, 250000,
+      500000, 1000000, 2500000, 5000000, 10000000 },
+    /* Response bytes: 256B .. 4MB */
+    { 256, 1024, 4096, 8192, 16384, 32768, 65536,
+      131072, 262144, 524288, 1048576, 4194304 },
+    /* Tokens per response */
+    { 16, 32, 64, 128, 256, 512, 1024,
+      2048, 4096, 8192, 16384, 32768 }
+};
+
+/* Prometheus name, help text and scale (1e6 for microseconds -> seconds) */
+static const struct {
+    const char *name;
+    const char *help;
+    double scale;
+} hist_info[MUSE_AI_HIST_COUNT] = {
+    { "mod_muse_ai_request_duration_seconds", "Total time to serve a request", 1e6 },
+    { "mod_muse_ai_time_to_first_byte_seconds", "Time from request start to the first body byte from the backend", 1e6 },
+    { "mod_muse_ai_time_to_first_token_seconds", "Time from request start to the first generated token", 1e6 },
+    { "mod_muse_ai_inter_token_seconds", "Gap between two streamed tokens", 1e6 },
+    { "mod_muse_ai_response_bytes", "Response body size in bytes", 1.0 },
+    { "mod_muse_ai_response_tokens", "Tokens generated per response", 1.0 }
+};
+
+/* Bucket bounds as Prometheus "le" strings, rendered once in post_config */
+static char hist_le[MUSE_AI_HIST_COUNT][MUSE_AI_HIST_SLOTS][24];
+
+static apr_shm_t *metrics_shm = NULL;
+static metrics_table_t *metrics_table = NULL;
+
+static void render_series_labels(metrics_series_t *series);
+
+/* The shard this thread writes to, and the table it was picked from */
+static _Thread_local metrics_shard_t *thread_shard = NULL;
+static _Thread_local metrics_table_t *thread_shard_table = NULL;
+
+static apr_status_t metrics_cleanup(void *data)
+{
+    (void)data;
+    if (metrics_shm) {
+        apr_shm_destroy(metrics_shm);
+        metrics_shm = NULL;
+    }
+    metrics_table = NULL;
+    return APR_SUCCESS;
+}
 
 /* Initialize metrics system */
 int init_metrics_system(apr_pool_t *pool, server_rec *s)
 {
+    extern module muse_ai_module;
+    apr_size_t size = sizeof(metrics_table_t);
     apr_status_t rv;
-    
-    /* Allocate global metrics structure */
-    global_metrics = apr_pcalloc(pool, sizeof(muse_ai_metrics_t));
-    if (!global_metrics) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, 
-                    "[mod_muse_ai] Failed to allocate metrics structure");
-        return -1;
+    server_rec *sv;
+    int needed = 0;
+
+    for (int h = 0; h < MUSE_AI_HIST_COUNT; h++) {
+        for (int b = 0; b < MUSE_AI_HIST_BOUNDS; b++) {
+            apr_snprintf(hist_le[h][b], sizeof(hist_le[h][b]), "%g",
+                         (double)hist_bounds[h][b] / hist_info[h].scale);
+        }
+        apr_cpystrn(hist_le[h][MUSE_AI_HIST_BOUNDS], "+Inf", sizeof(hist_le[h][MUSE_AI_HIST_BOUNDS]));
+    }
+
+    /* Only pay for the segment when some server collects metrics */
+    for (sv = s; sv; sv = sv->next) {
+        advanced_muse_ai_config *cfg = ap_get_module_config(sv->module_config, &muse_ai_module);
+        if (cfg && cfg->metrics_enable) {
+            needed = 1;
+            break;
+        }
+    }
+    if (!needed) {
+        return 0;
+    }
+
+    /* Anonymous shared memory is inherited by every forked child */
+    rv = apr_shm_create(&metrics_shm, size, NULL, pool);
+    if (APR_STATUS_IS_ENOTIMPL(rv)) {
+        const char *fname = ap_runtime_dir_relative(pool, "muse_ai_metrics.shm");
+        apr_shm_remove(fname, pool);
+        rv = apr_shm_create(&metrics_shm, size, fname, pool);
     }
-    
-    /* Initialize metrics */
-    global_metrics->total_requests = 0;
-    global_metrics->successful_requests = 0;
-    global_metrics->failed_requests = 0;
-    global_metrics->cached_responses = 0;
-    global_metrics->avg_response_time_ms = 0.0;
-    global_metrics->min_response_time_ms = 0.0;
-    global_metrics->max_response_time_ms = 0.0;
-    global_metrics->pool_active_connections = 0;
-    global_metrics->pool_idle_connections = 0;
-    global_metrics->pool_total_created = 0;
-    global_metrics->pool_total_reused = 0;
-    global_metrics->ratelimit_blocked_requests = 0;
-    global_metrics->healthy_backends = 0;
-    global_metrics->total_backends = 0;
-    global_metrics->last_updated = apr_time_now();
-    
-    /* Create mutex for thread safety */
-    rv = apr_thread_mutex_create(&metrics_mutex, APR_THREAD_MUTEX_DEFAULT, pool);
     if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, 
-                    "[mod_muse_ai] Failed to create metrics mutex");
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s,
+                    "[mod_muse_ai] Failed to create metrics shared memory (%" APR_SIZE_T_FMT " bytes)", size);
+        metrics_shm = NULL;
         return -1;
     }
-    
-    ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, s, 
+
+    metrics_table = apr_shm_baseaddr_get(metrics_shm);
+    memset(metrics_table, 0, size);
+    metrics_table->started = apr_time_now();
+
+    apr_pool_cleanup_register(pool, NULL, metrics_cleanup, apr_pool_cleanup_null);
+
+    ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, s,
                 "[mod_muse_ai] Metrics system initialized");
-    
+
     return 0;
 }
 
-/* Get global metrics instance */
-muse_ai_metrics_t *get_global_metrics(void)
+static metrics_shard_t *current_shard(void)
 {
-    return global_metrics;
+    if (thread_shard_table != metrics_table) {
+        apr_uint32_t n = apr_atomic_inc32(&metrics_table->next_shard);
+        thread_shard = &metrics_table->shards[n % MUSE_AI_METRICS_SHARDS];
+        thread_shard_table = metrics_table;
+    }
+    return thread_shard;
 }
 
-/* Update request metrics */
-void update_request_metrics(double response_time_ms, int success)
+static void atomic_min64(volatile apr_uint64_t *target, apr_uint64_t value)
 {
-    if (!global_metrics || !metrics_mutex) {
-        return;
+    apr_uint64_t cur = apr_atomic_read64(target);
+
+    while ((cur == 0 || value < cur) && apr_atomic_cas64(target, value, cur) != cur) {
+        cur = apr_atomic_read64(target);
+    }
+}
+
+static void atomic_max64(volatile apr_uint64_t *target, apr_uint64_t value)
+{
+    apr_uint64_t cur = apr_atomic_read64(target);
+
+    while (value > cur && apr_atomic_cas64(target, value, cur) != cur) {
+        cur = apr_atomic_read64(target);
     }
-    
-    apr_thread_mutex_lock(metrics_mutex);
-    
-    global_metrics->total_requests++;
-    global_metrics->last_updated = apr_time_now();
-    
-    if (success) {
-        global_metrics->successful_requests++;
-    } else {
-        global_metrics->failed_requests++;
-    }
-    
-    /* Update response time statistics */
-    if (response_time_ms > 0) {
-        if (global_metrics->min_response_time_ms == 0.0 || 
-            response_time_ms < global_metrics->min_response_time_ms) {
-            global_metrics->min_response_time_ms = response_time_ms;
+}
+
+/* Hash one label value, including its terminator as a separator */
+static apr_uint64_t hash_label(apr_uint64_t h, const char *value)
+{
+    return muse_hash64_continue(h, value, strlen(value) + 1);
+}
+
+/* Find or claim the series for a label set; NULL when the table is full */
+static metrics_series_t *find_series(const char *model, const char *backend,
+                                     const char *locale, const char *cache)
+{
+    apr_uint64_t key = MUSE_HASH64_INIT;
+    apr_uint32_t start;
+
+    key = hash_label(key, model);
+    key = hash_label(key, backend);
+    key = hash_label(key, locale);
+    key = hash_label(key, cache);
+    key = key ? key : 1;
+    start = (apr_uint32_t)(key % MUSE_AI_METRICS_MAX_SERIES);
+
+    for (apr_uint32_t i = 0; i < MUSE_AI_METRICS_MAX_SERIES; i++) {
+        metrics_series_t *series = &metrics_table->series[(start + i) % MUSE_AI_METRICS_MAX_SERIES];
+        apr_uint64_t cur = apr_atomic_read64(&series->key);
+
+        if (cur == 0) {
+            cur = apr_atomic_cas64(&series->key, key, 0);
+            if (cur == 0) {
+                apr_cpystrn(series->model, model, sizeof(series->model));
+                apr_cpystrn(series->backend, backend, sizeof(series->backend));
+                apr_cpystrn(series->locale, locale, sizeof(series->locale));
+                apr_cpystrn(series->cache, cache, sizeof(series->cache));
+                render_series_labels(series);
+                apr_atomic_set32(&series->ready, 1);
+                return series;
+            }
         }
-        
-        if (response_time_ms > global_metrics->max_response_time_ms) {
-            global_metrics->max_response_time_ms = response_time_ms;
+
+        if (cur == key) {
+            return series;
         }
-        
-        /* Calculate running average */
-        if (global_metrics->successful_requests > 1) {
-            global_metrics->avg_response_time_ms = 
-                (global_metrics->avg_response_time_ms * (global_metrics->successful_requests - 1) + 
-                 response_time_ms) / global_metrics->successful_requests;
-        } else {
-            global_metrics->avg_response_time_ms = response_time_ms;
+    }
+
+    apr_atomic_inc32(&metrics_table->series_dropped);
+    return NULL;
+}
+
+int metrics_histogram_slot(muse_ai_histogram_t hist, apr_uint64_t value)
+{
+    int slot = 0;
+
+    while (slot < MUSE_AI_HIST_BOUNDS && value > hist_bounds[hist][slot]) {
+        slot++;
+    }
+
+    return slot;
+}
+
+static void observe(metrics_series_t *series, muse_ai_histogram_t hist, apr_uint64_t value)
+{
+    apr_atomic_add64(&series->buckets[hist][metrics_histogram_slot(hist, value)], 1);
+    apr_atomic_add64(&series->sums[hist], value);
+}
+
+/* Add tokens to the current throughput window, retiring the previous one */
+static void add_window_tokens(metrics_series_t *series, apr_uint64_t tokens, apr_uint64_t window)
+{
+    apr_uint64_t cur, next;
+
+    do {
+        cur = apr_atomic_read64(&series->token_window);
+        next = (cur && WINDOW_NUMBER(cur) == window) ? cur + tokens : WINDOW_PACK(window, tokens);
+    } while (apr_atomic_cas64(&series->token_window, next, cur) != cur);
+
+    if (cur && WINDOW_NUMBER(cur) != window) {
+        apr_atomic_set64(&series->token_window_prev, cur);
+    }
+}
+
+/* Throughput of the last complete window, 0 when nothing flowed in it */
+static double series_tokens_per_second(metrics_series_t *series, apr_uint64_t window)
+{
+    apr_uint64_t cur = apr_atomic_read64(&series->token_window);
+    apr_uint64_t prev = apr_atomic_read64(&series->token_window_prev);
+
+    if (cur && WINDOW_NUMBER(cur) + 1 == window) {
+        return (double)WINDOW_TOKENS(cur) / MUSE_AI_TOKEN_RATE_WINDOW;
+    }
+    if (prev && WINDOW_NUMBER(prev) + 1 == window) {
+        return (double)WINDOW_TOKENS(prev) / MUSE_AI_TOKEN_RATE_WINDOW;
+    }
+    return 0.0;
+}
+
+static apr_uint64_t current_window(void)
+{
+    return (apr_uint64_t)apr_time_sec(apr_time_now()) / MUSE_AI_TOKEN_RATE_WINDOW;
+}
+
+void metrics_observe_token(request_rec *r)
+{
+    muse_ai_request_ctx_t *ctx;
+    apr_time_t now;
+
+    if (!metrics_table) {
+        return;
+    }
+
+    ctx = muse_ai_request_ctx(r);
+    now = apr_time_now();
+
+    /* Gaps stay in the request context until the request is logged */
+    if (ctx->last_token_time != 0) {
+        apr_uint64_t gap = now > ctx->last_token_time ? (apr_uint64_t)(now - ctx->last_token_time) : 0;
+        ctx->token_gap_counts[metrics_histogram_slot(MUSE_AI_HIST_TOKEN_GAP, gap)]++;
+        ctx->token_gap_sum += gap;
+    }
+    ctx->last_token_time = now;
+}
+
+/* Microseconds from request start to a recorded phase */
+static apr_uint64_t phase_offset(request_rec *r, muse_ai_request_ctx_t *ctx, muse_ai_phase_t phase)
+{
+    return ctx->phases[phase] > r->request_time ? (apr_uint64_t)(ctx->phases[phase] - r->request_time) : 0;
+}
+
+apr_time_t metrics_started(void)
+{
+    return metrics_table ? metrics_table->started : 0;
+}
+
+void metrics_request_started(request_rec *r)
+{
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+
+    if (!metrics_table || ctx->inflight) {
+        return;
+    }
+    apr_atomic_inc32(&metrics_table->inflight);
+    ctx->inflight = 1;
+}
+
+apr_uint32_t metrics_inflight(void)
+{
+    return metrics_table ? apr_atomic_read32(&metrics_table->inflight) : 0;
+}
+
+void metrics_record_request(request_rec *r)
+{
+    extern module muse_ai_module;
+    advanced_muse_ai_config *cfg;
+    muse_ai_request_ctx_t *ctx;
+    metrics_shard_t *shard;
+    metrics_series_t *series;
+    apr_time_t now;
+    apr_uint64_t latency;
+    int success;
+
+    if (!metrics_table) {
+        return;
+    }
+
+    /* Only requests that went through one of our handlers have a context */
+    ctx = ap_get_module_config(r->request_config, &muse_ai_module);
+    if (!ctx) {
+        return;
+    }
+
+    /* The in-flight gauge is kept even when metrics are off for the vhost;
+     * readiness depends on it */
+    if (ctx->inflight) {
+        apr_atomic_dec32(&metrics_table->inflight);
+        ctx->inflight = 0;
+    }
+
+    cfg = ap_get_module_config(r->server->module_config, &muse_ai_module);
+    if (!cfg || !cfg->metrics_enable) {
+        return;
+    }
+
+    now = apr_time_now();
+    latency = now > r->request_time ? (apr_uint64_t)(now - r->request_time) : 0;
+    success = r->status < HTTP_BAD_REQUEST;
+
+    shard = current_shard();
+    apr_atomic_add64(&shard->value[CTR_REQUESTS], 1);
+    apr_atomic_add64(&shard->value[success ? CTR_SUCCESSFUL : CTR_FAILED], 1);
+    apr_atomic_add64(&shard->value[CTR_LATENCY_SUM], latency);
+    apr_atomic_add64(&shard->value[CTR_TOKENS], ctx->completion_tokens);
+    atomic_min64(&metrics_table->min_latency, latency ? latency : 1);
+    atomic_max64(&metrics_table->max_latency, latency);
+    apr_atomic_set64(&metrics_table->last_updated, (apr_uint64_t)now);
+
+    series = find_series(ctx->model ? ctx->model : "none",
+                         ctx->backend_url ? ctx->backend_url : "none",
+                         ctx->locale ? ctx->locale : "default",
+                         ctx->cache_status ? ctx->cache_status : "off");
+    if (!series) {
+        return;
+    }
+
+    apr_atomic_add64(&series->requests, 1);
+    observe(series, MUSE_AI_HIST_LATENCY, latency);
+    observe(series, MUSE_AI_HIST_BYTES, (apr_uint64_t)r->bytes_sent);
+
+    /* Requests turned away before reaching a backend have no token data */
+    if (!ctx->backend_url) {
+        return;
+    }
+
+    if (ctx->phases[MUSE_AI_PHASE_FIRST_BYTE]) {
+        observe(series, MUSE_AI_HIST_TTFB, phase_offset(r, ctx, MUSE_AI_PHASE_FIRST_BYTE));
+    }
+
+    /* Without streamed deltas the whole answer arrives with the first byte */
+    if (ctx->phases[MUSE_AI_PHASE_FIRST_TOKEN]) {
+        observe(series, MUSE_AI_HIST_TTFT, phase_offset(r, ctx, MUSE_AI_PHASE_FIRST_TOKEN));
+    } else if (ctx->last_token_time == 0 && ctx->phases[MUSE_AI_PHASE_FIRST_BYTE]) {
+        observe(series, MUSE_AI_HIST_TTFT, phase_offset(r, ctx, MUSE_AI_PHASE_FIRST_BYTE));
+    }
+
+    for (int i = 0; i < MUSE_AI_HIST_SLOTS; i++) {
+        if (ctx->token_gap_counts[i]) {
+            apr_atomic_add64(&series->buckets[MUSE_AI_HIST_TOKEN_GAP][i], ctx->token_gap_counts[i]);
         }
     }
-    
-    apr_thread_mutex_unlock(metrics_mutex);
+    if (ctx->token_gap_sum) {
+        apr_atomic_add64(&series->sums[MUSE_AI_HIST_TOKEN_GAP], ctx->token_gap_sum);
+    }
+
+    observe(series, MUSE_AI_HIST_TOKENS, ctx->completion_tokens);
+    if (ctx->completion_tokens) {
+        apr_atomic_add64(&series->tokens, ctx->completion_tokens);
+        add_window_tokens(series, ctx->completion_tokens, current_window());
+    }
+}
+
+/* Sum one counter over all shards */
+static apr_uint64_t counter_total(int counter)
+{
+    apr_uint64_t total = 0;
+
+    for (int i = 0; i < MUSE_AI_METRICS_SHARDS; i++) {
+        total += apr_atomic_read64(&metrics_table->shards[i].value[counter]);
+    }
+
+    return total;
+}
+
+/* Get an aggregated snapshot of all counters, NULL if metrics are off */
+muse_ai_metrics_t *get_global_metrics(apr_pool_t *pool)
+{
+    muse_ai_metrics_t *metrics;
+    apr_uint64_t latency_sum;
+
+    if (!metrics_table) {
+        return NULL;
+    }
+
+    metrics = apr_pcalloc(pool, sizeof(muse_ai_metrics_t));
+    metrics->total_requests = (long)counter_total(CTR_REQUESTS);
+    metrics->successful_requests = (long)counter_total(CTR_SUCCESSFUL);
+    metrics->failed_requests = (long)counter_total(CTR_FAILED);
+    metrics->cached_responses = (long)counter_total(CTR_CACHED);
+    metrics->ratelimit_blocked_requests = (long)counter_total(CTR_RATELIMITED);
+    metrics->generated_tokens = (long)counter_total(CTR_TOKENS);
+    metrics->pool_total_created = (int)counter_total(CTR_POOL_CREATED);
+    metrics->pool_total_reused = (int)counter_total(CTR_POOL_REUSED);
+    metrics->accept_language_hits = (long)counter_total(CTR_ACCEPT_LANG_HITS);
+    metrics->accept_language_misses = (long)counter_total(CTR_ACCEPT_LANG_MISSES);
+    metrics->translation_memory_hits = (long)counter_total(CTR_TM_HITS);
+    metrics->translation_memory_misses = (long)counter_total(CTR_TM_MISSES);
+    metrics->translation_tokens_saved = (long)counter_total(CTR_TM_TOKENS_SAVED);
+    metrics->pool_active_connections = (int)apr_atomic_read32(&metrics_table->pool_active);
+    metrics->pool_idle_connections = (int)apr_atomic_read32(&metrics_table->pool_idle);
+    metrics->healthy_backends = (int)apr_atomic_read32(&metrics_table->healthy_backends);
+    metrics->total_backends = (int)apr_atomic_read32(&metrics_table->total_backends);
+
+    latency_sum = counter_total(CTR_LATENCY_SUM);
+    metrics->avg_response_time_ms = metrics->total_requests > 0 ?
+        (double)latency_sum / metrics->total_requests / 1000.0 : 0.0;
+    metrics->min_response_time_ms = (double)apr_atomic_read64(&metrics_table->min_latency) / 1000.0;
+    metrics->max_response_time_ms = (double)apr_atomic_read64(&metrics_table->max_latency) / 1000.0;
+    metrics->last_updated = (apr_time_t)apr_atomic_read64(&metrics_table->last_updated);
+
+    return metrics;
 }
 
 /* Update cache metrics */
 void update_cache_metrics(int cache_hit)
 {
-    if (!global_metrics || !metrics_mutex) {
+    if (!metrics_table || !cache_hit) {
         return;
     }
-    
-    apr_thread_mutex_lock(metrics_mutex);
-    
-    if (cache_hit) {
-        global_metrics->cached_responses++;
+
+    apr_atomic_add64(&current_shard()->value[CTR_CACHED], 1);
+}
+
+/* Count an Accept-Language negotiation cache lookup */
+void metrics_accept_language_lookup(int hit)
+{
+    if (!metrics_table) {
+        return;
+    }
+
+    apr_atomic_add64(&current_shard()->value[hit ? CTR_ACCEPT_LANG_HITS : CTR_ACCEPT_LANG_MISSES], 1);
+}
+
+/* Count the translation memory lookups of one translated page */
+void metrics_translation_memory(apr_uint32_t hits, apr_uint32_t misses, apr_uint32_t tokens_saved)
+{
+    metrics_shard_t *shard;
+
+    if (!metrics_table) {
+        return;
     }
-    
-    global_metrics->last_updated = apr_time_now();
-    
-    apr_thread_mutex_unlock(metrics_mutex);
+
+    shard = current_shard();
+    apr_atomic_add64(&shard->value[CTR_TM_HITS], hits);
+    apr_atomic_add64(&shard->value[CTR_TM_MISSES], misses);
+    apr_atomic_add64(&shard->value[CTR_TM_TOKENS_SAVED], tokens_saved);
 }
 
 /* Update connection pool metrics */
 void update_pool_metrics(int active, int idle, int created, int reused)
 {
-    if (!global_metrics || !metrics_mutex) {
+    metrics_shard_t *shard;
+
+    if (!metrics_table) {
         return;
     }
-    
-    apr_thread_mutex_lock(metrics_mutex);
-    
-    global_metrics->pool_active_connections = active;
-    global_metrics->pool_idle_connections = idle;
-    
+
+    apr_atomic_set32(&metrics_table->pool_active, (apr_uint32_t)active);
+    apr_atomic_set32(&metrics_table->pool_idle, (apr_uint32_t)idle);
+
+    shard = current_shard();
     if (created > 0) {
-        global_metrics->pool_total_created += created;
+        apr_atomic_add64(&shard->value[CTR_POOL_CREATED], (apr_uint64_t)created);
     }
-    
     if (reused > 0) {
-        global_metrics->pool_total_reused += reused;
+        apr_atomic_add64(&shard->value[CTR_POOL_REUSED], (apr_uint64_t)reused);
     }
-    
-    global_metrics->last_updated = apr_time_now();
-    
-    apr_thread_mutex_unlock(metrics_mutex);
 }
 
 /* Update rate limiting metrics */
 void update_ratelimit_metrics(int blocked)
 {
-    if (!global_metrics || !metrics_mutex) {
+    if (!metrics_table || blocked <= 0) {
         return;
     }
-    
-    apr_thread_mutex_lock(metrics_mutex);
-    
-    if (blocked > 0) {
-        global_metrics->ratelimit_blocked_requests += blocked;
+
+    apr_atomic_add64(&current_shard()->value[CTR_RATELIMITED], (apr_uint64_t)blocked);
+}
+
+/* Update backend health metrics */
+void update_backend_metrics(int healthy, int total)
+{
+    if (!metrics_table) {
+        return;
     }
-    
-    global_metrics->last_updated = apr_time_now();
-    
-    apr_thread_mutex_unlock(metrics_mutex);
+
+    apr_atomic_set32(&metrics_table->healthy_backends, (apr_uint32_t)healthy);
+    apr_atomic_set32(&metrics_table->total_backends, (apr_uint32_t)total);
 }
 
-/* Reset all metrics */
+/* Reset all metrics. Series keep their slots, only their values are cleared. */
 void reset_metrics(void)
 {
-    if (!global_metrics || !metrics_mutex) {
+    if (!metrics_table) {
         return;
     }
-    
-    apr_thread_mutex_lock(metrics_mutex);
-    
-    global_metrics->total_requests = 0;
-    global_metrics->successful_requests = 0;
-    global_metrics->failed_requests = 0;
-    global_metrics->cached_responses = 0;
-    global_metrics->avg_response_time_ms = 0.0;
-    global_metrics->min_response_time_ms = 0.0;
-    global_metrics->max_response_time_ms = 0.0;
-    global_metrics->pool_total_created = 0;
-    global_metrics->pool_total_reused = 0;
-    global_metrics->ratelimit_blocked_requests = 0;
-    global_metrics->last_updated = apr_time_now();
-    
-    apr_thread_mutex_unlock(metrics_mutex);
-}
-
-/* Generate Prometheus-style metrics output */
-char *generate_prometheus_metrics(apr_pool_t *pool)
-{
-    char *metrics_output;
-    muse_ai_metrics_t *metrics = get_global_metrics();
-    
-    if (!metrics) {
-        return apr_pstrdup(pool, "# Metrics not available\n");
+
+    for (int i = 0; i < MUSE_AI_METRICS_SHARDS; i++) {
+        for (int c = 0; c < CTR_COUNT; c++) {
+            apr_atomic_set64(&metrics_table->shards[i].value[c], 0);
+        }
+    }
+
+    for (int i = 0; i < MUSE_AI_METRICS_MAX_SERIES; i++) {
+        metrics_series_t *series = &metrics_table->series[i];
+        apr_atomic_set64(&series->requests, 0);
+        apr_atomic_set64(&series->tokens, 0);
+        apr_atomic_set64(&series->token_window, 0);
+        apr_atomic_set64(&series->token_window_prev, 0);
+        for (int h = 0; h < MUSE_AI_HIST_COUNT; h++) {
+            for (int b = 0; b < MUSE_AI_HIST_SLOTS; b++) {
+                apr_atomic_set64(&series->buckets[h][b], 0);
+            }
+            apr_atomic_set64(&series->sums[h], 0);
+        }
+    }
+
+    apr_atomic_set64(&metrics_table->min_latency, 0);
+    apr_atomic_set64(&metrics_table->max_latency, 0);
+    apr_atomic_set64(&metrics_table->last_updated, (apr_uint64_t)apr_time_now());
+}
+
+/* Escape a label value for the Prometheus text format (also valid JSON).
+ * Returns the length written; out is always terminated. */
+static apr_size_t escape_label_into(char *out, apr_size_t size, const char *value)
+{
+    apr_size_t n = 0;
+
+    for (; *value && n + 2 < size; value++) {
+        if (*value == '\\' || *value == '"') {
+            out[n++] = '\\';
+            out[n++] = *value;
+        } else if (*value == '\n') {
+            out[n++] = '\\';
+            out[n++] = 'n';
+        } else {
+            out[n++] = *value;
+        }
+    }
+    out[n] = '\0';
+
+    return n;
+}
+
+/* Render the label block of a freshly claimed series once, so scrapes
+ * never have to escape or format labels */
+static void render_series_labels(metrics_series_t *series)
+{
+    char model[2 * sizeof(series->model)];
+    char backend[2 * sizeof(series->backend)];
+    char locale[2 * sizeof(series->locale)];
+    char cache[2 * sizeof(series->cache)];
+
+    escape_label_into(model, sizeof(model), series->model);
+    escape_label_into(backend, sizeof(backend), series->backend);
+    escape_label_into(locale, sizeof(locale), series->locale);
+    escape_label_into(cache, sizeof(cache), series->cache);
+
+    apr_snprintf(series->labels, sizeof(series->labels),
+                 "model=\"%s\",backend=\"%s\",locale=\"%s\",cache=\"%s\"",
+                 model, backend, locale, cache);
+}
+
+static const char *escape_label(apr_pool_t *pool, const char *value)
+{
+    apr_size_t size = strlen(value) * 2 + 1;
+    char *out = apr_palloc(pool, size);
+
+    escape_label_into(out, size, value);
+    return out;
+}
+
+/* Append a formatted piece of output */
+static void emit(apr_array_header_t *out, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    APR_ARRAY_PUSH(out, const char *) = apr_pvsprintf(out->pool, fmt, ap);
+    va_end(ap);
+}
+
+/*
+ * Prometheus exposition writer. Every line is formatted into a stack
+ * buffer and appended to a brigade that is passed down the filter chain
+ * whenever it fills up, so a scrape allocates nothing from the request
+ * pool no matter how many series exist.
+ */
+typedef struct {
+    apr_bucket_brigade *bb;
+    ap_filter_t *f;
+    apr_status_t rv;
+    char line[1024];
+} prom_writer_t;
+
+static void prom_write(prom_writer_t *w, const char *data, apr_size_t len)
+{
+    if (w->rv == APR_SUCCESS) {
+        w->rv = apr_brigade_write(w->bb, ap_filter_flush, w->f, data, len);
+    }
+}
+
+static void prom_printf(prom_writer_t *w, const char *fmt, ...)
+{
+    va_list ap;
+    int len;
+
+    va_start(ap, fmt);
+    len = apr_vsnprintf(w->line, sizeof(w->line), fmt, ap);
+    va_end(ap);
+
+    prom_write(w, w->line, (apr_size_t)len);
+}
+
+static void prom_header(prom_writer_t *w, const char *name, const char *help, const char *type)
+{
+    prom_printf(w, "\n# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void write_histogram(prom_writer_t *w, muse_ai_histogram_t hist)
+{
+    const char *name = hist_info[hist].name;
+    double scale = hist_info[hist].scale;
+
+    prom_header(w, name, hist_info[hist].help, "histogram");
+
+    for (int i = 0; i < MUSE_AI_METRICS_MAX_SERIES && w->rv == APR_SUCCESS; i++) {
+        metrics_series_t *series = &metrics_table->series[i];
+        apr_uint64_t cumulative = 0;
+
+        if (!apr_atomic_read32(&series->ready)) {
+            continue;
+        }
+
+        for (int b = 0; b < MUSE_AI_HIST_SLOTS; b++) {
+            cumulative += apr_atomic_read64(&series->buckets[hist][b]);
+            prom_printf(w, "%s_bucket{%s,le=\"%s\"} %" APR_UINT64_T_FMT "\n",
+                        name, series->labels, hist_le[hist][b], cumulative);
+        }
+
+        prom_printf(w, "%s_sum{%s} %.6f\n", name, series->labels,
+                    (double)apr_atomic_read64(&series->sums[hist]) / scale);
+        prom_printf(w, "%s_count{%s} %" APR_UINT64_T_FMT "\n", name, series->labels, cumulative);
+    }
+}
+
+/* Write Prometheus-style metrics output into the response */
+apr_status_t write_prometheus_metrics(request_rec *r)
+{
+    prom_writer_t writer;
+    prom_writer_t *w = &writer;
+    apr_uint64_t window;
+
+    w->bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+    w->f = r->output_filters;
+    w->rv = APR_SUCCESS;
+
+    if (!metrics_table) {
+        prom_printf(w, "# Metrics not available\n");
+        return w->rv == APR_SUCCESS ? ap_pass_brigade(w->f, w->bb) : w->rv;
     }
-    
-    apr_thread_mutex_lock(metrics_mutex);
-    
-    metrics_output = apr_psprintf(pool,
+
+    prom_printf(w,
         "# HELP mod_muse_ai_requests_total Total number of requests processed\n"
         "# TYPE mod_muse_ai_requests_total counter\n"
-        "mod_muse_ai_requests_total %ld\n"
-        "\n"
-        "# HELP mod_muse_ai_requests_successful_total Total number of successful requests\n"
-        "# TYPE mod_muse_ai_requests_successful_total counter\n"
-        "mod_muse_ai_requests_successful_total %ld\n"
-        "\n"
-        "# HELP mod_muse_ai_requests_failed_total Total number of failed requests\n"
-        "# TYPE mod_muse_ai_requests_failed_total counter\n"
-        "mod_muse_ai_requests_failed_total %ld\n"
-        "\n"
-        "# HELP mod_muse_ai_cache_hits_total Total number of cache hits\n"
-        "# TYPE mod_muse_ai_cache_hits_total counter\n"
-        "mod_muse_ai_cache_hits_total %ld\n"
-        "\n"
-        "# HELP mod_muse_ai_response_time_seconds Response time statistics\n"
-        "# TYPE mod_muse_ai_response_time_seconds gauge\n"
-        "mod_muse_ai_response_time_seconds{quantile=\"avg\"} %.3f\n"
-        "mod_muse_ai_response_time_seconds{quantile=\"min\"} %.3f\n"
-        "mod_muse_ai_response_time_seconds{quantile=\"max\"} %.3f\n"
-        "\n"
-        "# HELP mod_muse_ai_pool_connections Current connection pool status\n"
-        "# TYPE mod_muse_ai_pool_connections gauge\n"
-        "mod_muse_ai_pool_connections{state=\"active\"} %d\n"
-        "mod_muse_ai_pool_connections{state=\"idle\"} %d\n"
-        "\n"
-        "# HELP mod_muse_ai_pool_connections_total Total connection pool operations\n"
-        "# TYPE mod_muse_ai_pool_connections_total counter\n"
-        "mod_muse_ai_pool_connections_total{operation=\"created\"} %d\n"
-        "mod_muse_ai_pool_connections_total{operation=\"reused\"} %d\n"
-        "\n"
-        "# HELP mod_muse_ai_ratelimit_blocked_total Total number of rate-limited requests\n"
-        "# TYPE mod_muse_ai_ratelimit_blocked_total counter\n"
-        "mod_muse_ai_ratelimit_blocked_total %ld\n"
-        "\n"
-        "# HELP mod_muse_ai_backends_healthy Number of healthy backend endpoints\n"
-        "# TYPE mod_muse_ai_backends_healthy gauge\n"
-        "mod_muse_ai_backends_healthy %d\n"
-        "\n"
-        "# HELP mod_muse_ai_backends_total Total number of configured backend endpoints\n"
-        "# TYPE mod_muse_ai_backends_total gauge\n"
-        "mod_muse_ai_backends_total %d\n",
-        
-        metrics->total_requests,
-        metrics->successful_requests,
-        metrics->failed_requests,
-        metrics->cached_responses,
-        metrics->avg_response_time_ms / 1000.0,
-        metrics->min_response_time_ms / 1000.0,
-        metrics->max_response_time_ms / 1000.0,
-        metrics->pool_active_connections,
-        metrics->pool_idle_connections,
-        metrics->pool_total_created,
-        metrics->pool_total_reused,
-        metrics->ratelimit_blocked_requests,
-        metrics->healthy_backends,
-        metrics->total_backends
-    );
-    
-    apr_thread_mutex_unlock(metrics_mutex);
-    
-    return metrics_output;
+        "mod_muse_ai_requests_total %" APR_UINT64_T_FMT "\n",
+        counter_total(CTR_REQUESTS));
+
+    prom_header(w, "mod_muse_ai_requests_successful_total", "Total number of successful requests", "counter");
+    prom_printf(w, "mod_muse_ai_requests_successful_total %" APR_UINT64_T_FMT "\n", counter_total(CTR_SUCCESSFUL));
+
+    prom_header(w, "mod_muse_ai_requests_failed_total", "Total number of failed requests", "counter");
+    prom_printf(w, "mod_muse_ai_requests_failed_total %" APR_UINT64_T_FMT "\n", counter_total(CTR_FAILED));
+
+    prom_header(w, "mod_muse_ai_cache_hits_total", "Total number of cache hits", "counter");
+    prom_printf(w, "mod_muse_ai_cache_hits_total %" APR_UINT64_T_FMT "\n", counter_total(CTR_CACHED));
+
+    prom_header(w, "mod_muse_ai_accept_language_cache_total", "Accept-Language negotiation cache lookups", "counter");
+    prom_printf(w, "mod_muse_ai_accept_language_cache_total{result=\"hit\"} %" APR_UINT64_T_FMT "\n"
+                   "mod_muse_ai_accept_language_cache_total{result=\"miss\"} %" APR_UINT64_T_FMT "\n",
+                counter_total(CTR_ACCEPT_LANG_HITS), counter_total(CTR_ACCEPT_LANG_MISSES));
+
+    prom_header(w, "mod_muse_ai_translation_memory_segments_total", "Text segments looked up in the translation memory", "counter");
+    prom_printf(w, "mod_muse_ai_translation_memory_segments_total{result=\"hit\"} %" APR_UINT64_T_FMT "\n"
+                   "mod_muse_ai_translation_memory_segments_total{result=\"miss\"} %" APR_UINT64_T_FMT "\n",
+                counter_total(CTR_TM_HITS), counter_total(CTR_TM_MISSES));
+
+    prom_header(w, "mod_muse_ai_translation_memory_tokens_saved_total", "Estimated completion tokens not generated thanks to the translation memory", "counter");
+    prom_printf(w, "mod_muse_ai_translation_memory_tokens_saved_total %" APR_UINT64_T_FMT "\n", counter_total(CTR_TM_TOKENS_SAVED));
+
+    prom_header(w, "mod_muse_ai_pool_connections", "Current connection pool status", "gauge");
+    prom_printf(w, "mod_muse_ai_pool_connections{state=\"active\"} %u\n"
+                   "mod_muse_ai_pool_connections{state=\"idle\"} %u\n",
+                apr_atomic_read32(&metrics_table->pool_active),
+                apr_atomic_read32(&metrics_table->pool_idle));
+
+    prom_header(w, "mod_muse_ai_pool_connections_total", "Total connection pool operations", "counter");
+    prom_printf(w, "mod_muse_ai_pool_connections_total{operation=\"created\"} %" APR_UINT64_T_FMT "\n"
+                   "mod_muse_ai_pool_connections_total{operation=\"reused\"} %" APR_UINT64_T_FMT "\n",
+                counter_total(CTR_POOL_CREATED), counter_total(CTR_POOL_REUSED));
+
+    prom_header(w, "mod_muse_ai_ratelimit_blocked_total", "Total number of rate-limited requests", "counter");
+    prom_printf(w, "mod_muse_ai_ratelimit_blocked_total %" APR_UINT64_T_FMT "\n", counter_total(CTR_RATELIMITED));
+
+    prom_header(w, "mod_muse_ai_requests_inflight", "Requests admitted and not yet completed", "gauge");
+    prom_printf(w, "mod_muse_ai_requests_inflight %u\n", apr_atomic_read32(&metrics_table->inflight));
+
+    prom_header(w, "mod_muse_ai_backends_healthy", "Number of healthy backend endpoints", "gauge");
+    prom_printf(w, "mod_muse_ai_backends_healthy %u\n", apr_atomic_read32(&metrics_table->healthy_backends));
+
+    prom_header(w, "mod_muse_ai_backends_total", "Total number of configured backend endpoints", "gauge");
+    prom_printf(w, "mod_muse_ai_backends_total %u\n", apr_atomic_read32(&metrics_table->total_backends));
+
+    prom_header(w, "mod_muse_ai_metrics_series_dropped_total", "Observations without a free label slot", "counter");
+    prom_printf(w, "mod_muse_ai_metrics_series_dropped_total %u\n", apr_atomic_read32(&metrics_table->series_dropped));
+
+    /* Per label set token counters and live throughput */
+    prom_header(w, "mod_muse_ai_generated_tokens_total", "Tokens generated by backends", "counter");
+    for (int i = 0; i < MUSE_AI_METRICS_MAX_SERIES && w->rv == APR_SUCCESS; i++) {
+        metrics_series_t *series = &metrics_table->series[i];
+        if (apr_atomic_read32(&series->ready)) {
+            prom_printf(w, "mod_muse_ai_generated_tokens_total{%s} %" APR_UINT64_T_FMT "\n",
+                        series->labels, apr_atomic_read64(&series->tokens));
+        }
+    }
+
+    window = current_window();
+    prom_header(w, "mod_muse_ai_tokens_per_second",
+                "Token generation throughput over the last complete 10 second window", "gauge");
+    for (int i = 0; i < MUSE_AI_METRICS_MAX_SERIES && w->rv == APR_SUCCESS; i++) {
+        metrics_series_t *series = &metrics_table->series[i];
+        if (apr_atomic_read32(&series->ready)) {
+            prom_printf(w, "mod_muse_ai_tokens_per_second{%s} %.2f\n",
+                        series->labels, series_tokens_per_second(series, window));
+        }
+    }
+
+    for (int h = 0; h < MUSE_AI_HIST_COUNT; h++) {
+        write_histogram(w, (muse_ai_histogram_t)h);
+    }
+
+    if (w->rv != APR_SUCCESS) {
+        apr_brigade_cleanup(w->bb);
+        return w->rv;
+    }
+
+    return ap_pass_brigade(w->f, w->bb);
 }
 
 /* Generate JSON metrics output */
 char *generate_json_metrics(apr_pool_t *pool)
 {
-    char *metrics_output;
-    muse_ai_metrics_t *metrics = get_global_metrics();
-    
+    muse_ai_metrics_t *metrics = get_global_metrics(pool);
+    apr_array_header_t *series_out;
+    apr_uint64_t window;
+
     if (!metrics) {
         return apr_pstrdup(pool, "{\"error\": \"Metrics not available\"}");
     }
-    
-    apr_thread_mutex_lock(metrics_mutex);
-    
-    metrics_output = apr_psprintf(pool,
+
+    /* Per label set token counters and live throughput */
+    series_out = apr_array_make(pool, 16, sizeof(const char *));
+    window = current_window();
+    for (int i = 0; i < MUSE_AI_METRICS_MAX_SERIES; i++) {
+        metrics_series_t *series = &metrics_table->series[i];
+        if (!apr_atomic_read32(&series->ready)) {
+            continue;
+        }
+        emit(series_out,
+            "%s\n      {\"model\": \"%s\", \"backend\": \"%s\", \"locale\": \"%s\", \"cache\": \"%s\", "
+            "\"requests\": %" APR_UINT64_T_FMT ", \"tokens\": %" APR_UINT64_T_FMT ", \"tokens_per_second\": %.2f}",
+            series_out->nelts > 0 ? "," : "",
+            escape_label(pool, series->model), escape_label(pool, series->backend),
+            escape_label(pool, series->locale), escape_label(pool, series->cache),
+            apr_atomic_read64(&series->requests), apr_atomic_read64(&series->tokens),
+            series_tokens_per_second(series, window));
+    }
+    if (series_out->nelts > 0) {
+        emit(series_out, "\n    ");
+    }
+
+    return apr_psprintf(pool,
         "{\n"
         "  \"requests\": {\n"
         "    \"total\": %ld,\n"
@@ -287,6 +898,17 @@ char *generate_json_metrics(apr_pool_t *pool)
         "    \"hits\": %ld,\n"
         "    \"hit_rate\": %.2f\n"
         "  },\n"
+        "  \"accept_language_cache\": {\n"
+        "    \"hits\": %ld,\n"
+        "    \"misses\": %ld,\n"
+        "    \"hit_rate\": %.2f\n"
+        "  },\n"
+        "  \"translation_memory\": {\n"
+        "    \"hits\": %ld,\n"
+        "    \"misses\": %ld,\n"
+        "    \"hit_rate\": %.2f,\n"
+        "    \"tokens_saved\": %ld\n"
+        "  },\n"
         "  \"response_time_ms\": {\n"
         "    \"avg\": %.2f,\n"
         "    \"min\": %.2f,\n"
@@ -307,38 +929,52 @@ char *generate_json_metrics(apr_pool_t *pool)
         "    \"total\": %d,\n"
         "    \"health_rate\": %.2f\n"
         "  },\n"
+        "  \"tokens\": {\n"
+        "    \"generated\": %ld,\n"
+        "    \"series\": [%s]\n"
+        "  },\n"
         "  \"last_updated\": %lld\n"
         "}",
-        
+
         metrics->total_requests,
         metrics->successful_requests,
         metrics->failed_requests,
         metrics->total_requests > 0 ? (double)metrics->successful_requests / metrics->total_requests * 100.0 : 0.0,
-        
+
         metrics->cached_responses,
         metrics->total_requests > 0 ? (double)metrics->cached_responses / metrics->total_requests * 100.0 : 0.0,
-        
+
+        metrics->accept_language_hits,
+        metrics->accept_language_misses,
+        (metrics->accept_language_hits + metrics->accept_language_misses) > 0 ?
+            (double)metrics->accept_language_hits / (metrics->accept_language_hits + metrics->accept_language_misses) * 100.0 : 0.0,
+
+        metrics->translation_memory_hits,
+        metrics->translation_memory_misses,
+        (metrics->translation_memory_hits + metrics->translation_memory_misses) > 0 ?
+            (double)metrics->translation_memory_hits / (metrics->translation_memory_hits + metrics->translation_memory_misses) * 100.0 : 0.0,
+        metrics->translation_tokens_saved,
+
         metrics->avg_response_time_ms,
         metrics->min_response_time_ms,
         metrics->max_response_time_ms,
-        
+
         metrics->pool_active_connections,
         metrics->pool_idle_connections,
         metrics->pool_total_created,
         metrics->pool_total_reused,
-        (metrics->pool_total_created + metrics->pool_total_reused) > 0 ? 
+        (metrics->pool_total_created + metrics->pool_total_reused) > 0 ?
             (double)metrics->pool_total_reused / (metrics->pool_total_created + metrics->pool_total_reused) * 100.0 : 0.0,
-        
+
         metrics->ratelimit_blocked_requests,
-        
+
         metrics->healthy_backends,
         metrics->total_backends,
         metrics->total_backends > 0 ? (double)metrics->healthy_backends / metrics->total_backends * 100.0 : 0.0,
-        
+
+        metrics->generated_tokens,
+        apr_array_pstrcat(pool, series_out, '\0'),
+
         (long long)metrics->last_updated
     );
-    
-    apr_thread_mutex_unlock(metrics_mutex);
-    
-    return metrics_output;
 }
@@ -0,0 +1,69 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <httpd.h>
+#include <http_config.h>
+#include <apr_pools.h>
+
+/* Shared-memory layout */
+#define MUSE_AI_CACHE_LINE 64
+#define MUSE_AI_METRICS_SHARDS 64           /* Counter shards; each thread sticks to one */
+#define MUSE_AI_METRICS_MAX_SERIES 2048     /* Distinct model/backend/locale/cache label sets */
+#define MUSE_AI_METRICS_LABELS_MAX 512      /* Rendered label block per series */
+#define MUSE_AI_TOKEN_RATE_WINDOW 10        /* seconds per throughput window */
+
+/* Histogram geometry: fixed upper bounds plus +Inf */
+#define MUSE_AI_HIST_BOUNDS 12
+#define MUSE_AI_HIST_SLOTS (MUSE_AI_HIST_BOUNDS + 1)
+
+/* Histogram families. Times are observed in microseconds. */
+typedef enum {
+    MUSE_AI_HIST_LATENCY = 0,   /* Total request time */
+    MUSE_AI_HIST_TTFB,          /* Time to the first backend body byte */
+    MUSE_AI_HIST_TTFT,          /* Time to first token */
+    MUSE_AI_HIST_TOKEN_GAP,     /* Gap between two streamed tokens */
+    MUSE_AI_HIST_BYTES,         /* Response body bytes */
+    MUSE_AI_HIST_TOKENS,        /* Generated tokens per response */
+    MUSE_AI_HIST_COUNT
+} muse_ai_histogram_t;
+
+/* Function declarations */
+
+/* Create the shared metrics segment. Called from post_config so that every
+ * child process inherits the same mapping. */
+int init_metrics_system(apr_pool_t *pool, server_rec *s);
+
+/* Bucket index of a value for the given histogram family */
+int metrics_histogram_slot(muse_ai_histogram_t hist, apr_uint64_t value);
+
+/* Note a streamed content delta; every one after the first feeds the
+ * inter-token gap histogram of this request */
+void metrics_observe_token(request_rec *r);
+
+/* Time the shared segment was created (server start or restart), 0 if none */
+apr_time_t metrics_started(void);
+
+/* Count a request as admitted; it leaves the in-flight gauge when it is
+ * logged. Safe to call more than once per request. */
+void metrics_request_started(request_rec *r);
+
+/* Count an Accept-Language negotiation cache lookup, hit or miss */
+void metrics_accept_language_lookup(int hit);
+
+/* Count translation memory lookups of one page: segments found, segments
+ * sent to the model, and the completion tokens the hits saved */
+void metrics_translation_memory(apr_uint32_t hits, apr_uint32_t misses, apr_uint32_t tokens_saved);
+
+/* Requests admitted and not yet logged, over all processes */
+apr_uint32_t metrics_inflight(void);
+
+/* Fold one finished request into the shared counters and histograms.
+ * Requests without a mod_muse_ai request context are ignored. */
+void metrics_record_request(request_rec *r);
+
+/* Scrape output, aggregated over all shards and processes.
+ * The Prometheus text format is streamed straight into the response. */
+apr_status_t write_prometheus_metrics(request_rec *r);
+char *generate_json_metrics(apr_pool_t *pool);
+
+#endif /* METRICS_H */
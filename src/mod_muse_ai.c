@@ -10,6 +10,7 @@
 #include "httpd.h"
 #include "http_config.h"
 #include "http_log.h"
+#include "http_protocol.h"
 #include "ap_config.h"
 
 /*
@@ -20,6 +21,12 @@
 #include "advanced_config.h"
 #include "request_handlers.h"
 #include "model_config.h"
+#include "backend_health.h"
+#include "rate_limit.h"
+#include "metrics.h"
+#include "request_context.h"
+#include "slow_trace.h"
+#include "translation_memory.h"
 
 /* Forward declaration for the module */
 module AP_MODULE_DECLARE_DATA muse_ai_module;
@@ -50,19 +57,80 @@ static int muse_ai_post_config(apr_pool_t *pconf, apr_pool_t *plog, apr_pool_t *
         return HTTP_INTERNAL_SERVER_ERROR;
     }
     
-    /* Start the model configuration monitor thread */
-    rv = start_model_config_monitor(pconf);
+    /* Shared-memory rate limiter, inherited by every child process */
+    rv = init_rate_limiter(pconf, s);
     if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, "[mod_muse_ai] Failed to start model configuration monitor thread");
-        /* Continue anyway, we'll just have to manually reload Apache to pick up config changes */
-    } else {
-        ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, "[mod_muse_ai] Model configuration monitor thread started successfully");
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, "[mod_muse_ai] Rate limiting unavailable");
+        /* Continue anyway, requests are simply not limited */
+    }
+
+    /* Shared-memory metrics, so every child reports into the same counters */
+    if (init_metrics_system(pconf, s) != 0) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, "[mod_muse_ai] Metrics collection unavailable");
+        /* Continue anyway, the metrics endpoint reports nothing */
+    }
+
+    /* Opened here, before the children drop privileges */
+    if (init_slow_trace(pconf, s) != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, "[mod_muse_ai] Slow request tracing unavailable");
+    }
+
+    /* Mapped shared, so every child reads and extends the same memory */
+    if (init_translation_memory(pconf, s) != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, "[mod_muse_ai] Translation memory unavailable");
+        /* Continue anyway, every segment is sent for translation */
     }
 
     /* The main initialization logic is in request_handlers.c */
     return init_phase3_features(pconf, s, cfg);
 }
 
+/*
+ * Child-init hook to set up per-process backend state.
+ * Every child gets its own backend registry and health probe thread, so
+ * circuit breaker state never has to be shared between processes.
+ */
+static void muse_ai_child_init(apr_pool_t *pchild, server_rec *s)
+{
+    apr_status_t rv;
+
+    /* Slow request traces are written by a thread of their own */
+    start_slow_trace_writer(pchild, s);
+
+    rv = init_backend_registry(pchild, s);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, "[mod_muse_ai] Failed to initialize backend registry");
+        return;
+    }
+
+    rv = start_backend_health_monitor(pchild, s);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, "[mod_muse_ai] Failed to start backend health monitor thread");
+        /* Continue anyway, the passive circuit breaker still works */
+    }
+
+    /* Threads do not survive the fork, so each child watches models.json
+     * itself and swaps in its own configuration snapshots */
+    rv = start_model_config_monitor(pchild);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, "[mod_muse_ai] Failed to start model configuration monitor thread");
+        /* Continue anyway, we'll just have to manually reload Apache to pick up config changes */
+    }
+}
+
+/*
+ * Log-transaction hook to record request metrics.
+ * Runs after the response is complete, so total time and bytes sent are final.
+ * It runs ahead of mod_log_config so the muse_* timing notes can be logged.
+ */
+static int muse_ai_log_transaction(request_rec *r)
+{
+    muse_ai_timing_notes(r);
+    slow_trace_record(r);
+    metrics_record_request(r);
+    return DECLINED;
+}
+
 /*
  * Hook for registering handlers and other hooks.
  * This function is called by Apache to set up the module. It wires up all the
@@ -79,11 +147,14 @@ static void muse_ai_register_hooks(apr_pool_t *p)
      * - enhanced_muse_ai_handler: Handles core AI requests to /ai
      * - metrics_handler: Exposes Prometheus-compatible metrics at /metrics
      * - health_check_handler: Provides a system health check at /health
+     * - liveness_handler / readiness_handler: Probe endpoints for load balancers
      */
     /* Register the main AI handler under the standard name "muse-ai-handler" */
     ap_hook_handler(enhanced_muse_ai_handler, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_handler(metrics_handler, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_handler(health_check_handler, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_handler(liveness_handler, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_handler(readiness_handler, NULL, NULL, APR_HOOK_MIDDLE);
 
     /*
      * Register the post-config hook. This is critical for initializing
@@ -91,6 +162,12 @@ static void muse_ai_register_hooks(apr_pool_t *p)
      * Apache has finished parsing the configuration files.
      */
     ap_hook_post_config(muse_ai_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+
+    /* Per-process backend registry and health checking */
+    ap_hook_child_init(muse_ai_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+
+    /* Request metrics once the response has been sent */
+    ap_hook_log_transaction(muse_ai_log_transaction, NULL, NULL, APR_HOOK_FIRST);
 }
 
 /*
@@ -13,7 +13,7 @@
 #include "language_selection.h"
 
 /* Module configuration structure */
-typedef struct {
+typedef struct muse_ai_config {
     char *endpoint;     /* MuseWeb endpoint URL */
     int timeout;        /* Request timeout in seconds */
     int debug;          /* Debug flag */
@@ -21,6 +21,11 @@ typedef struct {
     char *api_key;      /* API key for authentication */
     int streaming;      /* Enable streaming responses */
     int max_tokens;     /* Maximum tokens for AI response generation */
+    int max_retries;    /* Retries before any byte reaches the client */
+    int retry_delay_ms; /* Pause between retries */
+    int hedge_percentile;   /* First-byte percentile that triggers a hedge, 0 = off */
+    int hedge_min_delay_ms; /* Never hedge earlier than this */
+    int raw_content;    /* Non-streaming: return the content unsanitized, it is not a page */
 } muse_ai_config;
 
 /* Default configuration values */
@@ -67,6 +72,7 @@ int find_html_start(const char *content);
 int find_html_end(const char *content);
 
 /* Sanitization functions */
+char *remove_thinking_tags(apr_pool_t *pool, const char *content);
 char *cleanup_code_fences(apr_pool_t *pool, const char *content);
 char *sanitize_response(apr_pool_t *pool, const char *content, const muse_language_selection_t *lang_selection);
 char *extract_html_content(apr_pool_t *pool, const char *content);
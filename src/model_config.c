@@ -1,295 +1,323 @@
 #include "model_config.h"
-#include "apr_file_io.h"
+#include "mod_muse_ai.h"
 #include "apr_env.h"
 #include "apr_strings.h"
-#include "apr_json.h"
+#include "apr_atomic.h"
 #include "httpd.h"
 #include "http_log.h"
 #include "http_protocol.h"
 #include "http_config.h"
+#include "cJSON.h"
 #include <unistd.h>
 
-/* Global variables */
-static muse_ai_models_config *g_models_config = NULL;
-static apr_thread_t *g_monitor_thread = NULL;
-static int g_monitor_thread_stop = 0;
+/* Global variables, shared with model_selection.c and model_thread.c */
+muse_ai_models_config *g_models_config = NULL;
+apr_thread_t *g_monitor_thread = NULL;
+int g_monitor_thread_stop = 0;
+apr_pool_t *g_config_pool = NULL;
 static const char *g_config_file_path = NULL;
-static apr_pool_t *g_config_pool = NULL;
 
-/* Forward declarations */
-static apr_status_t load_model_config(apr_pool_t *p, request_rec *r);
-static void *APR_THREAD_FUNC model_config_monitor(apr_thread_t *thd, void *data);
-static const char *resolve_env_vars(const char *value, apr_pool_t *p);
-
-/* Load model configuration from JSON file */
-static apr_status_t load_model_config(apr_pool_t *p, request_rec *r) {
-    apr_file_t *file = NULL;
-    apr_status_t rv;
-    apr_finfo_t finfo;
-    apr_json_value_t *json_root = NULL;
-    apr_json_value_t *json_models = NULL;
-    apr_json_value_t *json_default_model = NULL;
-    apr_pool_t *tmp_pool = NULL;
-    apr_hash_t *new_models = NULL;
-    const char *default_model_name = NULL;
-    
-    /* Create a temporary pool for parsing */
-    rv = apr_pool_create(&tmp_pool, p);
-    if (rv != APR_SUCCESS) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "mod_muse_ai: Failed to create memory pool for model config parsing");
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, "mod_muse_ai: Failed to create memory pool for model config parsing");
-        }
-        return rv;
+/* Resolve environment variables in a string */
+static const char *resolve_env_vars(const char *value, apr_pool_t *p) {
+    if (!value || !*value) {
+        return value;
     }
-    
-    /* Open the config file */
-    rv = apr_file_open(&file, g_config_file_path, APR_READ, APR_OS_DEFAULT, tmp_pool);
-    if (rv != APR_SUCCESS) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "mod_muse_ai: Failed to open model config file: %s", g_config_file_path);
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, "mod_muse_ai: Failed to open model config file: %s", g_config_file_path);
-        }
-        apr_pool_destroy(tmp_pool);
-        return rv;
-    }
-    
-    /* Get file info to check modification time */
-    rv = apr_file_info_get(&finfo, APR_FINFO_MTIME, file);
-    if (rv != APR_SUCCESS) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "mod_muse_ai: Failed to get file info for model config file");
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, "mod_muse_ai: Failed to get file info for model config file");
+
+    /* Check if the value contains an environment variable reference */
+    if (strstr(value, "${") && strchr(value, '}')) {
+        const char *start, *end;
+        char *result = apr_pstrdup(p, "");
+        const char *current = value;
+
+        while ((start = strstr(current, "${"))) {
+            /* Append the text before the variable reference */
+            result = apr_pstrcat(p, result, apr_pstrndup(p, current, start - current), NULL);
+
+            /* Find the end of the variable reference */
+            start += 2; /* Skip the ${ */
+            end = strchr(start, '}');
+            if (!end) {
+                /* Malformed reference, just append the rest and stop */
+                result = apr_pstrcat(p, result, start - 2, NULL);
+                current = "";
+                break;
+            }
+
+            /* Extract the variable name */
+            char *var_name = apr_pstrndup(p, start, end - start);
+
+            /* Get the environment variable value */
+            char *env_value = NULL;
+            apr_env_get(&env_value, var_name, p);
+
+            /* Append the environment variable value or empty string if not found */
+            result = apr_pstrcat(p, result, env_value ? env_value : "", NULL);
+
+            /* Move past the closing brace */
+            current = end + 1;
         }
-        apr_file_close(file);
-        apr_pool_destroy(tmp_pool);
-        return rv;
-    }
-    
-    /* Check if the file has been modified since last load */
-    if (g_models_config->last_mtime == finfo.mtime) {
-        /* File hasn't changed, nothing to do */
-        apr_file_close(file);
-        apr_pool_destroy(tmp_pool);
-        return APR_SUCCESS;
-    }
-    
-    /* Parse the JSON file */
-    rv = apr_json_parse_file(&json_root, file, tmp_pool);
-    apr_file_close(file);
-    if (rv != APR_SUCCESS) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "mod_muse_ai: Failed to parse model config JSON file");
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, "mod_muse_ai: Failed to parse model config JSON file");
+
+        /* Append any remaining text */
+        if (*current) {
+            result = apr_pstrcat(p, result, current, NULL);
         }
-        apr_pool_destroy(tmp_pool);
-        return rv;
+
+        return result;
     }
-    
-    /* Validate that the root is an object */
-    if (json_root->type != APR_JSON_OBJECT) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, APR_EINVAL, r, "mod_muse_ai: Model config JSON root is not an object");
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, APR_EINVAL, NULL, "mod_muse_ai: Model config JSON root is not an object");
+
+    /* No environment variables to resolve */
+    return value;
+}
+
+/* Destroy retired snapshots whose last reference has been released. Called
+ * with the mutex held. */
+static void reclaim_model_snapshots(void) {
+    int current = (int)(apr_atomic_read64(&g_models_config->published) >> MUSE_AI_MODELS_SLOT_SHIFT);
+
+    for (int i = 0; i < MUSE_AI_MODELS_SNAPSHOTS; i++) {
+        muse_ai_models_snapshot *snapshot = g_models_config->snapshots[i];
+
+        if (i != current && snapshot && apr_atomic_read64(&snapshot->refs) == 0) {
+            g_models_config->snapshots[i] = NULL;
+            apr_pool_destroy(snapshot->pool);
         }
-        apr_pool_destroy(tmp_pool);
-        return APR_EINVAL;
     }
-    
-    /* Get the models array */
-    json_models = apr_json_object_get(json_root, "models", tmp_pool);
-    if (!json_models || json_models->type != APR_JSON_ARRAY) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, APR_EINVAL, r, "mod_muse_ai: Model config JSON does not contain a valid 'models' array");
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, APR_EINVAL, NULL, "mod_muse_ai: Model config JSON does not contain a valid 'models' array");
-        }
-        apr_pool_destroy(tmp_pool);
+}
+
+/* Make a snapshot the one new requests get, and retire the previous one.
+ * Called with the mutex held. */
+static void publish_model_snapshot(int slot, muse_ai_models_snapshot *snapshot) {
+    apr_uint64_t old;
+
+    g_models_config->snapshots[slot] = snapshot;
+    old = apr_atomic_xchg64(&g_models_config->published, (apr_uint64_t)slot << MUSE_AI_MODELS_SLOT_SHIFT);
+
+    /* Every reference taken through the old word is now counted by the
+     * retired snapshot itself */
+    apr_atomic_add64(&g_models_config->snapshots[old >> MUSE_AI_MODELS_SLOT_SHIFT]->refs,
+                     old & MUSE_AI_MODELS_REFS_MASK);
+}
+
+/* Build a snapshot from the parsed configuration file, in a pool of its own */
+static apr_status_t build_model_snapshot(const cJSON *json_root, request_rec *r,
+                                         muse_ai_models_snapshot **result) {
+    server_rec *s = r ? r->server : NULL;
+    const cJSON *json_models = cJSON_GetObjectItemCaseSensitive(json_root, "models");
+    const cJSON *json_default_model = cJSON_GetObjectItemCaseSensitive(json_root, "default_model");
+    muse_ai_models_snapshot *snapshot;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    if (!cJSON_IsArray(json_models)) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_EINVAL, s, "mod_muse_ai: Model config JSON does not contain a valid 'models' array");
         return APR_EINVAL;
     }
-    
-    /* Get the default model name */
-    json_default_model = apr_json_object_get(json_root, "default_model", tmp_pool);
-    if (!json_default_model || json_default_model->type != APR_JSON_STRING) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, APR_EINVAL, r, "mod_muse_ai: Model config JSON does not contain a valid 'default_model' string");
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, APR_EINVAL, NULL, "mod_muse_ai: Model config JSON does not contain a valid 'default_model' string");
-        }
-        apr_pool_destroy(tmp_pool);
+    if (!cJSON_IsString(json_default_model)) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_EINVAL, s, "mod_muse_ai: Model config JSON does not contain a valid 'default_model' string");
         return APR_EINVAL;
     }
-    
-    /* Create a new hash table for the models */
-    new_models = apr_hash_make(p);
-    if (!new_models) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, APR_ENOMEM, r, "mod_muse_ai: Failed to create hash table for model configuration");
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, APR_ENOMEM, NULL, "mod_muse_ai: Failed to create hash table for model configuration");
-        }
-        apr_pool_destroy(tmp_pool);
-        return APR_ENOMEM;
+
+    rv = apr_pool_create(&pool, g_config_pool);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, "mod_muse_ai: Failed to create memory pool for model configuration");
+        return rv;
     }
-    
+
+    snapshot = apr_pcalloc(pool, sizeof(muse_ai_models_snapshot));
+    snapshot->pool = pool;
+    snapshot->models = apr_hash_make(pool);
+
     /* Process each model in the array */
-    for (int i = 0; i < json_models->value.array->nelts; i++) {
-        apr_json_value_t *json_model = APR_ARRAY_IDX(json_models->value.array, i, apr_json_value_t*);
-        apr_json_value_t *json_name, *json_endpoint, *json_api_key, *json_model_name;
+    for (int i = 0; i < cJSON_GetArraySize(json_models); i++) {
+        const cJSON *json_model = cJSON_GetArrayItem(json_models, i);
+        const cJSON *json_name = cJSON_GetObjectItemCaseSensitive(json_model, "name");
+        const cJSON *json_endpoint = cJSON_GetObjectItemCaseSensitive(json_model, "endpoint");
+        const cJSON *json_api_key = cJSON_GetObjectItemCaseSensitive(json_model, "api_key");
+        const cJSON *json_model_name = cJSON_GetObjectItemCaseSensitive(json_model, "model");
         muse_ai_model_config *model_config;
-        
-        /* Validate that the model is an object */
-        if (json_model->type != APR_JSON_OBJECT) {
-            if (r) {
-                ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r, "mod_muse_ai: Skipping invalid model entry (not an object) at index %d", i);
-            } else {
-                ap_log_error(APLOG_MARK, APLOG_WARNING, 0, NULL, "mod_muse_ai: Skipping invalid model entry (not an object) at index %d", i);
-            }
-            continue;
-        }
-        
-        /* Get the required fields */
-        json_name = apr_json_object_get(json_model, "name", tmp_pool);
-        json_endpoint = apr_json_object_get(json_model, "endpoint", tmp_pool);
-        json_api_key = apr_json_object_get(json_model, "api_key", tmp_pool);
-        json_model_name = apr_json_object_get(json_model, "model", tmp_pool);
-        
+
         /* Validate the required fields */
-        if (!json_name || json_name->type != APR_JSON_STRING ||
-            !json_endpoint || json_endpoint->type != APR_JSON_STRING ||
-            !json_api_key || json_api_key->type != APR_JSON_STRING ||
-            !json_model_name || json_model_name->type != APR_JSON_STRING) {
-            if (r) {
-                ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r, "mod_muse_ai: Skipping invalid model entry (missing or invalid required fields) at index %d", i);
-            } else {
-                ap_log_error(APLOG_MARK, APLOG_WARNING, 0, NULL, "mod_muse_ai: Skipping invalid model entry (missing or invalid required fields) at index %d", i);
-            }
+        if (!cJSON_IsString(json_name) || !cJSON_IsString(json_endpoint) ||
+            !cJSON_IsString(json_api_key) || !cJSON_IsString(json_model_name)) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, "mod_muse_ai: Skipping invalid model entry (missing or invalid required fields) at index %d", i);
             continue;
         }
-        
-        /* Create a new model config */
-        model_config = apr_pcalloc(p, sizeof(muse_ai_model_config));
-        if (!model_config) {
-            if (r) {
-                ap_log_rerror(APLOG_MARK, APLOG_ERR, APR_ENOMEM, r, "mod_muse_ai: Failed to allocate memory for model configuration");
-            } else {
-                ap_log_error(APLOG_MARK, APLOG_ERR, APR_ENOMEM, NULL, "mod_muse_ai: Failed to allocate memory for model configuration");
-            }
-            apr_pool_destroy(tmp_pool);
-            return APR_ENOMEM;
-        }
-        
-        /* Set the model config fields */
-        model_config->name = apr_pstrdup(p, json_name->value.string.p);
-        model_config->endpoint = apr_pstrdup(p, json_endpoint->value.string.p);
-        model_config->api_key = apr_pstrdup(p, json_api_key->value.string.p);
-        model_config->model = apr_pstrdup(p, json_model_name->value.string.p);
-        
+
+        /* API keys are resolved here, once per load, not on every request */
+        model_config = apr_pcalloc(pool, sizeof(muse_ai_model_config));
+        model_config->name = apr_pstrdup(pool, json_name->valuestring);
+        model_config->endpoint = apr_pstrdup(pool, json_endpoint->valuestring);
+        model_config->api_key = resolve_env_vars(apr_pstrdup(pool, json_api_key->valuestring), pool);
+        model_config->model = apr_pstrdup(pool, json_model_name->valuestring);
+
         /* Add the model to the hash table */
-        apr_hash_set(new_models, model_config->name, APR_HASH_KEY_STRING, model_config);
-        
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "mod_muse_ai: Loaded model configuration for '%s'", model_config->name);
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, NULL, "mod_muse_ai: Loaded model configuration for '%s'", model_config->name);
-        }
+        apr_hash_set(snapshot->models, model_config->name, APR_HASH_KEY_STRING, model_config);
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, "mod_muse_ai: Loaded model configuration for '%s'", model_config->name);
     }
-    
-    /* Get the default model name */
-    default_model_name = apr_pstrdup(p, json_default_model->value.string.p);
-    
+
     /* Validate that the default model exists */
-    if (!apr_hash_get(new_models, default_model_name, APR_HASH_KEY_STRING)) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, APR_EINVAL, r, "mod_muse_ai: Default model '%s' not found in configuration", default_model_name);
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, APR_EINVAL, NULL, "mod_muse_ai: Default model '%s' not found in configuration", default_model_name);
-        }
-        apr_pool_destroy(tmp_pool);
+    snapshot->default_model = apr_pstrdup(pool, json_default_model->valuestring);
+    if (!apr_hash_get(snapshot->models, snapshot->default_model, APR_HASH_KEY_STRING)) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_EINVAL, s, "mod_muse_ai: Default model '%s' not found in configuration", snapshot->default_model);
+        apr_pool_destroy(pool);
         return APR_EINVAL;
     }
-    
-    /* Lock the mutex for the update */
+
+    *result = snapshot;
+    return APR_SUCCESS;
+}
+
+/* A failed load only matters while nothing has been loaded. Called with the
+ * mutex held. */
+static void model_config_failed(void) {
+    if (g_models_config->state != MUSE_AI_MODELS_LOADED) {
+        apr_atomic_set32(&g_models_config->state, MUSE_AI_MODELS_FAILED);
+    }
+}
+
+/* Get the load state of models.json */
+muse_ai_models_state get_model_config_state(void) {
+    if (!g_models_config) {
+        return MUSE_AI_MODELS_DIRECTIVES;
+    }
+    return (muse_ai_models_state)apr_atomic_read32(&g_models_config->state);
+}
+
+/* Load model configuration from JSON file */
+apr_status_t load_model_config(apr_pool_t *p, request_rec *r) {
+    server_rec *s = r ? r->server : NULL;
+    muse_ai_models_snapshot *snapshot = NULL;
+    apr_finfo_t finfo;
+    apr_status_t rv;
+    cJSON *json_root;
+    char *content;
+    int slot = -1;
+
+    /* Only one reload at a time; requests never wait for this mutex */
     rv = apr_thread_mutex_lock(g_models_config->mutex);
     if (rv != APR_SUCCESS) {
-        if (r) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, "mod_muse_ai: Failed to lock mutex for model configuration update");
-        } else {
-            ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, "mod_muse_ai: Failed to lock mutex for model configuration update");
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, "mod_muse_ai: Failed to lock mutex for model configuration update");
+        return rv;
+    }
+
+    reclaim_model_snapshots();
+
+    /* Check if the file has been modified since last load */
+    rv = apr_stat(&finfo, g_config_file_path, APR_FINFO_MTIME, p);
+    if (APR_STATUS_IS_ENOENT(rv)) {
+        /* No models file: requests use MuseAiEndpoint and MuseAiModel */
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, s, "mod_muse_ai: No model config file at %s", g_config_file_path);
+        if (g_models_config->state == MUSE_AI_MODELS_FAILED) {
+            apr_atomic_set32(&g_models_config->state, MUSE_AI_MODELS_DIRECTIVES);
         }
-        apr_pool_destroy(tmp_pool);
+        apr_thread_mutex_unlock(g_models_config->mutex);
+        return APR_SUCCESS;
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, "mod_muse_ai: Failed to get file info for model config file: %s", g_config_file_path);
+        model_config_failed();
+        apr_thread_mutex_unlock(g_models_config->mutex);
         return rv;
     }
-    
-    /* Update the configuration */
-    g_models_config->models = new_models;
-    g_models_config->default_model = default_model_name;
-    g_models_config->last_mtime = finfo.mtime;
-    
-    /* Unlock the mutex */
-    apr_thread_mutex_unlock(g_models_config->mutex);
-    
-    if (r) {
-        ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r, "mod_muse_ai: Successfully loaded model configuration with %d models", apr_hash_count(new_models));
+    if (g_models_config->last_mtime == finfo.mtime) {
+        /* File hasn't changed, nothing to do */
+        apr_thread_mutex_unlock(g_models_config->mutex);
+        return APR_SUCCESS;
+    }
+
+    /* A free slot for the new snapshot; while every one is taken by a
+     * snapshot still in use the reload waits for the next check */
+    for (int i = 0; i < MUSE_AI_MODELS_SNAPSHOTS && slot < 0; i++) {
+        if (!g_models_config->snapshots[i]) {
+            slot = i;
+        }
+    }
+    if (slot < 0) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, "mod_muse_ai: Model configuration not reloaded yet, older configurations are still in use");
+        apr_thread_mutex_unlock(g_models_config->mutex);
+        return APR_SUCCESS;
+    }
+
+    /* Parse the JSON file */
+    content = read_file_contents(p, g_config_file_path);
+    json_root = content ? cJSON_Parse(content) : NULL;
+    if (!cJSON_IsObject(json_root)) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_EINVAL, s, "mod_muse_ai: Failed to parse model config JSON file: %s", g_config_file_path);
+        cJSON_Delete(json_root);
+        model_config_failed();
+        apr_thread_mutex_unlock(g_models_config->mutex);
+        return APR_EINVAL;
+    }
+
+    rv = build_model_snapshot(json_root, r, &snapshot);
+    cJSON_Delete(json_root);
+    if (rv == APR_SUCCESS) {
+        publish_model_snapshot(slot, snapshot);
+        g_models_config->last_mtime = finfo.mtime;
+        apr_atomic_set32(&g_models_config->state, MUSE_AI_MODELS_LOADED);
+        ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, "mod_muse_ai: Successfully loaded model configuration with %d models", apr_hash_count(snapshot->models));
     } else {
-        ap_log_error(APLOG_MARK, APLOG_INFO, 0, NULL, "mod_muse_ai: Successfully loaded model configuration with %d models", apr_hash_count(new_models));
+        model_config_failed();
     }
-    
-    apr_pool_destroy(tmp_pool);
-    return APR_SUCCESS;
+
+    apr_thread_mutex_unlock(g_models_config->mutex);
+    return rv;
 }
 
 /* Initialize the model configuration system */
 apr_status_t init_model_config(apr_pool_t *p) {
+    apr_pool_t *empty_pool, *tmp_pool;
     apr_status_t rv;
-    
+
     /* Create a subpool for configuration */
     rv = apr_pool_create(&g_config_pool, p);
     if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, 
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL,
                     "mod_muse_ai: Failed to create memory pool for model configuration");
         return rv;
     }
-    
-    /* Set the config file path */
-    g_config_file_path = apr_pstrdup(g_config_pool, "models.json");
-    
+
+    /* Set the config file path, next to the server configuration */
+    g_config_file_path = ap_server_root_relative(g_config_pool, "models.json");
+    if (!g_config_file_path) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_EBADPATH, NULL,
+                    "mod_muse_ai: Invalid path for model config file: models.json");
+        return APR_EBADPATH;
+    }
+
     /* Create the models configuration structure */
     g_models_config = apr_pcalloc(g_config_pool, sizeof(muse_ai_models_config));
-    if (!g_models_config) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, APR_ENOMEM, NULL, 
-                    "mod_muse_ai: Failed to allocate memory for model configuration");
-        return APR_ENOMEM;
-    }
-    
+
     /* Create the mutex */
     rv = apr_thread_mutex_create(&g_models_config->mutex, APR_THREAD_MUTEX_DEFAULT, g_config_pool);
     if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL, 
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL,
                     "mod_muse_ai: Failed to create mutex for model configuration");
         return rv;
     }
-    
-    /* Create the models hash table */
-    g_models_config->models = apr_hash_make(g_config_pool);
-    if (!g_models_config->models) {
-        ap_log_error(APLOG_MARK, APLOG_ERR, APR_ENOMEM, NULL, 
-                    "mod_muse_ai: Failed to create hash table for model configuration");
-        return APR_ENOMEM;
+
+    /* An empty snapshot is published until the file has been loaded */
+    rv = apr_pool_create(&empty_pool, g_config_pool);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, NULL,
+                    "mod_muse_ai: Failed to create memory pool for model configuration");
+        return rv;
     }
-    
+    g_models_config->snapshots[0] = apr_pcalloc(empty_pool, sizeof(muse_ai_models_snapshot));
+    g_models_config->snapshots[0]->pool = empty_pool;
+    g_models_config->snapshots[0]->models = apr_hash_make(empty_pool);
+
     /* Load the initial configuration */
-    rv = load_model_config(g_config_pool, NULL);
+    rv = apr_pool_create(&tmp_pool, p);
+    if (rv == APR_SUCCESS) {
+        rv = load_model_config(tmp_pool, NULL);
+        apr_pool_destroy(tmp_pool);
+    }
     if (rv != APR_SUCCESS) {
-        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, NULL, 
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, NULL,
                     "mod_muse_ai: Failed to load initial model configuration, will retry later");
         /* Continue anyway, we'll retry later */
     }
-    
+
     return APR_SUCCESS;
 }
@@ -15,14 +15,47 @@ typedef struct {
     const char *model;         /* Model identifier for the API */
 } muse_ai_model_config;
 
+/* Where requests get their model configuration from */
+typedef enum {
+    MUSE_AI_MODELS_DIRECTIVES = 0,  /* No models.json: MuseAiEndpoint and MuseAiModel */
+    MUSE_AI_MODELS_LOADED,          /* models.json has been loaded */
+    MUSE_AI_MODELS_FAILED           /* models.json exists but has never loaded */
+} muse_ai_models_state;
+
+/* Published plus retired snapshots that can exist at the same time */
+#define MUSE_AI_MODELS_SNAPSHOTS 8
+
+/* The published word: snapshot slot in the top bits, references taken from
+ * it while published in the rest */
+#define MUSE_AI_MODELS_SLOT_SHIFT 48
+#define MUSE_AI_MODELS_REFS_MASK ((APR_UINT64_C(1) << MUSE_AI_MODELS_SLOT_SHIFT) - 1)
+
 /**
- * Structure representing the global model configuration
+ * An immutable set of model configurations, API keys already resolved.
+ * A snapshot is never changed after it is published: a reload builds a new
+ * one in a pool of its own and swaps it in, and the old one is destroyed
+ * once no request that took it is still running.
  */
 typedef struct {
+    apr_pool_t *pool;             /* Owns the snapshot and everything it points to */
     apr_hash_t *models;           /* Hash table of model configurations */
-    const char *default_model;     /* Name of the default model */
+    const char *default_model;     /* Name of the default model, NULL before the first load */
+    volatile apr_uint64_t refs;   /* References held; counts down from zero while published */
+} muse_ai_models_snapshot;
+
+/**
+ * Structure representing the global model configuration. A request takes a
+ * reference by adding one to the published word, which names the snapshot,
+ * so lookups need no lock. When a snapshot is replaced the references taken
+ * through the word are moved to its refs counter, which the releases have
+ * been counting down, and it is destroyed when that reaches zero.
+ */
+typedef struct {
+    volatile apr_uint64_t published;  /* slot << MUSE_AI_MODELS_SLOT_SHIFT | references taken */
+    muse_ai_models_snapshot *snapshots[MUSE_AI_MODELS_SNAPSHOTS]; /* NULL = free slot */
     apr_time_t last_mtime;        /* Last modification time of the config file */
-    apr_thread_mutex_t *mutex;    /* Mutex for thread-safe access */
+    volatile apr_uint32_t state;  /* muse_ai_models_state */
+    apr_thread_mutex_t *mutex;    /* Serializes reloads; readers never take it */
 } muse_ai_models_config;
 
 /**
@@ -60,6 +93,23 @@ const muse_ai_model_config *get_default_model_config(request_rec *r);
  */
 const muse_ai_model_config *get_request_model_config(request_rec *r);
 
+/**
+ * Get the load state of models.json. A failed reload keeps the configuration
+ * loaded before it in use, so the state only becomes MUSE_AI_MODELS_FAILED
+ * when no load has succeeded yet.
+ * @return The current muse_ai_models_state
+ */
+muse_ai_models_state get_model_config_state(void);
+
+/**
+ * Load the configuration file into a new snapshot if it has changed, and
+ * destroy retired snapshots no request holds any more
+ * @param p Pool for parsing, cleared by the caller
+ * @param r The current request (for logging), or NULL
+ * @return APR_SUCCESS on success, error code on failure
+ */
+apr_status_t load_model_config(apr_pool_t *p, request_rec *r);
+
 /**
  * Reload the model configuration if the file has changed
  * @param r The current request (for logging)
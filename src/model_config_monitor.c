@@ -5,8 +5,6 @@
 #include "httpd.h"
 #include "http_log.h"
 
-extern apr_status_t load_model_config(apr_pool_t *p, request_rec *r);
-
 /* Background thread function for monitoring the model configuration file */
 void *APR_THREAD_FUNC model_config_monitor(apr_thread_t *thd, void *data) {
     apr_pool_t *pool;
@@ -26,12 +24,14 @@ void *APR_THREAD_FUNC model_config_monitor(apr_thread_t *thd, void *data) {
     
     /* Monitor loop */
     while (!*stop_flag) {
-        /* Check if the config file has changed */
+        /* Check if the config file has changed; this also destroys the
+         * replaced configurations no request uses any more */
         rv = load_model_config(pool, NULL);
         if (rv != APR_SUCCESS) {
             ap_log_error(APLOG_MARK, APLOG_WARNING, rv, NULL, 
                         "mod_muse_ai: Failed to reload model configuration");
         }
+        apr_pool_clear(pool);
         
         /* Sleep for 5 seconds */
         apr_sleep(5 * 1000000);
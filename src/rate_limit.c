@@ -0,0 +1,404 @@
+/* Per-client token bucket rate limiting in shared memory */
+#include "rate_limit.h"
+#include "utils.h"
+#include <apr_strings.h>
+#include <apr_atomic.h>
+#include <apr_shm.h>
+#include <apr_network_io.h>
+#include <http_log.h>
+#include <http_protocol.h>
+
+/*
+ * The table is a fixed-size open-addressing hash shared by every child.
+ * Each slot holds the hashed client address and a packed bucket word, both
+ * updated with 64-bit compare-and-swap, so no lock is ever taken:
+ *
+ *   bucket = (last refill in ms since table epoch + 1) << 24 | millitokens
+ *
+ * A zero bucket means "never used" and is treated as a full bucket.
+ *
+ * A second region of the same size holds token budgets, one fixed window
+ * per client and per virtual host:
+ *
+ *   budget = (window number + 1) << 40 | generated tokens in that window
+ */
+#define BUCKET_TOKEN_BITS 24
+#define BUCKET_TOKEN_MASK ((APR_UINT64_C(1) << BUCKET_TOKEN_BITS) - 1)
+#define BUCKET_PACK(ms, millitokens) ((((apr_uint64_t)(ms) + 1) << BUCKET_TOKEN_BITS) | (apr_uint64_t)(millitokens))
+#define BUCKET_TIME(b) (((b) >> BUCKET_TOKEN_BITS) - 1)
+#define BUCKET_TOKENS(b) ((b) & BUCKET_TOKEN_MASK)
+
+#define BUDGET_TOKEN_BITS 40
+#define BUDGET_TOKEN_MASK ((APR_UINT64_C(1) << BUDGET_TOKEN_BITS) - 1)
+#define BUDGET_PACK(window, tokens) ((((apr_uint64_t)(window) + 1) << BUDGET_TOKEN_BITS) | ((apr_uint64_t)(tokens) & BUDGET_TOKEN_MASK))
+#define BUDGET_WINDOW(b) (((b) >> BUDGET_TOKEN_BITS) - 1)
+#define BUDGET_TOKENS(b) ((b) & BUDGET_TOKEN_MASK)
+
+typedef struct {
+    volatile apr_uint64_t key;      /* Hashed client address, 0 = empty */
+    volatile apr_uint64_t value;    /* Packed bucket or budget word */
+} rate_limit_slot_t;
+
+typedef struct {
+    apr_time_t epoch;
+    apr_uint32_t mask;
+    rate_limit_slot_t slots[];      /* Request buckets, then token budgets */
+} rate_limit_table_t;
+
+/* Decides whether an occupied slot may be handed to another key */
+typedef int (*slot_stale_fn)(apr_uint64_t value, apr_uint64_t now, apr_uint64_t limit);
+
+static apr_shm_t *rate_limit_shm = NULL;
+static rate_limit_table_t *rate_limit_table = NULL;
+
+/* FNV-1a, never returning the empty-slot marker */
+static apr_uint64_t hash_key(const char *ip)
+{
+    apr_uint64_t h = muse_hash64(ip, strlen(ip));
+
+    return h ? h : 1;
+}
+
+static apr_status_t rate_limiter_cleanup(void *data)
+{
+    (void)data;
+    if (rate_limit_shm) {
+        apr_shm_destroy(rate_limit_shm);
+        rate_limit_shm = NULL;
+    }
+    rate_limit_table = NULL;
+    return APR_SUCCESS;
+}
+
+apr_status_t init_rate_limiter(apr_pool_t *pconf, server_rec *s)
+{
+    extern module muse_ai_module;
+    apr_size_t size = sizeof(rate_limit_table_t) + 2 * MUSE_AI_RATELIMIT_SLOTS * sizeof(rate_limit_slot_t);
+    apr_status_t rv;
+    server_rec *sv;
+    int needed = 0;
+
+    /* Only pay for the table when some server limits requests or tokens */
+    for (sv = s; sv; sv = sv->next) {
+        advanced_muse_ai_config *cfg = ap_get_module_config(sv->module_config, &muse_ai_module);
+        if (cfg && (cfg->ratelimit_enable > 0 || cfg->token_budget_client > 0 || cfg->token_budget_vhost > 0)) {
+            needed = 1;
+            break;
+        }
+    }
+    if (!needed) {
+        return APR_SUCCESS;
+    }
+
+    /* Anonymous shared memory is inherited by every forked child */
+    rv = apr_shm_create(&rate_limit_shm, size, NULL, pconf);
+    if (APR_STATUS_IS_ENOTIMPL(rv)) {
+        const char *fname = ap_runtime_dir_relative(pconf, "muse_ai_ratelimit.shm");
+        apr_shm_remove(fname, pconf);
+        rv = apr_shm_create(&rate_limit_shm, size, fname, pconf);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s,
+                    "[mod_muse_ai] Failed to create rate limit shared memory (%" APR_SIZE_T_FMT " bytes)", size);
+        rate_limit_shm = NULL;
+        return rv;
+    }
+
+    rate_limit_table = apr_shm_baseaddr_get(rate_limit_shm);
+    memset(rate_limit_table, 0, size);
+    rate_limit_table->epoch = apr_time_now();
+    rate_limit_table->mask = MUSE_AI_RATELIMIT_SLOTS - 1;
+
+    apr_pool_cleanup_register(pconf, NULL, rate_limiter_cleanup, apr_pool_cleanup_null);
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s,
+                "[mod_muse_ai] Rate limiter initialized with %d shared slots per table", MUSE_AI_RATELIMIT_SLOTS);
+
+    return APR_SUCCESS;
+}
+
+const char *rate_limit_add_whitelist(apr_pool_t *pool, apr_array_header_t **list, const char *arg)
+{
+    char *entries = apr_pstrdup(pool, arg);
+    char *last;
+    char *entry;
+
+    if (!*list) {
+        *list = apr_array_make(pool, 4, sizeof(apr_ipsubnet_t *));
+    }
+
+    for (entry = apr_strtok(entries, ", \t", &last); entry; entry = apr_strtok(NULL, ", \t", &last)) {
+        apr_ipsubnet_t *subnet;
+        char *mask = strchr(entry, '/');
+        apr_status_t rv;
+
+        if (mask) {
+            *mask++ = '\0';
+        }
+
+        rv = apr_ipsubnet_create(&subnet, entry, mask, pool);
+        if (rv != APR_SUCCESS) {
+            return apr_psprintf(pool, "MuseAiRateLimitWhitelistIPs: '%s' is not a valid IP address or CIDR range", arg);
+        }
+
+        APR_ARRAY_PUSH(*list, apr_ipsubnet_t *) = subnet;
+    }
+
+    return NULL;
+}
+
+static int client_whitelisted(request_rec *r, advanced_muse_ai_config *cfg)
+{
+    if (!cfg->ratelimit_whitelist_ips || !r->useragent_addr) {
+        return 0;
+    }
+
+    for (int i = 0; i < cfg->ratelimit_whitelist_ips->nelts; i++) {
+        apr_ipsubnet_t *subnet = APR_ARRAY_IDX(cfg->ratelimit_whitelist_ips, i, apr_ipsubnet_t *);
+        if (apr_ipsubnet_test(subnet, r->useragent_addr)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* A bucket that has refilled completely looks exactly like a new client */
+static int bucket_is_stale(apr_uint64_t value, apr_uint64_t now_ms, apr_uint64_t refill_ms)
+{
+    return value == 0 || now_ms - BUCKET_TIME(value) >= refill_ms;
+}
+
+/* A budget from an earlier window has nothing left to enforce */
+static int budget_is_stale(apr_uint64_t value, apr_uint64_t window, apr_uint64_t unused)
+{
+    (void)unused;
+    return value == 0 || BUDGET_WINDOW(value) != window;
+}
+
+/* Find or claim the slot for a key within a short probe window. When the
+ * window is full, a stale slot (see the predicates above) is recycled. */
+static rate_limit_slot_t *find_slot(rate_limit_slot_t *slots, apr_uint64_t key,
+                                    slot_stale_fn is_stale, apr_uint64_t now, apr_uint64_t limit)
+{
+    apr_uint32_t start = (apr_uint32_t)key & rate_limit_table->mask;
+
+    for (int i = 0; i < MUSE_AI_RATELIMIT_MAX_PROBE; i++) {
+        rate_limit_slot_t *slot = &slots[(start + i) & rate_limit_table->mask];
+        apr_uint64_t current = apr_atomic_read64(&slot->key);
+
+        if (current == key) {
+            return slot;
+        }
+        if (current == 0) {
+            current = apr_atomic_cas64(&slot->key, key, 0);
+            if (current == 0 || current == key) {
+                return slot;
+            }
+        }
+    }
+
+    for (int i = 0; i < MUSE_AI_RATELIMIT_MAX_PROBE; i++) {
+        rate_limit_slot_t *slot = &slots[(start + i) & rate_limit_table->mask];
+        apr_uint64_t current = apr_atomic_read64(&slot->key);
+
+        if (is_stale(apr_atomic_read64(&slot->value), now, limit)) {
+            if (apr_atomic_cas64(&slot->key, key, current) == current) {
+                apr_atomic_set64(&slot->value, 0);
+                return slot;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static rate_limit_slot_t *budget_slots(void)
+{
+    return rate_limit_table->slots + MUSE_AI_RATELIMIT_SLOTS;
+}
+
+static apr_uint64_t vhost_key(request_rec *r)
+{
+    return hash_key(apr_psprintf(r->pool, "vhost:%s:%u",
+                                 r->server->server_hostname ? r->server->server_hostname : "",
+                                 (unsigned)r->server->port));
+}
+
+static apr_uint64_t current_window(advanced_muse_ai_config *cfg)
+{
+    apr_uint64_t window_sec = cfg->token_budget_window > 0 ? (apr_uint64_t)cfg->token_budget_window
+                                                           : MUSE_AI_TOKEN_BUDGET_DEFAULT_WINDOW;
+    return (apr_uint64_t)apr_time_sec(apr_time_now() - rate_limit_table->epoch) / window_sec;
+}
+
+/* Seconds until the current budget window ends */
+static apr_uint64_t window_remaining(advanced_muse_ai_config *cfg)
+{
+    apr_uint64_t window_sec = cfg->token_budget_window > 0 ? (apr_uint64_t)cfg->token_budget_window
+                                                           : MUSE_AI_TOKEN_BUDGET_DEFAULT_WINDOW;
+    apr_uint64_t elapsed = (apr_uint64_t)apr_time_sec(apr_time_now() - rate_limit_table->epoch);
+    return window_sec - elapsed % window_sec;
+}
+
+/* Has the key already used up its budget in this window? */
+static int budget_exhausted(apr_uint64_t key, apr_uint64_t window, apr_uint64_t budget)
+{
+    rate_limit_slot_t *slot = find_slot(budget_slots(), key, budget_is_stale, window, 0);
+    apr_uint64_t value;
+
+    if (!slot) {
+        return 0;
+    }
+
+    value = apr_atomic_read64(&slot->value);
+    return value != 0 && BUDGET_WINDOW(value) == window && BUDGET_TOKENS(value) >= budget;
+}
+
+static void budget_charge(apr_uint64_t key, apr_uint64_t window, apr_uint64_t tokens)
+{
+    rate_limit_slot_t *slot = find_slot(budget_slots(), key, budget_is_stale, window, 0);
+
+    if (!slot) {
+        return;
+    }
+
+    while (1) {
+        apr_uint64_t old = apr_atomic_read64(&slot->value);
+        apr_uint64_t used = (old != 0 && BUDGET_WINDOW(old) == window) ? BUDGET_TOKENS(old) : 0;
+
+        if (apr_atomic_cas64(&slot->value, BUDGET_PACK(window, used + tokens), old) == old) {
+            return;
+        }
+    }
+}
+
+static int reject_over_budget(request_rec *r, advanced_muse_ai_config *cfg, const char *scope)
+{
+    apr_uint64_t retry_after = window_remaining(cfg);
+
+    apr_table_setn(r->err_headers_out, "Retry-After",
+                   apr_psprintf(r->pool, "%" APR_UINT64_T_FMT, retry_after));
+    update_ratelimit_metrics(1);
+    ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r,
+                 "[mod_muse_ai] Token budget exhausted for %s %s (retry after %" APR_UINT64_T_FMT "s)",
+                 scope, strcmp(scope, "client") == 0 ? r->useragent_ip : r->server->server_hostname,
+                 retry_after);
+    return HTTP_TOO_MANY_REQUESTS;
+}
+
+/* Per-minute request bucket for one client */
+static int take_request_token(request_rec *r, advanced_muse_ai_config *cfg)
+{
+    apr_uint64_t rpm, capacity, refill_ms, now_ms;
+    rate_limit_slot_t *slot;
+
+    rpm = cfg->ratelimit_requests_per_minute > 0 ? (apr_uint64_t)cfg->ratelimit_requests_per_minute
+                                                  : MUSE_AI_RATELIMIT_DEFAULT_RPM;
+    capacity = (apr_uint64_t)(cfg->ratelimit_burst_size > 0 ? cfg->ratelimit_burst_size
+                                                             : MUSE_AI_RATELIMIT_DEFAULT_BURST) * 1000;
+    /* Time for an empty bucket to refill completely */
+    refill_ms = capacity * 60 / rpm + 1;
+
+    now_ms = (apr_uint64_t)apr_time_as_msec(apr_time_now() - rate_limit_table->epoch);
+
+    slot = find_slot(rate_limit_table->slots, hash_key(r->useragent_ip), bucket_is_stale, now_ms, refill_ms);
+    if (!slot) {
+        /* Table neighbourhood saturated with active clients: fail open */
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
+                     "[mod_muse_ai] Rate limit table full, not limiting %s", r->useragent_ip);
+        return OK;
+    }
+
+    while (1) {
+        apr_uint64_t old = apr_atomic_read64(&slot->value);
+        apr_uint64_t tokens, last_ms;
+
+        if (old == 0) {
+            tokens = capacity;
+            last_ms = now_ms;
+        } else {
+            last_ms = BUCKET_TIME(old);
+            tokens = BUCKET_TOKENS(old);
+            if (now_ms > last_ms) {
+                apr_uint64_t elapsed = now_ms - last_ms;
+                /* rpm tokens per minute = rpm millitokens per 60 ms */
+                tokens = elapsed >= refill_ms ? capacity : tokens + elapsed * rpm / 60;
+                if (tokens > capacity) {
+                    tokens = capacity;
+                }
+            }
+        }
+
+        if (tokens < 1000) {
+            /* Not enough for one request: report when the next token lands */
+            apr_uint64_t wait_ms = (1000 - tokens) * 60 / rpm + 1;
+            apr_uint64_t retry_after = (wait_ms + 999) / 1000;
+
+            apr_table_setn(r->err_headers_out, "Retry-After",
+                           apr_psprintf(r->pool, "%" APR_UINT64_T_FMT, retry_after));
+            update_ratelimit_metrics(1);
+            ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r,
+                         "[mod_muse_ai] Rate limit exceeded for %s (retry after %" APR_UINT64_T_FMT "s)",
+                         r->useragent_ip, retry_after);
+            return HTTP_TOO_MANY_REQUESTS;
+        }
+
+        if (apr_atomic_cas64(&slot->value,
+                             BUCKET_PACK(now_ms > last_ms ? now_ms : last_ms, tokens - 1000),
+                             old) == old) {
+            return OK;
+        }
+        /* Another request for the same client won the race; recompute */
+    }
+}
+
+int check_rate_limit(request_rec *r, advanced_muse_ai_config *cfg)
+{
+    int whitelisted;
+
+    if (!cfg || !rate_limit_table || !r->useragent_ip) {
+        return OK;
+    }
+
+    whitelisted = client_whitelisted(r, cfg);
+
+    /* Token budgets: refuse new work once a window's budget is spent */
+    if (cfg->token_budget_client > 0 || cfg->token_budget_vhost > 0) {
+        apr_uint64_t window = current_window(cfg);
+
+        if (cfg->token_budget_vhost > 0 &&
+            budget_exhausted(vhost_key(r), window, (apr_uint64_t)cfg->token_budget_vhost)) {
+            return reject_over_budget(r, cfg, "vhost");
+        }
+        if (!whitelisted && cfg->token_budget_client > 0 &&
+            budget_exhausted(hash_key(r->useragent_ip), window, (apr_uint64_t)cfg->token_budget_client)) {
+            return reject_over_budget(r, cfg, "client");
+        }
+    }
+
+    if (cfg->ratelimit_enable > 0 && !whitelisted) {
+        return take_request_token(r, cfg);
+    }
+
+    return OK;
+}
+
+void rate_limit_charge_tokens(request_rec *r, advanced_muse_ai_config *cfg, apr_uint32_t tokens)
+{
+    apr_uint64_t window;
+
+    if (!cfg || !rate_limit_table || tokens == 0 ||
+        (cfg->token_budget_client <= 0 && cfg->token_budget_vhost <= 0)) {
+        return;
+    }
+
+    window = current_window(cfg);
+
+    if (cfg->token_budget_vhost > 0) {
+        budget_charge(vhost_key(r), window, tokens);
+    }
+    if (cfg->token_budget_client > 0 && r->useragent_ip && !client_whitelisted(r, cfg)) {
+        budget_charge(hash_key(r->useragent_ip), window, tokens);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <httpd.h>
+#include <http_config.h>
+#include <apr_pools.h>
+
+#include "advanced_config.h"
+
+/* Rate limiting defaults */
+#define MUSE_AI_RATELIMIT_DEFAULT_RPM 60
+#define MUSE_AI_RATELIMIT_DEFAULT_BURST 10
+#define MUSE_AI_RATELIMIT_MAX_BURST 10000
+#define MUSE_AI_TOKEN_BUDGET_DEFAULT_WINDOW 3600  /* seconds */
+
+/* Shared table geometry: slots must be a power of two */
+#define MUSE_AI_RATELIMIT_SLOTS 16384
+#define MUSE_AI_RATELIMIT_MAX_PROBE 16
+
+/* Function declarations */
+
+/* Create the shared-memory bucket table. Called from post_config so that
+ * every child process inherits the same mapping. */
+apr_status_t init_rate_limiter(apr_pool_t *pconf, server_rec *s);
+
+/* Parse a whitelist argument ("10.0.0.0/8", "127.0.0.1,::1", ...) into
+ * apr_ipsubnet_t entries appended to *list. Returns an error string or NULL. */
+const char *rate_limit_add_whitelist(apr_pool_t *pool, apr_array_header_t **list, const char *arg);
+
+/* Admission check before any backend work: token budgets of the client and
+ * the virtual host, then the client's request bucket.
+ * Returns OK, or HTTP_TOO_MANY_REQUESTS with Retry-After already set. */
+int check_rate_limit(request_rec *r, advanced_muse_ai_config *cfg);
+
+/* Charge generated tokens against the client and vhost budgets */
+void rate_limit_charge_tokens(request_rec *r, advanced_muse_ai_config *cfg, apr_uint32_t tokens);
+
+#endif /* RATE_LIMIT_H */
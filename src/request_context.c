@@ -0,0 +1,280 @@
+/* Per-request context, token accounting and phase timing helpers */
+#include "request_context.h"
+#include "advanced_config.h"
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern module AP_MODULE_DECLARE_DATA muse_ai_module;
+
+muse_ai_request_ctx_t *muse_ai_request_ctx(request_rec *r)
+{
+    muse_ai_request_ctx_t *ctx = ap_get_module_config(r->request_config, &muse_ai_module);
+
+    if (!ctx) {
+        ctx = apr_pcalloc(r->pool, sizeof(muse_ai_request_ctx_t));
+        ap_set_module_config(r->request_config, &muse_ai_module, ctx);
+    }
+
+    return ctx;
+}
+
+/* Find "name": <number> after the usage key */
+static int read_usage_field(const char *usage, const char *name, apr_uint32_t *value)
+{
+    const char *p = strstr(usage, name);
+    char *end;
+    unsigned long n;
+
+    if (!p) {
+        return 0;
+    }
+
+    p += strlen(name);
+    while (*p == ' ' || *p == '\t' || *p == ':' || *p == '"') {
+        p++;
+    }
+
+    n = strtoul(p, &end, 10);
+    if (end == p) {
+        return 0;
+    }
+
+    *value = (apr_uint32_t)n;
+    return 1;
+}
+
+int muse_ai_parse_usage(muse_ai_request_ctx_t *ctx, const char *json)
+{
+    const char *usage;
+    apr_uint32_t completion = 0;
+
+    if (!ctx || !json || !(usage = strstr(json, "\"usage\""))) {
+        return 0;
+    }
+
+    /* Streaming servers send "usage": null on every chunk but the last */
+    if (!read_usage_field(usage, "\"completion_tokens\"", &completion)) {
+        return 0;
+    }
+
+    read_usage_field(usage, "\"prompt_tokens\"", &ctx->prompt_tokens);
+    ctx->completion_tokens = completion;
+    ctx->tokens_from_usage = 1;
+    return 1;
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = (char)(c | 0x20);
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+/* Percent-decode [s, end) in place and NUL-terminate it; '+' is a space */
+static void form_decode(char *s, char *end)
+{
+    char *out = s;
+
+    for (; s < end; s++) {
+        int hi, lo;
+
+        if (*s == '+') {
+            *out++ = ' ';
+        } else if (*s == '%' && end - s > 2 && (hi = hex_value(s[1])) >= 0 && (lo = hex_value(s[2])) >= 0) {
+            *out++ = (char)(hi << 4 | lo);
+            s += 2;
+        } else {
+            *out++ = *s;
+        }
+    }
+    *out = '\0';
+}
+
+/* Split "a=1&b=2" into name/value pairs, decoding each part */
+static void split_query(apr_pool_t *pool, const char *args, muse_ai_params_t *params)
+{
+    char *p = apr_pstrdup(pool, args);
+
+    params->parsed = 1;
+    while (*p && params->count < MUSE_AI_MAX_PARAMS) {
+        char *end = p + strcspn(p, "&");
+        char *eq = memchr(p, '=', (apr_size_t)(end - p));
+        char *next = *end ? end + 1 : end;
+        muse_ai_param_t *param;
+
+        if (end == p) {
+            p = next;
+            continue;
+        }
+
+        param = &params->items[params->count++];
+        if (eq) {
+            form_decode(eq + 1, end);
+            form_decode(p, eq);
+            param->value = eq + 1;
+        } else {
+            form_decode(p, end);
+            param->value = "";
+        }
+        param->name = p;
+        p = next;
+    }
+}
+
+/* Split "a=1; b=2" into name/value pairs with surrounding blanks removed */
+static void split_cookies(apr_pool_t *pool, const char *header, muse_ai_params_t *params)
+{
+    char *p = apr_pstrdup(pool, header);
+
+    params->parsed = 1;
+    while (*p && params->count < MUSE_AI_MAX_PARAMS) {
+        char *end = p + strcspn(p, ";");
+        char *next = *end ? end + 1 : end;
+        char *eq = memchr(p, '=', (apr_size_t)(end - p));
+        char *name_end, *value;
+
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if (!eq || eq == p) {
+            p = next;
+            continue;
+        }
+
+        name_end = eq;
+        while (name_end > p && (name_end[-1] == ' ' || name_end[-1] == '\t')) {
+            name_end--;
+        }
+        value = eq + 1;
+        while (value < end && (*value == ' ' || *value == '\t')) {
+            value++;
+        }
+        while (end > value && (end[-1] == ' ' || end[-1] == '\t')) {
+            end--;
+        }
+        *name_end = '\0';
+        *end = '\0';
+
+        params->items[params->count].name = p;
+        params->items[params->count].value = value;
+        params->count++;
+        p = next;
+    }
+}
+
+static const char *find_param(const muse_ai_params_t *params, const char *name)
+{
+    for (int i = 0; i < params->count; i++) {
+        if (strcmp(params->items[i].name, name) == 0) {
+            return params->items[i].value;
+        }
+    }
+    return NULL;
+}
+
+const char *muse_ai_query_param(request_rec *r, const char *name)
+{
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+
+    if (!ctx->query.parsed) {
+        if (!r->args) {
+            return NULL;
+        }
+        split_query(r->pool, r->args, &ctx->query);
+    }
+
+    return find_param(&ctx->query, name);
+}
+
+const char *muse_ai_cookie(request_rec *r, const char *name)
+{
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+
+    if (!ctx->cookies.parsed) {
+        const char *header = apr_table_get(r->headers_in, "Cookie");
+        if (!header) {
+            return NULL;
+        }
+        split_cookies(r->pool, header, &ctx->cookies);
+    }
+
+    return find_param(&ctx->cookies, name);
+}
+
+/* Short names used for Server-Timing metrics and muse_* notes */
+static const char *const phase_names[MUSE_AI_PHASE_COUNT] = {
+    "lang", "prompt", "payload", "connect", "sent", "headers",
+    "ttfb", "ttft", "flush", "html", "close"
+};
+
+const char *muse_ai_phase_name(muse_ai_phase_t phase)
+{
+    return phase_names[phase];
+}
+
+void muse_ai_mark_phase(request_rec *r, muse_ai_phase_t phase)
+{
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+
+    if (ctx->phases[phase] == 0) {
+        ctx->phases[phase] = apr_time_now();
+    }
+}
+
+double muse_ai_phase_offset_ms(request_rec *r, muse_ai_phase_t phase)
+{
+    muse_ai_request_ctx_t *ctx = ap_get_module_config(r->request_config, &muse_ai_module);
+
+    if (!ctx || ctx->phases[phase] == 0) {
+        return -1.0;
+    }
+
+    return ctx->phases[phase] > r->request_time ?
+        (double)(ctx->phases[phase] - r->request_time) / 1000.0 : 0.0;
+}
+
+void muse_ai_set_server_timing(request_rec *r)
+{
+    advanced_muse_ai_config *cfg = ap_get_module_config(r->server->module_config, &muse_ai_module);
+    muse_ai_request_ctx_t *ctx = ap_get_module_config(r->request_config, &muse_ai_module);
+    apr_array_header_t *parts;
+    apr_time_t previous = r->request_time;
+
+    if (!cfg || !cfg->server_timing || !ctx) {
+        return;
+    }
+
+    /* Each metric is the time spent since the previous phase was reached */
+    parts = apr_array_make(r->pool, MUSE_AI_PHASE_COUNT, sizeof(const char *));
+    for (int i = 0; i < MUSE_AI_PHASE_COUNT; i++) {
+        if (ctx->phases[i] == 0) {
+            continue;
+        }
+        APR_ARRAY_PUSH(parts, const char *) = apr_psprintf(r->pool, "%s;dur=%.1f", phase_names[i],
+            ctx->phases[i] > previous ? (double)(ctx->phases[i] - previous) / 1000.0 : 0.0);
+        previous = ctx->phases[i];
+    }
+
+    if (parts->nelts > 0) {
+        apr_table_merge(r->headers_out, "Server-Timing", apr_array_pstrcat(r->pool, parts, ','));
+    }
+}
+
+void muse_ai_timing_notes(request_rec *r)
+{
+    if (!ap_get_module_config(r->request_config, &muse_ai_module)) {
+        return;
+    }
+
+    for (int i = 0; i < MUSE_AI_PHASE_COUNT; i++) {
+        double offset = muse_ai_phase_offset_ms(r, (muse_ai_phase_t)i);
+        if (offset >= 0) {
+            apr_table_setn(r->notes, apr_pstrcat(r->pool, "muse_", phase_names[i], NULL),
+                           apr_psprintf(r->pool, "%.1f", offset));
+        }
+    }
+}
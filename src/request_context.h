@@ -0,0 +1,107 @@
+#ifndef REQUEST_CONTEXT_H
+#define REQUEST_CONTEXT_H
+
+#include "httpd.h"
+#include "http_config.h"
+#include "metrics.h"
+
+/* Pipeline phases timed per request. Each is recorded once, the first
+ * time it is reached. */
+typedef enum {
+    MUSE_AI_PHASE_LANGUAGE = 0,     /* Language detection done */
+    MUSE_AI_PHASE_PROMPT,           /* Prompt files loaded */
+    MUSE_AI_PHASE_PAYLOAD,          /* JSON payload built */
+    MUSE_AI_PHASE_CONNECT,          /* Backend connection established */
+    MUSE_AI_PHASE_SENT,             /* Request written to the backend */
+    MUSE_AI_PHASE_HEADERS,          /* Backend response headers received */
+    MUSE_AI_PHASE_FIRST_BYTE,       /* First SSE/body byte from the backend */
+    MUSE_AI_PHASE_FIRST_TOKEN,      /* First token outside a <think> block */
+    MUSE_AI_PHASE_FIRST_FLUSH,      /* First byte flushed to the client */
+    MUSE_AI_PHASE_HTML_DONE,        /* </html> seen */
+    MUSE_AI_PHASE_CLOSE,            /* Backend connection closed */
+    MUSE_AI_PHASE_COUNT
+} muse_ai_phase_t;
+
+/* Query string and Cookie header, each split once per request. Names and
+ * values point into one request-pool copy of the source; query names and
+ * values are percent-decoded in place. Pairs beyond MUSE_AI_MAX_PARAMS are
+ * ignored. */
+#define MUSE_AI_MAX_PARAMS 16
+
+typedef struct {
+    const char *name;
+    const char *value;
+} muse_ai_param_t;
+
+typedef struct {
+    int parsed;                     /* Source has been split */
+    int count;
+    muse_ai_param_t items[MUSE_AI_MAX_PARAMS];
+} muse_ai_params_t;
+
+/* Per-request state shared between the handlers, the HTTP client and the
+ * accounting code. Stored in r->request_config. */
+typedef struct {
+    const char *backend_url;        /* Backend that served the request */
+    const char *model;              /* Model identifier sent to the backend */
+    apr_uint32_t prompt_tokens;     /* From the backend's usage report, if any */
+    apr_uint32_t completion_tokens; /* Generated tokens (reported or counted) */
+    int tokens_from_usage;          /* completion_tokens came from a usage report */
+
+    /* Metrics labels and timings, folded into the histograms at log time */
+    const char *locale;             /* Selected locale, NULL for the default */
+    const char *cache_status;       /* "off", "miss" or "hit"; NULL means off */
+    apr_time_t phases[MUSE_AI_PHASE_COUNT]; /* 0 = phase not reached */
+    apr_time_t last_token_time;     /* Last streamed content delta */
+    int in_thinking;                /* Inside a <think> block of a reasoning model */
+    apr_uint32_t token_gap_counts[MUSE_AI_HIST_SLOTS]; /* Local inter-token histogram */
+    apr_uint64_t token_gap_sum;     /* microseconds */
+    int inflight;                   /* Counted in the shared in-flight gauge */
+
+    /* Slow-request trace details */
+    apr_off_t backend_bytes;        /* Bytes read from the backend */
+    int connection_reused;          /* Backend connection came from the pool */
+    apr_uint32_t flushes;           /* Flushes to the client */
+    apr_uint32_t sanitize_passes;   /* Sanitizer runs over generated content */
+
+    int capture_sampled;            /* Stream capture: 0 = undecided, 1 = yes, -1 = no */
+
+    muse_ai_params_t query;         /* r->args, split on first use */
+    muse_ai_params_t cookies;       /* Cookie header, split on first use */
+} muse_ai_request_ctx_t;
+
+/* Function declarations */
+
+/* Get the context for this request, creating it on first use */
+muse_ai_request_ctx_t *muse_ai_request_ctx(request_rec *r);
+
+/* Read prompt/completion token counts from an OpenAI-style "usage" object
+ * contained in json. Returns 1 if a completion count was found. */
+int muse_ai_parse_usage(muse_ai_request_ctx_t *ctx, const char *json);
+
+/* Decoded value of the first query parameter called name, NULL if absent.
+ * The query string is split on the first call for a request. */
+const char *muse_ai_query_param(request_rec *r, const char *name);
+
+/* Value of the cookie called name (exact match), NULL if absent. The
+ * Cookie header is split on the first call for a request. */
+const char *muse_ai_cookie(request_rec *r, const char *name);
+
+/* Record that a phase was reached (only the first call per phase counts) */
+void muse_ai_mark_phase(request_rec *r, muse_ai_phase_t phase);
+
+/* Short name of a phase ("ttft", "connect", ...) */
+const char *muse_ai_phase_name(muse_ai_phase_t phase);
+
+/* Milliseconds from the start of the request to a phase, -1 if not reached */
+double muse_ai_phase_offset_ms(request_rec *r, muse_ai_phase_t phase);
+
+/* Add a Server-Timing header with the phases reached so far, if
+ * MuseAiServerTiming is on. Must be called before the headers are sent. */
+void muse_ai_set_server_timing(request_rec *r);
+
+/* Copy the phase offsets into r->notes (muse_ttft, muse_connect, ...) so
+ * they can be logged with %{muse_ttft}n */
+void muse_ai_timing_notes(request_rec *r);
+
+#endif /* REQUEST_CONTEXT_H */
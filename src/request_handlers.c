@@ -7,22 +7,146 @@
 #include "supported_locales.h"
 #include "error_pages.h"
 #include "model_config.h"
+#include "backend_health.h"
+#include "rate_limit.h"
+#include "metrics.h"
+#include "request_context.h"
+#include "http_response.h"
+#include "source_translation.h"
+#include "utils.h"
 #include <apr_time.h>
 #include "cJSON.h"
 #include "http_core.h"
-#include <ctype.h>
-
-/* Forward declarations for metrics functions */
-int init_metrics_system(apr_pool_t *pool, server_rec *s);
-void update_request_metrics(double response_time_ms, int success);
-char *generate_prometheus_metrics(apr_pool_t *pool);
-char *generate_json_metrics(apr_pool_t *pool);
+#include <unistd.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <zlib.h>
 
 /* Forward declaration for the main module structure */
 extern module AP_MODULE_DECLARE_DATA muse_ai_module;
 
 /* Language error handling is now handled by error_pages.c */
 
+/* Does the client accept a gzip response? Honours q=0 exclusions */
+static int client_accepts_gzip(request_rec *r)
+{
+    const char *accept = apr_table_get(r->headers_in, "Accept-Encoding");
+    const char *item;
+
+    if (!accept) {
+        return 0;
+    }
+
+    while (*accept && (item = ap_getword(r->pool, &accept, ',')) != NULL) {
+        const char *params = strchr(item, ';');
+        apr_size_t name_len = params ? (apr_size_t)(params - item) : strlen(item);
+
+        while (*item == ' ' || *item == '\t') {
+            item++;
+            name_len--;
+        }
+        while (name_len > 0 && (item[name_len - 1] == ' ' || item[name_len - 1] == '\t')) {
+            name_len--;
+        }
+        if (!((name_len == 4 && strncasecmp(item, "gzip", 4) == 0) ||
+              (name_len == 6 && strncasecmp(item, "x-gzip", 6) == 0))) {
+            continue;
+        }
+
+        /* "gzip;q=0" explicitly refuses the coding */
+        if (params) {
+            const char *q = ap_strcasestr(params, "q=");
+            if (q && atof(q + 2) <= 0.0) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+/* Fold a prompt file's mtime into r->mtime for Last-Modified */
+static void note_prompt_mtime(request_rec *r, const char *path)
+{
+    apr_finfo_t finfo;
+
+    if (apr_stat(&finfo, path, APR_FINFO_MTIME, r->pool) == APR_SUCCESS) {
+        ap_update_mtime(r, finfo.mtime);
+    }
+}
+
+/* Validators for a cacheable generated page. The payload already carries
+ * everything the page is generated from (prompts, translation instructions
+ * for the locale, model and token limit), so its hash is a strong ETag;
+ * the gzip variant gets its own tag as the bytes differ. Pages whose locale
+ * came from the cookie or Accept-Language vary on those headers, while the
+ * /xx/ prefix and ?lang= keep the locale in the URL and so in the cache key.
+ * Returns OK or the status answering a conditional request, so a revalidation
+ * never reaches the backend. */
+static int set_page_validators(request_rec *r, const muse_language_selection_t *lang_selection,
+                               const char *json_payload)
+{
+    apr_uint64_t hash = muse_hash64(json_payload, strlen(json_payload));
+    const char *etag;
+
+    etag = apr_psprintf(r->pool, "\"muse-%016" APR_UINT64_T_HEX_FMT "%s\"", hash,
+                        client_accepts_gzip(r) ? "-gzip" : "");
+    apr_table_setn(r->headers_out, "ETag", etag);
+    ap_set_last_modified(r);
+
+    apr_table_mergen(r->headers_out, "Vary", "Accept-Encoding");
+    if (lang_selection && lang_selection->source &&
+        strcmp(lang_selection->source, "url") != 0 && strcmp(lang_selection->source, "query") != 0) {
+        apr_table_mergen(r->headers_out, "Vary", "Accept-Language, Cookie");
+    }
+
+    return ap_meets_conditions(r);
+}
+
+/* Send a page generated in non-streaming mode in one piece, with its
+ * Content-Length, so that caches and keep-alive clients see an ordinary
+ * response. A cacheable page is compressed here, once, at the best level:
+ * mod_cache stores the gzip variant under Vary: Accept-Encoding and serves
+ * later hits without spending any compression CPU, and mod_deflate leaves
+ * the already encoded body alone. */
+static int send_generated_page(request_rec *r, const char *page, int cacheable)
+{
+    muse_ai_request_ctx_t *req_ctx = muse_ai_request_ctx(r);
+    apr_size_t len = strlen(page);
+    apr_bucket_brigade *bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+
+    ap_set_content_type(r, "text/html;charset=UTF-8");
+
+    if (cacheable) {
+        char *gz;
+        apr_size_t gz_len;
+
+        if (client_accepts_gzip(r)) {
+            if (http_gzip_body(r->pool, page, len, Z_BEST_COMPRESSION, &gz, &gz_len) == 0) {
+                apr_table_setn(r->headers_out, "Content-Encoding", "gzip");
+                page = gz;
+                len = gz_len;
+            } else {
+                /* The ETag names the gzip variant, which is not what is sent */
+                apr_table_unset(r->headers_out, "ETag");
+            }
+        }
+    }
+
+    ap_set_content_length(r, (apr_off_t)len);
+    muse_ai_set_server_timing(r);
+
+    /* The page lives in r->pool already; a pool bucket sends it without a copy */
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_pool_create(page, len, r->pool, r->connection->bucket_alloc));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(r->connection->bucket_alloc));
+    if (ap_pass_brigade(r->output_filters, bb) != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Client went away while the page was sent");
+    }
+    req_ctx->flushes++;
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_FIRST_FLUSH);
+    return OK;
+}
+
 /* Phase 3 integration functions */
 
 /* Initialize Phase 3 features */
@@ -75,7 +199,7 @@ int init_phase3_features(apr_pool_t *pool, server_rec *s, advanced_muse_ai_confi
                 cfg->cache_ttl_seconds);
     ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, s, 
                 "[mod_muse_ai]   - Rate Limiting: %s (%d req/min)", 
-                cfg->ratelimit_enable ? "ENABLED" : "DISABLED",
+                cfg->ratelimit_enable > 0 ? "ENABLED" : "DISABLED",
                 cfg->ratelimit_requests_per_minute);
     ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, s, 
                 "[mod_muse_ai]   - Advanced Streaming: %s (buffer: %d bytes)", 
@@ -85,6 +209,31 @@ int init_phase3_features(apr_pool_t *pool, server_rec *s, advanced_muse_ai_confi
     return 0;
 }
 
+/* The backend settings of this request. Endpoint, model and API key come
+ * together from models.json (the MuseAIModel variable, else its default
+ * model), or from MuseAiEndpoint/MuseAiModel/MuseAiApiKey when no models
+ * file is loaded; the rest from the server configuration. */
+static void init_backend_config(request_rec *r, advanced_muse_ai_config *cfg, muse_ai_config *basic_cfg)
+{
+    const muse_ai_model_config *model_cfg = get_request_model_config(r);
+
+    basic_cfg->endpoint = model_cfg ? (char *)model_cfg->endpoint : cfg->endpoint;
+    basic_cfg->timeout = cfg->timeout;
+    basic_cfg->debug = cfg->debug;
+    basic_cfg->model = model_cfg ? (char *)model_cfg->model : cfg->model;
+    basic_cfg->api_key = model_cfg ? (char *)model_cfg->api_key : cfg->api_key;
+    basic_cfg->streaming = cfg->streaming;
+    basic_cfg->max_tokens = cfg->max_tokens;
+    basic_cfg->max_retries = cfg->max_retries;
+    basic_cfg->retry_delay_ms = cfg->retry_delay_ms;
+    basic_cfg->hedge_percentile = cfg->hedge_percentile;
+    basic_cfg->hedge_min_delay_ms = cfg->hedge_min_delay_ms;
+    basic_cfg->raw_content = 0;
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Using model: %s, endpoint: %s",
+                 basic_cfg->model ? basic_cfg->model : "default", basic_cfg->endpoint ? basic_cfg->endpoint : "(none)");
+}
+
 /* AI file handler for .ai files in document root */
 int ai_file_handler(request_rec *r)
 {
@@ -112,9 +261,24 @@ int ai_file_handler(request_rec *r)
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, "[mod_muse_ai] Failed to get configuration");
         return HTTP_INTERNAL_SERVER_ERROR;
     }
+
+    /* The request context also marks this request for metrics at log time */
+    muse_ai_request_ctx_t *req_ctx = muse_ai_request_ctx(r);
+
+    /* Per-client rate limiting before any prompt or backend work */
+    int limit_status = check_rate_limit(r, cfg);
+    if (limit_status != OK) {
+        return limit_status;
+    }
+    metrics_request_started(r);
+
+    /* Endpoint, model and API key for this request, from one place */
+    muse_ai_config basic_cfg;
+    init_backend_config(r, cfg, &basic_cfg);
     
     /* Detect language for translation */
     muse_language_selection_t *lang_selection = muse_detect_language(r, "en_US");
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_LANGUAGE);
     
     /* Check for language errors and provide helpful error pages */
     if (lang_selection && lang_selection->is_translation_requested && !lang_selection->is_supported) {
@@ -122,6 +286,10 @@ int ai_file_handler(request_rec *r)
     }
     
     if (lang_selection) {
+        if (lang_selection->is_supported) {
+            req_ctx->locale = lang_selection->selected_locale;
+        }
+        
         ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r, 
                      "[mod_muse_ai] Language detection: locale=%s, source=%s, translation_requested=%s",
                      lang_selection->selected_locale ? lang_selection->selected_locale : "NULL",
@@ -134,11 +302,6 @@ int ai_file_handler(request_rec *r)
                          "[mod_muse_ai] URI updated from %s to %s", r->uri, lang_selection->processed_uri);
             r->uri = apr_pstrdup(r->pool, lang_selection->processed_uri);
         }
-        
-        /* Set language preference cookie if translation was explicitly requested */
-        if (lang_selection->is_translation_requested && lang_selection->selected_locale) {
-            muse_set_language_cookie(r, lang_selection->selected_locale, 86400); /* 24 hours */
-        }
     }
     
     /* Construct path to .ai file using Apache's filename translation */
@@ -165,6 +328,7 @@ int ai_file_handler(request_rec *r)
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, "[mod_muse_ai] Could not read AI file: %s", ai_file_path);
         return HTTP_NOT_FOUND;
     }
+    note_prompt_mtime(r, ai_file_path);
     
     /* Read system prompts from MuseAiPromptsDir if configured */
     if (cfg->prompts_dir && strlen(cfg->prompts_dir) > 0) {
@@ -173,6 +337,7 @@ int ai_file_handler(request_rec *r)
         
         if (system_prompt) {
             ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Loaded system prompt from: %s", system_prompt_path);
+            note_prompt_mtime(r, system_prompt_path);
             
             /* Read layout prompt */
             const char *layout_filename = cfg->prompts_minify ? "/layout.min.ai" : "/layout.ai";
@@ -181,6 +346,7 @@ int ai_file_handler(request_rec *r)
             
             if (layout_prompt) {
                 ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Loaded layout prompt from: %s", layout_prompt_path);
+                note_prompt_mtime(r, layout_prompt_path);
                 final_system_prompt = apr_pstrcat(r->pool, system_prompt, "\n\n", layout_prompt, NULL);
             } else {
                 final_system_prompt = system_prompt;
@@ -189,6 +355,7 @@ int ai_file_handler(request_rec *r)
             ap_log_rerror(APLOG_MARK, APLOG_NOTICE, 0, r, "[mod_muse_ai] Could not load system prompt from: %s", system_prompt_path);
         }
     }
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_PROMPT);
     
 
 
@@ -204,26 +371,6 @@ int ai_file_handler(request_rec *r)
             const char *display_name = muse_get_locale_display_name(lang_selection->selected_locale);
             const char *tier = muse_get_locale_tier(lang_selection->selected_locale);
             
-            /* Convert locale to URL-friendly format for URL prefixes */
-            char url_lang_buffer[16];
-            const char *url_lang_code = "en"; /* default */
-            
-            /* Convert es_MX -> es-mx, zh_CN -> zh-cn, etc. */
-            if (lang_selection->selected_locale) {
-                strncpy(url_lang_buffer, lang_selection->selected_locale, sizeof(url_lang_buffer) - 1);
-                url_lang_buffer[sizeof(url_lang_buffer) - 1] = '\0';
-                
-                /* Convert to lowercase and replace _ with - */
-                for (char *p = url_lang_buffer; *p; p++) {
-                    if (*p == '_') {
-                        *p = '-';
-                    } else {
-                        *p = tolower(*p);
-                    }
-                }
-                url_lang_code = url_lang_buffer;
-            }
-            
             enhanced_system_prompt = apr_psprintf(r->pool,
                 "%s\n\n"
                 "**TRANSLATION INSTRUCTIONS:**\n"
@@ -232,22 +379,11 @@ int ai_file_handler(request_rec *r)
                 "- Maintain the original meaning, tone, and formatting\n"
                 "- Preserve any HTML tags, markdown, or special formatting\n"
                 "- Use natural, fluent language appropriate for the target locale\n"
-                "- If technical terms don't translate well, keep them in English with brief explanation\n"
-                "\n"
-                "**CRITICAL URL LOCALIZATION REQUIREMENT:**\n"
-                "- MUST update navigation links in <nav> to include language prefix '/%s/'\n"
-                "- REQUIRED changes: href=\"/\" becomes href=\"/%s/\", href=\"/features\" becomes href=\"/%s/features\"\n"
-                "- NEVER modify: CSS links (/css/), JavaScript (/js/), images, or external URLs\n"
-                "- Example: <a href=\"/\">Home</a> must become <a href=\"/%s/\">Home</a>\n"
-                "- This is essential for maintaining language context during navigation",
+                "- If technical terms don't translate well, keep them in English with brief explanation",
                 final_system_prompt,
                 display_name ? display_name : lang_selection->selected_locale,
                 lang_selection->selected_locale,
-                tier ? tier : "Unknown",
-                url_lang_code,
-                url_lang_code,
-                url_lang_code,
-                url_lang_code);
+                tier ? tier : "Unknown");
                 
             ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
                          "[mod_muse_ai] Added translation instructions for %s", lang_selection->selected_locale);
@@ -266,7 +402,7 @@ int ai_file_handler(request_rec *r)
                 "  \"max_tokens\": %d,\n"
                 "  \"stream\": %s\n"
                 "}",
-                cfg->model ? cfg->model : "default",
+                basic_cfg.model ? basic_cfg.model : "default",
                 escaped_system,
                 escaped_user,
                 cfg->max_tokens,
@@ -281,7 +417,7 @@ int ai_file_handler(request_rec *r)
                 "  ],\n"
                 "  \"stream\": %s\n"
                 "}",
-                cfg->model ? cfg->model : "default",
+                basic_cfg.model ? basic_cfg.model : "default",
                 escaped_system,
                 escaped_user,
                 cfg->streaming ? "true" : "false");
@@ -299,7 +435,7 @@ int ai_file_handler(request_rec *r)
                 "  \"max_tokens\": %d,\n"
                 "  \"stream\": %s\n"
                 "}",
-                cfg->model ? cfg->model : "default",
+                basic_cfg.model ? basic_cfg.model : "default",
                 escaped_user,
                 cfg->max_tokens,
                 cfg->streaming ? "true" : "false");
@@ -312,45 +448,73 @@ int ai_file_handler(request_rec *r)
                 "  ],\n"
                 "  \"stream\": %s\n"
                 "}",
-                cfg->model ? cfg->model : "default",
+                basic_cfg.model ? basic_cfg.model : "default",
                 escaped_user,
                 cfg->streaming ? "true" : "false");
         }
     }
     
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Generated JSON payload for AI file request");
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_PAYLOAD);
+
+    /* Translated pages name their language */
+    if (lang_selection && lang_selection->is_translation_requested && lang_selection->is_supported) {
+        char *content_language = apr_pstrdup(r->pool, lang_selection->selected_locale);
+        char *underscore = strchr(content_language, '_');
+        if (underscore) {
+            *underscore = '-';
+        }
+        apr_table_setn(r->headers_out, "Content-Language", content_language);
+    }
+
+    /* If caching is enabled for this directory (and not streaming), set Cache-Control
+     * and the validators before the backend is asked for anything */
+    if (d_cfg->cache_enable == 1 && !cfg->streaming) {
+        int cache_ttl = (d_cfg->cache_ttl > 0) ? d_cfg->cache_ttl : cfg->cache_ttl_seconds;
+        const char *cache_control_header = apr_psprintf(r->pool, "max-age=%d", cache_ttl);
+        apr_table_set(r->headers_out, "Cache-Control", cache_control_header);
+        ap_log_rerror(APLOG_MARK, APLOG_NOTICE, 0, r, "[mod_muse_ai] Caching enabled. Setting Cache-Control: %s", cache_control_header);
+
+        int cond_status = set_page_validators(r, lang_selection, json_payload);
+        if (cond_status != OK) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
+                         "[mod_muse_ai] Conditional request answered with %d, backend skipped", cond_status);
+            req_ctx->cache_status = "hit";
+            update_cache_metrics(1);
+            return cond_status;
+        }
+        req_ctx->cache_status = "miss";
+    }
     
-    /* Create basic config structure for backend request */
-    muse_ai_config basic_cfg = {
-        .endpoint = cfg->endpoint,
-        .timeout = cfg->timeout,
-        .debug = cfg->debug,
-        .model = cfg->model,
-        .api_key = cfg->api_key,
-        .streaming = cfg->streaming,
-        .max_tokens = cfg->max_tokens
-    };
-    
+    /* Translated pages can be made from the cached source page */
+    if (translate_from_source_enabled(r, cfg, lang_selection)) {
+        char *translated_page = NULL;
+        int translate_status = translate_from_source(r, cfg, &basic_cfg, lang_selection, final_system_prompt,
+                                                     page_prompt, &translated_page);
+        if (translate_status == OK) {
+            return send_generated_page(r, translated_page, d_cfg->cache_enable == 1 && !cfg->streaming);
+        }
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
+                     "[mod_muse_ai] Translation from the source page failed (%d), generating the %s page directly",
+                     translate_status, lang_selection->selected_locale);
+    }
+
+    /* Pick a backend whose circuit breaker lets traffic through */
+    const char *backend_url = select_backend_endpoint(r, cfg, basic_cfg.endpoint, NULL);
+    if (!backend_url) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, "[mod_muse_ai] All backends are unavailable (circuit open), failing fast");
+        apr_table_setn(r->err_headers_out, "Retry-After", apr_itoa(r->pool, cfg->circuit_breaker_cooldown));
+        return HTTP_SERVICE_UNAVAILABLE;
+    }
+
     /* Forward to backend */
     char *response_body = NULL;
-    int status = make_backend_request(r, &basic_cfg, cfg->endpoint, json_payload, &response_body, lang_selection);
+    int status = make_backend_request(r, &basic_cfg, backend_url, json_payload, &response_body, lang_selection);
 
     if (status == OK) {
-        /* If caching is enabled for this directory (and not streaming), set Cache-Control header */
-        if (d_cfg->cache_enable == 1 && !cfg->streaming) {
-            int cache_ttl = (d_cfg->cache_ttl > 0) ? d_cfg->cache_ttl : cfg->cache_ttl_seconds;
-            const char *cache_control_header = apr_psprintf(r->pool, "max-age=%d", cache_ttl);
-            apr_table_set(r->headers_out, "Cache-Control", cache_control_header);
-            ap_log_rerror(APLOG_MARK, APLOG_NOTICE, 0, r, "[mod_muse_ai] Caching enabled. Setting Cache-Control: %s", cache_control_header);
-        }
-
         if (!cfg->streaming) {
             if (response_body) {
-                apr_bucket_brigade *bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-                apr_bucket *b = apr_bucket_heap_create(response_body, strlen(response_body), NULL, r->connection->bucket_alloc);
-                APR_BRIGADE_INSERT_TAIL(bb, b);
-                APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(r->connection->bucket_alloc));
-                return ap_pass_brigade(r->output_filters, bb);
+                return send_generated_page(r, response_body, d_cfg->cache_enable == 1);
             } else {
                  ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, "[mod_muse_ai] Backend returned OK but response body was empty in non-streaming mode.");
                  return HTTP_INTERNAL_SERVER_ERROR;
@@ -440,9 +604,8 @@ int enhanced_muse_ai_handler(request_rec *r)
     advanced_muse_ai_config *cfg;
     apr_time_t start_time, end_time;
     double response_time_ms;
-    int success = 0;
     char *json_payload = NULL;
-    char *prompt = NULL;
+    const char *prompt = NULL;
 
     start_time = apr_time_now();
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Enhanced handler called for URI: %s", r->uri);
@@ -457,8 +620,26 @@ int enhanced_muse_ai_handler(request_rec *r)
         return HTTP_INTERNAL_SERVER_ERROR;
     }
 
+    /* The request context also marks this request for metrics at log time */
+    muse_ai_request_ctx_t *req_ctx = muse_ai_request_ctx(r);
+
+    /* Per-client rate limiting before any prompt or backend work */
+    int limit_status = check_rate_limit(r, cfg);
+    if (limit_status != OK) {
+        return limit_status;
+    }
+    metrics_request_started(r);
+
+    /* Endpoint, model and API key for this request, from one place */
+    muse_ai_config basic_cfg;
+    init_backend_config(r, cfg, &basic_cfg);
+
     /* Detect language for RTL support */
     muse_language_selection_t *lang_selection = muse_detect_language(r, "en_US");
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_LANGUAGE);
+    if (lang_selection && lang_selection->is_supported) {
+        req_ctx->locale = lang_selection->selected_locale;
+    }
 
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] HANDLER USING ENDPOINT: %s", cfg->endpoint ? cfg->endpoint : "(not set)");
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] HANDLER CONFIG: timeout=%d, debug=%d, api_key=%s", 
@@ -517,37 +698,12 @@ int enhanced_muse_ai_handler(request_rec *r)
     }
     // Priority 2: GET request
     else if (r->method_number == M_GET) {
-        // Priority 2a: GET with ?prompt=... parameter
-        if (r->args) {
-            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: START. Checking args.");
-            char *decoded_args = url_decode(r->pool, r->args);
-            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: url_decode finished.");
-
-            if (decoded_args) {
-                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: decoded_args is not null. Value: %s", decoded_args);
-                char *last_state;
-                char *pair = apr_strtok(decoded_args, "&", &last_state);
-                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: first apr_strtok finished.");
-
-                while (pair) {
-                    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: loop start. Pair: %s", pair);
-                    char *eq = strchr(pair, '=');
-                    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: strchr finished.");
-
-                    if (eq && strncmp(pair, "prompt", eq - pair) == 0) {
-                        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: found prompt key.");
-                        prompt = apr_pstrdup(r->pool, eq + 1);
-                        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: extracted prompt value: %s", prompt);
-                        break;
-                    }
-                    pair = apr_strtok(NULL, "&", &last_state);
-                    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: next apr_strtok finished.");
-                }
-                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: loop finished.");
-            } else {
-                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: decoded_args is null.");
-            }
-            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: END.");
+        // Priority 2a: GET with ?prompt=... parameter, from the query string
+        // already split for language detection
+        const char *prompt_param = muse_ai_query_param(r, "prompt");
+        if (prompt_param && *prompt_param) {
+            prompt = prompt_param;
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] GET query handler: extracted prompt value: %s", prompt);
         }
         // Priority 2b: GET with Prompts Directory configured (file-based content)
         else if (cfg->prompts_dir && strlen(cfg->prompts_dir) > 0) {
@@ -577,10 +733,10 @@ int enhanced_muse_ai_handler(request_rec *r)
                 char *escaped_user = escape_json_string(r->pool, user_prompt);
                 if (cfg->max_tokens > 0) {
                     json_payload = apr_psprintf(r->pool, "{\n  \"model\": \"%s\",\n  \"messages\": [\n    {\"role\": \"system\", \"content\": \"%s\"},\n    {\"role\": \"user\", \"content\": \"%s\"}\n  ],\n  \"max_tokens\": %d,\n  \"stream\": %s\n}",
-                                               cfg->model ? cfg->model : "default", escaped_system, escaped_user, cfg->max_tokens, cfg->streaming ? "true" : "false");
+                                               basic_cfg.model ? basic_cfg.model : "default", escaped_system, escaped_user, cfg->max_tokens, cfg->streaming ? "true" : "false");
                 } else {
                     json_payload = apr_psprintf(r->pool, "{\n  \"model\": \"%s\",\n  \"messages\": [\n    {\"role\": \"system\", \"content\": \"%s\"},\n    {\"role\": \"user\", \"content\": \"%s\"}\n  ],\n  \"stream\": %s\n}",
-                                               cfg->model ? cfg->model : "default", escaped_system, escaped_user, cfg->streaming ? "true" : "false");
+                                               basic_cfg.model ? basic_cfg.model : "default", escaped_system, escaped_user, cfg->streaming ? "true" : "false");
                 }
             } else {
                 ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r, "[mod_muse_ai] No index.ai or page.ai found for URI '%s'", r->uri);
@@ -589,6 +745,8 @@ int enhanced_muse_ai_handler(request_rec *r)
         }
     }
 
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_PROMPT);
+
     // If no prompt was extracted from any source, we can't proceed.
     if (!prompt && !json_payload) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, "[mod_muse_ai] No prompt found in POST body, GET parameters, or file-based sources.");
@@ -605,14 +763,14 @@ int enhanced_muse_ai_handler(request_rec *r)
         if (cfg->max_tokens > 0) {
             json_payload = apr_psprintf(r->pool, 
                                         "{\n  \"model\": \"%s\",\n  \"messages\": [\n    {\"role\": \"user\", \"content\": \"%s\"}\n  ],\n  \"max_tokens\": %d,\n  \"stream\": %s\n}",
-                                        cfg->model ? cfg->model : "default", 
+                                        basic_cfg.model ? basic_cfg.model : "default", 
                                         escaped_prompt, 
                                         cfg->max_tokens,
                                         cfg->streaming ? "true" : "false");
         } else {
             json_payload = apr_psprintf(r->pool, 
                                         "{\n  \"model\": \"%s\",\n  \"messages\": [\n    {\"role\": \"user\", \"content\": \"%s\"}\n  ],\n  \"stream\": %s\n}",
-                                        cfg->model ? cfg->model : "default", 
+                                        basic_cfg.model ? basic_cfg.model : "default", 
                                         escaped_prompt, 
                                         cfg->streaming ? "true" : "false");
         }
@@ -623,6 +781,7 @@ int enhanced_muse_ai_handler(request_rec *r)
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, "[mod_muse_ai] Failed to construct JSON payload.");
         return HTTP_INTERNAL_SERVER_ERROR;
     }
+    muse_ai_mark_phase(r, MUSE_AI_PHASE_PAYLOAD);
 
     if (cfg->debug && json_payload) {
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] JSON Payload: %s", json_payload);
@@ -630,44 +789,28 @@ int enhanced_muse_ai_handler(request_rec *r)
 
     char *response_body = NULL;
     
-    /* Get model configuration from request environment or use default */
-    const muse_ai_model_config *model_cfg = get_request_model_config(r);
-    if (!model_cfg) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, "[mod_muse_ai] Failed to get model configuration");
-        return HTTP_INTERNAL_SERVER_ERROR;
-    }
-    
-    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Using model: %s, endpoint: %s", 
-                 model_cfg->name, model_cfg->endpoint);
-    
-    /* Create temporary basic config from advanced config and dynamic model config */
-    muse_ai_config basic_cfg = {
-        .endpoint = model_cfg->endpoint, /* Use model-specific endpoint */
-        .timeout = cfg->timeout,
-        .debug = cfg->debug,
-        .model = model_cfg->model,    /* Use model-specific model identifier */
-        .api_key = model_cfg->api_key, /* Use model-specific API key */
-        .streaming = cfg->streaming,
-        .max_tokens = cfg->max_tokens
-    };
-    
     if (cfg->debug) {
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] BASIC CONFIG: timeout=%d, debug=%d", 
                      basic_cfg.timeout, basic_cfg.debug);
     }
     
-    int status = make_backend_request(r, &basic_cfg, cfg->endpoint, json_payload, &response_body, lang_selection);
+    /* Pick a backend whose circuit breaker lets traffic through */
+    const char *backend_url = select_backend_endpoint(r, cfg, basic_cfg.endpoint, NULL);
+    if (!backend_url) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, "[mod_muse_ai] All backends are unavailable (circuit open), failing fast");
+        apr_table_setn(r->err_headers_out, "Retry-After", apr_itoa(r->pool, cfg->circuit_breaker_cooldown));
+        return HTTP_SERVICE_UNAVAILABLE;
+    }
+
+    int status = make_backend_request(r, &basic_cfg, backend_url, json_payload, &response_body, lang_selection);
+    if (status == OK && !cfg->streaming && response_body) {
+        status = send_generated_page(r, response_body, 0);
+    }
     
-    /* Calculate response time */
+    /* Calculate response time; request metrics are recorded at log time */
     end_time = apr_time_now();
     response_time_ms = (double)(end_time - start_time) / 1000.0; /* Convert to milliseconds */
     
-    /* Update metrics */
-    success = (status == OK);
-    if (cfg->metrics_enable) {
-        update_request_metrics(response_time_ms, success);
-    }
-    
     /* Log performance information */
     if (cfg->debug) {
         ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, 
@@ -718,26 +861,127 @@ int metrics_handler(request_rec *r)
     if (strcmp(format, "json") == 0) {
         metrics_output = generate_json_metrics(r->pool);
         ap_set_content_type(r, "application/json");
+        ap_rprintf(r, "%s", metrics_output);
     } else {
-        metrics_output = generate_prometheus_metrics(r->pool);
+        /* Streamed into the output filters, however many series exist */
         ap_set_content_type(r, "text/plain; version=0.0.4");
+        if (write_prometheus_metrics(r) != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Metrics scrape aborted by client");
+            return OK;
+        }
     }
     
-    /* Send response */
-    ap_rprintf(r, "%s", metrics_output);
-    
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, 
                  "[mod_muse_ai] Metrics served in %s format", format);
     
     return OK;
 }
 
+/* Seconds since the server (re)started, from the shared metrics segment */
+static long long server_uptime(void)
+{
+    apr_time_t started = metrics_started();
+    return started ? (long long)apr_time_sec(apr_time_now() - started) : 0LL;
+}
+
+/* Evaluate readiness from in-memory state only: cached probe results and
+ * breaker states, pool occupancy, the in-flight gauge and the model
+ * configuration. Nothing here blocks or talks to a backend, so load
+ * balancers can poll it as often as they like. The checks are returned as
+ * a JSON object body in *checks. */
+static int evaluate_readiness(request_rec *r, advanced_muse_ai_config *cfg, const char **checks)
+{
+    connection_pool_t *pool = get_global_connection_pool();
+    int backends_total = 0;
+    int backends_available = backend_available_count(&backends_total);
+    int pool_active = pool ? pool->active_count : 0;
+    int pool_max = pool ? pool->max_connections : 0;
+    apr_uint32_t inflight = metrics_inflight();
+    int inflight_max = cfg ? cfg->readiness_max_inflight : 0;
+    muse_ai_models_state models_state = get_model_config_state();
+
+    /* Without MuseAiBackendEndpoint there is no registry; the single endpoint
+     * is only judged per request */
+    int backends_ok = backends_total == 0 || backends_available > 0;
+    int pool_ok = !pool || pool_max <= 0 || pool_active < pool_max;
+    int inflight_ok = inflight_max <= 0 || inflight < (apr_uint32_t)inflight_max;
+    /* A models.json that has never loaded would leave every request on the
+     * directive defaults instead */
+    int model_ok = models_state != MUSE_AI_MODELS_FAILED;
+    const char *model_reason = models_state == MUSE_AI_MODELS_LOADED ? "models.json loaded" :
+                               models_state == MUSE_AI_MODELS_FAILED ? "models.json failed to load" : "no models.json, using the directives";
+
+    *checks = apr_psprintf(r->pool,
+        "{\n"
+        "    \"backends\": {\"ok\": %s, \"available\": %d, \"total\": %d},\n"
+        "    \"connection_pool\": {\"ok\": %s, \"active\": %d, \"max\": %d},\n"
+        "    \"inflight\": {\"ok\": %s, \"current\": %u, \"max\": %d},\n"
+        "    \"model_config\": {\"ok\": %s, \"reason\": \"%s\"}\n"
+        "  }",
+        backends_ok ? "true" : "false", backends_available, backends_total,
+        pool_ok ? "true" : "false", pool_active, pool_max,
+        inflight_ok ? "true" : "false", inflight, inflight_max,
+        model_ok ? "true" : "false", model_reason);
+
+    return backends_ok && pool_ok && inflight_ok && model_ok;
+}
+
+/* Liveness: the process answers requests. Never looks at backends, so a
+ * backend outage does not get healthy workers restarted. */
+int liveness_handler(request_rec *r)
+{
+    if (!r->handler || strcmp(r->handler, "muse-ai-live")) {
+        return DECLINED;
+    }
+    
+    if (r->method_number != M_GET) {
+        return HTTP_METHOD_NOT_ALLOWED;
+    }
+    
+    apr_table_setn(r->headers_out, "Cache-Control", "no-store");
+    ap_set_content_type(r, "application/json");
+    ap_rprintf(r, "{\"status\": \"alive\", \"pid\": %d, \"uptime_seconds\": %lld}\n",
+               (int)getpid(), server_uptime());
+    
+    return OK;
+}
+
+/* Readiness: may this node receive traffic? 503 when it should be taken
+ * out of rotation. */
+int readiness_handler(request_rec *r)
+{
+    advanced_muse_ai_config *cfg;
+    const char *checks;
+    int ready;
+    
+    if (!r->handler || strcmp(r->handler, "muse-ai-ready")) {
+        return DECLINED;
+    }
+    
+    if (r->method_number != M_GET) {
+        return HTTP_METHOD_NOT_ALLOWED;
+    }
+    
+    cfg = (advanced_muse_ai_config *)ap_get_module_config(r->server->module_config, &muse_ai_module);
+    ready = evaluate_readiness(r, cfg, &checks);
+    
+    r->status = ready ? HTTP_OK : HTTP_SERVICE_UNAVAILABLE;
+    apr_table_setn(r->headers_out, "Cache-Control", "no-store");
+    ap_set_content_type(r, "application/json");
+    ap_rprintf(r, "{\n  \"status\": \"%s\",\n  \"checks\": %s\n}\n",
+               ready ? "ready" : "not_ready", checks);
+    
+    return OK;
+}
+
 /* Health check endpoint */
 int health_check_handler(request_rec *r)
 {
     advanced_muse_ai_config *cfg;
     muse_ai_metrics_t *metrics;
+    const char *checks;
     char *health_output;
+    int ready;
     
     /* Check if this is a health check request */
     if (!r->handler || strcmp(r->handler, "muse-ai-health")) {
@@ -750,12 +994,13 @@ int health_check_handler(request_rec *r)
     
     /* Get configuration and metrics */
     cfg = (advanced_muse_ai_config *)ap_get_module_config(r->server->module_config, &muse_ai_module);
-    metrics = get_global_metrics();
+    metrics = get_global_metrics(r->pool);
+    ready = evaluate_readiness(r, cfg, &checks);
     
-    /* Generate health status */
+    /* Generate health status; same verdict as the readiness endpoint */
     health_output = apr_psprintf(r->pool,
         "{\n"
-        "  \"status\": \"healthy\",\n"
+        "  \"status\": \"%s\",\n"
         "  \"version\": \"1.0.0-phase3\",\n"
         "  \"features\": {\n"
         "    \"connection_pooling\": %s,\n"
@@ -764,18 +1009,23 @@ int health_check_handler(request_rec *r)
         "    \"rate_limiting\": %s,\n"
         "    \"advanced_streaming\": %s\n"
         "  },\n"
+        "  \"checks\": %s,\n"
         "  \"uptime_seconds\": %lld,\n"
         "  \"requests_processed\": %ld\n"
-        "}",
+        "}\n",
+        ready ? "healthy" : "unhealthy",
         cfg && cfg->pool_max_connections > 0 ? "true" : "false",
         cfg && cfg->metrics_enable ? "true" : "false", 
         cfg && cfg->cache_enable ? "true" : "false",
-        cfg && cfg->ratelimit_enable ? "true" : "false",
+        cfg && cfg->ratelimit_enable > 0 ? "true" : "false",
         cfg && cfg->streaming_buffer_size > 0 ? "true" : "false",
-        metrics ? (long long)((apr_time_now() - metrics->last_updated) / APR_USEC_PER_SEC) : 0LL,
+        checks,
+        server_uptime(),
         metrics ? metrics->total_requests : 0L
     );
     
+    r->status = ready ? HTTP_OK : HTTP_SERVICE_UNAVAILABLE;
+    apr_table_setn(r->headers_out, "Cache-Control", "no-store");
     ap_set_content_type(r, "application/json");
     ap_rprintf(r, "%s", health_output);
     
@@ -823,7 +1073,7 @@ int validate_phase3_config(advanced_muse_ai_config *cfg, server_rec *s)
     }
     
     /* Validate rate limiting */
-    if (cfg->ratelimit_enable) {
+    if (cfg->ratelimit_enable > 0) {
         if (cfg->ratelimit_requests_per_minute > 1000) {
             ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, s, 
                         "[mod_muse_ai] High rate limit: %d req/min", 
@@ -14,5 +14,7 @@ int enhanced_muse_ai_handler(request_rec *r);
 int ai_file_handler(request_rec *r);
 int metrics_handler(request_rec *r);
 int health_check_handler(request_rec *r);
+int liveness_handler(request_rec *r);
+int readiness_handler(request_rec *r);
 
 #endif /* REQUEST_HANDLERS_H */
@@ -1,6 +1,7 @@
 #include "mod_muse_ai.h"
 #include <string.h>
 #include <ctype.h>
+#include <strings.h>  /* for strncasecmp */
 
 /* Helper function to replace all occurrences of a substring */
 static char *str_replace_all(apr_pool_t *pool, const char *str, const char *old, const char *new)
@@ -86,7 +87,7 @@ static char *str_case_str(const char *haystack, const char *needle)
 }
 
 /* Remove thinking tags and their content (for reasoning models) */
-static char *remove_thinking_tags(apr_pool_t *pool, const char *content)
+char *remove_thinking_tags(apr_pool_t *pool, const char *content)
 {
     if (!content) return apr_pstrdup(pool, "");
     
@@ -301,9 +302,55 @@ char *extract_html_content(apr_pool_t *pool, const char *content)
     return cleanup_code_fences(pool, start_pos);
 }
 
+/* Find HTML document start position */
+int find_html_start(const char *content)
+{
+    if (!content) return -1;
+    
+    /* Simple case-insensitive search without dynamic allocation */
+    const char *pos = content;
+    int len = strlen(content);
+    
+    /* Look for DOCTYPE (case insensitive) */
+    for (int i = 0; i <= len - 9; i++) {
+        if (strncasecmp(pos + i, "<!doctype", 9) == 0) {
+            return i;
+        }
+    }
+    
+    /* Look for <html tag (case insensitive) */
+    for (int i = 0; i <= len - 5; i++) {
+        if (strncasecmp(pos + i, "<html", 5) == 0) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
+/* Find HTML document end position */
+int find_html_end(const char *content)
+{
+    if (!content) return -1;
+    
+    /* Simple case-insensitive search without dynamic allocation */
+    const char *pos = content;
+    int len = strlen(content);
+    
+    /* Look for </html> tag (case insensitive) */
+    for (int i = 0; i <= len - 7; i++) {
+        if (strncasecmp(pos + i, "</html>", 7) == 0) {
+            return i;
+        }
+    }
+    
+    return -1;
+}
+
 /* Enhanced sanitize response using MuseWeb's proven approach */
 char *sanitize_response(apr_pool_t *pool, const char *content, const muse_language_selection_t *lang_selection)
 {
+    (void)lang_selection; /* dir="rtl" is added by the output rewriter */
     if (!content) return apr_pstrdup(pool, "");
     
     /* Step 1: Remove thinking tags first (for reasoning models) */
@@ -386,24 +433,7 @@ char *sanitize_response(apr_pool_t *pool, const char *content, const muse_langua
         cleaned = str_replace_all(pool, cleaned, "\n\n\n", "\n\n");
     }
     
-    /* Step 8: Add dir="rtl" for RTL languages */
-    if (lang_selection && lang_selection->is_rtl) {
-        char *html_tag = str_case_str(cleaned, "<html");
-        if (html_tag) {
-            char *tag_end = strchr(html_tag, '>');
-            if (tag_end) {
-                char *existing_dir = str_case_str(html_tag, "dir=");
-                if (!existing_dir || existing_dir > tag_end) {
-                    /* No dir attribute, add it */
-                    char *before = apr_pstrndup(pool, cleaned, html_tag - cleaned + 5); // up to "<html"
-                    char *after = apr_pstrdup(pool, html_tag + 5);
-                    cleaned = apr_pstrcat(pool, before, " dir=\"rtl\"", after, NULL);
-                }
-            }
-        }
-    }
-
-    /* Step 9: Final trim */
+    /* Step 8: Final trim */
     cleaned = trim_whitespace(pool, cleaned);
     
     return cleaned;
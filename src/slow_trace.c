@@ -0,0 +1,306 @@
+/* Slow-request trace log: one JSON line per slow request, written by a
+ * background thread so request threads never touch the file */
+#include "slow_trace.h"
+#include "advanced_config.h"
+#include "request_context.h"
+#include <apr_strings.h>
+#include <apr_file_io.h>
+#include <apr_time.h>
+#include <apr_thread_proc.h>
+#include <apr_thread_mutex.h>
+#include <apr_thread_cond.h>
+#include <http_log.h>
+
+extern module AP_MODULE_DECLARE_DATA muse_ai_module;
+
+typedef struct {
+    apr_size_t len;
+    char line[MUSE_AI_SLOW_TRACE_RECORD_MAX];
+} trace_slot_t;
+
+/* Line being formatted on the request thread's stack */
+typedef struct {
+    char buf[MUSE_AI_SLOW_TRACE_RECORD_MAX];
+    apr_size_t len;
+} trace_line_t;
+
+/* Opened in post_config and inherited by every child */
+static apr_file_t *g_trace_file = NULL;
+static const char *g_trace_path = NULL;
+
+/* Per-process ring. Request threads fill the slot at g_head under the
+ * mutex; slots from g_tail up to g_head belong to the writer thread until
+ * it advances g_tail. */
+static trace_slot_t *g_slots = NULL;
+static apr_uint32_t g_head = 0;
+static apr_uint32_t g_tail = 0;
+static apr_uint32_t g_dropped = 0;
+static int g_trace_stop = 0;
+static apr_thread_mutex_t *g_trace_mutex = NULL;
+static apr_thread_cond_t *g_trace_cond = NULL;
+static apr_thread_t *g_trace_thread = NULL;
+static server_rec *g_trace_server = NULL;
+
+apr_status_t init_slow_trace(apr_pool_t *pconf, server_rec *s)
+{
+    advanced_muse_ai_config *main_cfg = ap_get_module_config(s->module_config, &muse_ai_module);
+    int enabled = 0;
+    apr_status_t rv;
+
+    g_trace_file = NULL;
+    for (server_rec *sv = s; sv; sv = sv->next) {
+        advanced_muse_ai_config *cfg = ap_get_module_config(sv->module_config, &muse_ai_module);
+        if (cfg && cfg->slow_trace_threshold_ms > 0) {
+            enabled = 1;
+            break;
+        }
+    }
+
+    if (!enabled) {
+        return APR_SUCCESS;
+    }
+
+    g_trace_path = main_cfg && main_cfg->slow_trace_file ? main_cfg->slow_trace_file :
+                   ap_server_root_relative(pconf, MUSE_AI_SLOW_TRACE_DEFAULT_FILE);
+
+    /* Unbuffered append: every record is one write(), so lines from
+     * different children never interleave */
+    rv = apr_file_open(&g_trace_file, g_trace_path, APR_WRITE | APR_CREATE | APR_APPEND,
+                       APR_OS_DEFAULT, pconf);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s,
+                    "[mod_muse_ai] Could not open slow trace file %s", g_trace_path);
+        g_trace_file = NULL;
+        return rv;
+    }
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s,
+                "[mod_muse_ai] Slow request traces go to %s", g_trace_path);
+    return APR_SUCCESS;
+}
+
+static void *APR_THREAD_FUNC slow_trace_writer(apr_thread_t *thd, void *data)
+{
+    apr_uint32_t dropped_reported = 0;
+    (void)thd;
+    (void)data;
+
+    apr_thread_mutex_lock(g_trace_mutex);
+    for (;;) {
+        apr_uint32_t head, tail, dropped;
+
+        while (g_head == g_tail && !g_trace_stop) {
+            apr_thread_cond_wait(g_trace_cond, g_trace_mutex);
+        }
+        if (g_head == g_tail) {
+            break;
+        }
+
+        head = g_head;
+        tail = g_tail;
+        dropped = g_dropped;
+        apr_thread_mutex_unlock(g_trace_mutex);
+
+        /* The slots up to head are ours; write them without the lock */
+        for (; tail != head; tail++) {
+            trace_slot_t *slot = &g_slots[tail % MUSE_AI_SLOW_TRACE_SLOTS];
+            apr_file_write_full(g_trace_file, slot->line, slot->len, NULL);
+        }
+
+        if (dropped != dropped_reported) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, 0, g_trace_server,
+                        "[mod_muse_ai] %u slow trace record(s) dropped, writer fell behind",
+                        dropped - dropped_reported);
+            dropped_reported = dropped;
+        }
+
+        apr_thread_mutex_lock(g_trace_mutex);
+        g_tail = head;
+    }
+    apr_thread_mutex_unlock(g_trace_mutex);
+
+    return NULL;
+}
+
+static apr_status_t slow_trace_cleanup(void *data)
+{
+    (void)data;
+    stop_slow_trace_writer();
+    return APR_SUCCESS;
+}
+
+apr_status_t start_slow_trace_writer(apr_pool_t *pool, server_rec *s)
+{
+    apr_status_t rv;
+
+    if (!g_trace_file) {
+        return APR_SUCCESS;
+    }
+
+    g_slots = apr_pcalloc(pool, sizeof(trace_slot_t) * MUSE_AI_SLOW_TRACE_SLOTS);
+    g_head = g_tail = g_dropped = 0;
+    g_trace_stop = 0;
+    g_trace_server = s;
+
+    rv = apr_thread_mutex_create(&g_trace_mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    if (rv == APR_SUCCESS) {
+        rv = apr_thread_cond_create(&g_trace_cond, pool);
+    }
+    if (rv == APR_SUCCESS) {
+        rv = apr_thread_create(&g_trace_thread, NULL, slow_trace_writer, NULL, pool);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s,
+                    "[mod_muse_ai] Failed to start slow trace writer thread");
+        g_slots = NULL;
+        return rv;
+    }
+
+    apr_pool_cleanup_register(pool, NULL, slow_trace_cleanup, apr_pool_cleanup_null);
+    return APR_SUCCESS;
+}
+
+void stop_slow_trace_writer(void)
+{
+    apr_status_t thread_rv;
+
+    if (!g_trace_thread) {
+        return;
+    }
+
+    apr_thread_mutex_lock(g_trace_mutex);
+    g_trace_stop = 1;
+    apr_thread_cond_signal(g_trace_cond);
+    apr_thread_mutex_unlock(g_trace_mutex);
+
+    /* The writer drains the ring before it exits */
+    apr_thread_join(&thread_rv, g_trace_thread);
+    g_trace_thread = NULL;
+    g_slots = NULL;
+}
+
+static void line_printf(trace_line_t *line, const char *fmt, ...)
+{
+    va_list ap;
+    apr_size_t room = sizeof(line->buf) - line->len;
+
+    if (room <= 1) {
+        return;
+    }
+
+    va_start(ap, fmt);
+    line->len += apr_vsnprintf(line->buf + line->len, room, fmt, ap);
+    va_end(ap);
+    if (line->len >= sizeof(line->buf)) {
+        line->len = sizeof(line->buf) - 1;
+    }
+}
+
+/* Append "value" as a JSON string of at most max input bytes */
+static void line_string(trace_line_t *line, const char *value, apr_size_t max)
+{
+    char *out = line->buf + line->len;
+    char *end = line->buf + sizeof(line->buf) - 8;
+    apr_size_t n = 0;
+
+    if (!value) {
+        line_printf(line, "null");
+        return;
+    }
+    if (out >= end) {
+        return;
+    }
+
+    *out++ = '"';
+    for (; *value && n < max && out < end; value++, n++) {
+        unsigned char c = (unsigned char)*value;
+        if (c == '"' || c == '\\') {
+            *out++ = '\\';
+            *out++ = (char)c;
+        } else if (c < 0x20) {
+            out += apr_snprintf(out, 8, "\\u%04x", c);
+        } else {
+            *out++ = (char)c;
+        }
+    }
+    *out++ = '"';
+    *out = '\0';
+    line->len = out - line->buf;
+}
+
+void slow_trace_record(request_rec *r)
+{
+    advanced_muse_ai_config *cfg;
+    muse_ai_request_ctx_t *ctx;
+    trace_line_t line;
+    apr_time_exp_t t;
+    apr_time_t now = apr_time_now();
+    apr_interval_time_t duration;
+    const char *sep = "";
+
+    if (!g_slots) {
+        return;
+    }
+
+    cfg = ap_get_module_config(r->server->module_config, &muse_ai_module);
+    ctx = ap_get_module_config(r->request_config, &muse_ai_module);
+    if (!ctx || !cfg || cfg->slow_trace_threshold_ms <= 0) {
+        return;
+    }
+
+    duration = now - r->request_time;
+    if (duration < (apr_interval_time_t)cfg->slow_trace_threshold_ms * 1000) {
+        return;
+    }
+
+    apr_time_exp_gmt(&t, r->request_time);
+    line.len = 0;
+    line_printf(&line, "{\"time\":\"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ\",\"host\":",
+                t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+                t.tm_usec / 1000);
+    line_string(&line, r->server->server_hostname, 128);
+    line_printf(&line, ",\"method\":");
+    line_string(&line, r->method, 16);
+    line_printf(&line, ",\"uri\":");
+    line_string(&line, r->uri, 512);
+    line_printf(&line, ",\"status\":%d,\"duration_ms\":%.1f,\"backend\":",
+                r->status, (double)duration / 1000.0);
+    line_string(&line, ctx->backend_url, 128);
+    line_printf(&line, ",\"model\":");
+    line_string(&line, ctx->model, 64);
+    line_printf(&line, ",\"conn_reused\":%s,\"bytes_in\":%" APR_OFF_T_FMT ",\"bytes_out\":%" APR_OFF_T_FMT
+                ",\"prompt_tokens\":%u,\"completion_tokens\":%u,\"flushes\":%u,\"sanitizer_passes\":%u,\"cache\":",
+                ctx->connection_reused ? "true" : "false", ctx->backend_bytes, r->bytes_sent,
+                ctx->prompt_tokens, ctx->completion_tokens, ctx->flushes, ctx->sanitize_passes);
+    line_string(&line, ctx->cache_status ? ctx->cache_status : "off", 8);
+    line_printf(&line, ",\"locale\":");
+    line_string(&line, ctx->locale, 16);
+
+    /* Offsets from the start of the request, in milliseconds */
+    line_printf(&line, ",\"phases\":{");
+    for (int i = 0; i < MUSE_AI_PHASE_COUNT; i++) {
+        double offset = muse_ai_phase_offset_ms(r, (muse_ai_phase_t)i);
+        if (offset >= 0) {
+            line_printf(&line, "%s\"%s\":%.1f", sep, muse_ai_phase_name((muse_ai_phase_t)i), offset);
+            sep = ",";
+        }
+    }
+    line_printf(&line, "}}\n");
+
+    /* A truncated record still ends the line */
+    if (line.buf[line.len - 1] != '\n') {
+        line.buf[line.len - 1] = '\n';
+    }
+
+    apr_thread_mutex_lock(g_trace_mutex);
+    if (g_head - g_tail >= MUSE_AI_SLOW_TRACE_SLOTS) {
+        g_dropped++;
+    } else {
+        trace_slot_t *slot = &g_slots[g_head % MUSE_AI_SLOW_TRACE_SLOTS];
+        memcpy(slot->line, line.buf, line.len);
+        slot->len = line.len;
+        g_head++;
+        apr_thread_cond_signal(g_trace_cond);
+    }
+    apr_thread_mutex_unlock(g_trace_mutex);
+}
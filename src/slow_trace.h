@@ -0,0 +1,31 @@
+#ifndef SLOW_TRACE_H
+#define SLOW_TRACE_H
+
+#include <httpd.h>
+#include <http_config.h>
+#include <apr_pools.h>
+
+/* Ring buffer geometry */
+#define MUSE_AI_SLOW_TRACE_SLOTS 256          /* Records waiting to be written */
+#define MUSE_AI_SLOW_TRACE_RECORD_MAX 2048    /* One JSON line, truncated beyond this */
+#define MUSE_AI_SLOW_TRACE_DEFAULT_FILE "logs/muse_ai_slow.log"
+
+/* Function declarations */
+
+/* Open the trace file if any server has MuseAiSlowTraceThreshold set.
+ * Called from post_config, while still running as root, so that the
+ * children inherit the descriptor. */
+apr_status_t init_slow_trace(apr_pool_t *pconf, server_rec *s);
+
+/* Start the writer thread of this child process. Called from child_init. */
+apr_status_t start_slow_trace_writer(apr_pool_t *pool, server_rec *s);
+
+/* Stop the writer thread, writing out what is still queued */
+void stop_slow_trace_writer(void);
+
+/* Queue a trace record for this request if it exceeded the threshold of its
+ * virtual host. Only formats into memory; the file is written by the
+ * writer thread. Called from the log_transaction hook. */
+void slow_trace_record(request_rec *r);
+
+#endif /* SLOW_TRACE_H */
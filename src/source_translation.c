@@ -0,0 +1,417 @@
+/* Locale variants translated from a cached source page, see source_translation.h */
+#include "source_translation.h"
+#include "mod_muse_ai.h"
+#include "supported_locales.h"
+#include "backend_health.h"
+#include "html_tokenizer.h"
+#include "html_rewriter.h"
+#include "translation_memory.h"
+#include "metrics.h"
+#include "utils.h"
+#include "cJSON.h"
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <apr_file_io.h>
+#include <http_log.h>
+#include <ctype.h>
+#include <string.h>
+
+/* A span of the source page to replace: a text node to translate, or the
+ * <html> language attribute */
+typedef struct {
+    apr_size_t start;
+    apr_size_t len;
+    const char *text;       /* Replacement; NULL until translated */
+} splice_t;
+
+typedef struct {
+    request_rec *r;
+    const muse_language_selection_t *lang_selection;
+    const char *page;
+    apr_size_t page_len;
+    apr_array_header_t *splices;    /* splice_t, in page order */
+    int skip_depth;                 /* Inside <pre>, <code> or <textarea> */
+} extract_ctx_t;
+
+int translate_from_source_enabled(request_rec *r, advanced_muse_ai_config *cfg,
+                                  const muse_language_selection_t *lang_selection)
+{
+    (void)r;
+    return cfg->translate_source_dir && lang_selection && lang_selection->is_translation_requested &&
+           lang_selection->is_supported && lang_selection->selected_locale &&
+           strcmp(lang_selection->selected_locale, MUSE_AI_TRANSLATE_SOURCE_LOCALE) != 0;
+}
+
+/* Chat completion request body; cJSON does the escaping */
+static const char *build_payload(request_rec *r, advanced_muse_ai_config *cfg, const char *model,
+                                 const char *system_prompt, const char *user_prompt)
+{
+    cJSON *root = cJSON_CreateObject();
+    cJSON *messages = cJSON_AddArrayToObject(root, "messages");
+    cJSON *message;
+    char *json;
+    const char *payload;
+
+    cJSON_AddStringToObject(root, "model", model ? model : "default");
+    if (system_prompt) {
+        message = cJSON_CreateObject();
+        cJSON_AddStringToObject(message, "role", "system");
+        cJSON_AddStringToObject(message, "content", system_prompt);
+        cJSON_AddItemToArray(messages, message);
+    }
+    message = cJSON_CreateObject();
+    cJSON_AddStringToObject(message, "role", "user");
+    cJSON_AddStringToObject(message, "content", user_prompt);
+    cJSON_AddItemToArray(messages, message);
+    if (cfg->max_tokens > 0) {
+        cJSON_AddNumberToObject(root, "max_tokens", cfg->max_tokens);
+    }
+    cJSON_AddBoolToObject(root, "stream", 0);
+
+    json = cJSON_PrintUnformatted(root);
+    payload = apr_pstrdup(r->pool, json);
+    cJSON_free(json);
+    cJSON_Delete(root);
+    return payload;
+}
+
+/* One non-streaming backend request, to the endpoint of the page request */
+static int call_backend(request_rec *r, advanced_muse_ai_config *cfg, const muse_ai_config *backend,
+                        const char *model, const char *payload, int raw_content, char **content)
+{
+    muse_ai_config basic_cfg = *backend;
+    const char *backend_url = select_backend_endpoint(r, cfg, backend->endpoint, NULL);
+
+    basic_cfg.model = (char *)model;
+    basic_cfg.streaming = 0;
+    basic_cfg.raw_content = raw_content;
+
+    if (!backend_url) {
+        return HTTP_SERVICE_UNAVAILABLE;
+    }
+    return make_backend_request(r, &basic_cfg, backend_url, payload, content, NULL);
+}
+
+/* Write the source page next to its final name, then rename it into place
+ * so that other children never read a partial file */
+static void store_source_page(request_rec *r, const char *path, const char *page)
+{
+    char *tmp = apr_pstrcat(r->pool, path, ".XXXXXX", NULL);
+    apr_file_t *file;
+    apr_status_t rv;
+
+    rv = apr_file_mktemp(&file, tmp, APR_CREATE | APR_WRITE | APR_EXCL | APR_BINARY, r->pool);
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_write_full(file, page, strlen(page), NULL);
+        if (apr_file_close(file) == APR_SUCCESS && rv == APR_SUCCESS) {
+            rv = apr_file_rename(tmp, path, r->pool);
+        }
+        if (rv != APR_SUCCESS) {
+            apr_file_remove(tmp, r->pool);
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r,
+                     "[mod_muse_ai] Could not store source page %s", path);
+    }
+}
+
+/* The source page for these prompts, from the cache or freshly generated */
+static int load_source_page(request_rec *r, advanced_muse_ai_config *cfg, const muse_ai_config *backend,
+                            const char *system_prompt, const char *page_prompt, char **page)
+{
+    const char *payload = build_payload(r, cfg, backend->model, system_prompt, page_prompt);
+    apr_uint64_t hash = muse_hash64(payload, strlen(payload));
+    const char *path;
+    int status;
+
+    path = apr_psprintf(r->pool, "%s/%016" APR_UINT64_T_HEX_FMT ".html", cfg->translate_source_dir, hash);
+
+    *page = read_file_contents(r->pool, path);
+    if (*page) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, "[mod_muse_ai] Source page cache hit: %s", path);
+        return OK;
+    }
+
+    ap_log_rerror(APLOG_MARK, APLOG_INFO, 0, r, "[mod_muse_ai] Generating source page %s", path);
+    status = call_backend(r, cfg, backend, backend->model, payload, 0, page);
+    if (status == OK && *page && **page) {
+        store_source_page(r, path, *page);
+    }
+    return status;
+}
+
+static int has_letters(const char *p, apr_size_t len)
+{
+    for (apr_size_t i = 0; i < len; i++) {
+        if (isalpha((unsigned char)p[i]) || (unsigned char)p[i] >= 0x80) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Collect the text nodes worth translating and the <html> attribute to
+ * rewrite. The page is fed in one piece, so token bytes point into it, except
+ * for what html_tokenizer_finish() emits from its own buffer when the page
+ * ends inside a tag or comment: that tail stays as it is. */
+static int collect_splices(void *baton, const html_token_t *token)
+{
+    extract_ctx_t *ex = baton;
+    splice_t *sp;
+
+    if (token->data < ex->page || token->data + token->len > ex->page + ex->page_len) {
+        return 0;
+    }
+
+    if (token->type == HTML_TOKEN_TAG) {
+        if (html_tag_is(token, "pre") || html_tag_is(token, "code") || html_tag_is(token, "textarea")) {
+            ex->skip_depth += token->end_tag ? -1 : 1;
+            if (ex->skip_depth < 0) {
+                ex->skip_depth = 0;
+            }
+        } else if (html_tag_is(token, "html") && !token->end_tag) {
+            char *lang = apr_pstrdup(ex->r->pool, ex->lang_selection->selected_locale);
+            char *underscore = strchr(lang, '_');
+            html_attr_t attr;
+
+            if (underscore) {
+                *underscore = '-';
+            }
+            /* dir="rtl" is added by the output rewriter */
+            if (html_tag_attr(token, "lang", &attr) && attr.value) {
+                sp = &APR_ARRAY_PUSH(ex->splices, splice_t);
+                sp->start = (apr_size_t)(attr.value - ex->page);
+                sp->len = attr.value_len;
+                sp->text = lang;
+            } else {
+                sp = &APR_ARRAY_PUSH(ex->splices, splice_t);
+                sp->start = (apr_size_t)(token->name + token->name_len - ex->page);
+                sp->len = 0;
+                sp->text = apr_pstrcat(ex->r->pool, " lang=\"", lang, "\"", NULL);
+            }
+        }
+        return 0;
+    }
+
+    if (token->type != HTML_TOKEN_TEXT || token->raw_text || ex->skip_depth > 0) {
+        return 0;
+    }
+
+    /* Surrounding whitespace stays in the markup */
+    const char *start = token->data, *end = token->data + token->len;
+    while (start < end && isspace((unsigned char)*start)) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    if (!has_letters(start, (apr_size_t)(end - start))) {
+        return 0;
+    }
+
+    sp = &APR_ARRAY_PUSH(ex->splices, splice_t);
+    sp->start = (apr_size_t)(start - ex->page);
+    sp->len = (apr_size_t)(end - start);
+    sp->text = NULL;
+    return 0;
+}
+
+/* Translated text goes back into a text node: it must not open markup */
+static const char *escape_text(apr_pool_t *pool, const char *text)
+{
+    apr_size_t extra = 0, len = 0;
+    char *out, *o;
+
+    for (const char *p = text; *p; p++, len++) {
+        if (*p == '<' || *p == '>') {
+            extra += 3;
+        }
+    }
+    if (extra == 0) {
+        return text;
+    }
+
+    o = out = apr_palloc(pool, len + extra + 1);
+    for (const char *p = text; *p; p++) {
+        if (*p == '<') {
+            memcpy(o, "&lt;", 4);
+            o += 4;
+        } else if (*p == '>') {
+            memcpy(o, "&gt;", 4);
+            o += 4;
+        } else {
+            *o++ = *p;
+        }
+    }
+    *o = '\0';
+    return out;
+}
+
+/* Translate batch[0..count) with one request. The segments go out as a JSON
+ * array and must come back as an array of the same length. */
+static int translate_batch(request_rec *r, advanced_muse_ai_config *cfg, const muse_ai_config *backend,
+                           const muse_language_selection_t *lang_selection, const char *page,
+                           splice_t **batch, int count)
+{
+    const char *locale = lang_selection->selected_locale;
+    const char *display_name = muse_get_locale_display_name(locale);
+    const char *model = cfg->translate_model ? cfg->translate_model : backend->model;
+    cJSON *segments = cJSON_CreateArray();
+    cJSON *answer;
+    char *json, *content, *open, *close;
+    const char *system_prompt, *payload;
+    int status;
+
+    for (int i = 0; i < count; i++) {
+        cJSON_AddItemToArray(segments, cJSON_CreateString(apr_pstrndup(r->pool, page + batch[i]->start, batch[i]->len)));
+    }
+    json = cJSON_PrintUnformatted(segments);
+    cJSON_Delete(segments);
+
+    system_prompt = apr_psprintf(r->pool,
+        "You translate website text from English to %s (%s).\n"
+        "The user message is a JSON array of text segments from one HTML page, in page order.\n"
+        "Reply with only a JSON array of exactly %d strings: the translation of each segment, in the same order.\n"
+        "Keep HTML entities such as &amp;, numbers, URLs and product names unchanged.",
+        display_name ? display_name : locale, locale, count);
+    payload = build_payload(r, cfg, model, system_prompt, json);
+    cJSON_free(json);
+
+    status = call_backend(r, cfg, backend, model, payload, 1, &content);
+    if (status != OK) {
+        return status;
+    }
+
+    /* Tolerate code fences or a sentence around the array */
+    open = content ? strchr(content, '[') : NULL;
+    close = content ? strrchr(content, ']') : NULL;
+    answer = open && close > open ? cJSON_ParseWithLength(open, (apr_size_t)(close + 1 - open)) : NULL;
+    if (!cJSON_IsArray(answer) || cJSON_GetArraySize(answer) != count) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r,
+                     "[mod_muse_ai] Translation to %s did not return %d segments: '%.200s'",
+                     locale, count, content ? content : "");
+        cJSON_Delete(answer);
+        return HTTP_BAD_GATEWAY;
+    }
+
+    for (int i = 0; i < count; i++) {
+        cJSON *item = cJSON_GetArrayItem(answer, i);
+        if (!cJSON_IsString(item)) {
+            cJSON_Delete(answer);
+            return HTTP_BAD_GATEWAY;
+        }
+        batch[i]->text = escape_text(r->pool, apr_pstrdup(r->pool, item->valuestring));
+        translation_memory_put(locale, page + batch[i]->start, batch[i]->len, batch[i]->text);
+    }
+    cJSON_Delete(answer);
+    return OK;
+}
+
+/* Copy the source page with every splice applied */
+static char *apply_splices(apr_pool_t *pool, const char *page, apr_array_header_t *splices)
+{
+    apr_size_t page_len = strlen(page), out_len = page_len, pos = 0;
+    char *out, *o;
+
+    for (int i = 0; i < splices->nelts; i++) {
+        splice_t *sp = &APR_ARRAY_IDX(splices, i, splice_t);
+        out_len += strlen(sp->text) - sp->len;
+    }
+
+    o = out = apr_palloc(pool, out_len + 1);
+    for (int i = 0; i < splices->nelts; i++) {
+        splice_t *sp = &APR_ARRAY_IDX(splices, i, splice_t);
+        apr_size_t text_len = strlen(sp->text);
+
+        memcpy(o, page + pos, sp->start - pos);
+        o += sp->start - pos;
+        memcpy(o, sp->text, text_len);
+        o += text_len;
+        pos = sp->start + sp->len;
+    }
+    memcpy(o, page + pos, page_len - pos);
+    o[page_len - pos] = '\0';
+    return out;
+}
+
+int translate_from_source(request_rec *r, advanced_muse_ai_config *cfg, const muse_ai_config *backend,
+                          const muse_language_selection_t *lang_selection,
+                          const char *system_prompt, const char *page_prompt, char **page)
+{
+    int batch_size = cfg->translate_batch_size > 0 ? cfg->translate_batch_size : MUSE_AI_TRANSLATE_DEFAULT_BATCH;
+    splice_t **batch = apr_palloc(r->pool, sizeof(splice_t *) * batch_size);
+    extract_ctx_t ex;
+    html_tokenizer_t *tok;
+    char *source;
+    int status, count = 0, segments = 0;
+    apr_uint32_t remembered = 0, tokens_saved = 0;
+    apr_size_t batch_bytes = 0;
+
+    status = load_source_page(r, cfg, backend, system_prompt, page_prompt, &source);
+    if (status != OK) {
+        return status;
+    }
+    if (!source || !*source) {
+        return HTTP_BAD_GATEWAY;
+    }
+
+    memset(&ex, 0, sizeof(ex));
+    ex.r = r;
+    ex.lang_selection = lang_selection;
+    ex.page = source;
+    ex.page_len = strlen(source);
+    ex.splices = apr_array_make(r->pool, 256, sizeof(splice_t));
+    tok = html_tokenizer_create(r->pool, collect_splices, &ex);
+    html_tokenizer_feed(tok, source, ex.page_len);
+    html_tokenizer_finish(tok);
+
+    /* Segments seen before, on any page, come from the translation memory;
+     * the rest are batched by segment count and by bytes of source text */
+    for (int i = 0; i < ex.splices->nelts; i++) {
+        splice_t *sp = &APR_ARRAY_IDX(ex.splices, i, splice_t);
+
+        if (sp->text) {
+            continue;
+        }
+        sp->text = translation_memory_get(r->pool, lang_selection->selected_locale, source + sp->start, sp->len);
+        if (sp->text) {
+            remembered++;
+            tokens_saved += (apr_uint32_t)(strlen(sp->text) / 4);
+            continue;
+        }
+        if (count > 0 && batch_bytes + sp->len > MUSE_AI_TRANSLATE_MAX_BATCH_BYTES) {
+            status = translate_batch(r, cfg, backend, lang_selection, source, batch, count);
+            if (status != OK) {
+                return status;
+            }
+            count = 0;
+            batch_bytes = 0;
+        }
+        batch[count++] = sp;
+        batch_bytes += sp->len;
+        segments++;
+        if (count == batch_size) {
+            status = translate_batch(r, cfg, backend, lang_selection, source, batch, count);
+            if (status != OK) {
+                return status;
+            }
+            count = 0;
+            batch_bytes = 0;
+        }
+    }
+    if (count > 0) {
+        status = translate_batch(r, cfg, backend, lang_selection, source, batch, count);
+        if (status != OK) {
+            return status;
+        }
+    }
+
+    metrics_translation_memory(remembered, (apr_uint32_t)segments, tokens_saved);
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r,
+                 "[mod_muse_ai] Translated %d text segments of the source page to %s, %u from memory",
+                 segments, lang_selection->selected_locale, remembered);
+
+    *page = html_rewrite_page(r, lang_selection, apply_splices(r->pool, source, ex.splices));
+    return OK;
+}
@@ -0,0 +1,36 @@
+#ifndef SOURCE_TRANSLATION_H
+#define SOURCE_TRANSLATION_H
+
+#include <httpd.h>
+#include "advanced_config.h"
+#include "language_selection.h"
+
+/* Two-stage translation. The canonical page is generated once, in the
+ * source locale, and kept in MuseAiTranslateSourceDir under the hash of its
+ * generation request. Other locales are made from that page: only its text
+ * nodes go to the model, in batches of short segments, and the answers are
+ * spliced back into the untouched markup. Cached pages are never pruned
+ * here; HOWTO.md shows the cron cleanup. */
+#define MUSE_AI_TRANSLATE_SOURCE_LOCALE "en_US"
+#define MUSE_AI_TRANSLATE_DEFAULT_BATCH 40             /* Segments per translation request */
+#define MUSE_AI_TRANSLATE_MAX_BATCH_BYTES (16 * 1024)  /* Source text per translation request */
+
+struct muse_ai_config;
+
+/* Function declarations */
+
+/* Is this request served from the translated source page? */
+int translate_from_source_enabled(request_rec *r, advanced_muse_ai_config *cfg,
+                                  const muse_language_selection_t *lang_selection);
+
+/* Produce the page for the selected locale from the cached source page,
+ * generating the source first when it is not cached yet. backend holds the
+ * endpoint, model and API key of the page request, which the source page
+ * and (unless MuseAiTranslateModel is set) the translations use too.
+ * system_prompt may be NULL. Returns OK with *page set, or an HTTP status;
+ * the caller may then still generate the page directly. */
+int translate_from_source(request_rec *r, advanced_muse_ai_config *cfg, const struct muse_ai_config *backend,
+                          const muse_language_selection_t *lang_selection,
+                          const char *system_prompt, const char *page_prompt, char **page);
+
+#endif /* SOURCE_TRANSLATION_H */
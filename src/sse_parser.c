@@ -0,0 +1,129 @@
+/* SSE line and streaming JSON chunk parsing for OpenAI-compatible backends.
+ * Pure functions on an APR pool, so they can be benchmarked outside httpd. */
+#include "sse_parser.h"
+#include <apr_strings.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Parse SSE (Server-Sent Events) data chunk */
+char *parse_sse_chunk(apr_pool_t *pool, const char *chunk)
+{
+    if (!chunk) return NULL;
+    
+    /* Look for "data: " prefix anywhere in the chunk */
+    const char *data_prefix = "data: ";
+    char *data_line = strstr(chunk, data_prefix);
+    
+    if (!data_line) {
+        /* Check for [DONE] marker */
+        if (strstr(chunk, "[DONE]")) {
+            return NULL; /* End of stream */
+        }
+        return NULL;
+    }
+    
+    /* Skip the "data: " prefix */
+    data_line += strlen(data_prefix);
+    
+    /* Find end of line */
+    char *line_end = strchr(data_line, '\n');
+    if (!line_end) line_end = strchr(data_line, '\r');
+    
+    if (line_end) {
+        /* Extract the data content */
+        int data_len = line_end - data_line;
+        char *data_content = apr_palloc(pool, data_len + 1);
+        strncpy(data_content, data_line, data_len);
+        data_content[data_len] = '\0';
+        
+        /* Check for [DONE] marker */
+        if (strcmp(data_content, "[DONE]") == 0) {
+            return NULL; /* End of stream */
+        }
+        
+        return data_content;
+    }
+    
+    return NULL;
+}
+
+/* Extract content from JSON chunk */
+char *extract_json_content(apr_pool_t *pool, const char *json_data)
+{
+    if (!json_data) return NULL;
+    
+    /* Simple JSON parsing - look for "content":"..." pattern */
+    char *content_start = strstr(json_data, "\"content\":\"");
+    if (!content_start) return NULL;
+    
+    content_start += strlen("\"content\":\"");
+    
+    /* Find the closing quote, handling escaped quotes */
+    char *content_end = content_start;
+    while (*content_end && !(*content_end == '"' && *(content_end - 1) != '\\')) {
+        content_end++;
+    }
+    
+    if (*content_end == '"') {
+        int content_len = content_end - content_start;
+        char *content = apr_palloc(pool, content_len + 1);
+        strncpy(content, content_start, content_len);
+        content[content_len] = '\0';
+        
+        /* Unescape common JSON escape sequences */
+        char *unescaped = apr_pstrdup(pool, content);
+        
+        /* Replace Unicode escape sequences */
+        char *unicode_pos;
+        char *search = unescaped;
+        while ((unicode_pos = strstr(search, "\\u")) != NULL) {
+            /* Parse the 4-digit hex code */
+            if (strlen(unicode_pos) >= 6) {
+                char hex_str[5];
+                strncpy(hex_str, unicode_pos + 2, 4);
+                hex_str[4] = '\0';
+                
+                /* Convert hex to integer */
+                unsigned int unicode_val = (unsigned int)strtol(hex_str, NULL, 16);
+                
+                /* Convert common Unicode values to ASCII */
+                char replacement = 0;
+                if (unicode_val == 0x003c) replacement = '<';      /* \u003c -> < */
+                else if (unicode_val == 0x003e) replacement = '>'; /* \u003e -> > */
+                else if (unicode_val == 0x0026) replacement = '&'; /* \u0026 -> & */
+                else if (unicode_val == 0x0022) replacement = '"'; /* \u0022 -> " */
+                else if (unicode_val == 0x0027) replacement = '\''; /* \u0027 -> ' */
+                else if (unicode_val == 0x002f) replacement = '/'; /* \u002f -> / */
+                
+                if (replacement) {
+                    *unicode_pos = replacement;
+                    memmove(unicode_pos + 1, unicode_pos + 6, strlen(unicode_pos + 6) + 1);
+                    search = unicode_pos + 1;
+                } else {
+                    /* Skip this Unicode sequence if we don't handle it */
+                    search = unicode_pos + 6;
+                }
+            } else {
+                break;
+            }
+        }
+        
+        /* Replace \\n with \n */
+        char *newline_pos;
+        while ((newline_pos = strstr(unescaped, "\\n")) != NULL) {
+            *newline_pos = '\n';
+            memmove(newline_pos + 1, newline_pos + 2, strlen(newline_pos + 2) + 1);
+        }
+        
+        /* Replace \\\" with \" */
+        char *quote_pos;
+        while ((quote_pos = strstr(unescaped, "\\\"")) != NULL) {
+            *quote_pos = '"';
+            memmove(quote_pos + 1, quote_pos + 2, strlen(quote_pos + 2) + 1);
+        }
+        
+        return unescaped;
+    }
+    
+    return NULL;
+}
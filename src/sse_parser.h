@@ -0,0 +1,15 @@
+#ifndef SSE_PARSER_H
+#define SSE_PARSER_H
+
+#include <apr_pools.h>
+
+/* Function declarations */
+
+/* Payload of the first "data: " line in chunk, or NULL for [DONE] and
+ * chunks without a complete data line */
+char *parse_sse_chunk(apr_pool_t *pool, const char *chunk);
+
+/* Unescaped "content" string of a streamed chat completion chunk, or NULL */
+char *extract_json_content(apr_pool_t *pool, const char *json_data);
+
+#endif /* SSE_PARSER_H */
@@ -0,0 +1,161 @@
+/* Record-and-replay capture of backend response streams. Sampled requests
+ * keep every read from the backend socket, with its receive time, in the
+ * request pool; the capture file is written once the request is over so
+ * that recording never delays the stream it measures. */
+#include "stream_capture.h"
+#include "advanced_config.h"
+#include "request_context.h"
+#include <apr_strings.h>
+#include <apr_tables.h>
+#include <apr_file_io.h>
+#include <apr_atomic.h>
+#include <apr_time.h>
+#include <http_log.h>
+#include <unistd.h>
+
+extern module AP_MODULE_DECLARE_DATA muse_ai_module;
+
+typedef struct {
+    apr_interval_time_t offset;     /* Since the request was sent */
+    const char *data;
+    apr_size_t len;
+} capture_record_t;
+
+struct stream_capture {
+    request_rec *r;
+    const char *dir;
+    const char *backend_url;
+    apr_time_t started;
+    apr_array_header_t *records;    /* capture_record_t */
+    apr_size_t bytes;
+    apr_size_t max_bytes;
+    int truncated;
+    int kept;
+};
+
+/* Sampling counter of this child process */
+static volatile apr_uint32_t g_capture_seq = 0;
+
+stream_capture_t *stream_capture_start(request_rec *r, const char *backend_url)
+{
+    advanced_muse_ai_config *cfg = ap_get_module_config(r->server->module_config, &muse_ai_module);
+    muse_ai_request_ctx_t *ctx;
+    stream_capture_t *cap;
+
+    if (!cfg || !cfg->capture_dir || cfg->capture_sample <= 0) {
+        return NULL;
+    }
+
+    ctx = muse_ai_request_ctx(r);
+    if (ctx->capture_sampled == 0) {
+        apr_uint32_t seq = apr_atomic_inc32(&g_capture_seq);
+        ctx->capture_sampled = seq % (apr_uint32_t)cfg->capture_sample == 0 ? 1 : -1;
+    }
+    if (ctx->capture_sampled < 0) {
+        return NULL;
+    }
+
+    cap = apr_pcalloc(r->pool, sizeof(stream_capture_t));
+    cap->r = r;
+    cap->dir = cfg->capture_dir;
+    cap->backend_url = backend_url;
+    cap->started = apr_time_now();
+    cap->records = apr_array_make(r->pool, 256, sizeof(capture_record_t));
+    cap->max_bytes = (apr_size_t)cfg->capture_max_bytes;
+    return cap;
+}
+
+void stream_capture_data(stream_capture_t *cap, const char *data, apr_size_t len)
+{
+    capture_record_t *rec;
+
+    if (!cap || len == 0 || cap->truncated) {
+        return;
+    }
+
+    if (cap->bytes + len > cap->max_bytes) {
+        len = cap->max_bytes - cap->bytes;
+        cap->truncated = 1;
+        if (len == 0) {
+            return;
+        }
+    }
+
+    rec = &APR_ARRAY_PUSH(cap->records, capture_record_t);
+    rec->offset = apr_time_now() - cap->started;
+    rec->data = apr_pmemdup(cap->r->pool, data, len);
+    rec->len = len;
+    cap->bytes += len;
+}
+
+static apr_status_t write_capture(void *data)
+{
+    stream_capture_t *cap = data;
+    request_rec *r = cap->r;
+    muse_ai_request_ctx_t *ctx = muse_ai_request_ctx(r);
+    apr_pool_t *pool;
+    apr_file_t *file;
+    apr_time_exp_t t;
+    const char *path;
+    apr_status_t rv;
+
+    if (cap->records->nelts == 0) {
+        return APR_SUCCESS;
+    }
+
+    /* The request pool is being destroyed; work in a pool of our own */
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS) {
+        return APR_SUCCESS;
+    }
+
+    apr_time_exp_gmt(&t, r->request_time);
+    path = apr_psprintf(pool, "%s/%04d%02d%02d-%02d%02d%02d-%d-%u" MUSE_AI_CAPTURE_EXTENSION,
+                        cap->dir, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+                        t.tm_hour, t.tm_min, t.tm_sec, (int)getpid(),
+                        apr_atomic_inc32(&g_capture_seq));
+
+    rv = apr_file_open(&file, path, APR_WRITE | APR_CREATE | APR_EXCL | APR_BUFFERED | APR_BINARY,
+                       APR_FPROT_UREAD | APR_FPROT_UWRITE, pool);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, r->server,
+                    "[mod_muse_ai] Could not create capture file %s", path);
+        apr_pool_destroy(pool);
+        return APR_SUCCESS;
+    }
+
+    apr_file_printf(file, MUSE_AI_CAPTURE_MAGIC "\n"
+                    "backend: %s\n"
+                    "model: %s\n"
+                    "started: %04d-%02d-%02dT%02d:%02d:%02d.%03dZ\n"
+                    "bytes: %" APR_SIZE_T_FMT "\n"
+                    "truncated: %d\n\n",
+                    cap->backend_url, ctx->model ? ctx->model : "",
+                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+                    t.tm_usec / 1000, cap->bytes, cap->truncated);
+
+    for (int i = 0; i < cap->records->nelts; i++) {
+        capture_record_t *rec = &APR_ARRAY_IDX(cap->records, i, capture_record_t);
+        apr_file_printf(file, "%" APR_TIME_T_FMT " %" APR_SIZE_T_FMT "\n", rec->offset, rec->len);
+        apr_file_write_full(file, rec->data, rec->len, NULL);
+        apr_file_putc('\n', file);
+    }
+
+    rv = apr_file_close(file);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, r->server,
+                    "[mod_muse_ai] Could not write capture file %s", path);
+    }
+
+    apr_pool_destroy(pool);
+    return APR_SUCCESS;
+}
+
+void stream_capture_keep(stream_capture_t *cap)
+{
+    if (!cap || cap->kept) {
+        return;
+    }
+
+    cap->kept = 1;
+    apr_pool_cleanup_register(cap->r->pool, cap, write_capture, apr_pool_cleanup_null);
+}
@@ -0,0 +1,46 @@
+#ifndef STREAM_CAPTURE_H
+#define STREAM_CAPTURE_H
+
+#include <httpd.h>
+#include <http_config.h>
+#include <apr_pools.h>
+
+/* Capture file format, version 1. A text header, a blank line, then one
+ * record per read from the backend socket:
+ *
+ *   MUSEAI-CAPTURE 1
+ *   backend: http://127.0.0.1:11434/v1
+ *   model: llama3.2:latest
+ *   started: 2025-01-15T10:42:07.512Z
+ *   bytes: 48213
+ *   truncated: 0
+ *
+ *   <microseconds since the request was sent> <length>\n<raw bytes>\n
+ *   ...
+ *
+ * The raw bytes are the backend response as received, HTTP head included,
+ * so a replay reproduces framing and timing exactly. */
+#define MUSE_AI_CAPTURE_MAGIC "MUSEAI-CAPTURE 1"
+#define MUSE_AI_CAPTURE_EXTENSION ".musecap"
+#define MUSE_AI_CAPTURE_DEFAULT_SAMPLE 100          /* One in 100 responses */
+#define MUSE_AI_CAPTURE_DEFAULT_MAX_BYTES (1024 * 1024)
+
+typedef struct stream_capture stream_capture_t;
+
+/* Function declarations */
+
+/* Start recording a backend attempt whose request has just been sent.
+ * Returns NULL unless MuseAiCaptureDir is set and this request is sampled;
+ * the sampling decision is made once per request, so retries and hedged
+ * attempts of a sampled request are all recorded. */
+stream_capture_t *stream_capture_start(request_rec *r, const char *backend_url);
+
+/* Record bytes just read from the backend. No-op for a NULL capture. */
+void stream_capture_data(stream_capture_t *cap, const char *data, apr_size_t len);
+
+/* Keep this capture: it is written to the capture directory when the
+ * request pool is destroyed, after the response has been sent. Captures
+ * that are never kept (losing hedged attempts) are discarded. */
+void stream_capture_keep(stream_capture_t *cap);
+
+#endif /* STREAM_CAPTURE_H */
@@ -1,7 +1,7 @@
 #include "mod_muse_ai.h"
+#include "request_context.h"
 #include <string.h>
 #include <ctype.h>
-#include <strings.h>  /* for strncasecmp */
 
 /* Create streaming state structure */
 streaming_state_t *create_streaming_state(apr_pool_t *pool)
@@ -24,51 +24,6 @@ void reset_streaming_state(streaming_state_t *state)
     /* Note: pending_buffer will be reset by caller if needed */
 }
 
-/* Find HTML document start position */
-int find_html_start(const char *content)
-{
-    if (!content) return -1;
-    
-    /* Simple case-insensitive search without dynamic allocation */
-    const char *pos = content;
-    int len = strlen(content);
-    
-    /* Look for DOCTYPE (case insensitive) */
-    for (int i = 0; i <= len - 9; i++) {
-        if (strncasecmp(pos + i, "<!doctype", 9) == 0) {
-            return i;
-        }
-    }
-    
-    /* Look for <html tag (case insensitive) */
-    for (int i = 0; i <= len - 5; i++) {
-        if (strncasecmp(pos + i, "<html", 5) == 0) {
-            return i;
-        }
-    }
-    
-    return -1;
-}
-
-/* Find HTML document end position */
-int find_html_end(const char *content)
-{
-    if (!content) return -1;
-    
-    /* Simple case-insensitive search without dynamic allocation */
-    const char *pos = content;
-    int len = strlen(content);
-    
-    /* Look for </html> tag (case insensitive) */
-    for (int i = 0; i <= len - 7; i++) {
-        if (strncasecmp(pos + i, "</html>", 7) == 0) {
-            return i;
-        }
-    }
-    
-    return -1;
-}
-
 /* Process streaming content using MuseWeb's smart streaming approach */
 char *process_streaming_content(request_rec *r, streaming_state_t *state, 
                                const char *new_content, 
@@ -98,6 +53,7 @@ char *process_streaming_content(request_rec *r, streaming_state_t *state,
         if (elapsed >= buffer_duration || buffer_len > 1000) {
             /* Apply comprehensive sanitization to the buffered content before streaming */
             char *fully_sanitized = sanitize_response(r->pool, state->pending_buffer, lang_selection);
+            muse_ai_request_ctx(r)->sanitize_passes++;
             state->pending_buffer = fully_sanitized;
             
             /* Start streaming the sanitized content */
@@ -122,6 +78,7 @@ char *process_streaming_content(request_rec *r, streaming_state_t *state,
             
             /* Apply sanitization to new portion to handle markdown artifacts in streaming */
             char *sanitized_portion = cleanup_code_fences(r->pool, new_portion);
+            muse_ai_request_ctx(r)->sanitize_passes++;
             
             state->last_sent_length = buffer_len;
             return sanitized_portion;
@@ -143,6 +100,7 @@ char *process_streaming_content(request_rec *r, streaming_state_t *state,
             
             /* Apply sanitization to final portion */
             final_content = cleanup_code_fences(r->pool, raw_final);
+            muse_ai_request_ctx(r)->sanitize_passes++;
         }
         
         /* Mark HTML as complete */
@@ -2,69 +2,76 @@
  * @file supported_locales.c
  * @brief Implementation of supported locales module
  * 
- * This file is auto-generated from docs/locale-identifiers.csv
+ * This file is auto-generated from docs/pruned-languages.csv
  * Do not edit manually - run scripts/generate_locales.py to regenerate
  * 
- * Generated on: 2025-06-29 20:02:28
+ * Generated on: 2026-10-18 23:29:56
  * Total locales: 46
+ * 
+ * Lookups do not scan the locale array. A full locale "ll_CC" is packed
+ * into a 32-bit key and found through a perfect hash chosen by the
+ * generator; a language code indexes a table of its default locale by its
+ * two letters. Display names, tiers and RTL flags are precomputed.
+ * 
+ * Nothing here is mutable: every function is thread-safe and returns
+ * pointers into the static tables, which callers may keep without copying.
  */
 
 #include "supported_locales.h"
 #include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
+#include <stdint.h>
 #include <ctype.h>
 
 /**
  * @brief Static array of all supported locales
  */
 static const muse_locale_t supported_locales[] = {
-    {"ar_SA", "Arabic", "Saudi Arabia", "Tier 2 (Good)", "Good and Reliable. Works well for Modern Standard Arabic (MSA)."},
-    {"bg_BG", "Bulgarian", "Bulgaria", "Tier 3 (Functional)", "Functional. Best for understanding the gist or for basic communication."},
-    {"bn_BD", "Bengali", "Bangladesh", "Tier 2 (Good)", "Good and Reliable. Suitable for most professional and personal use."},
-    {"ca_ES", "Catalan", "Spain", "Tier 3 (Functional)", "Functional. Works well, especially when translating to/from Spanish."},
-    {"cs_CZ", "Czech", "Czech Republic", "Tier 2 (Good)", "Good and Reliable. Consistent performance for most content."},
-    {"da_DK", "Danish", "Denmark", "Tier 2 (Good)", "Good and Reliable. Solid choice for general-purpose translation."},
-    {"de_DE", "German", "Germany", "Tier 1 (High)", "Excellent. Highly accurate and natural-sounding translations."},
-    {"el_GR", "Greek", "Greece", "Tier 2 (Good)", "Good and Reliable. Strong performance in modern Greek."},
-    {"en_GB", "English", "United Kingdom", "Tier 1 (High)", "Excellent. Fully aware of British spelling and common idioms."},
-    {"en_US", "English", "United States", "Tier 1 (High)", "Excellent. Translations are nuanced, accurate, and preserve context and tone."},
-    {"es_ES", "Spanish", "Spain", "Tier 1 (High)", "Excellent. Aware of Castilian vocabulary and norms."},
-    {"es_MX", "Spanish", "Mexico", "Tier 1 (High)", "Excellent. The primary standard for Latin American Spanish."},
-    {"fa_IR", "Persian", "Iran", "Tier 3 (Functional)", "Functional. Reliable for standard Farsi text; review is recommended."},
-    {"fi_FI", "Finnish", "Finland", "Tier 2 (Good)", "Good and Reliable. Handles complex grammar well for most cases."},
-    {"fr_FR", "French", "France", "Tier 1 (High)", "Excellent. Consistently high-quality translation."},
-    {"he_IL", "Hebrew", "Israel", "Tier 2 (Good)", "Good and Reliable. Consistent and accurate translations."},
-    {"hi_IN", "Hindi", "India", "Tier 2 (Good)", "Good and Reliable. Understands Devanagari script and common usage."},
-    {"hr_HR", "Croatian", "Croatia", "Tier 3 (Functional)", "Functional. Good for general understanding; may lack natural flow."},
-    {"hu_HU", "Hungarian", "Hungary", "Tier 2 (Good)", "Good and Reliable. Suitable for a wide range of translation needs."},
-    {"id_ID", "Indonesian", "Indonesia", "Tier 2 (Good)", "Good and Reliable. Very functional and widely applicable."},
-    {"it_IT", "Italian", "Italy", "Tier 1 (High)", "Excellent. Reliable for all types of translation tasks."},
-    {"ja_JP", "Japanese", "Japan", "Tier 1 (High)", "Excellent. Strong grasp of grammar, script, and cultural context."},
-    {"ko_KR", "Korean", "South Korea", "Tier 2 (Good)", "Good and Reliable. Strong understanding of Hangul and modern usage."},
-    {"lt_LT", "Lithuanian", "Lithuania", "Tier 3 (Functional)", "Functional. Can produce literal translations; best for simple texts."},
-    {"lv_LV", "Latvian", "Latvia", "Tier 3 (Functional)", "Functional. Similar to Lithuanian; best to review for important use."},
-    {"ms_MY", "Malay", "Malaysia", "Tier 3 (Functional)", "Functional. Suitable for standard requests and getting the main idea."},
-    {"nb_NO", "Norwegian", "Norway", "Tier 2 (Good)", "Good and Reliable. Strong support for the Bokmål standard."},
-    {"nl_NL", "Dutch", "Netherlands", "Tier 2 (Good)", "Good and Reliable. High-quality translations for general content."},
-    {"pl_PL", "Polish", "Poland", "Tier 2 (Good)", "Good and Reliable. A solid choice for professional use cases."},
-    {"pt_BR", "Portuguese", "Brazil", "Tier 1 (High)", "Excellent. The most common and well-supported variant of Portuguese."},
-    {"pt_PT", "Portuguese", "Portugal", "Tier 1 (High)", "Excellent. Fully proficient in European Portuguese."},
-    {"ro_RO", "Romanian", "Romania", "Tier 2 (Good)", "Good and Reliable. Consistent performance."},
-    {"ru_RU", "Russian", "Russia", "Tier 2 (Good)", "Good and Reliable. High accuracy for a wide variety of texts."},
-    {"sk_SK", "Slovak", "Slovakia", "Tier 3 (Functional)", "Functional. Good for straightforward text; review complex content."},
-    {"sl_SI", "Slovenian", "Slovenia", "Tier 3 (Functional)", "Functional. Best for simple sentences and direct translations."},
-    {"sr_RS", "Serbian", "Serbia", "Tier 3 (Functional)", "Functional. Understands Cyrillic/Latin scripts; best for simple text."},
-    {"sv_SE", "Swedish", "Sweden", "Tier 2 (Good)", "Good and Reliable. Solid performance for general-purpose translation."},
-    {"sw_KE", "Swahili", "Kenya", "Tier 3 (Functional)", "Functional. Primarily useful for basic translation and simple questions."},
-    {"th_TH", "Thai", "Thailand", "Tier 2 (Good)", "Good and Reliable. Handles Thai script and nuances effectively."},
-    {"tl_PH", "Tagalog", "Philippines", "Tier 3 (Functional)", "Functional. Also fil_PH. Good for gist; may sound machine-like."},
-    {"tr_TR", "Turkish", "Turkey", "Tier 2 (Good)", "Good and Reliable. Strong performance for most translation tasks."},
-    {"uk_UA", "Ukrainian", "Ukraine", "Tier 2 (Good)", "Good and Reliable. Quality is high and consistently improving."},
-    {"ur_PK", "Urdu", "Pakistan", "Tier 3 (Functional)", "Functional. Capable of translating standard text; review recommended."},
-    {"vi_VN", "Vietnamese", "Vietnam", "Tier 2 (Good)", "Good and Reliable. Suitable for a wide variety of contexts."},
-    {"zh_CN", "Chinese", "China (Simplified)", "Tier 1 (High)", "Excellent. Expert-level translation for Simplified Chinese."},
-    {"zh_TW", "Chinese", "Taiwan (Traditional)", "Tier 1 (High)", "Excellent. Expert-level translation for Traditional Chinese."}
+    {"ar_SA", "Arabic", "Saudi Arabia", "Tier 2 (Good)", "Good and Reliable. Works well for Modern Standard Arabic (MSA).", "ar", "Arabic (Saudi Arabia)", true},
+    {"bg_BG", "Bulgarian", "Bulgaria", "Tier 3 (Functional)", "Functional. Best for understanding the gist or for basic communication.", "bg", "Bulgarian (Bulgaria)", false},
+    {"bn_BD", "Bengali", "Bangladesh", "Tier 2 (Good)", "Good and Reliable. Suitable for most professional and personal use.", "bn", "Bengali (Bangladesh)", false},
+    {"ca_ES", "Catalan", "Spain", "Tier 3 (Functional)", "Functional. Works well, especially when translating to/from Spanish.", "ca", "Catalan (Spain)", false},
+    {"cs_CZ", "Czech", "Czech Republic", "Tier 2 (Good)", "Good and Reliable. Consistent performance for most content.", "cs", "Czech (Czech Republic)", false},
+    {"da_DK", "Danish", "Denmark", "Tier 2 (Good)", "Good and Reliable. Solid choice for general-purpose translation.", "da", "Danish (Denmark)", false},
+    {"de_DE", "German", "Germany", "Tier 1 (High)", "Excellent. Highly accurate and natural-sounding translations.", "de", "German (Germany)", false},
+    {"el_GR", "Greek", "Greece", "Tier 2 (Good)", "Good and Reliable. Strong performance in modern Greek.", "el", "Greek (Greece)", false},
+    {"en_GB", "English", "United Kingdom", "Tier 1 (High)", "Excellent. Fully aware of British spelling and common idioms.", "en", "English (United Kingdom)", false},
+    {"en_US", "English", "United States", "Tier 1 (High)", "Excellent. Translations are nuanced, accurate, and preserve context and tone.", "en", "English (United States)", false},
+    {"es_ES", "Spanish", "Spain", "Tier 1 (High)", "Excellent. Aware of Castilian vocabulary and norms.", "es", "Spanish (Spain)", false},
+    {"es_MX", "Spanish", "Mexico", "Tier 1 (High)", "Excellent. The primary standard for Latin American Spanish.", "es", "Spanish (Mexico)", false},
+    {"fa_IR", "Persian", "Iran", "Tier 3 (Functional)", "Functional. Reliable for standard Farsi text; review is recommended.", "fa", "Persian (Iran)", true},
+    {"fi_FI", "Finnish", "Finland", "Tier 2 (Good)", "Good and Reliable. Handles complex grammar well for most cases.", "fi", "Finnish (Finland)", false},
+    {"fr_FR", "French", "France", "Tier 1 (High)", "Excellent. Consistently high-quality translation.", "fr", "French (France)", false},
+    {"he_IL", "Hebrew", "Israel", "Tier 2 (Good)", "Good and Reliable. Consistent and accurate translations.", "he", "Hebrew (Israel)", true},
+    {"hi_IN", "Hindi", "India", "Tier 2 (Good)", "Good and Reliable. Understands Devanagari script and common usage.", "hi", "Hindi (India)", false},
+    {"hr_HR", "Croatian", "Croatia", "Tier 3 (Functional)", "Functional. Good for general understanding; may lack natural flow.", "hr", "Croatian (Croatia)", false},
+    {"hu_HU", "Hungarian", "Hungary", "Tier 2 (Good)", "Good and Reliable. Suitable for a wide range of translation needs.", "hu", "Hungarian (Hungary)", false},
+    {"id_ID", "Indonesian", "Indonesia", "Tier 2 (Good)", "Good and Reliable. Very functional and widely applicable.", "id", "Indonesian (Indonesia)", false},
+    {"it_IT", "Italian", "Italy", "Tier 1 (High)", "Excellent. Reliable for all types of translation tasks.", "it", "Italian (Italy)", false},
+    {"ja_JP", "Japanese", "Japan", "Tier 1 (High)", "Excellent. Strong grasp of grammar, script, and cultural context.", "ja", "Japanese (Japan)", false},
+    {"ko_KR", "Korean", "South Korea", "Tier 2 (Good)", "Good and Reliable. Strong understanding of Hangul and modern usage.", "ko", "Korean (South Korea)", false},
+    {"lt_LT", "Lithuanian", "Lithuania", "Tier 3 (Functional)", "Functional. Can produce literal translations; best for simple texts.", "lt", "Lithuanian (Lithuania)", false},
+    {"lv_LV", "Latvian", "Latvia", "Tier 3 (Functional)", "Functional. Similar to Lithuanian; best to review for important use.", "lv", "Latvian (Latvia)", false},
+    {"ms_MY", "Malay", "Malaysia", "Tier 3 (Functional)", "Functional. Suitable for standard requests and getting the main idea.", "ms", "Malay (Malaysia)", false},
+    {"nb_NO", "Norwegian", "Norway", "Tier 2 (Good)", "Good and Reliable. Strong support for the Bokmål standard.", "nb", "Norwegian (Norway)", false},
+    {"nl_NL", "Dutch", "Netherlands", "Tier 2 (Good)", "Good and Reliable. High-quality translations for general content.", "nl", "Dutch (Netherlands)", false},
+    {"pl_PL", "Polish", "Poland", "Tier 2 (Good)", "Good and Reliable. A solid choice for professional use cases.", "pl", "Polish (Poland)", false},
+    {"pt_BR", "Portuguese", "Brazil", "Tier 1 (High)", "Excellent. The most common and well-supported variant of Portuguese.", "pt", "Portuguese (Brazil)", false},
+    {"pt_PT", "Portuguese", "Portugal", "Tier 1 (High)", "Excellent. Fully proficient in European Portuguese.", "pt", "Portuguese (Portugal)", false},
+    {"ro_RO", "Romanian", "Romania", "Tier 2 (Good)", "Good and Reliable. Consistent performance.", "ro", "Romanian (Romania)", false},
+    {"ru_RU", "Russian", "Russia", "Tier 2 (Good)", "Good and Reliable. High accuracy for a wide variety of texts.", "ru", "Russian (Russia)", false},
+    {"sk_SK", "Slovak", "Slovakia", "Tier 3 (Functional)", "Functional. Good for straightforward text; review complex content.", "sk", "Slovak (Slovakia)", false},
+    {"sl_SI", "Slovenian", "Slovenia", "Tier 3 (Functional)", "Functional. Best for simple sentences and direct translations.", "sl", "Slovenian (Slovenia)", false},
+    {"sr_RS", "Serbian", "Serbia", "Tier 3 (Functional)", "Functional. Understands Cyrillic/Latin scripts; best for simple text.", "sr", "Serbian (Serbia)", false},
+    {"sv_SE", "Swedish", "Sweden", "Tier 2 (Good)", "Good and Reliable. Solid performance for general-purpose translation.", "sv", "Swedish (Sweden)", false},
+    {"sw_KE", "Swahili", "Kenya", "Tier 3 (Functional)", "Functional. Primarily useful for basic translation and simple questions.", "sw", "Swahili (Kenya)", false},
+    {"th_TH", "Thai", "Thailand", "Tier 2 (Good)", "Good and Reliable. Handles Thai script and nuances effectively.", "th", "Thai (Thailand)", false},
+    {"tl_PH", "Tagalog", "Philippines", "Tier 3 (Functional)", "Functional. Also fil_PH. Good for gist; may sound machine-like.", "tl", "Tagalog (Philippines)", false},
+    {"tr_TR", "Turkish", "Turkey", "Tier 2 (Good)", "Good and Reliable. Strong performance for most translation tasks.", "tr", "Turkish (Turkey)", false},
+    {"uk_UA", "Ukrainian", "Ukraine", "Tier 2 (Good)", "Good and Reliable. Quality is high and consistently improving.", "uk", "Ukrainian (Ukraine)", false},
+    {"ur_PK", "Urdu", "Pakistan", "Tier 3 (Functional)", "Functional. Capable of translating standard text; review recommended.", "ur", "Urdu (Pakistan)", true},
+    {"vi_VN", "Vietnamese", "Vietnam", "Tier 2 (Good)", "Good and Reliable. Suitable for a wide variety of contexts.", "vi", "Vietnamese (Vietnam)", false},
+    {"zh_CN", "Chinese", "China (Simplified)", "Tier 1 (High)", "Excellent. Expert-level translation for Simplified Chinese.", "zh", "Chinese (China (Simplified))", false},
+    {"zh_TW", "Chinese", "Taiwan (Traditional)", "Tier 1 (High)", "Excellent. Expert-level translation for Traditional Chinese.", "zh", "Chinese (Taiwan (Traditional))", false}
 
 };
 
@@ -73,98 +80,144 @@ static const muse_locale_t supported_locales[] = {
  */
 static const size_t num_supported_locales = 46;
 
+#define LOCALE_NONE 0xFF
+#define LOCALE_HASH_BITS 7
+#define LOCALE_HASH_MULTIPLIER 0x9E37829Bu
+
 /**
- * @brief Forward declaration for internal use
+ * @brief Packed "ll_CC" key of each locale, in array order
  */
-static bool muse_extract_language_code_internal(const char *locale_code, char *buffer, size_t buffer_size);
+static const uint32_t locale_keys[] = {
+    0x61725341, 0x62674247, 0x626E4244, 0x63614553, 0x6373435A, 0x6461444B,
+    0x64654445, 0x656C4752, 0x656E4742, 0x656E5553, 0x65734553, 0x65734D58,
+    0x66614952, 0x66694649, 0x66724652, 0x6865494C, 0x6869494E, 0x68724852,
+    0x68754855, 0x69644944, 0x69744954, 0x6A614A50, 0x6B6F4B52, 0x6C744C54,
+    0x6C764C56, 0x6D734D59, 0x6E624E4F, 0x6E6C4E4C, 0x706C504C, 0x70744252,
+    0x70745054, 0x726F524F, 0x72755255, 0x736B534B, 0x736C5349, 0x73725253,
+    0x73765345, 0x73774B45, 0x74685448, 0x746C5048, 0x74725452, 0x756B5541,
+    0x7572504B, 0x7669564E, 0x7A68434E, 0x7A685457,
+};
+
+/**
+ * @brief Perfect hash of the packed keys to locale indexes
+ */
+static const uint8_t locale_slots[1 << LOCALE_HASH_BITS] = {
+     38, 255, 255,  32,  41, 255, 255,   0, 255,   1,  10, 255, 255, 255, 255, 255,
+      5, 255, 255,  21, 255, 255,  39, 255, 255, 255, 255, 255,  24,  28, 255,  37,
+     30,  31, 255, 255,  40,  15, 255, 255, 255,   7, 255,  26, 255,  22, 255,  25,
+    255, 255, 255, 255, 255,  17, 255, 255, 255,  19,   8,   6,  36, 255, 255,  20,
+    255, 255, 255, 255, 255, 255, 255, 255,  33,  16,  27, 255, 255, 255, 255,  13,
+    255, 255, 255, 255,  44, 255, 255,   3, 255,  42, 255, 255, 255, 255, 255, 255,
+     12,   4, 255,  14, 255,   2, 255,  18, 255, 255, 255,  34, 255, 255,  35,  43,
+    255, 255, 255,  11,  45, 255, 255, 255, 255, 255, 255,  23, 255,  29, 255,   9,
+};
+
+/**
+ * @brief Default locale index of each two-letter language code ("aa".."zz")
+ */
+static const uint8_t language_locales[26 * 26] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,   0, 255, 255, 255, 255, 255, 255, 255, 255, /* a? */
+    255, 255, 255, 255, 255, 255,   1, 255, 255, 255, 255, 255, 255,   2, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* b? */
+      3, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,   4, 255, 255, 255, 255, 255, 255, 255, /* c? */
+      5, 255, 255, 255,   6, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* d? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,   7, 255,   9, 255, 255, 255, 255,  10, 255, 255, 255, 255, 255, 255, 255, /* e? */
+     12, 255, 255, 255, 255, 255, 255, 255,  13, 255, 255, 255, 255, 255, 255, 255, 255,  14, 255, 255, 255, 255, 255, 255, 255, 255, /* f? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* g? */
+    255, 255, 255, 255,  15, 255, 255, 255,  16, 255, 255, 255, 255, 255, 255, 255, 255,  17, 255, 255,  18, 255, 255, 255, 255, 255, /* h? */
+    255, 255, 255,  19, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  20, 255, 255, 255, 255, 255, 255, /* i? */
+     21, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* j? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  22, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* k? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  23, 255,  24, 255, 255, 255, 255, /* l? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  25, 255, 255, 255, 255, 255, 255, 255, /* m? */
+    255,  26, 255, 255, 255, 255, 255, 255, 255, 255, 255,  27, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* n? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* o? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  28, 255, 255, 255, 255, 255, 255, 255,  29, 255, 255, 255, 255, 255, 255, /* p? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* q? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  31, 255, 255, 255, 255, 255,  32, 255, 255, 255, 255, 255, /* r? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  33,  34, 255, 255, 255, 255, 255,  35, 255, 255, 255,  36,  37, 255, 255, 255, /* s? */
+    255, 255, 255, 255, 255, 255, 255,  38, 255, 255, 255,  39, 255, 255, 255, 255, 255,  40, 255, 255, 255, 255, 255, 255, 255, 255, /* t? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  41, 255, 255, 255, 255, 255, 255,  42, 255, 255, 255, 255, 255, 255, 255, 255, /* u? */
+    255, 255, 255, 255, 255, 255, 255, 255,  43, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* v? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* w? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* x? */
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* y? */
+    255, 255, 255, 255, 255, 255, 255,  44, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, /* z? */
+};
+
+/* Find a locale by its language and country letters; NULL if unsupported */
+static const muse_locale_t *lookup_locale(unsigned char l0, unsigned char l1,
+                                          unsigned char c0, unsigned char c1) {
+    uint32_t key = ((uint32_t)l0 << 24) | ((uint32_t)l1 << 16) | ((uint32_t)c0 << 8) | c1;
+    uint8_t idx = locale_slots[(uint32_t)(key * LOCALE_HASH_MULTIPLIER) >> (32 - LOCALE_HASH_BITS)];
+    
+    return (idx != LOCALE_NONE && locale_keys[idx] == key) ? &supported_locales[idx] : NULL;
+}
+
+/* Find a full locale code ("ll_CC"); NULL if unsupported */
+static const muse_locale_t *find_locale(const char *code) {
+    if (!code[0] || !code[1] || code[2] != '_' || !code[3] || !code[4] || code[5]) {
+        return NULL;
+    }
+    return lookup_locale(code[0], code[1], code[3], code[4]);
+}
+
+/* Find the default locale of a language code ("ll"); NULL if unsupported */
+static const muse_locale_t *find_language(const char *code) {
+    uint8_t idx;
+    
+    if (code[0] < 'a' || code[0] > 'z' || code[1] < 'a' || code[1] > 'z' || code[2]) {
+        return NULL;
+    }
+    
+    idx = language_locales[(code[0] - 'a') * 26 + (code[1] - 'a')];
+    return idx != LOCALE_NONE ? &supported_locales[idx] : NULL;
+}
 
 bool muse_is_locale_supported(const char *locale_code) {
     if (!locale_code) {
         return false;
     }
     
-    // First try exact match
-    for (size_t i = 0; i < num_supported_locales; i++) {
-        if (strcmp(supported_locales[i].code, locale_code) == 0) {
-            return true;
-        }
-    }
+    // Exact match, or a language-only code with any variant (e.g., "en" matches "en_US")
+    return find_locale(locale_code) != NULL || find_language(locale_code) != NULL;
+}
+
+const muse_locale_t *muse_find_locale(const char *locale_code) {
+    const muse_locale_t *locale;
     
-    // If no exact match, try language-only match (e.g., "en" matches "en_US")
-    char lang_code[8];
-    if (muse_extract_language_code_internal(locale_code, lang_code, sizeof(lang_code))) {
-        // Check if the input was already a language code
-        if (strcmp(lang_code, locale_code) == 0) {
-            // Input is language-only, check if any variant exists
-            for (size_t i = 0; i < num_supported_locales; i++) {
-                char supported_lang[8];
-                if (muse_extract_language_code_internal(supported_locales[i].code, supported_lang, sizeof(supported_lang))) {
-                    if (strcmp(supported_lang, lang_code) == 0) {
-                        return true;
-                    }
-                }
-            }
-        }
+    if (!locale_code) {
+        return NULL;
     }
     
-    return false;
+    locale = find_locale(locale_code);
+    return locale ? locale : find_language(locale_code);
 }
 
 const char *muse_get_full_locale(const char *language_code) {
+    const muse_locale_t *locale;
+    
     if (!language_code) {
         return NULL;
     }
     
-    // Convert hyphenated format to underscore format (es-mx -> es_MX)
-    static char normalized_input[16];
-    if (strchr(language_code, '-') != NULL) {
-        strncpy(normalized_input, language_code, sizeof(normalized_input) - 1);
-        normalized_input[sizeof(normalized_input) - 1] = '\0';
-        
-        // Convert to uppercase after hyphen and replace hyphen with underscore
-        char *hyphen = strchr(normalized_input, '-');
-        if (hyphen && hyphen[1] && hyphen[2]) {
-            *hyphen = '_';
-            hyphen[1] = toupper(hyphen[1]);
-            hyphen[2] = toupper(hyphen[2]);
-        }
-        
-        // If it's a full locale code, return it if supported
-        if (muse_is_locale_supported(normalized_input)) {
-            return normalized_input;
+    // Hyphenated format, country in any case (es-mx -> es_MX)
+    const char *hyphen = strchr(language_code, '-');
+    if (hyphen == language_code + 2 && hyphen[1] && hyphen[2] && !hyphen[3]) {
+        locale = lookup_locale(language_code[0], language_code[1],
+                               toupper((unsigned char)hyphen[1]), toupper((unsigned char)hyphen[2]));
+        if (locale) {
+            return locale->code;
         }
     }
     
-    // If it's already a full locale code, return it if supported
+    // A full locale code, or the default locale of a language
+    // (e.g., "en" -> "en_US", "pt" -> "pt_BR")
     if (strchr(language_code, '_') != NULL) {
-        return muse_is_locale_supported(language_code) ? language_code : NULL;
-    }
-    
-    // Smart defaults for ambiguous language codes
-    if (strcmp(language_code, "zh") == 0) {
-        return "zh_CN"; // Default to Simplified Chinese (most common)
-    }
-    if (strcmp(language_code, "pt") == 0) {
-        return "pt_BR"; // Default to Brazilian Portuguese (most common)
-    }
-    if (strcmp(language_code, "es") == 0) {
-        return "es_ES"; // Default to Spain Spanish (original)
-    }
-    if (strcmp(language_code, "en") == 0) {
-        return "en_US"; // Default to US English (most common on web)
-    }
-    
-    // Find first matching locale for this language (fallback)
-    for (size_t i = 0; i < num_supported_locales; i++) {
-        char lang_code[8];
-        if (muse_extract_language_code_internal(supported_locales[i].code, lang_code, sizeof(lang_code))) {
-            if (strcmp(lang_code, language_code) == 0) {
-                return supported_locales[i].code;
-            }
-        }
+        locale = find_locale(language_code);
+    } else {
+        locale = find_language(language_code);
     }
-    
-    return NULL;
+    return locale ? locale->code : NULL;
 }
 
 const muse_locale_t *muse_get_supported_locales(size_t *count) {
@@ -175,65 +228,60 @@ const muse_locale_t *muse_get_supported_locales(size_t *count) {
 }
 
 const char *muse_get_locale_display_name(const char *locale_code) {
+    const muse_locale_t *locale;
+    
     if (!locale_code) {
         return NULL;
     }
     
-    for (size_t i = 0; i < num_supported_locales; i++) {
-        if (strcmp(supported_locales[i].code, locale_code) == 0) {
-            static char display_name[256];
-            snprintf(display_name, sizeof(display_name), "%s (%s)", 
-                    supported_locales[i].language, supported_locales[i].country);
-            return display_name;
-        }
-    }
-    
-    return NULL;
+    locale = find_locale(locale_code);
+    return locale ? locale->display_name : NULL;
 }
 
-static bool muse_extract_language_code_internal(const char *locale_code, char *buffer, size_t buffer_size) {
+bool muse_extract_language_code(const char *locale_code, char *buffer, size_t buffer_size) {
     if (!locale_code || !buffer || buffer_size < 3) {
         return false;
     }
     
     // Check for empty string
-    if (strlen(locale_code) == 0) {
+    if (locale_code[0] == '\0') {
         return false;
     }
     
     const char *underscore = strchr(locale_code, '_');
-    if (underscore) {
-        size_t lang_len = underscore - locale_code;
-        if (lang_len == 0 || lang_len >= buffer_size) {
-            return false;
-        }
-        strncpy(buffer, locale_code, lang_len);
-        buffer[lang_len] = '\0';
-    } else {
-        // No underscore, assume it's already a language code
-        if (strlen(locale_code) >= buffer_size) {
-            return false;
-        }
-        strcpy(buffer, locale_code);
+    size_t lang_len = underscore ? (size_t)(underscore - locale_code) : strlen(locale_code);
+    
+    // No underscore means it is already a language code
+    if (lang_len == 0 || lang_len >= buffer_size) {
+        return false;
     }
+    memcpy(buffer, locale_code, lang_len);
+    buffer[lang_len] = '\0';
     
     return true;
 }
 
-bool muse_extract_language_code(const char *locale_code, char *buffer, size_t buffer_size) {
-    return muse_extract_language_code_internal(locale_code, buffer, buffer_size);
-}
-
 const char *muse_get_locale_tier(const char *locale_code) {
+    const muse_locale_t *locale;
+    
     if (!locale_code) {
         return NULL;
     }
     
-    for (size_t i = 0; i < num_supported_locales; i++) {
-        if (strcmp(supported_locales[i].code, locale_code) == 0) {
-            return supported_locales[i].tier;
-        }
+    locale = find_locale(locale_code);
+    return locale ? locale->tier : NULL;
+}
+
+bool muse_is_locale_rtl(const char *locale_code) {
+    const muse_locale_t *locale;
+    
+    if (!locale_code) {
+        return false;
     }
     
-    return NULL;
+    locale = find_locale(locale_code);
+    if (!locale) {
+        locale = find_language(locale_code);
+    }
+    return locale ? locale->is_rtl : false;
 }
@@ -5,8 +5,13 @@
  * This module provides functions to validate locale codes and retrieve
  * the list of supported locales for AI translation services.
  * 
- * The locale data is generated from docs/locale-identifiers.csv and
- * embedded as static arrays in the compiled module.
+ * The locale data is generated from docs/pruned-languages.csv and
+ * embedded as static arrays in the compiled module, together with a
+ * perfect hash of the locale codes, so every lookup takes constant time.
+ * 
+ * All functions are thread-safe. Returned strings and structures point
+ * into immutable static tables: they must not be freed and need not be
+ * copied into a pool.
  */
 
 #ifndef SUPPORTED_LOCALES_H
@@ -24,6 +29,9 @@ typedef struct {
     const char *country;     /**< Country/region name (e.g., "United States", "Spain") */
     const char *tier;        /**< Proficiency tier (e.g., "Tier 1 (High)", "Tier 2 (Good)") */
     const char *notes;       /**< Translation performance notes */
+    const char *language_code; /**< Language part of the code (e.g., "en") */
+    const char *display_name; /**< Precomputed "Language (Country)" */
+    bool is_rtl;             /**< Language is written right-to-left */
 } muse_locale_t;
 
 /**
@@ -38,14 +46,27 @@ typedef struct {
  */
 bool muse_is_locale_supported(const char *locale_code);
 
+/**
+ * @brief Find the table entry of a locale
+ * 
+ * @param locale_code Full locale code (e.g., "es_MX") or language-only code
+ * @return The locale entry, the language's default locale for a
+ *         language-only code, or NULL if not supported
+ * 
+ * One lookup gives the code, language code, display name, tier and
+ * RTL flag of the locale.
+ */
+const muse_locale_t *muse_find_locale(const char *locale_code);
+
 /**
  * @brief Get the full locale code for a language
  * 
- * @param language_code The language code (e.g., "en", "es", "fr")
- * @return The full locale code if found, or NULL if not supported
+ * @param language_code The language code (e.g., "en", "es", "fr"), a full
+ *                      locale code or a hyphenated tag (e.g., "es-mx")
+ * @return The full locale code from the locale table, or NULL if not supported
  * 
- * For language-only codes, this returns the first matching full locale.
- * For example, "en" might return "en_US", "es" might return "es_ES".
+ * For language-only codes, this returns the language's default locale.
+ * For example, "en" returns "en_US", "es" returns "es_ES".
  */
 const char *muse_get_full_locale(const char *language_code);
 
@@ -91,4 +112,12 @@ bool muse_extract_language_code(const char *locale_code, char *buffer, size_t bu
  */
 const char *muse_get_locale_tier(const char *locale_code);
 
+/**
+ * @brief Check whether a locale is written right-to-left
+ * 
+ * @param locale_code Full locale code or language-only code
+ * @return true for right-to-left languages (Arabic, Persian, Hebrew, Urdu)
+ */
+bool muse_is_locale_rtl(const char *locale_code);
+
 #endif /* SUPPORTED_LOCALES_H */
@@ -0,0 +1,222 @@
+/* Memory-mapped segment translation memory, see translation_memory.h */
+#include "translation_memory.h"
+#include "advanced_config.h"
+#include "utils.h"
+#include <apr_strings.h>
+#include <apr_file_io.h>
+#include <apr_mmap.h>
+#include <apr_atomic.h>
+#include <apr_general.h>
+#include <http_log.h>
+#include <string.h>
+
+extern module AP_MODULE_DECLARE_DATA muse_ai_module;
+
+typedef struct {
+    char magic[16];
+    apr_uint64_t file_size;
+    apr_uint64_t slots;                 /* Power of two */
+    apr_uint64_t data_size;
+    volatile apr_uint64_t data_used;    /* Append offset into the data area */
+} tm_header_t;
+
+typedef struct {
+    volatile apr_uint64_t loc;          /* Record offset + 1, 0 = free */
+} tm_slot_t;
+
+/* Data record, 8-byte aligned, followed by the translation */
+typedef struct {
+    apr_uint64_t key;
+    apr_uint64_t check;                 /* Second hash of the source text */
+    apr_uint32_t source_len;
+    apr_uint32_t length;                /* Translation bytes */
+} tm_record_t;
+
+static tm_header_t *tm_header = NULL;
+static tm_slot_t *tm_slots = NULL;
+static char *tm_data = NULL;
+static volatile apr_uint32_t tm_full_logged = 0;
+
+static apr_status_t tm_cleanup(void *data)
+{
+    (void)data;
+    tm_header = NULL;
+    tm_slots = NULL;
+    tm_data = NULL;
+    return APR_SUCCESS;
+}
+
+apr_status_t init_translation_memory(apr_pool_t *pool, server_rec *s)
+{
+    advanced_muse_ai_config *cfg = ap_get_module_config(s->module_config, &muse_ai_module);
+    apr_uint64_t size, slots = 1;
+    apr_file_t *file;
+    apr_finfo_t finfo;
+    apr_mmap_t *mm;
+    apr_status_t rv;
+    tm_header_t *header;
+
+    if (!cfg || !cfg->translation_memory_file) {
+        return APR_SUCCESS;
+    }
+
+    size = (apr_uint64_t)cfg->translation_memory_size_mb * 1024 * 1024;
+    while (slots * 2 <= size / MUSE_AI_TM_BYTES_PER_SLOT) {
+        slots *= 2;
+    }
+
+    rv = apr_file_open(&file, cfg->translation_memory_file, APR_READ | APR_WRITE | APR_CREATE | APR_BINARY,
+                       APR_FPROT_UREAD | APR_FPROT_UWRITE, pool);
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_info_get(&finfo, APR_FINFO_SIZE, file);
+    }
+    if (rv == APR_SUCCESS && (apr_uint64_t)finfo.size != size) {
+        /* New file or a new size: start over, the holes read as zeroes */
+        rv = apr_file_trunc(file, 0);
+        if (rv == APR_SUCCESS) {
+            rv = apr_file_trunc(file, (apr_off_t)size);
+        }
+    }
+    if (rv == APR_SUCCESS) {
+        rv = apr_mmap_create(&mm, file, 0, (apr_size_t)size, APR_MMAP_READ | APR_MMAP_WRITE, pool);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s,
+                    "[mod_muse_ai] Could not map translation memory %s", cfg->translation_memory_file);
+        return rv;
+    }
+
+    header = mm->mm;
+    if (strcmp(header->magic, MUSE_AI_TM_MAGIC) != 0 || header->file_size != size || header->slots != slots) {
+        memset(header, 0, sizeof(tm_header_t) + slots * sizeof(tm_slot_t));
+        header->file_size = size;
+        header->slots = slots;
+        header->data_size = size - sizeof(tm_header_t) - slots * sizeof(tm_slot_t);
+        apr_cpystrn(header->magic, MUSE_AI_TM_MAGIC, sizeof(header->magic));
+    }
+
+    tm_header = header;
+    tm_slots = (tm_slot_t *)(header + 1);
+    tm_data = (char *)(tm_slots + slots);
+    apr_pool_cleanup_register(pool, NULL, tm_cleanup, apr_pool_cleanup_null);
+
+    ap_log_error(APLOG_MARK, APLOG_NOTICE, 0, s,
+                "[mod_muse_ai] Translation memory %s: %" APR_UINT64_T_FMT " of %" APR_UINT64_T_FMT " bytes used",
+                cfg->translation_memory_file, apr_atomic_read64(&header->data_used), header->data_size);
+    return APR_SUCCESS;
+}
+
+/* Hash of the locale, a separator and the text */
+static apr_uint64_t segment_key(const char *locale, const char *text, apr_size_t len)
+{
+    apr_uint64_t hash = muse_hash64(locale, strlen(locale));
+
+    hash = muse_hash64_continue(hash, "\xFF", 1);
+    return muse_hash64_continue(hash, text, len);
+}
+
+/* Hash of the text alone, to tell apart segments whose keys collide */
+static apr_uint64_t segment_check(const char *text, apr_size_t len)
+{
+    return muse_hash64(text, len);
+}
+
+/* The record a slot points to, or NULL for a free slot or a bad location */
+static const tm_record_t *slot_record(tm_slot_t *slot)
+{
+    apr_uint64_t loc = apr_atomic_read64(&slot->loc);
+    const tm_record_t *rec;
+
+    if (loc == 0 || loc - 1 + sizeof(tm_record_t) > tm_header->data_size) {
+        return NULL;
+    }
+    rec = (const tm_record_t *)(tm_data + loc - 1);
+    if (loc - 1 + sizeof(tm_record_t) + rec->length > tm_header->data_size) {
+        return NULL;
+    }
+    return rec;
+}
+
+static int record_matches(const tm_record_t *rec, apr_uint64_t key, apr_uint64_t check, apr_size_t len)
+{
+    return rec->key == key && rec->check == check && rec->source_len == len;
+}
+
+const char *translation_memory_get(apr_pool_t *pool, const char *locale, const char *text, apr_size_t len)
+{
+    apr_uint64_t key, check, mask;
+
+    if (!tm_header) {
+        return NULL;
+    }
+
+    key = segment_key(locale, text, len);
+    check = segment_check(text, len);
+    mask = tm_header->slots - 1;
+    for (apr_uint64_t i = 0; i < MUSE_AI_TM_MAX_PROBES; i++) {
+        const tm_record_t *rec = slot_record(&tm_slots[(key + i) & mask]);
+
+        if (!rec) {
+            return NULL;
+        }
+        if (record_matches(rec, key, check, len)) {
+            return apr_pstrmemdup(pool, (const char *)(rec + 1), rec->length);
+        }
+    }
+    return NULL;
+}
+
+void translation_memory_put(const char *locale, const char *text, apr_size_t len, const char *translation)
+{
+    apr_uint64_t key, check, mask, loc = 0, length = strlen(translation);
+
+    if (!tm_header || length == 0 || length > MUSE_AI_TM_MAX_SEGMENT || len > MUSE_AI_TM_MAX_SEGMENT) {
+        return;
+    }
+
+    key = segment_key(locale, text, len);
+    check = segment_check(text, len);
+    mask = tm_header->slots - 1;
+    for (apr_uint64_t i = 0; i < MUSE_AI_TM_MAX_PROBES; i++) {
+        tm_slot_t *slot = &tm_slots[(key + i) & mask];
+        const tm_record_t *rec = slot_record(slot);
+
+        if (rec) {
+            if (record_matches(rec, key, check, len)) {
+                return; /* Known already */
+            }
+            continue;
+        }
+
+        if (loc == 0) {
+            /* Write the record before any slot can point to it */
+            apr_uint64_t size = APR_ALIGN(sizeof(tm_record_t) + length, 8);
+            apr_uint64_t offset = apr_atomic_add64(&tm_header->data_used, size);
+            tm_record_t *mine;
+
+            if (offset + size > tm_header->data_size) {
+                if (apr_atomic_cas32(&tm_full_logged, 1, 0) == 0) {
+                    ap_log_error(APLOG_MARK, APLOG_WARNING, 0, NULL,
+                                "[mod_muse_ai] Translation memory is full; raise MuseAiTranslationMemorySize");
+                }
+                return;
+            }
+            mine = (tm_record_t *)(tm_data + offset);
+            mine->key = key;
+            mine->check = check;
+            mine->source_len = (apr_uint32_t)len;
+            mine->length = (apr_uint32_t)length;
+            memcpy(mine + 1, translation, (apr_size_t)length);
+            loc = offset + 1;
+        }
+
+        if (apr_atomic_cas64(&slot->loc, loc, 0) == 0) {
+            return;
+        }
+        /* Another request took the slot first, maybe for the same segment */
+        rec = slot_record(slot);
+        if (rec && record_matches(rec, key, check, len)) {
+            return;
+        }
+    }
+}
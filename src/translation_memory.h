@@ -0,0 +1,45 @@
+#ifndef TRANSLATION_MEMORY_H
+#define TRANSLATION_MEMORY_H
+
+#include <httpd.h>
+#include <apr_pools.h>
+
+/* Segment translation memory. Translated text segments are kept in a
+ * memory-mapped file, keyed by the hash of (locale, source text), so that
+ * navigation labels, footers and other repeated sentences are translated
+ * once for all pages, all children and across restarts.
+ *
+ * File layout, version 2:
+ *
+ *   header   magic, sizes and the append offset
+ *   index    power-of-two array of record locations, linear probing
+ *   data     records, appended and never rewritten: the key, the source
+ *            length and a second hash of the source, then the translation
+ *
+ * A writer reserves and fills its record first, then publishes it by
+ * setting an empty slot to its location with one compare-and-swap. A
+ * process that dies half way leaves at most unreferenced bytes behind, and
+ * readers never see a half-written entry. A hit must match the key, the
+ * source length and the second hash. When the data area is full new
+ * segments are simply not remembered. */
+#define MUSE_AI_TM_MAGIC "MUSEAI-TM 2"
+#define MUSE_AI_TM_DEFAULT_SIZE_MB 64
+#define MUSE_AI_TM_BYTES_PER_SLOT 256   /* Bytes of file per index slot */
+#define MUSE_AI_TM_MAX_PROBES 32
+#define MUSE_AI_TM_MAX_SEGMENT ((1 << 24) - 1)
+
+/* Function declarations */
+
+/* Map the file named by MuseAiTranslationMemory. Called from post_config;
+ * the mapping is shared with every child. */
+apr_status_t init_translation_memory(apr_pool_t *pool, server_rec *s);
+
+/* The remembered translation of text[0..len) into locale, copied into pool,
+ * or NULL */
+const char *translation_memory_get(apr_pool_t *pool, const char *locale, const char *text, apr_size_t len);
+
+/* Remember a translation. Does nothing when it is known already or the file
+ * is full. */
+void translation_memory_put(const char *locale, const char *text, apr_size_t len, const char *translation);
+
+#endif /* TRANSLATION_MEMORY_H */
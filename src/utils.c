@@ -1,4 +1,5 @@
 #include "mod_muse_ai.h"
+#include "utils.h"
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>  /* for sprintf */
@@ -48,9 +49,19 @@ char *escape_json_string(apr_pool_t *pool, const char *str)
     if (!str) return apr_pstrdup(pool, "");
     
     int len = strlen(str);
-    /* Worst case: every character needs escaping */
-    char *escaped = apr_palloc(pool, len * 2 + 1);
-    int i, j = 0;
+    int i, j = 0, size = len + 1;
+
+    /* Size the output exactly: two bytes for the short escapes, six for
+     * other control characters */
+    for (i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if (c == '"' || c == '\\' || c == '\n' || c == '\r' || c == '\t' || c == '\b' || c == '\f') {
+            size += 1;
+        } else if (c < 32) {
+            size += 5;
+        }
+    }
+    char *escaped = apr_palloc(pool, size);
     
     for (i = 0; i < len; i++) {
         switch (str[i]) {
@@ -83,7 +94,8 @@ char *escape_json_string(apr_pool_t *pool, const char *str)
                 escaped[j++] = 'f';
                 break;
             default:
-                if (str[i] < 32) {
+                /* Bytes of UTF-8 sequences are copied as they are */
+                if ((unsigned char)str[i] < 32) {
                     /* Escape other control characters */
                     j += sprintf(escaped + j, "\\u%04x", (unsigned char)str[i]);
                 } else {
@@ -134,3 +146,18 @@ char *read_file_contents(apr_pool_t *pool, const char *file_path)
 
     return buffer;
 }
+
+apr_uint64_t muse_hash64_continue(apr_uint64_t hash, const char *data, apr_size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+
+    for (apr_size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * APR_UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+apr_uint64_t muse_hash64(const char *data, apr_size_t len)
+{
+    return muse_hash64_continue(MUSE_HASH64_INIT, data, len);
+}
@@ -0,0 +1,18 @@
+#ifndef UTILS_H
+#define UTILS_H
+
+#include <apr.h>
+
+/* 64-bit FNV-1a, for hash table keys and cache names. Not for anything an
+ * attacker must not be able to collide. */
+#define MUSE_HASH64_INIT APR_UINT64_C(14695981039346656037)
+
+/* Function declarations */
+
+/* Hash of data[0..len) */
+apr_uint64_t muse_hash64(const char *data, apr_size_t len);
+
+/* Continue hash over data[0..len), for keys made of several parts */
+apr_uint64_t muse_hash64_continue(apr_uint64_t hash, const char *data, apr_size_t len);
+
+#endif /* UTILS_H */